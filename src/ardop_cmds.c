@@ -23,6 +23,7 @@
 
 #include <stdio.h>
 #include <stdlib.h>
+#include <stddef.h>
 #include <string.h>
 #include <ctype.h>
 #include "main.h"
@@ -34,12 +35,307 @@
 #include "arim_arq_files.h"
 #include "arim_arq_msg.h"
 #include "bufq.h"
+#include "ardop_flow.h"
 #include "tnc_attach.h"
+#include "tnc_state.h"
 #include "ui.h"
 
-size_t ardop_cmds_proc_resp(char *response, size_t size)
+/* TNC_SET field updated with a response's value */
+#define TNC_FIELD(f)    offsetof(TNC_SET, f), sizeof(((TNC_SET *)0)->f)
+#define TNC_NO_FIELD    0, 0
+
+typedef struct ardop_resp {
+    const char *verb;
+    size_t offset, size;
+    void (*handler)(char *line, char *val);
+    unsigned long hits;
+} ARDOP_RESP;
+
+typedef struct ardop_verb {
+    const char *name;
+    size_t len;
+} ARDOP_VERB;
+
+static void ardop_cmds_on_buffer(char *line, char *val)
+{
+    tnc_state_set_buffer(atoi(val));
+    ardop_flow_on_buffer(atoi(val));
+}
+
+static void ardop_cmds_on_newstate(char *line, char *val)
+{
+    tnc_state_set_state(val);
+    arim_on_event(EV_TNC_NEWSTATE, 0);
+}
+
+static void ardop_cmds_on_state(char *line, char *val)
+{
+    tnc_state_set_state(val);
+}
+
+static void ardop_cmds_on_cancelpending(char *line, char *val)
+{
+    arim_on_event(EV_ARQ_CAN_PENDING, 0);
+}
+
+static void ardop_cmds_on_pending(char *line, char *val)
+{
+    arim_on_event(EV_ARQ_PENDING, 0);
+}
+
+static void ardop_cmds_on_disconnected(char *line, char *val)
+{
+    arim_on_event(EV_ARQ_DISCONNECTED, 0);
+}
+
+static void ardop_cmds_on_connected(char *line, char *val)
+{
+    char *start, *end, call[TNC_MYCALL_SIZE], bw_hz[TNC_ARQ_BW_SIZE];
+
+    /* parse remote call sign, ARQ bandwidth and grid square */
+    start = end = val;
+    while (*end && *end != ' ')
+        ++end;
+    if (*end) {
+        *end = '\0';
+        ++end;
+    }
+    snprintf(call, sizeof(call), "%s", start);
+    /* parse ARQ bandwidth token */
+    bw_hz[0] = '\0';
+    if (*end) {
+        while (*end && *end == ' ')
+            ++end;
+        start = end;
+        while (*end && *end != ' ')
+            ++end;
+        if (*end) {
+            *end = '\0';
+            ++end;
+        }
+        snprintf(bw_hz, sizeof(bw_hz), "%s", start);
+        if (g_tnc_version.major >= 2) {
+            /* parse grid square token (v2 TNC only) */
+            pthread_mutex_lock(&mutex_tnc_set);
+            snprintf(g_tnc_settings[g_cur_tnc].arq_remote_gridsq,
+                sizeof(g_tnc_settings[g_cur_tnc].arq_remote_gridsq), "        ");
+            if (*end) {
+                while (*end && *end != '[')
+                    ++end;
+                if (*end == '[') {
+                    ++end;
+                    start = end;
+                    while (*end && *end != ']')
+                        ++end;
+                    if (*end == ']') {
+                        *end = '\0';
+                        snprintf(g_tnc_settings[g_cur_tnc].arq_remote_gridsq,
+                            sizeof(g_tnc_settings[g_cur_tnc].arq_remote_gridsq), "%s", start);
+                    }
+                }
+            }
+            pthread_mutex_unlock(&mutex_tnc_set);
+        }
+    }
+    tnc_state_set_remote(call, bw_hz);
+    arim_on_event(EV_ARQ_CONNECTED, 0);
+}
+
+static void ardop_cmds_on_target(char *line, char *val)
+{
+    arim_on_event(EV_ARQ_TARGET, 0);
+}
+
+static void ardop_cmds_on_rejectedbusy(char *line, char *val)
+{
+    tnc_state_set_remote(val, NULL);
+    arim_on_event(EV_ARQ_REJ_BUSY, 0);
+}
+
+static void ardop_cmds_on_rejectedbw(char *line, char *val)
+{
+    tnc_state_set_remote(val, NULL);
+    arim_on_event(EV_ARQ_REJ_BW, 0);
+}
+
+static void ardop_cmds_on_title_setting(char *line, char *val)
+{
+    ui_set_title_dirty(TITLE_TNC_ATTACHED);
+}
+
+static void ardop_cmds_on_fecrepeats(char *line, char *val)
+{
+    tnc_state_set_fec_repeats(val);
+    ui_set_status_dirty(STATUS_REFRESH);
+}
+
+static void ardop_cmds_on_status_setting(char *line, char *val)
+{
+    ui_set_status_dirty(STATUS_REFRESH);
+}
+
+static void ardop_cmds_on_beacon_setting(char *line, char *val)
+{
+    arim_beacon_set(-1);
+}
+
+static void ardop_cmds_on_pingack(char *line, char *val)
+{
+    arim_recv_ping_ack(line);
+}
+
+static void ardop_cmds_on_pingreply(char *line, char *val)
+{
+    arim_send_ping_ack();
+}
+
+static void ardop_cmds_on_ping(char *line, char *val)
+{
+    arim_recv_ping(line);
+}
+
+static void ardop_cmds_on_ptt(char *line, char *val)
+{
+    if (!strncasecmp(val, "TRUE", 4)) {
+        arim_on_event(EV_TNC_PTT, 1);
+        arim_beacon_reset_btimer();
+    } else {
+        arim_on_event(EV_TNC_PTT, 0);
+    }
+}
+
+static void ardop_cmds_on_busy(char *line, char *val)
+{
+    if (!strncasecmp(val, "TRUE", 4)) {
+        tnc_state_set_busy(1);
+        bufq_queue_debug_log("Cmd thread: TNC is BUSY");
+    } else {
+        tnc_state_set_busy(0);
+        bufq_queue_debug_log("Cmd thread: TNC is not BUSY");
+    }
+}
+
+static void ardop_cmds_on_version(char *line, char *val)
 {
     static int negbw_once = 0;
+    char buffer[MAX_CMD_SIZE];
+
+    tnc_get_version(val);
+    /* NEGOTIATEBW command supported only by the ARDOP_2Win TNC */
+    if (!negbw_once && g_tnc_version.vendor == 'W' &&
+                          g_tnc_version.major >= 2 &&
+                          g_tnc_version.minor >= 0 &&
+                          g_tnc_version.revision >= 4) {
+        negbw_once = 1;
+        snprintf(buffer, sizeof(buffer), "NEGOTIATEBW %s", g_tnc_settings[g_cur_tnc].arq_negotiate_bw);
+        bufq_queue_cmd_out(buffer);
+    }
+    /* now that we know tnc version, validate and update FECMODE */
+    if (!ini_validate_fecmode(g_tnc_settings[g_cur_tnc].fecmode)) {
+        if (g_tnc_version.major <= 1)
+            snprintf(g_tnc_settings[g_cur_tnc].fecmode,
+                     sizeof(g_tnc_settings[g_cur_tnc].fecmode), "%s", "4FSK.200.50S");
+        else
+            snprintf(g_tnc_settings[g_cur_tnc].fecmode,
+                     sizeof(g_tnc_settings[g_cur_tnc].fecmode), "%s", "4PSK.200.50");
+    }
+    snprintf(buffer, sizeof(buffer), "FECMODE %s", g_tnc_settings[g_cur_tnc].fecmode);
+    bufq_queue_cmd_out(buffer);
+    /* next validate and update ARQBW */
+    if (!ini_validate_arq_bw(g_tnc_settings[g_cur_tnc].arq_bandwidth)) {
+        if (g_tnc_version.major <= 1)
+            snprintf(g_tnc_settings[g_cur_tnc].arq_bandwidth,
+                     sizeof(g_tnc_settings[g_cur_tnc].arq_bandwidth), "%s", "500MAX");
+        else
+            snprintf(g_tnc_settings[g_cur_tnc].arq_bandwidth,
+                     sizeof(g_tnc_settings[g_cur_tnc].arq_bandwidth), "%s", "500");
+    }
+    snprintf(buffer, sizeof(buffer), "ARQBW %s", g_tnc_settings[g_cur_tnc].arq_bandwidth);
+    bufq_queue_cmd_out(buffer);
+}
+
+/* responses handled, sorted by verb for binary search */
+static ARDOP_RESP resp_table[] = {
+    { "ARQBW",         TNC_FIELD(arq_bandwidth),  NULL,                          0 },
+    { "BUFFER",        TNC_NO_FIELD,              ardop_cmds_on_buffer,          0 },
+    { "BUSY",          TNC_NO_FIELD,              ardop_cmds_on_busy,            0 },
+    { "BUSYDET",       TNC_FIELD(busydet),        NULL,                          0 },
+    { "CANCELPENDING", TNC_NO_FIELD,              ardop_cmds_on_cancelpending,   0 },
+    { "CONNECTED",     TNC_NO_FIELD,              ardop_cmds_on_connected,       0 },
+    { "DISCONNECTED",  TNC_NO_FIELD,              ardop_cmds_on_disconnected,    0 },
+    { "ENABLEPINGACK", TNC_FIELD(en_pingack),     ardop_cmds_on_title_setting,   0 },
+    { "FECID",         TNC_FIELD(fecid),          NULL,                          0 },
+    { "FECMODE",       TNC_FIELD(fecmode),        ardop_cmds_on_status_setting,  0 },
+    { "FECREPEATS",    TNC_NO_FIELD,              ardop_cmds_on_fecrepeats,      0 },
+    { "GRIDSQUARE",    TNC_FIELD(gridsq),         ardop_cmds_on_beacon_setting,  0 },
+    { "LEADER",        TNC_FIELD(leader),         NULL,                          0 },
+    { "LISTEN",        TNC_FIELD(tmp_listen),     ardop_cmds_on_title_setting,   0 },
+    { "MYCALL",        TNC_FIELD(mycall),         ardop_cmds_on_beacon_setting,  0 },
+    { "NEWSTATE",      TNC_NO_FIELD,              ardop_cmds_on_newstate,        0 },
+    { "PENDING",       TNC_NO_FIELD,              ardop_cmds_on_pending,         0 },
+    { "PING",          TNC_NO_FIELD,              ardop_cmds_on_ping,            0 },
+    { "PINGACK",       TNC_NO_FIELD,              ardop_cmds_on_pingack,         0 },
+    { "PINGREPLY",     TNC_NO_FIELD,              ardop_cmds_on_pingreply,       0 },
+    { "PTT",           TNC_NO_FIELD,              ardop_cmds_on_ptt,             0 },
+    { "REJECTEDBUSY",  TNC_NO_FIELD,              ardop_cmds_on_rejectedbusy,    0 },
+    { "REJECTEDBW",    TNC_NO_FIELD,              ardop_cmds_on_rejectedbw,      0 },
+    { "SQUELCH",       TNC_FIELD(squelch),        NULL,                          0 },
+    { "STATE",         TNC_NO_FIELD,              ardop_cmds_on_state,           0 },
+    { "TARGET",        TNC_FIELD(arq_target_call), ardop_cmds_on_target,         0 },
+    { "TRAILER",       TNC_FIELD(trailer),        NULL,                          0 },
+    { "VERSION",       TNC_FIELD(version),        ardop_cmds_on_version,         0 },
+};
+
+#define RESP_TABLE_LEN  (sizeof(resp_table) / sizeof(resp_table[0]))
+
+static int ardop_cmds_cmp_verb(const void *key, const void *entry)
+{
+    const ARDOP_VERB *v = key;
+    const ARDOP_RESP *r = entry;
+    int result;
+
+    result = strncasecmp(v->name, r->verb, v->len);
+    if (result)
+        return result;
+    return r->verb[v->len] ? -1 : 0; /* shorter verb sorts first */
+}
+
+static void ardop_cmds_dispatch(char *line, char *val)
+{
+    ARDOP_VERB verb;
+    ARDOP_RESP *r;
+
+    verb.name = line;
+    verb.len = strcspn(line, " ");
+    r = bsearch(&verb, resp_table, RESP_TABLE_LEN, sizeof(resp_table[0]), ardop_cmds_cmp_verb);
+    if (!r)
+        return;
+    ++r->hits;
+    if (r->size) {
+        pthread_mutex_lock(&mutex_tnc_set);
+        snprintf((char *)&g_tnc_settings[g_cur_tnc] + r->offset, r->size, "%s", val);
+        pthread_mutex_unlock(&mutex_tnc_set);
+    }
+    if (r->handler)
+        r->handler(line, val);
+}
+
+void ardop_cmds_log_stats()
+{
+    char linebuf[MAX_LOG_LINE_SIZE];
+    size_t i;
+
+    for (i = 0; i < RESP_TABLE_LEN; i++) {
+        if (!resp_table[i].hits)
+            continue;
+        snprintf(linebuf, sizeof(linebuf), "Cmd thread: %s responses from TNC: %lu",
+                     resp_table[i].verb, resp_table[i].hits);
+        bufq_queue_debug_log(linebuf);
+    }
+}
+
+size_t ardop_cmds_proc_resp(char *response, size_t size)
+{
     static char buffer[MAX_CMD_SIZE*3];
     char inbuffer[MAX_CMD_SIZE];
     static size_t cnt = 0;
@@ -73,227 +369,7 @@ size_t ardop_cmds_proc_resp(char *response, size_t size)
                 while (*val && *val == ' ')
                     ++val;
             }
-            if (!strncasecmp(start, "BUFFER", 6)) {
-                pthread_mutex_lock(&mutex_tnc_set);
-                snprintf(g_tnc_settings[g_cur_tnc].buffer,
-                    sizeof(g_tnc_settings[g_cur_tnc].buffer), "%s", val);
-                pthread_mutex_unlock(&mutex_tnc_set);
-            } else if (!strncasecmp(start, "NEWSTATE", 8)) {
-                pthread_mutex_lock(&mutex_tnc_set);
-                snprintf(g_tnc_settings[g_cur_tnc].state,
-                    sizeof(g_tnc_settings[g_cur_tnc].state), "%s", val);
-                pthread_mutex_unlock(&mutex_tnc_set);
-                arim_on_event(EV_TNC_NEWSTATE, 0);
-            } else if (!strncasecmp(start, "CANCELPENDING", 13)) {
-                arim_on_event(EV_ARQ_CAN_PENDING, 0);
-            } else if (!strncasecmp(start, "PENDING", 7)) {
-                arim_on_event(EV_ARQ_PENDING, 0);
-            } else if (!strncasecmp(start, "DISCONNECTED", 12)) {
-                arim_on_event(EV_ARQ_DISCONNECTED, 0);
-            } else if (!strncasecmp(start, "CONNECTED", 9)) {
-                /* parse remote call sign, ARQ bandwidth and grid square */
-                start = end = val;
-                while (*end && *end != ' ')
-                    ++end;
-                if (*end) {
-                    *end = '\0';
-                    ++end;
-                }
-                pthread_mutex_lock(&mutex_tnc_set);
-                snprintf(g_tnc_settings[g_cur_tnc].arq_remote_call,
-                    sizeof(g_tnc_settings[g_cur_tnc].arq_remote_call), "%s", start);
-                /* parse ARQ bandwidth token */
-                g_tnc_settings[g_cur_tnc].arq_bandwidth_hz[0] = '\0';
-                if (*end) {
-                    while (*end && *end == ' ')
-                        ++end;
-                    start = end;
-                    while (*end && *end != ' ')
-                        ++end;
-                    if (*end) {
-                        *end = '\0';
-                        ++end;
-                    }
-                    snprintf(g_tnc_settings[g_cur_tnc].arq_bandwidth_hz,
-                        sizeof(g_tnc_settings[g_cur_tnc].arq_bandwidth_hz), "%s", start);
-                    if (g_tnc_version.major >= 2) {
-                        /* parse grid square token (v2 TNC only) */
-                        snprintf(g_tnc_settings[g_cur_tnc].arq_remote_gridsq,
-                            sizeof(g_tnc_settings[g_cur_tnc].arq_remote_gridsq), "        ");
-                        if (*end) {
-                            while (*end && *end != '[')
-                                ++end;
-                            if (*end == '[') {
-                                ++end;
-                                start = end;
-                                while (*end && *end != ']')
-                                    ++end;
-                                if (*end == ']') {
-                                    *end = '\0';
-                                    snprintf(g_tnc_settings[g_cur_tnc].arq_remote_gridsq,
-                                        sizeof(g_tnc_settings[g_cur_tnc].arq_remote_gridsq), "%s", start);
-                                }
-                            }
-                        }
-                    }
-                }
-                pthread_mutex_unlock(&mutex_tnc_set);
-                arim_on_event(EV_ARQ_CONNECTED, 0);
-            } else if (!strncasecmp(start, "TARGET", 6)) {
-                /* parse target call sign */
-                pthread_mutex_lock(&mutex_tnc_set);
-                snprintf(g_tnc_settings[g_cur_tnc].arq_target_call,
-                    sizeof(g_tnc_settings[g_cur_tnc].arq_target_call), "%s", val);
-                pthread_mutex_unlock(&mutex_tnc_set);
-                arim_on_event(EV_ARQ_TARGET, 0);
-            } else if (!strncasecmp(start, "REJECTEDBUSY", 12)) {
-                pthread_mutex_lock(&mutex_tnc_set);
-                snprintf(g_tnc_settings[g_cur_tnc].arq_remote_call,
-                    sizeof(g_tnc_settings[g_cur_tnc].arq_remote_call), "%s", val);
-                pthread_mutex_unlock(&mutex_tnc_set);
-                arim_on_event(EV_ARQ_REJ_BUSY, 0);
-            } else if (!strncasecmp(start, "REJECTEDBW", 10)) {
-                pthread_mutex_lock(&mutex_tnc_set);
-                snprintf(g_tnc_settings[g_cur_tnc].arq_remote_call,
-                    sizeof(g_tnc_settings[g_cur_tnc].arq_remote_call), "%s", val);
-                pthread_mutex_unlock(&mutex_tnc_set);
-                arim_on_event(EV_ARQ_REJ_BW, 0);
-            } else if (!strncasecmp(start, "LISTEN", 6)) {
-                pthread_mutex_lock(&mutex_tnc_set);
-                snprintf(g_tnc_settings[g_cur_tnc].tmp_listen,
-                    sizeof(g_tnc_settings[g_cur_tnc].tmp_listen), "%s", val);
-                pthread_mutex_unlock(&mutex_tnc_set);
-                ui_set_title_dirty(TITLE_TNC_ATTACHED);
-            } else if (!strncasecmp(start, "ENABLEPINGACK", 13)) {
-                pthread_mutex_lock(&mutex_tnc_set);
-                snprintf(g_tnc_settings[g_cur_tnc].en_pingack,
-                    sizeof(g_tnc_settings[g_cur_tnc].en_pingack), "%s", val);
-                pthread_mutex_unlock(&mutex_tnc_set);
-                ui_set_title_dirty(TITLE_TNC_ATTACHED);
-            } else if (!strncasecmp(start, "PINGACK", 7)) {
-                arim_recv_ping_ack(start);
-            } else if (!strncasecmp(start, "PINGREPLY", 9)) {
-                arim_send_ping_ack();
-            } else if (!strncasecmp(start, "PING", 4)) {
-                arim_recv_ping(start);
-            } else if (!strncasecmp(start, "PTT", 3)) {
-                if (!strncasecmp(val, "TRUE", 4)) {
-                    arim_on_event(EV_TNC_PTT, 1);
-                    arim_beacon_reset_btimer();
-                } else {
-                    arim_on_event(EV_TNC_PTT, 0);
-                }
-            } else if (!strncasecmp(start, "STATE", 5)) {
-                pthread_mutex_lock(&mutex_tnc_set);
-                snprintf(g_tnc_settings[g_cur_tnc].state,
-                    sizeof(g_tnc_settings[g_cur_tnc].state), "%s", val);
-                pthread_mutex_unlock(&mutex_tnc_set);
-            } else if (!strncasecmp(start, "FECMODE", 7)) {
-                pthread_mutex_lock(&mutex_tnc_set);
-                snprintf(g_tnc_settings[g_cur_tnc].fecmode,
-                    sizeof(g_tnc_settings[g_cur_tnc].fecmode), "%s", val);
-                pthread_mutex_unlock(&mutex_tnc_set);
-                ui_set_status_dirty(STATUS_REFRESH);
-            } else if (!strncasecmp(start, "FECREPEATS", 10)) {
-                pthread_mutex_lock(&mutex_tnc_set);
-                snprintf(g_tnc_settings[g_cur_tnc].fecrepeats,
-                     sizeof(g_tnc_settings[g_cur_tnc].fecrepeats), "%s", val);
-                pthread_mutex_unlock(&mutex_tnc_set);
-                ui_set_status_dirty(STATUS_REFRESH);
-            } else if (!strncasecmp(start, "FECID", 5)) {
-                pthread_mutex_lock(&mutex_tnc_set);
-                snprintf(g_tnc_settings[g_cur_tnc].fecid,
-                     sizeof(g_tnc_settings[g_cur_tnc].fecid), "%s", val);
-                pthread_mutex_unlock(&mutex_tnc_set);
-            } else if (!strncasecmp(start, "MYCALL", 6)) {
-                pthread_mutex_lock(&mutex_tnc_set);
-                snprintf(g_tnc_settings[g_cur_tnc].mycall,
-                     sizeof(g_tnc_settings[g_cur_tnc].mycall), "%s", val);
-                pthread_mutex_unlock(&mutex_tnc_set);
-                arim_beacon_set(-1);
-            } else if (!strncasecmp(start, "GRIDSQUARE", 10)) {
-                pthread_mutex_lock(&mutex_tnc_set);
-                snprintf(g_tnc_settings[g_cur_tnc].gridsq,
-                    sizeof(g_tnc_settings[g_cur_tnc].gridsq), "%s", val);
-                pthread_mutex_unlock(&mutex_tnc_set);
-                arim_beacon_set(-1);
-            } else if (!strncasecmp(start, "SQUELCH", 7)) {
-                pthread_mutex_lock(&mutex_tnc_set);
-                snprintf(g_tnc_settings[g_cur_tnc].squelch,
-                    sizeof(g_tnc_settings[g_cur_tnc].squelch), "%s", val);
-                pthread_mutex_unlock(&mutex_tnc_set);
-            } else if (!strncasecmp(start, "BUSYDET", 7)) {
-                pthread_mutex_lock(&mutex_tnc_set);
-                snprintf(g_tnc_settings[g_cur_tnc].busydet,
-                    sizeof(g_tnc_settings[g_cur_tnc].busydet), "%s", val);
-                pthread_mutex_unlock(&mutex_tnc_set);
-            } else if (!strncasecmp(start, "BUSY", 4)) {
-                if (!strncasecmp(val, "TRUE", 4)) {
-                    pthread_mutex_lock(&mutex_tnc_set);
-                    snprintf(g_tnc_settings[g_cur_tnc].busy,
-                        sizeof(g_tnc_settings[g_cur_tnc].busy), "%s", "TRUE");
-                    pthread_mutex_unlock(&mutex_tnc_set);
-                    bufq_queue_debug_log("Cmd thread: TNC is BUSY");
-                } else {
-                    pthread_mutex_lock(&mutex_tnc_set);
-                    snprintf(g_tnc_settings[g_cur_tnc].busy,
-                        sizeof(g_tnc_settings[g_cur_tnc].busy), "%s", "FALSE");
-                    pthread_mutex_unlock(&mutex_tnc_set);
-                    bufq_queue_debug_log("Cmd thread: TNC is not BUSY");
-                }
-            } else if (!strncasecmp(start, "LEADER", 6)) {
-                pthread_mutex_lock(&mutex_tnc_set);
-                snprintf(g_tnc_settings[g_cur_tnc].leader,
-                    sizeof(g_tnc_settings[g_cur_tnc].leader), "%s", val);
-                pthread_mutex_unlock(&mutex_tnc_set);
-            } else if (!strncasecmp(start, "TRAILER", 7)) {
-                pthread_mutex_lock(&mutex_tnc_set);
-                snprintf(g_tnc_settings[g_cur_tnc].trailer,
-                    sizeof(g_tnc_settings[g_cur_tnc].trailer), "%s", val);
-                pthread_mutex_unlock(&mutex_tnc_set);
-            } else if (!strncasecmp(start, "ARQBW", 5)) {
-                pthread_mutex_lock(&mutex_tnc_set);
-                snprintf(g_tnc_settings[g_cur_tnc].arq_bandwidth,
-                    sizeof(g_tnc_settings[g_cur_tnc].arq_bandwidth), "%s", val);
-                pthread_mutex_unlock(&mutex_tnc_set);
-            } else if (!strncasecmp(start, "VERSION", 7)) {
-                pthread_mutex_lock(&mutex_tnc_set);
-                snprintf(g_tnc_settings[g_cur_tnc].version,
-                    sizeof(g_tnc_settings[g_cur_tnc].version), "%s", val);
-                pthread_mutex_unlock(&mutex_tnc_set);
-                tnc_get_version(val);
-                /* NEGOTIATEBW command supported only by the ARDOP_2Win TNC */
-                if (!negbw_once && g_tnc_version.vendor == 'W' &&
-                                      g_tnc_version.major >= 2 &&
-                                      g_tnc_version.minor >= 0 &&
-                                      g_tnc_version.revision >= 4) {
-                    negbw_once = 1;
-                    snprintf(buffer, sizeof(buffer), "NEGOTIATEBW %s", g_tnc_settings[g_cur_tnc].arq_negotiate_bw);
-                    bufq_queue_cmd_out(buffer);
-                }
-                /* now that we know tnc version, validate and update FECMODE */
-                if (!ini_validate_fecmode(g_tnc_settings[g_cur_tnc].fecmode)) {
-                    if (g_tnc_version.major <= 1)
-                        snprintf(g_tnc_settings[g_cur_tnc].fecmode,
-                                 sizeof(g_tnc_settings[g_cur_tnc].fecmode), "%s", "4FSK.200.50S");
-                    else
-                        snprintf(g_tnc_settings[g_cur_tnc].fecmode,
-                                 sizeof(g_tnc_settings[g_cur_tnc].fecmode), "%s", "4PSK.200.50");
-                }
-                snprintf(buffer, sizeof(buffer), "FECMODE %s", g_tnc_settings[g_cur_tnc].fecmode);
-                bufq_queue_cmd_out(buffer);
-                /* next validate and update ARQBW */
-                if (!ini_validate_arq_bw(g_tnc_settings[g_cur_tnc].arq_bandwidth)) {
-                    if (g_tnc_version.major <= 1)
-                        snprintf(g_tnc_settings[g_cur_tnc].arq_bandwidth,
-                                 sizeof(g_tnc_settings[g_cur_tnc].arq_bandwidth), "%s", "500MAX");
-                    else
-                        snprintf(g_tnc_settings[g_cur_tnc].arq_bandwidth,
-                                 sizeof(g_tnc_settings[g_cur_tnc].arq_bandwidth), "%s", "500");
-                }
-                snprintf(buffer, sizeof(buffer), "ARQBW %s", g_tnc_settings[g_cur_tnc].arq_bandwidth);
-                bufq_queue_cmd_out(buffer);
-            }
+            ardop_cmds_dispatch(start, val);
             cnt -= (end - buffer + 1);
             memmove(buffer, end + 1, cnt);
         } else {
@@ -308,6 +384,10 @@ void ardop_cmds_init()
     int i;
     char buffer[MAX_CMD_SIZE];
 
+    ardop_flow_reset();
+    tnc_state_init();
+    for (i = 0; i < RESP_TABLE_LEN; i++)
+        resp_table[i].hits = 0;
     bufq_queue_cmd_out("INITIALIZE");
     snprintf(buffer, sizeof(buffer), "MYCALL %s", g_tnc_settings[g_cur_tnc].mycall);
     bufq_queue_cmd_out(buffer);
@@ -30,6 +30,7 @@ extern "C" {
 
 extern size_t ardop_cmds_proc_resp(char *response, size_t size);
 extern void ardop_cmds_init();
+extern void ardop_cmds_log_stats(void);
 
 #ifdef __cplusplus
 }
@@ -204,82 +204,136 @@ void ardop_data_on_err(char *data, size_t size)
     bufq_queue_debug_log("Data thread: received ARDOP ERR frame from TNC");
 }
 
+/* data port byte stream, holds at most one partial frame between reads */
+static unsigned char rxbuf[MIN_DATA_BUF_SIZE+1]; /* +1 for terminating null */
+static size_t rx_head, rx_tail;
+
+static size_t ardop_data_frame_size(const unsigned char *frame)
+{
+    size_t datasize = 0;
+
+    /* is this a valid frame? */
+    if ((frame[2] == 'A' && frame[3] == 'R' && frame[4] == 'Q') ||
+        (frame[2] == 'F' && frame[3] == 'E' && frame[4] == 'C') ||
+        (frame[2] == 'E' && frame[3] == 'R' && frame[4] == 'R') ||
+        (frame[2] == 'I' && frame[3] == 'D' && frame[4] == 'F')) {
+        /* yes, extract payload size, includes the frame type */
+        datasize = frame[0] << 8;
+        datasize += frame[1];
+    }
+    if (datasize < 3 || datasize > (sizeof(rxbuf) - 3))
+        return 0;
+    return datasize;
+}
+
 //#define VIEW_DATA_IN
-size_t ardop_data_handle_data(unsigned char *data, size_t size)
+static void ardop_data_dispatch(unsigned char *frame, size_t datasize)
 {
-    static unsigned char buffer[MIN_DATA_BUF_SIZE];
-    static size_t cnt = 0;
     static int arim_frame_type = 0;
-    int is_new_frame, is_arim_frame, datasize = 0;
+    char *payload = (char *)&frame[5];
+    size_t size = datasize - 3;
+    int is_new_frame, is_arim_frame;
 
 #ifdef VIEW_DATA_IN
 char buf[MIN_DATA_BUF_SIZE];
-#endif
-
-    if ((cnt + size) > sizeof(buffer)) {
-        /* too much data, can't be a valid ARIM payload */
-        cnt = 0;
-        return cnt;
-    }
-    ardop_data_inc_num_bytes_in(size);
-    memcpy(buffer + cnt, data, size);
-    cnt += size;
-    /* extract data size */
-    if (cnt < 5) /* not enough data yet, wait for more */
-        return cnt;
-    /* is this a valid frame? */
-    if ((buffer[2] == 'A' && buffer[3] == 'R' && buffer[4] == 'Q') ||
-        (buffer[2] == 'F' && buffer[3] == 'E' && buffer[4] == 'C') ||
-        (buffer[2] == 'E' && buffer[3] == 'R' && buffer[4] == 'R') ||
-        (buffer[2] == 'I' && buffer[3] == 'D' && buffer[4] == 'F')) {
-        /* yes, extract payload size */
-        datasize = buffer[0] << 8;
-        datasize += buffer[1];
-    }
-    if (datasize <= 0) {
-        /* invalid frame or bad payload size */
-        bufq_queue_debug_log("Data thread: received bad ARDOP ARQ frame from TNC");
-        cnt = 0;
-        return cnt;
-    }
-    if (datasize <= (cnt - 2)) {
-        /* got all data, dispatch on frame type */
-#ifdef VIEW_DATA_IN
-snprintf(buf, datasize + 7, "[%04X]%s", datasize, buffer + 2);
+snprintf(buf, datasize + 7, "[%04zX]%s", datasize, frame + 2);
 bufq_queue_debug_log(buf);
 sleep(1);
 #endif
-        if (buffer[2] == 'F') { /* FEC frame */
-            is_arim_frame = 0;
-            is_arim_frame = arim_test_frame((char *)&buffer[5], datasize - 3);
-            is_new_frame = 0;
-            is_new_frame = (!arim_data_waiting && is_arim_frame);
-            if (is_new_frame) {
-                arim_frame_type = is_arim_frame;
-                arim_on_event(EV_FRAME_START, arim_frame_type);
-                bufq_queue_debug_log("Data thread: received start of ARIM frame");
-            }
-            if (arim_data_waiting || is_new_frame)
-                arim_data_waiting = arim_on_data((char *)&buffer[5], datasize - 3);
-            else
-                ardop_data_on_fec((char *)&buffer[5], datasize - 3);
-            /* clear start time if done, otherwise update with current time */
-            if (!arim_data_waiting) {
-                arim_start_time = 0;
-                arim_on_event(EV_FRAME_END, arim_frame_type);
-            } else {
-                arim_start_time = time(NULL);
-            }
+    if (frame[2] == 'F') { /* FEC frame */
+        is_arim_frame = arim_test_frame(payload, size);
+        is_new_frame = (!arim_data_waiting && is_arim_frame);
+        if (is_new_frame) {
+            arim_frame_type = is_arim_frame;
+            arim_on_event(EV_FRAME_START, arim_frame_type);
+            bufq_queue_debug_log("Data thread: received start of ARIM frame");
+        }
+        if (arim_data_waiting || is_new_frame)
+            arim_data_waiting = arim_on_data(payload, size);
+        else
+            ardop_data_on_fec(payload, size);
+        /* clear start time if done, otherwise update with current time */
+        if (!arim_data_waiting) {
+            arim_start_time = 0;
+            arim_on_event(EV_FRAME_END, arim_frame_type);
+        } else {
+            arim_start_time = time(NULL);
         }
-        else if (buffer[2] == 'I') /* IDF frame */
-            ardop_data_on_idf((char *)&buffer[5], datasize - 3);
-        else if (buffer[2] == 'A') /* ARQ frame */
-            ardop_data_on_arq((char *)&buffer[5], datasize - 3);
-        else if (buffer[2] == 'E') /* ERR frame */
-            ardop_data_on_err((char *)&buffer[5], datasize - 3);
-        /* reset buffer */
-        cnt = 0;
     }
-    return cnt;
+    else if (frame[2] == 'I') /* IDF frame */
+        ardop_data_on_idf(payload, size);
+    else if (frame[2] == 'A') /* ARQ frame */
+        ardop_data_on_arq(payload, size);
+    else if (frame[2] == 'E') /* ERR frame */
+        ardop_data_on_err(payload, size);
 }
 
+static void ardop_data_dispatch_frames()
+{
+    unsigned char *frame, save;
+    size_t datasize;
+
+    /* dispatch every complete frame, payload is passed in place */
+    while (rx_tail - rx_head >= 5) {
+        frame = rxbuf + rx_head;
+        datasize = ardop_data_frame_size(frame);
+        if (!datasize) {
+            /* invalid frame or bad payload size, no way to resync */
+            bufq_queue_debug_log("Data thread: received bad ARDOP ARQ frame from TNC");
+            rx_head = rx_tail = 0;
+            break;
+        }
+        if (datasize > (rx_tail - rx_head - 2))
+            break; /* partial frame, wait for more */
+        /* null terminate payload for handlers that print it */
+        save = frame[datasize + 2];
+        frame[datasize + 2] = '\0';
+        ardop_data_dispatch(frame, datasize);
+        frame[datasize + 2] = save;
+        rx_head += datasize + 2;
+    }
+    if (rx_head == rx_tail)
+        rx_head = rx_tail = 0;
+}
+
+unsigned char *ardop_data_rx_space(size_t *size)
+{
+    if (rx_head) {
+        /* move partial frame left over from last read to front of buffer */
+        memmove(rxbuf, rxbuf + rx_head, rx_tail - rx_head);
+        rx_tail -= rx_head;
+        rx_head = 0;
+    }
+    /* never 0, a partial frame is always shorter than the buffer */
+    *size = sizeof(rxbuf) - 1 - rx_tail;
+    return rxbuf + rx_tail;
+}
+
+size_t ardop_data_on_read(size_t size)
+{
+    /* size bytes were read into the space from ardop_data_rx_space() */
+    ardop_data_inc_num_bytes_in(size);
+    rx_tail += size;
+    ardop_data_dispatch_frames();
+    return rx_tail - rx_head;
+}
+
+size_t ardop_data_handle_data(unsigned char *data, size_t size)
+{
+    unsigned char *space;
+    size_t len;
+
+    /* for data that's already in a buffer, e.g. a host mode frame */
+    ardop_data_inc_num_bytes_in(size);
+    while (size) {
+        space = ardop_data_rx_space(&len);
+        if (len > size)
+            len = size;
+        memcpy(space, data, len);
+        rx_tail += len;
+        data += len;
+        size -= len;
+        ardop_data_dispatch_frames();
+    }
+    return rx_tail - rx_head;
+}
@@ -38,6 +38,8 @@ extern size_t ardop_data_get_num_bytes_in(void);
 extern size_t ardop_data_get_num_bytes_out(void);
 extern void ardop_data_reset_num_bytes(void);
 extern size_t ardop_data_handle_data(unsigned char *data, size_t size);
+extern unsigned char *ardop_data_rx_space(size_t *size);
+extern size_t ardop_data_on_read(size_t size);
 
 #ifdef __cplusplus
 }
@@ -0,0 +1,157 @@
+/***********************************************************************
+
+    ARIM Amateur Radio Instant Messaging program for the ARDOP TNC.
+
+    Copyright (C) 2016-2021 Robert Cunnings NW8L
+
+    This file is part of the ARIM messaging program.
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+*************************************************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "main.h"
+#include "ardop_flow.h"
+#include "bufq.h"
+#include "ini.h"
+#include "util.h"
+
+/*
+    Adaptive pacing of data written to the TNC. The TNC reports the
+    number of bytes in its transmit buffer with BUFFER notifications.
+    The drain rate is estimated from successive notifications, taking
+    into account the bytes written in between, and the buffer is kept
+    filled to a level that covers FLOW_HORIZON_MSEC of transmission.
+*/
+
+static int flow_reported;           /* last BUFFER count from TNC */
+static long long flow_report_time;  /* time of last BUFFER notification */
+static size_t flow_written;         /* bytes written since last notification */
+static size_t flow_rate;            /* estimated drain rate, bytes/sec */
+static size_t flow_xfer_bytes;      /* bytes in current transfer */
+static long long flow_xfer_start;   /* time current transfer started */
+static int flow_xfer_done;          /* transfer written, awaiting drain */
+
+int ardop_flow_is_enabled()
+{
+    return !strncasecmp(g_tnc_settings[g_cur_tnc].adaptive_flow, "TRUE", 4);
+}
+
+void ardop_flow_reset()
+{
+    pthread_mutex_lock(&mutex_tnc_flow);
+    flow_reported = 0;
+    flow_report_time = util_msec_now();
+    flow_written = flow_rate = flow_xfer_bytes = 0;
+    flow_xfer_start = 0;
+    flow_xfer_done = 0;
+    pthread_mutex_unlock(&mutex_tnc_flow);
+}
+
+void ardop_flow_start(size_t size)
+{
+    pthread_mutex_lock(&mutex_tnc_flow);
+    flow_xfer_bytes = size;
+    flow_xfer_start = util_msec_now();
+    flow_xfer_done = 0;
+    pthread_mutex_unlock(&mutex_tnc_flow);
+}
+
+void ardop_flow_end()
+{
+    pthread_mutex_lock(&mutex_tnc_flow);
+    if (flow_xfer_start)
+        flow_xfer_done = 1;
+    pthread_mutex_unlock(&mutex_tnc_flow);
+}
+
+void ardop_flow_on_buffer(int cnt)
+{
+    char buffer[MAX_LOG_LINE_SIZE];
+    long long now, elapsed;
+    size_t sample;
+    int drained;
+
+    now = util_msec_now();
+    pthread_mutex_lock(&mutex_tnc_flow);
+    elapsed = now - flow_report_time;
+    drained = flow_reported + (int)flow_written - cnt;
+    if (elapsed > 0 && drained > 0) {
+        sample = (size_t)((long long)drained * 1000 / elapsed);
+        if (cnt == 0 || flow_reported == 0) {
+            /* buffer ran dry before this report, or was empty at the last
+               one and sat idle until written to, so the sample is a lower
+               bound. On a fast link it drains between every pair of
+               reports and this is the only estimate there is */
+            if (sample > flow_rate)
+                flow_rate = sample;
+        } else if (flow_rate) {
+            flow_rate = (flow_rate * 3 + sample) / 4;
+        } else {
+            flow_rate = sample;
+        }
+    }
+    flow_reported = cnt;
+    flow_report_time = now;
+    flow_written = 0;
+    if (flow_xfer_done && cnt == 0) {
+        /* transfer fully drained from TNC buffer, log throughput */
+        elapsed = now - flow_xfer_start;
+        snprintf(buffer, sizeof(buffer),
+                 "Data thread: sent %zu bytes in %lld.%03lld sec (%lld bytes/sec)",
+                 flow_xfer_bytes, elapsed / 1000, elapsed % 1000,
+                 elapsed > 0 ? (long long)flow_xfer_bytes * 1000 / elapsed : 0);
+        flow_xfer_done = 0;
+        flow_xfer_start = 0;
+        pthread_mutex_unlock(&mutex_tnc_flow);
+        bufq_queue_debug_log(buffer);
+        return;
+    }
+    pthread_mutex_unlock(&mutex_tnc_flow);
+}
+
+void ardop_flow_on_write(size_t size)
+{
+    pthread_mutex_lock(&mutex_tnc_flow);
+    flow_written += size;
+    pthread_mutex_unlock(&mutex_tnc_flow);
+}
+
+size_t ardop_flow_block_size(size_t nleft)
+{
+    long long level, target, credit;
+
+    pthread_mutex_lock(&mutex_tnc_flow);
+    /* estimate present fill level of TNC buffer */
+    level = flow_reported + (long long)flow_written -
+                (long long)flow_rate * (util_msec_now() - flow_report_time) / 1000;
+    if (level < (long long)flow_written)
+        level = flow_written; /* can't be less than what is unreported */
+    target = FLOW_MIN_TARGET + (long long)flow_rate * FLOW_HORIZON_MSEC / 1000;
+    if (target > FLOW_MAX_TARGET)
+        target = FLOW_MAX_TARGET;
+    pthread_mutex_unlock(&mutex_tnc_flow);
+    credit = target - level;
+    if (credit > FLOW_MAX_BLOCK)
+        credit = FLOW_MAX_BLOCK;
+    if (credit >= (long long)nleft)
+        return nleft;
+    /* avoid dribbling out tiny blocks, wait for more room */
+    if (credit < FLOW_MIN_BLOCK)
+        return 0;
+    return (size_t)credit;
+}
@@ -0,0 +1,42 @@
+/***********************************************************************
+
+    ARIM Amateur Radio Instant Messaging program for the ARDOP TNC.
+
+    Copyright (C) 2016-2021 Robert Cunnings NW8L
+
+    This file is part of the ARIM messaging program.
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+*************************************************************************/
+
+#ifndef _ARDOP_FLOW_H_INCLUDED_
+#define _ARDOP_FLOW_H_INCLUDED_
+
+#define FLOW_MIN_TARGET     2048
+#define FLOW_MAX_TARGET     16384
+#define FLOW_HORIZON_MSEC   4000
+#define FLOW_MIN_BLOCK      256
+#define FLOW_MAX_BLOCK      8192
+
+extern int ardop_flow_is_enabled(void);
+extern void ardop_flow_reset(void);
+extern void ardop_flow_start(size_t size);
+extern void ardop_flow_end(void);
+extern void ardop_flow_on_buffer(int cnt);
+extern void ardop_flow_on_write(size_t size);
+extern size_t ardop_flow_block_size(size_t nleft);
+
+#endif
+
@@ -87,7 +87,7 @@ void arim_reset()
 
 int arim_test_frame(const char *data, size_t size)
 {
-    if (size >= 4 && data[0] == '|' &&
+    if (size >= 5 && data[0] == '|' &&
         (data[1] == 'M' || data[1] == 'Q' || data[1] == 'R' ||
          data[1] == 'B' || data[1] == 'A' || data[1] == 'N') &&
         (isdigit((int)data[2]) && isdigit((int)data[3]) && atoi(&data[2]) ==
@@ -97,10 +97,200 @@ int arim_test_frame(const char *data, size_t size)
     return 0;
 }
 
+static int arim_test_frame_head(const char *data, size_t size)
+{
+    /* a payload tail too short for arim_test_frame that may still
+       be the start of a frame continued in the next payload */
+    if (!size || size >= 5 || data[0] != '|')
+        return 0;
+    if (size > 1 && (!data[1] || !strchr("MQRBAN", data[1])))
+        return 0;
+    if (size > 2 && !isdigit((int)data[2]))
+        return 0;
+    if (size > 3 && !isdigit((int)data[3]))
+        return 0;
+    return 1;
+}
+
+static void arim_on_frame_end(char *frame)
+{
+    char inbuffer[MIN_MSG_BUF_SIZE];
+    int check_valid, numch;
+
+    if (state == ST_MSG_END) {
+        if (!ini_check_ac_calls(fm_call)) {
+            numch = snprintf(inbuffer, sizeof(inbuffer), ">> [%c] (Access denied) %s", 'M', frame);
+            if (numch >= sizeof(inbuffer))
+                ui_truncate_line(inbuffer, sizeof(inbuffer));
+            bufq_queue_traffic_log(inbuffer);
+            numch = snprintf(inbuffer, sizeof(inbuffer), ">> [%c] Ignored [M] frame from %s (access denied)", 'X', fm_call);
+            if (numch >= sizeof(inbuffer))
+                ui_truncate_line(inbuffer, sizeof(inbuffer));
+            bufq_queue_data_in(inbuffer);
+            bufq_queue_debug_log("Data thread: ignored ARIM [M] frame from TNC (access denied)");
+        } else {
+            check_valid = arim_recv_msg(fm_call, to_call, check, frame + hdr_size);
+            numch = snprintf(inbuffer, sizeof(inbuffer), ">> [%c] %s", check_valid ? 'M' : '!', frame);
+            if (numch >= sizeof(inbuffer))
+                ui_truncate_line(inbuffer, sizeof(inbuffer));
+            bufq_queue_traffic_log(inbuffer);
+            bufq_queue_data_in(inbuffer);
+            bufq_queue_debug_log("Data thread: received ARIM [M] frame from TNC");
+        }
+        arim_reset();
+        /* end the download progress meter */
+        ui_status_xfer_end();
+    } else if (state == ST_BEACON_END) {
+        numch = snprintf(inbuffer, sizeof(inbuffer), ">> [B] %s", frame);
+        if (numch >= sizeof(inbuffer))
+            ui_truncate_line(inbuffer, sizeof(inbuffer));
+        bufq_queue_data_in(inbuffer);
+        bufq_queue_traffic_log(inbuffer);
+        bufq_queue_debug_log("Data thread: received ARIM [B] frame from TNC");
+        arim_beacon_recv(fm_call, gridsq, frame + hdr_size);
+        arim_reset();
+    } else if (state == ST_QUERY_END) {
+        if (!ini_check_ac_calls(fm_call)) {
+            numch = snprintf(inbuffer, sizeof(inbuffer), ">> [%c] (access denied) %s", 'Q', frame);
+            if (numch >= sizeof(inbuffer))
+                ui_truncate_line(inbuffer, sizeof(inbuffer));
+            bufq_queue_traffic_log(inbuffer);
+            numch = snprintf(inbuffer, sizeof(inbuffer), ">> [%c] Ignored [Q] frame from %s (access denied)", 'X', fm_call);
+            if (numch >= sizeof(inbuffer))
+                ui_truncate_line(inbuffer, sizeof(inbuffer));
+            bufq_queue_data_in(inbuffer);
+            bufq_queue_debug_log("Data thread: ignored ARIM [Q] frame from TNC (access denied)");
+        } else {
+            check_valid = arim_recv_query(fm_call, to_call, check, frame + hdr_size);
+            numch = snprintf(inbuffer, sizeof(inbuffer), ">> [%c] %s", check_valid ? 'Q' : '!', frame);
+            if (numch >= sizeof(inbuffer))
+                ui_truncate_line(inbuffer, sizeof(inbuffer));
+            bufq_queue_data_in(inbuffer);
+            bufq_queue_traffic_log(inbuffer);
+            bufq_queue_debug_log("Data thread: received ARIM [Q] frame from TNC");
+        }
+        arim_reset();
+    } else if (state == ST_RESPONSE_END) {
+        check_valid = arim_recv_response(fm_call, to_call, check, frame + hdr_size);
+        numch = snprintf(inbuffer, sizeof(inbuffer), ">> [%c] %s", check_valid ? 'R' : '!', frame);
+        if (numch >= sizeof(inbuffer))
+            ui_truncate_line(inbuffer, sizeof(inbuffer));
+        bufq_queue_data_in(inbuffer);
+        bufq_queue_traffic_log(inbuffer);
+        bufq_queue_debug_log("Data thread: received ARIM [R] frame from TNC");
+        arim_reset();
+        /* end the download progress meter */
+        ui_status_xfer_end();
+    } else if (state == ST_ACK_END) {
+        msg_size = 7 + strlen(fm_call) + strlen(to_call);
+        frame[msg_size] = 0;
+        numch = snprintf(inbuffer, sizeof(inbuffer), ">> [A] %s", frame);
+        if (numch >= sizeof(inbuffer))
+            ui_truncate_line(inbuffer, sizeof(inbuffer));
+        bufq_queue_data_in(inbuffer);
+        bufq_queue_traffic_log(inbuffer);
+        bufq_queue_debug_log("Data thread: received ARIM [A] frame from TNC");
+        arim_recv_ack(fm_call, to_call);
+        arim_reset();
+    } else if (state == ST_NAK_END) {
+        msg_size = 7 + strlen(fm_call) + strlen(to_call);
+        frame[msg_size] = 0;
+        numch = snprintf(inbuffer, sizeof(inbuffer), ">> [N] %s", frame);
+        if (numch >= sizeof(inbuffer))
+            ui_truncate_line(inbuffer, sizeof(inbuffer));
+        bufq_queue_data_in(inbuffer);
+        bufq_queue_traffic_log(inbuffer);
+        bufq_queue_debug_log("Data thread: received ARIM [N] frame from TNC");
+        arim_recv_nak(fm_call, to_call);
+        arim_reset();
+    }
+}
+
+static size_t arim_on_whole_frame(char *data, size_t size)
+{
+    char *p, *e, *end = data + size, numbuf[MAX_CHECK_SIZE], save;
+    size_t len;
+
+    /*  fast path for the common case of a complete frame at the start
+        of the payload: scan the header fields in place and dispatch
+        without going through the parse buffer. Returns the frame size,
+        or 0 to leave the payload to the incremental parser. */
+    type = arim_test_frame(data, size);
+    if (!type)
+        return 0;
+    p = data + 5;
+    e = memchr(p, '|', end - p);
+    if (!e || (e - p) >= sizeof(fm_call))
+        return 0;
+    memcpy(fm_call, p, e - p);
+    fm_call[e - p] = '\0';
+    p = e + 1;
+    if (type != 'B') {
+        e = memchr(p, '|', end - p);
+        if (!e || (e - p) >= sizeof(to_call))
+            return 0;
+        memcpy(to_call, p, e - p);
+        to_call[e - p] = '\0';
+        p = e + 1;
+        if (type == 'A' || type == 'N') {
+            hdr_size = msg_size = p - data;
+            state = (type == 'A') ? ST_ACK_END : ST_NAK_END;
+            goto dispatch;
+        }
+    }
+    if ((end - p) < 5 || p[4] != '|' || !isxdigit((int)p[0]) || !isxdigit((int)p[1]) ||
+                            !isxdigit((int)p[2]) || !isxdigit((int)p[3]))
+        return 0;
+    memcpy(numbuf, p, 4);
+    numbuf[4] = '\0';
+    msg_size = strtoul(numbuf, NULL, 16);
+    p += 5;
+    if (type == 'B') {
+        e = memchr(p, '|', end - p);
+        if (!e || (e - p) >= sizeof(gridsq))
+            return 0;
+        memcpy(gridsq, p, e - p);
+        gridsq[e - p] = '\0';
+        p = e + 1;
+    } else {
+        if ((end - p) < 5 || p[4] != '|' || !isxdigit((int)p[0]) || !isxdigit((int)p[1]) ||
+                                !isxdigit((int)p[2]) || !isxdigit((int)p[3]))
+            return 0;
+        memcpy(numbuf, p, 4);
+        numbuf[4] = '\0';
+        check = strtoul(numbuf, NULL, 16);
+        p += 5;
+    }
+    hdr_size = p - data;
+    if (msg_size >= MIN_MSG_BUF_SIZE || msg_size < hdr_size || msg_size > size)
+        return 0; /* bad size or fragmented, let the parser deal with it */
+    if (type == 'M')
+        state = ST_MSG_END;
+    else if (type == 'Q')
+        state = ST_QUERY_END;
+    else if (type == 'R')
+        state = ST_RESPONSE_END;
+    else
+        state = ST_BEACON_END;
+    if ((type == 'M' || type == 'R') &&
+        (arim_test_mycall(to_call) || arim_test_netcall(to_call))) {
+        /* start the download progress meter */
+        ui_status_xfer_start(0, msg_size, STATUS_XFER_DIR_DOWN);
+    }
+dispatch:
+    len = msg_size;
+    /* caller's buffer has room for a terminating null past the payload */
+    save = data[len];
+    data[len] = '\0';
+    arim_on_frame_end(data);
+    data[len] = save;
+    return len;
+}
+
 int arim_on_data(char *data, size_t size)
 {
-    int quit = 0, check_valid, numch, is_netcall, is_mycall;
-    size_t remaining;
+    int quit = 0, numch, is_netcall, is_mycall;
+    size_t remaining, next, len;
     char inbuffer[MIN_MSG_BUF_SIZE], numbuf[MAX_CHECK_SIZE];
     char *s, *e;
 
@@ -111,6 +301,18 @@ int arim_on_data(char *data, size_t size)
     /* if a new frame arrives when waiting reset and start over */
     if (state != ST_PIPE_1 && arim_test_frame(data, size))
         arim_reset();
+    if (state == ST_PIPE_1) {
+        /* take whole frames straight from the payload, several may be packed together */
+        while ((len = arim_on_whole_frame(data, size))) {
+            data += len;
+            size -= len;
+            if (!size)
+                return 0; /* not waiting */
+            if (!arim_test_frame(data, size) && !arim_test_frame_head(data, size))
+                return 0; /* not waiting, trailing bytes ignored as before */
+        }
+        arim_reset(); /* clear fields left by a fragmented header */
+    }
     memcpy(buffer + cnt, data, size);
     cnt += size;
     remaining = cnt - (c - buffer);
@@ -214,9 +416,9 @@ bufq_queue_debug_log("Parser: failed pipe_2");
 bufq_queue_debug_log("Parser: entering from_call");
 #endif
             e = c;
-            while (*e && *e != '|' && (e - c) < remaining)
+            while ((e - c) < remaining && *e && *e != '|')
                 ++e;
-            if (*e == '|') {
+            if ((e - c) < remaining && *e == '|') {
                 strncpy(fm_call, c, e - c);
                 fm_call[e - c + 1] = '\0';
                 remaining -= (e - c);
@@ -258,9 +460,9 @@ bufq_queue_debug_log("Parser: failed pipe_3");
 bufq_queue_debug_log("Parser: entering to_call");
 #endif
             e = c;
-            while (*e && *e != '|' && (e - c) < remaining)
+            while ((e - c) < remaining && *e && *e != '|')
                 ++e;
-            if (*e == '|') {
+            if ((e - c) < remaining && *e == '|') {
                 strncpy(to_call, c, e - c);
                 to_call[e - c + 1] = '\0';
                 remaining -= (e - c);
@@ -354,9 +556,9 @@ bufq_queue_debug_log("Parser: failed pipe_4");
 bufq_queue_debug_log("Parser: entering gridsq");
 #endif
             e = c;
-            while (*e && *e != '|' && (e - c) < remaining)
+            while ((e - c) < remaining && *e && *e != '|')
                 ++e;
-            if (*e == '|') {
+            if ((e - c) < remaining && *e == '|') {
                 strncpy(gridsq, c, e - c);
                 gridsq[e - c + 1] = '\0';
                 remaining -= (e - c);
@@ -481,92 +683,13 @@ sleep(1);
             break;
         } /* end switch */
     } while (!quit && remaining > 0);
-    if (state == ST_MSG_END) {
-        if (!ini_check_ac_calls(fm_call)) {
-            numch = snprintf(inbuffer, sizeof(inbuffer), ">> [%c] (Access denied) %s", 'M', buffer);
-            if (numch >= sizeof(inbuffer))
-                ui_truncate_line(inbuffer, sizeof(inbuffer));
-            bufq_queue_traffic_log(inbuffer);
-            numch = snprintf(inbuffer, sizeof(inbuffer), ">> [%c] Ignored [M] frame from %s (access denied)", 'X', fm_call);
-            if (numch >= sizeof(inbuffer))
-                ui_truncate_line(inbuffer, sizeof(inbuffer));
-            bufq_queue_data_in(inbuffer);
-            bufq_queue_debug_log("Data thread: ignored ARIM [M] frame from TNC (access denied)");
-        } else {
-            check_valid = arim_recv_msg(fm_call, to_call, check, buffer + hdr_size);
-            numch = snprintf(inbuffer, sizeof(inbuffer), ">> [%c] %s", check_valid ? 'M' : '!', buffer);
-            if (numch >= sizeof(inbuffer))
-                ui_truncate_line(inbuffer, sizeof(inbuffer));
-            bufq_queue_traffic_log(inbuffer);
-            bufq_queue_data_in(inbuffer);
-            bufq_queue_debug_log("Data thread: received ARIM [M] frame from TNC");
-        }
-        arim_reset();
-        /* end the download progress meter */
-        ui_status_xfer_end();
-    } else if (state == ST_BEACON_END) {
-        numch = snprintf(inbuffer, sizeof(inbuffer), ">> [B] %s", buffer);
-        if (numch >= sizeof(inbuffer))
-            ui_truncate_line(inbuffer, sizeof(inbuffer));
-        bufq_queue_data_in(inbuffer);
-        bufq_queue_traffic_log(inbuffer);
-        bufq_queue_debug_log("Data thread: received ARIM [B] frame from TNC");
-        arim_beacon_recv(fm_call, gridsq, buffer + hdr_size);
-        arim_reset();
-    } else if (state == ST_QUERY_END) {
-        if (!ini_check_ac_calls(fm_call)) {
-            numch = snprintf(inbuffer, sizeof(inbuffer), ">> [%c] (access denied) %s", 'Q', buffer);
-            if (numch >= sizeof(inbuffer))
-                ui_truncate_line(inbuffer, sizeof(inbuffer));
-            bufq_queue_traffic_log(inbuffer);
-            numch = snprintf(inbuffer, sizeof(inbuffer), ">> [%c] Ignored [Q] frame from %s (access denied)", 'X', fm_call);
-            if (numch >= sizeof(inbuffer))
-                ui_truncate_line(inbuffer, sizeof(inbuffer));
-            bufq_queue_data_in(inbuffer);
-            bufq_queue_debug_log("Data thread: ignored ARIM [Q] frame from TNC (access denied)");
-        } else {
-            check_valid = arim_recv_query(fm_call, to_call, check, buffer + hdr_size);
-            numch = snprintf(inbuffer, sizeof(inbuffer), ">> [%c] %s", check_valid ? 'Q' : '!', buffer);
-            if (numch >= sizeof(inbuffer))
-                ui_truncate_line(inbuffer, sizeof(inbuffer));
-            bufq_queue_data_in(inbuffer);
-            bufq_queue_traffic_log(inbuffer);
-            bufq_queue_debug_log("Data thread: received ARIM [Q] frame from TNC");
-        }
-        arim_reset();
-    } else if (state == ST_RESPONSE_END) {
-        check_valid = arim_recv_response(fm_call, to_call, check, buffer + hdr_size);
-        numch = snprintf(inbuffer, sizeof(inbuffer), ">> [%c] %s", check_valid ? 'R' : '!', buffer);
-        if (numch >= sizeof(inbuffer))
-            ui_truncate_line(inbuffer, sizeof(inbuffer));
-        bufq_queue_data_in(inbuffer);
-        bufq_queue_traffic_log(inbuffer);
-        bufq_queue_debug_log("Data thread: received ARIM [R] frame from TNC");
-        arim_reset();
-        /* end the download progress meter */
-        ui_status_xfer_end();
-    } else if (state == ST_ACK_END) {
-        msg_size = 7 + strlen(fm_call) + strlen(to_call);
-        buffer[msg_size] = 0;
-        numch = snprintf(inbuffer, sizeof(inbuffer), ">> [A] %s", buffer);
-        if (numch >= sizeof(inbuffer))
-            ui_truncate_line(inbuffer, sizeof(inbuffer));
-        bufq_queue_data_in(inbuffer);
-        bufq_queue_traffic_log(inbuffer);
-        bufq_queue_debug_log("Data thread: received ARIM [A] frame from TNC");
-        arim_recv_ack(fm_call, to_call);
-        arim_reset();
-    } else if (state == ST_NAK_END) {
-        msg_size = 7 + strlen(fm_call) + strlen(to_call);
-        buffer[msg_size] = 0;
-        numch = snprintf(inbuffer, sizeof(inbuffer), ">> [N] %s", buffer);
-        if (numch >= sizeof(inbuffer))
-            ui_truncate_line(inbuffer, sizeof(inbuffer));
-        bufq_queue_data_in(inbuffer);
-        bufq_queue_traffic_log(inbuffer);
-        bufq_queue_debug_log("Data thread: received ARIM [N] frame from TNC");
-        arim_recv_nak(fm_call, to_call);
-        arim_reset();
+    if (state >= ST_BEACON_END && state <= ST_RESPONSE_END) {
+        /* leftover bytes may be another frame packed into the same payload */
+        next = remaining;
+        arim_on_frame_end(buffer);
+        if (next && next <= size && (arim_test_frame(data + size - next, next) ||
+                                     arim_test_frame_head(data + size - next, next)))
+            return arim_on_data(data + size - next, next);
     } else if (state == ST_ERROR) {
         buffer[remaining] = '\0';
         numch = snprintf(inbuffer, sizeof(inbuffer), ">> [!] %s", buffer);
@@ -35,6 +35,7 @@
 #include "log.h"
 #include "arim_arq.h"
 #include "arim_arq_files.h"
+#include "arim_arq_codec.h"
 #include "arim_arq_msg.h"
 #include "arim_arq_auth.h"
 #include "ini.h"
@@ -49,6 +50,7 @@
 #include "ui_tnc_data_win.h"
 #include "ui_tnc_cmd_win.h"
 #include "tnc_attach.h"
+#include "tnc_state.h"
 
 #define ONE_SECOND_TIMER    5 /* 200 msec intervals */
 
@@ -86,10 +88,7 @@ int arim_arq_send_conn_req(int repeats, const char *to_call, const char *arqbw)
         tcall[i] = toupper(to_call[i]);
     tcall[i] = '\0';
     /* cache remote call and repeat count */
-    pthread_mutex_lock(&mutex_tnc_set);
-    snprintf(g_tnc_settings[g_cur_tnc].arq_remote_call,
-        sizeof(g_tnc_settings[g_cur_tnc].arq_remote_call), "%s", tcall);
-    pthread_mutex_unlock(&mutex_tnc_set);
+    tnc_state_set_remote(tcall, NULL);
     if (repeats)
         arq_rpts = repeats;
     else
@@ -167,10 +166,7 @@ int arim_arq_on_target()
     arim_copy_target_call(target_call, sizeof(target_call));
     /* populate remote call with placeholder value for display
        purposes until CONNECTED async response is received */
-    pthread_mutex_lock(&mutex_tnc_set);
-    snprintf(g_tnc_settings[g_cur_tnc].arq_remote_call,
-        sizeof(g_tnc_settings[g_cur_tnc].arq_remote_call), "%s", "?????");
-    pthread_mutex_unlock(&mutex_tnc_set);
+    tnc_state_set_remote("?????", NULL);
     snprintf(buffer, sizeof(buffer), ">> [@] %s>%s (Connect request)",
                 g_tnc_settings[g_cur_tnc].arq_remote_call, target_call);
     bufq_queue_traffic_log(buffer);
@@ -222,6 +218,9 @@ int arim_arq_on_connected()
     ardop_data_reset_num_bytes(); /* reset ARQ data transfer byte counters */
     arq_cmd_size = 0; /* reset ARQ command size */
     arim_arq_auth_set_status(0); /* reset sesson authenticated status */
+    arim_arq_msg_on_send_cancel(); /* keep unacknowledged /MGET messages */
+    arim_arq_files_on_abort(); /* drop partial file transfers */
+    arim_arq_codec_reset(); /* remote station's codec support unknown */
     arim_set_channel_not_busy(); /* force TNC not busy status */
     return 1;
 }
@@ -275,6 +274,8 @@ int arim_arq_on_disconnected()
     is_outbound = 0; /* reset outbound connection flag */
     arq_cmd_size = 0; /* reset ARQ command size */
     arim_arq_auth_set_status(0); /* reset session authenticated status */
+    arim_arq_msg_on_send_cancel(); /* keep unacknowledged /MGET messages */
+    arim_arq_files_on_abort(); /* drop partial file transfers */
     datathread_cancel_send_data_out(); /* cancel data transfer to TNC */
     return 1;
 }
@@ -305,6 +306,8 @@ int arim_arq_on_conn_timeout()
     is_outbound = 0; /* reset outbound connection flag */
     arq_cmd_size = 0; /* reset ARQ command size */
     arim_arq_auth_set_status(0); /* reset sesson authenticated status */
+    arim_arq_msg_on_send_cancel(); /* keep unacknowledged /MGET messages */
+    arim_arq_files_on_abort(); /* drop partial file transfers */
     datathread_cancel_send_data_out(); /* cancel data transfer to TNC */
     return 1;
 }
@@ -473,6 +476,8 @@ int arim_arq_on_conn_cancel()
     is_outbound = 0; /* reset outbound connection flag */
     arq_cmd_size = 0; /* reset ARQ command size */
     arim_arq_auth_set_status(0); /* reset sesson authenticated status */
+    arim_arq_msg_on_send_cancel(); /* keep unacknowledged /MGET messages */
+    arim_arq_files_on_abort(); /* drop partial file transfers */
     ui_status_xfer_end(); /* hide xfer progress meter */
     datathread_cancel_send_data_out(); /* cancel data transfer to TNC */
     return 1;
@@ -503,6 +508,8 @@ int arim_arq_on_conn_closed()
     is_outbound = 0; /* reset outbound connection flag */
     arq_cmd_size = 0; /* reset ARQ command size */
     arim_arq_auth_set_status(0); /* reset sesson authenticated status */
+    arim_arq_msg_on_send_cancel(); /* keep unacknowledged /MGET messages */
+    arim_arq_files_on_abort(); /* drop partial file transfers */
     ui_status_xfer_end(); /* hide xfer progress meter */
     datathread_cancel_send_data_out(); /* cancel data transfer to TNC */
     return 1;
@@ -518,7 +525,8 @@ size_t arim_arq_send_remote(const char *msg)
         snprintf(linebuf, sizeof(linebuf), "%s\r\n", msg);
     else
         snprintf(linebuf, sizeof(linebuf), "%s\n", msg);
-    bufq_queue_data_out(linebuf);
+    if (!bufq_queue_data_out(linebuf))
+        return 0;
     return strlen(linebuf);
 }
 
@@ -617,6 +625,34 @@ size_t arim_arq_on_cmd(const char *cmd, size_t size)
                 arim_arq_files_on_fget(cmdbuf, size, eol);
                 break;
             }
+        } else if (!strncasecmp(cmdbuf, "/FSYNC ", 7)) {
+            /* remote station sends block sums of its old copy of a file
+               and asks for a delta. If in a wait state already, abandon
+               that transaction and respond to the /FSYNC to avoid deadlock
+               when commands are issued by both parties simultaneously */
+            switch (state) {
+            case ST_ARQ_FILE_SEND_WAIT:
+            case ST_ARQ_FILE_SEND_WAIT_OK:
+            case ST_ARQ_FILE_RCV_WAIT:
+            case ST_ARQ_FILE_RCV_WAIT_OK:
+            case ST_ARQ_FLIST_SEND_WAIT:
+            case ST_ARQ_FLIST_RCV_WAIT:
+            case ST_ARQ_AUTH_RCV_A2_WAIT:
+            case ST_ARQ_AUTH_RCV_A3_WAIT:
+            case ST_ARQ_MSG_SEND_WAIT:
+                arim_on_event(EV_ARQ_CANCEL_WAIT, 0);
+                state = arim_get_state();
+                break;
+            }
+            switch (state) {
+            case ST_ARQ_AUTH_RCV_A4_WAIT:
+                /* /FSYNC implies remote stn accepted our /A3, auth successful */
+                arim_on_event(EV_ARQ_AUTH_OK, 0);
+                /* intentional fallthrough */
+            case ST_ARQ_CONNECTED:
+                arim_arq_files_on_fsync(cmdbuf, size, eol);
+                break;
+            }
         } else if (!strncasecmp(cmdbuf, "/FLPUT ", 7)) {
             /* remote station sends a file listing. If in a wait state already,
                abandon that transaction and respond to the /fput to avoid
@@ -802,12 +838,33 @@ size_t arim_arq_on_cmd(const char *cmd, size_t size)
                 break;
             }
         } else if (!strncasecmp(cmdbuf, "/OK", 3)) {
+            /* may advertise codecs for -z payloads */
+            if (arim_arq_codec_on_ok(cmdbuf)) {
+                snprintf(linebuf, sizeof(linebuf), "ARQ: Remote station supports codecs ");
+                arim_arq_codec_peer_desc(linebuf + strlen(linebuf), sizeof(linebuf) - strlen(linebuf));
+                bufq_queue_debug_log(linebuf);
+            }
             switch (state) {
-            case ST_ARQ_FILE_SEND:
             case ST_ARQ_FILE_SEND_WAIT_OK:
+                /* may carry offset to resume from */
+                arim_arq_files_on_ok(cmdbuf);
+                arim_on_event(EV_ARQ_FILE_OK, 0);
+                break;
+            case ST_ARQ_FILE_SEND:
+                /* if these were our /FSYNC block sums, the delta comes next */
+                if (arim_arq_files_on_sync_ok()) {
+                    arim_on_event(EV_ARQ_FILE_RCV_WAIT, 0);
+                    break;
+                }
+                /* intentional fallthrough */
             case ST_ARQ_FLIST_SEND:
                 arim_on_event(EV_ARQ_FILE_OK, 0);
                 break;
+            case ST_ARQ_FILE_RCV_WAIT:
+                /* our copy of the file matches, nothing to download */
+                if (arim_arq_files_on_unchanged(cmdbuf))
+                    arim_on_event(EV_ARQ_FILE_OK, 0);
+                break;
             case ST_ARQ_MSG_SEND:
                 arim_on_event(EV_ARQ_MSG_OK, 0);
                 /* must call this to uncompress if -z option invoked */
@@ -880,22 +937,22 @@ size_t arim_arq_on_cmd(const char *cmd, size_t size)
     } else if (cnt) {
         if (line_timer && --line_timer > 0)
             return cnt;
-        /* send data out one line at a time */
+        /* send data out one line at a time. If the outbound queue is
+           full the line stays put to be tried again on a later pass */
         e = buffer;
         if (*e) {
             while (*e && *e != '\n')
                 ++e;
-            if (*e) {
-                *e = '\0';
-                ++e;
-            }
             if (send_cr)
-                numch = snprintf(respbuf, sizeof(respbuf), "%s\r\n", buffer);
+                numch = snprintf(respbuf, sizeof(respbuf), "%.*s\r\n", (int)(e - buffer), buffer);
             else
-                numch = snprintf(respbuf, sizeof(respbuf), "%s\n", buffer);
-            bufq_queue_data_out(respbuf);
-            cnt -= (e - buffer);
-            memmove(buffer, e, cnt + 1);
+                numch = snprintf(respbuf, sizeof(respbuf), "%.*s\n", (int)(e - buffer), buffer);
+            if (*e)
+                ++e;
+            if (bufq_queue_data_out(respbuf)) {
+                cnt -= (e - buffer);
+                memmove(buffer, e, cnt + 1);
+            }
         }
         line_timer = ONE_SECOND_TIMER; /* delay to prevent data queue overrun */
     }
@@ -32,6 +32,7 @@
 #include "auth.h"
 #include "bufq.h"
 #include "arim_arq.h"
+#include "tnc_state.h"
 
 static int arq_auth_session_status;
 static char ha1[AUTH_BUFFER_SIZE], ha2[AUTH_BUFFER_SIZE];
@@ -125,10 +126,7 @@ int arim_arq_auth_on_send_a1(const char *call, const char *method, const char *p
                 "AUTH: Sending challenge with snonce %s", snonce);
     bufq_queue_debug_log(linebuf);
     /* prime buffer count because update from TNC not immediate */
-    pthread_mutex_lock(&mutex_tnc_set);
-    snprintf(g_tnc_settings[g_cur_tnc].buffer,
-        sizeof(g_tnc_settings[g_cur_tnc].buffer), "%zu", strlen(linebuf));
-    pthread_mutex_unlock(&mutex_tnc_set);
+    tnc_state_set_buffer(strlen(linebuf));
     return 1;
 }
 
@@ -163,10 +161,7 @@ int arim_arq_auth_on_send_a2()
     snprintf(linebuf, sizeof(linebuf), "ARQ: Sending /A2 response");
     bufq_queue_debug_log(linebuf);
     /* prime buffer count because update from TNC not immediate */
-    pthread_mutex_lock(&mutex_tnc_set);
-    snprintf(g_tnc_settings[g_cur_tnc].buffer,
-        sizeof(g_tnc_settings[g_cur_tnc].buffer), "%zu", strlen(linebuf));
-    pthread_mutex_unlock(&mutex_tnc_set);
+    tnc_state_set_buffer(strlen(linebuf));
     return 1;
 }
 
@@ -190,10 +185,7 @@ int arim_arq_auth_on_send_a3()
     snprintf(linebuf, sizeof(linebuf), "ARQ: Sending /A3 response");
     bufq_queue_debug_log(linebuf);
     /* prime buffer count because update from TNC not immediate */
-    pthread_mutex_lock(&mutex_tnc_set);
-    snprintf(g_tnc_settings[g_cur_tnc].buffer,
-        sizeof(g_tnc_settings[g_cur_tnc].buffer), "%zu", strlen(linebuf));
-    pthread_mutex_unlock(&mutex_tnc_set);
+    tnc_state_set_buffer(strlen(linebuf));
     return 1;
 }
 
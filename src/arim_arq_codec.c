@@ -0,0 +1,634 @@
+/***********************************************************************
+
+    ARIM Amateur Radio Instant Messaging program for the ARDOP TNC.
+
+    Copyright (C) 2016-2021 Robert Cunnings NW8L
+
+    This file is part of the ARIM messaging program.
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+*************************************************************************/
+
+
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+#include <pthread.h>
+#include "main.h"
+#include "ini.h"
+#include "bufq.h"
+#include "util.h"
+#include "arim_arq_codec.h"
+#include "arim_arq_deflate.h"
+#include "arim_arq_zdict.h"
+#include "arim_arq_lz.h"
+#include "arim_arq_text.h"
+
+#define ARQ_CODEC_STREAM_BLOCK_SIZE 4096
+#define ARQ_CODEC_MAX_CANDIDATES    4
+
+#define CODEC_STR(x)    #x
+#define CODEC_XSTR(x)   CODEC_STR(x)
+
+/* codecs other than zlib with a preset dictionary, which are numbered
+   by dictionary version. name is used by the arq-codec setting */
+static const struct {
+    int codec;
+    const char *flag;
+    const char *name;
+    char hist;      /* code in file history records */
+} codecs[] = {
+    { ARQ_CODEC_ZLIB, "", "zlib", 'Z' },
+    { ARQ_CODEC_LZ, ARQ_CODEC_LZ_FLAG, "lz", 'L' },
+    { ARQ_CODEC_TEXT, ARQ_CODEC_TEXT_FLAG, "text", 'T' },
+};
+
+#define ARQ_CODEC_CNT   (sizeof(codecs)/sizeof(codecs[0]))
+
+/* protocol extensions a station must advertise before they are used */
+static const struct {
+    int feature;
+    const char *flag;
+} features[] = {
+    { ARQ_FEATURE_HASH, ARQ_FEATURE_HASH_FLAG },
+    { ARQ_FEATURE_SYNC, ARQ_FEATURE_SYNC_FLAG },
+};
+
+#define ARQ_FEATURE_CNT (sizeof(features)/sizeof(features[0]))
+
+/* what the remote station has advertised this session */
+static int peer_zdict, peer_codecs, peer_features;
+static pthread_mutex_t mutex_codec = PTHREAD_MUTEX_INITIALIZER;
+
+static int codec_find(int codec)
+{
+    size_t i;
+
+    for (i = 0; i < ARQ_CODEC_CNT; i++) {
+        if (codecs[i].codec == codec)
+            return i;
+    }
+    return -1;
+}
+
+static void codec_peer(int *zdict, int *mask)
+{
+    pthread_mutex_lock(&mutex_codec);
+    *zdict = peer_zdict;
+    *mask = peer_codecs;
+    pthread_mutex_unlock(&mutex_codec);
+}
+
+static int codec_pref()
+{
+    size_t i;
+
+    /* codec chosen by arq-codec setting, ARQ_CODEC_ZDICT
+       for zlib with a dictionary or ARQ_CODEC_NONE for auto */
+    if (!strcasecmp(g_arim_settings.arq_codec, "dict"))
+        return ARQ_CODEC_ZDICT;
+    for (i = 0; i < ARQ_CODEC_CNT; i++) {
+        if (!strcasecmp(g_arim_settings.arq_codec, codecs[i].name))
+            return codecs[i].codec;
+    }
+    return ARQ_CODEC_NONE;
+}
+
+static int codec_supported(int codec, int zdict, int mask)
+{
+    /* zlib is supported by every station that handles -z */
+    if (codec == ARQ_CODEC_ZLIB)
+        return 1;
+    if (codec > ARQ_CODEC_ZDICT)
+        return codec - ARQ_CODEC_ZDICT <= zdict;
+    return (mask & (1 << codec)) != 0;
+}
+
+void arim_arq_codec_reset()
+{
+    /* new session, remote station's codec support is unknown */
+    pthread_mutex_lock(&mutex_codec);
+    peer_zdict = peer_codecs = peer_features = 0;
+    pthread_mutex_unlock(&mutex_codec);
+}
+
+int arim_arq_codec_on_ok(const char *cmd)
+{
+    const char *s, *e;
+    size_t len;
+    int i, zdict = 0, mask = 0, feat = 0, result = 0;
+
+    /* look for advert as last token of /OK response from remote station,
+       a list like "+Z1,lz,tx,fh,fs" of dictionary versions, codec names and
+       protocol extensions.
+       Returns 1 if codec support newly learned for this session */
+    s = strrchr(cmd, ' ');
+    if (!s || strncmp(s + 1, ARQ_CODEC_TOKEN, strlen(ARQ_CODEC_TOKEN)))
+        return 0;
+    s += 1 + strlen(ARQ_CODEC_TOKEN);
+    while (*s) {
+        e = s;
+        while (*e && *e != ',')
+            ++e;
+        len = e - s;
+        if (len && isdigit((int)*s)) {
+            /* use the newest dictionary version known to both stations */
+            i = atoi(s);
+            if (i > ARQ_ZDICT_VERSION)
+                i = ARQ_ZDICT_VERSION;
+            if (i > zdict)
+                zdict = i;
+        } else {
+            for (i = 0; i < ARQ_CODEC_CNT; i++) {
+                if (len && len == strlen(codecs[i].flag) && !strncmp(s, codecs[i].flag, len))
+                    mask |= (1 << codecs[i].codec);
+            }
+            for (i = 0; i < ARQ_FEATURE_CNT; i++) {
+                if (len && len == strlen(features[i].flag) && !strncmp(s, features[i].flag, len))
+                    feat |= features[i].feature;
+            }
+        }
+        s = *e ? e + 1 : e;
+    }
+    pthread_mutex_lock(&mutex_codec);
+    peer_features = feat;
+    if (peer_zdict != zdict || peer_codecs != mask) {
+        peer_zdict = zdict;
+        peer_codecs = mask;
+        result = (zdict || mask);
+    }
+    pthread_mutex_unlock(&mutex_codec);
+    return result;
+}
+
+const char *arim_arq_codec_peer_desc(char *buf, size_t size)
+{
+    char name[ARQ_CODEC_NAME_SIZE];
+    size_t i, len;
+    int zdict, mask;
+
+    /* list of codecs advertised by remote station, for the log */
+    codec_peer(&zdict, &mask);
+    snprintf(buf, size, "%s", "zlib");
+    if (zdict) {
+        len = strlen(buf);
+        snprintf(buf + len, size - len, ", %s",
+                 arim_arq_codec_name(ARQ_CODEC_DICT(zdict), name, sizeof(name)));
+    }
+    for (i = 0; i < ARQ_CODEC_CNT; i++) {
+        if (codecs[i].codec != ARQ_CODEC_ZLIB && (mask & (1 << codecs[i].codec))) {
+            len = strlen(buf);
+            snprintf(buf + len, size - len, ", %s", codecs[i].name);
+        }
+    }
+    return buf;
+}
+
+const char *arim_arq_codec_advert()
+{
+    return " " ARQ_CODEC_TOKEN CODEC_XSTR(ARQ_ZDICT_VERSION)
+               "," ARQ_CODEC_LZ_FLAG "," ARQ_CODEC_TEXT_FLAG
+               "," ARQ_FEATURE_HASH_FLAG "," ARQ_FEATURE_SYNC_FLAG;
+}
+
+int arim_arq_codec_peer_feature(int feature)
+{
+    int result;
+
+    /* true if the remote station advertised the protocol extension */
+    pthread_mutex_lock(&mutex_codec);
+    result = (peer_features & feature) != 0;
+    pthread_mutex_unlock(&mutex_codec);
+    return result;
+}
+
+int arim_arq_codec_parse(char **s)
+{
+    char *p, *e;
+    size_t len;
+    int i, version;
+
+    /* parse the -z option at *s and step over it. Returns the codec
+       it names, or -1 if the codec is unknown to this station */
+    p = *s + 2;
+    e = p;
+    while (isalnum((int)*e))
+        ++e;
+    *s = e;
+    len = e - p;
+    if (!len)
+        return ARQ_CODEC_ZLIB;
+    if (isdigit((int)*p)) {
+        /* -zN, zlib with preset dictionary version N */
+        version = atoi(p);
+        if (!arim_arq_zdict_get(version, NULL))
+            return -1;
+        return ARQ_CODEC_DICT(version);
+    }
+    for (i = 0; i < ARQ_CODEC_CNT; i++) {
+        if (len == strlen(codecs[i].flag) && !strncmp(p, codecs[i].flag, len))
+            return codecs[i].codec;
+    }
+    return -1;
+}
+
+const char *arim_arq_codec_flag(int codec, char *buf, size_t size)
+{
+    int i;
+
+    /* option flag for /MPUT, /FPUT, /FLPUT and /FGET commands */
+    if (codec > ARQ_CODEC_ZDICT) {
+        snprintf(buf, size, " -z%d", codec - ARQ_CODEC_ZDICT);
+    } else {
+        i = codec_find(codec);
+        if (i < 0)
+            snprintf(buf, size, "%s", "");
+        else
+            snprintf(buf, size, " -z%s", codecs[i].flag);
+    }
+    return buf;
+}
+
+const char *arim_arq_codec_name(int codec, char *buf, size_t size)
+{
+    int i;
+
+    if (codec > ARQ_CODEC_ZDICT) {
+        snprintf(buf, size, "zlib+dict v%d", codec - ARQ_CODEC_ZDICT);
+    } else {
+        i = codec_find(codec);
+        snprintf(buf, size, "%s", i < 0 ? "none" : codecs[i].name);
+    }
+    return buf;
+}
+
+char arim_arq_codec_hist_code(int codec)
+{
+    int i;
+
+    /* one character code for file history records,
+       a digit for the version of a preset dictionary */
+    if (codec > ARQ_CODEC_ZDICT && codec <= ARQ_CODEC_DICT(9))
+        return '0' + codec - ARQ_CODEC_ZDICT;
+    i = codec_find(codec);
+    return i < 0 ? ' ' : codecs[i].hist;
+}
+
+const char *arim_arq_codec_hist_flag(char code, char *buf, size_t size)
+{
+    size_t i;
+
+    /* option flag for file history record code */
+    if (isdigit((int)code) && code != '0') {
+        snprintf(buf, size, "-z%c", code);
+        return buf;
+    }
+    for (i = 0; i < ARQ_CODEC_CNT; i++) {
+        if (codecs[i].hist == code) {
+            snprintf(buf, size, "-z%s", codecs[i].flag);
+            return buf;
+        }
+    }
+    snprintf(buf, size, "%s", "");
+    return buf;
+}
+
+int arim_arq_codec_request()
+{
+    int pref, zdict, mask;
+
+    /* codec to ask for in /FGET -z commands, the one set by arq-codec if
+       the remote station supports it, otherwise plain -z leaves it to
+       the sending station to choose */
+    pref = codec_pref();
+    codec_peer(&zdict, &mask);
+    if (pref == ARQ_CODEC_ZDICT && zdict)
+        return ARQ_CODEC_DICT(zdict);
+    if (pref != ARQ_CODEC_ZDICT && pref != ARQ_CODEC_NONE && codec_supported(pref, zdict, mask))
+        return pref;
+    return ARQ_CODEC_ZLIB;
+}
+
+int arim_arq_codec_pick_stream(int want)
+{
+    int pref, zdict, mask;
+
+    /* codec for a file streamed from disk, want is the codec asked for by
+       the remote station or ARQ_CODEC_NONE. The text codec is for short
+       payloads held in memory, so it's never used here. Dictionaries
+       only help the first 32 KB, so auto uses them for messages only */
+    if (want == ARQ_CODEC_LZ || ARQ_CODEC_IS_ZLIB(want))
+        return want;
+    pref = codec_pref();
+    codec_peer(&zdict, &mask);
+    if (pref == ARQ_CODEC_ZDICT && zdict)
+        return ARQ_CODEC_DICT(zdict);
+    if (codec_supported(ARQ_CODEC_LZ, zdict, mask)) {
+        /* fast codec if asked for, or if zlib can't keep up with the link */
+        if (pref == ARQ_CODEC_LZ || (pref == ARQ_CODEC_NONE && !arim_arq_deflate_keeps_up()))
+            return ARQ_CODEC_LZ;
+    }
+    return ARQ_CODEC_ZLIB;
+}
+
+static int codec_encode_one(int codec, const void *in, size_t len,
+                            unsigned char *out, size_t outsize, size_t *outlen)
+{
+    ARQ_DEFLATE ad;
+    int result;
+
+    switch (codec) {
+    case ARQ_CODEC_LZ:
+        return arim_arq_lz_compress(in, len, out, outsize, outlen);
+    case ARQ_CODEC_TEXT:
+        return arim_arq_text_compress(in, len, out, outsize, outlen);
+    default:
+        if (!arim_arq_deflate_init(&ad, NULL, out, outsize, outsize,
+                                   codec > ARQ_CODEC_ZDICT ? codec - ARQ_CODEC_ZDICT : 0))
+            return -1;
+        result = arim_arq_deflate_write(&ad, in, len, 1);
+        arim_arq_deflate_end(&ad);
+        *outlen = ad.cnt;
+        return result;
+    }
+}
+
+int arim_arq_codec_encode(int want, const void *in, size_t len, unsigned char *out,
+                          size_t outsize, size_t *outlen, int *codec)
+{
+    char linebuf[MAX_LOG_LINE_SIZE], name[ARQ_CODEC_NAME_SIZE];
+    int cand[ARQ_CODEC_MAX_CANDIDATES];
+    unsigned char *trial = NULL;
+    size_t n, best = 0;
+    int i, num = 0, pref, zdict, mask, result, err = 0;
+
+    /* encode a payload held in memory into out, with the codec asked for
+       by the remote station if want is not ARQ_CODEC_NONE, otherwise with
+       the one set by arq-codec or, for auto, whichever of those supported
+       by both stations gives the smallest result. Returns 1 on success
+       with the codec used in *codec, 0 if the result exceeds outsize
+       or -1 on error */
+    if (want != ARQ_CODEC_NONE) {
+        cand[num++] = want;
+    } else {
+        pref = codec_pref();
+        codec_peer(&zdict, &mask);
+        if (pref == ARQ_CODEC_NONE) {
+            cand[num++] = ARQ_CODEC_ZLIB;
+            if (zdict)
+                cand[num++] = ARQ_CODEC_DICT(zdict);
+            if (codec_supported(ARQ_CODEC_LZ, zdict, mask))
+                cand[num++] = ARQ_CODEC_LZ;
+            if (codec_supported(ARQ_CODEC_TEXT, zdict, mask))
+                cand[num++] = ARQ_CODEC_TEXT;
+        } else if (pref == ARQ_CODEC_ZDICT) {
+            cand[num++] = zdict ? ARQ_CODEC_DICT(zdict) : ARQ_CODEC_ZLIB;
+        } else {
+            cand[num++] = codec_supported(pref, zdict, mask) ? pref : ARQ_CODEC_ZLIB;
+        }
+    }
+    if (num > 1) {
+        trial = malloc(outsize);
+        if (!trial)
+            num = 1;
+    }
+    for (i = 0; i < num; i++) {
+        result = codec_encode_one(cand[i], in, len, i ? trial : out, outsize, &n);
+        if (result < 0)
+            ++err;
+        if (result != 1 || (best && n >= best))
+            continue;
+        if (i)
+            memcpy(out, trial, n);
+        best = n;
+        *codec = cand[i];
+    }
+    free(trial);
+    if (!best)
+        return (err == num) ? -1 : 0;
+    *outlen = best;
+    if (num > 1) {
+        snprintf(linebuf, sizeof(linebuf), "ARQ: Encoded payload %zu bytes with %s, %zu bytes",
+                 len, arim_arq_codec_name(*codec, name, sizeof(name)), best);
+        bufq_queue_debug_log(linebuf);
+    }
+    return 1;
+}
+
+static int codec_inflate(int codec, z_stream *zs, int flush)
+{
+    return arim_arq_zdict_inflate(zs, flush, codec > ARQ_CODEC_ZDICT ? codec - ARQ_CODEC_ZDICT : 0);
+}
+
+int arim_arq_codec_decode(int codec, const unsigned char *in, size_t len,
+                          unsigned char *out, size_t outsize, size_t *outlen)
+{
+    z_stream zs;
+    int zret;
+
+    /* decode a payload held in memory, returns 1 on success, 0 if
+       the result exceeds outsize or -1 if the encoded data is bad */
+    switch (codec) {
+    case ARQ_CODEC_LZ:
+        return arim_arq_lz_decompress(in, len, out, outsize, outlen);
+    case ARQ_CODEC_TEXT:
+        return arim_arq_text_decompress(in, len, out, outsize, outlen);
+    default:
+        zs.zalloc = Z_NULL;
+        zs.zfree = Z_NULL;
+        zs.opaque = Z_NULL;
+        zs.avail_in = len;
+        zs.next_in = (Bytef *)in;
+        zs.avail_out = outsize;
+        zs.next_out = out;
+        if (inflateInit(&zs) != Z_OK)
+            return -1;
+        zret = codec_inflate(codec, &zs, Z_FINISH);
+        inflateEnd(&zs);
+        if (zret == Z_BUF_ERROR && zs.avail_out == 0)
+            return 0;
+        if (zret != Z_STREAM_END)
+            return -1;
+        *outlen = zs.total_out;
+        return 1;
+    }
+}
+
+static int codec_deflate_file(int codec, FILE *in, FILE *out, size_t max,
+                              size_t *size, unsigned int *check)
+{
+    unsigned char inbuf[ARQ_CODEC_STREAM_BLOCK_SIZE];
+    ARQ_DEFLATE ad;
+    size_t len;
+    int result = 1;
+
+    if (!arim_arq_deflate_init(&ad, out, NULL, 0, max,
+                               codec > ARQ_CODEC_ZDICT ? codec - ARQ_CODEC_ZDICT : 0))
+        return -1;
+    do {
+        len = fread(inbuf, 1, sizeof(inbuf), in);
+        if (ferror(in))
+            result = -1;
+        else
+            result = arim_arq_deflate_write(&ad, inbuf, len, feof(in));
+    } while (result == 1 && !feof(in));
+    arim_arq_deflate_end(&ad);
+    *size = ad.cnt;
+    *check = arim_arq_deflate_check(&ad);
+    return result;
+}
+
+static int codec_lz_file(FILE *in, FILE *out, size_t max, size_t *size, unsigned int *check)
+{
+    unsigned char inbuf[ARQ_LZ_BLOCK_SIZE], outbuf[ARQ_LZ_BLOCK_MAX];
+    size_t len, n, cnt = 0;
+    unsigned int cs = 0xFFFF;
+
+    while ((len = fread(inbuf, 1, sizeof(inbuf), in)) > 0) {
+        n = arim_arq_lz_block(inbuf, len, outbuf);
+        if (fwrite(outbuf, 1, n, out) != n)
+            return -1;
+        cs = ccitt_crc16_update(cs, outbuf, n);
+        cnt += n;
+        if (cnt > max)
+            return 0;
+    }
+    if (ferror(in))
+        return -1;
+    *size = cnt;
+    *check = cnt ? ccitt_crc16_final(cs) : ccitt_crc16(NULL, 0);
+    return 1;
+}
+
+int arim_arq_codec_encode_file(int codec, FILE *in, FILE *out, size_t max,
+                               size_t *size, unsigned int *check)
+{
+    char linebuf[MAX_LOG_LINE_SIZE];
+
+    /* encode file in to file out in blocks, giving the size and checksum
+       of the result. Returns 1 on success, 0 if the size exceeds max or
+       -1 on error. The text codec isn't streamable */
+    if (codec == ARQ_CODEC_LZ) {
+        snprintf(linebuf, sizeof(linebuf), "ARQ: Compressing payload with lz");
+        bufq_queue_debug_log(linebuf);
+        return codec_lz_file(in, out, max, size, check);
+    }
+    if (ARQ_CODEC_IS_ZLIB(codec))
+        return codec_deflate_file(codec, in, out, max, size, check);
+    return -1;
+}
+
+static int codec_inflate_file(int codec, FILE *in, FILE *out, size_t limit)
+{
+    unsigned char inbuf[ARQ_CODEC_STREAM_BLOCK_SIZE], outbuf[ARQ_CODEC_STREAM_BLOCK_SIZE];
+    size_t len;
+    z_stream zs;
+    int zret, result = 1;
+
+    zs.zalloc = Z_NULL;
+    zs.zfree = Z_NULL;
+    zs.opaque = Z_NULL;
+    zs.avail_in = 0;
+    zs.next_in = Z_NULL;
+    if (inflateInit(&zs) != Z_OK)
+        return -1;
+    zret = Z_OK;
+    while (result == 1 && zret != Z_STREAM_END) {
+        zs.avail_in = fread(inbuf, 1, sizeof(inbuf), in);
+        if (!zs.avail_in) {
+            result = -1; /* cut short */
+            break;
+        }
+        zs.next_in = inbuf;
+        do {
+            zs.avail_out = sizeof(outbuf);
+            zs.next_out = outbuf;
+            zret = codec_inflate(codec, &zs, Z_NO_FLUSH);
+            if (zret != Z_OK && zret != Z_STREAM_END && zret != Z_BUF_ERROR) {
+                result = -1;
+                break;
+            }
+            len = sizeof(outbuf) - zs.avail_out;
+            if (fwrite(outbuf, 1, len, out) != len) {
+                result = 0;
+                break;
+            }
+            if (zs.total_out > limit) {
+                result = -1;
+                break;
+            }
+        } while (zs.avail_out == 0);
+    }
+    inflateEnd(&zs);
+    return result;
+}
+
+static int codec_unlz_file(FILE *in, FILE *out, size_t limit)
+{
+    unsigned char hdr[ARQ_LZ_HDR_SIZE], inbuf[ARQ_LZ_BLOCK_SIZE], outbuf[ARQ_LZ_BLOCK_SIZE];
+    size_t len, rawlen, bodylen, cnt = 0;
+
+    while ((len = fread(hdr, 1, sizeof(hdr), in)) > 0) {
+        if (len != sizeof(hdr) || !arim_arq_lz_block_hdr(hdr, &rawlen, &bodylen))
+            return -1;
+        if (fread(inbuf, 1, bodylen, in) != bodylen ||
+            !arim_arq_lz_unblock(inbuf, bodylen, outbuf, rawlen))
+            return -1;
+        if (fwrite(outbuf, 1, rawlen, out) != rawlen)
+            return 0;
+        cnt += rawlen;
+        if (cnt > limit)
+            return -1;
+    }
+    return ferror(in) ? 0 : 1;
+}
+
+static int codec_untext_file(FILE *in, FILE *out)
+{
+    unsigned char *inbuf, *outbuf;
+    size_t len, n;
+    int result = -1;
+
+    /* text payloads come from buffers, so are never large */
+    inbuf = malloc(MAX_UNCOMP_DATA_SIZE);
+    outbuf = malloc(MAX_UNCOMP_DATA_SIZE);
+    if (inbuf && outbuf) {
+        len = fread(inbuf, 1, MAX_UNCOMP_DATA_SIZE, in);
+        if (!ferror(in) && feof(in) &&
+            arim_arq_text_decompress(inbuf, len, outbuf, MAX_UNCOMP_DATA_SIZE, &n) == 1)
+            result = (fwrite(outbuf, 1, n, out) == n) ? 1 : 0;
+    }
+    free(inbuf);
+    free(outbuf);
+    return result;
+}
+
+int arim_arq_codec_decode_file(int codec, FILE *in, FILE *out, size_t max)
+{
+    size_t limit;
+
+    /* decode file in to file out, returns 1 on success, 0 on write
+       error or -1 if the encoded data is bad. Same expansion limit
+       as for payloads held in memory */
+    limit = max * (MAX_UNCOMP_DATA_SIZE / MAX_DATA_SIZE);
+    if (codec == ARQ_CODEC_LZ)
+        return codec_unlz_file(in, out, limit);
+    if (codec == ARQ_CODEC_TEXT)
+        return codec_untext_file(in, out);
+    return codec_inflate_file(codec, in, out, limit);
+}
+
@@ -0,0 +1,74 @@
+/***********************************************************************
+
+    ARIM Amateur Radio Instant Messaging program for the ARDOP TNC.
+
+    Copyright (C) 2016-2021 Robert Cunnings NW8L
+
+    This file is part of the ARIM messaging program.
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+*************************************************************************/
+
+
+
+#ifndef _ARIM_ARQ_CODEC_H_INCLUDED_
+#define _ARIM_ARQ_CODEC_H_INCLUDED_
+
+#include <stdio.h>
+
+/* payload codecs, named on the air by the suffix to the -z option
+   of /MPUT, /FPUT, /FLPUT and /FGET commands */
+#define ARQ_CODEC_NONE          0
+#define ARQ_CODEC_ZLIB          1   /* -z, zlib at a level picked for the link */
+#define ARQ_CODEC_LZ            2   /* -zlz, built-in fast LZ77 */
+#define ARQ_CODEC_TEXT          3   /* -ztx, codebook for short text */
+#define ARQ_CODEC_ZDICT         16  /* -zN, zlib with preset dictionary vN */
+#define ARQ_CODEC_DICT(v)       (ARQ_CODEC_ZDICT+(v))
+#define ARQ_CODEC_IS_ZLIB(c)    ((c) == ARQ_CODEC_ZLIB || (c) > ARQ_CODEC_ZDICT)
+
+#define ARQ_CODEC_LZ_FLAG       "lz"
+#define ARQ_CODEC_TEXT_FLAG     "tx"
+/* appended to /OK responses to advertise codecs other than plain zlib */
+#define ARQ_CODEC_TOKEN         "+Z"
+/* other protocol extensions named in the same advert */
+#define ARQ_FEATURE_HASH        0x01    /* '#' hash token of /FGET */
+#define ARQ_FEATURE_HASH_FLAG   "fh"
+#define ARQ_FEATURE_SYNC        0x02    /* /FSYNC command */
+#define ARQ_FEATURE_SYNC_FLAG   "fs"
+#define ARQ_CODEC_FLAG_SIZE     16
+#define ARQ_CODEC_NAME_SIZE     64
+
+extern void arim_arq_codec_reset(void);
+extern int arim_arq_codec_on_ok(const char *cmd);
+extern const char *arim_arq_codec_peer_desc(char *buf, size_t size);
+extern const char *arim_arq_codec_advert(void);
+extern int arim_arq_codec_peer_feature(int feature);
+extern int arim_arq_codec_parse(char **s);
+extern const char *arim_arq_codec_flag(int codec, char *buf, size_t size);
+extern const char *arim_arq_codec_name(int codec, char *buf, size_t size);
+extern char arim_arq_codec_hist_code(int codec);
+extern const char *arim_arq_codec_hist_flag(char code, char *buf, size_t size);
+extern int arim_arq_codec_request(void);
+extern int arim_arq_codec_pick_stream(int want);
+extern int arim_arq_codec_encode(int want, const void *in, size_t len, unsigned char *out,
+                                 size_t outsize, size_t *outlen, int *codec);
+extern int arim_arq_codec_decode(int codec, const unsigned char *in, size_t len,
+                                 unsigned char *out, size_t outsize, size_t *outlen);
+extern int arim_arq_codec_encode_file(int codec, FILE *in, FILE *out, size_t max,
+                                      size_t *size, unsigned int *check);
+extern int arim_arq_codec_decode_file(int codec, FILE *in, FILE *out, size_t max);
+
+#endif
+
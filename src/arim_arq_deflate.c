@@ -0,0 +1,201 @@
+/***********************************************************************
+
+    ARIM Amateur Radio Instant Messaging program for the ARDOP TNC.
+
+    Copyright (C) 2016-2021 Robert Cunnings NW8L
+
+    This file is part of the ARIM messaging program.
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+*************************************************************************/
+
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#include <time.h>
+#include "main.h"
+#include "ini.h"
+#include "bufq.h"
+#include "util.h"
+#include "arim_proto.h"
+#include "arim_arq_deflate.h"
+#include "arim_arq_zdict.h"
+
+#define ARQ_DEFLATE_BLOCK_SIZE     4096
+#define ARQ_DEFLATE_MAX_BW_HZ      2000
+/* generous upper bound on ARDOP net throughput, bits/sec per Hz of bandwidth */
+#define ARQ_DEFLATE_BITS_PER_HZ    3
+/* compression may take at most 1/ARQ_DEFLATE_CPU_SHARE of the air time it saves */
+#define ARQ_DEFLATE_CPU_SHARE      10
+/* ignore timings for payloads too small to measure reliably */
+#define ARQ_DEFLATE_MIN_SAMPLE     16384
+
+/* measured compressor input rate in bytes per CPU second and
+   compressed/uncompressed size ratio for each zlib level, seeded
+   with conservative figures for a slow single board computer */
+static struct {
+    double rate;
+    double ratio;
+} zstats[Z_BEST_COMPRESSION+1] = {
+    { 0.0, 1.0 },
+    { 12.0e6, 0.45 }, { 11.0e6, 0.43 }, { 9.0e6, 0.41 },
+    { 6.0e6, 0.39 },  { 4.5e6, 0.37 },  { 3.0e6, 0.36 },
+    { 2.5e6, 0.36 },  { 1.5e6, 0.35 },  { 0.8e6, 0.35 },
+};
+static pthread_mutex_t mutex_zstats = PTHREAD_MUTEX_INITIALIZER;
+
+static double arim_arq_deflate_link()
+{
+    char bw_hz[TNC_ARQ_BW_SIZE];
+    int hz;
+
+    /* ARQ link rate in bytes/sec */
+    arim_copy_arq_bw_hz(bw_hz, sizeof(bw_hz));
+    hz = atoi(bw_hz);
+    if (hz <= 0 || hz > ARQ_DEFLATE_MAX_BW_HZ)
+        hz = ARQ_DEFLATE_MAX_BW_HZ;
+    return (double)hz * ARQ_DEFLATE_BITS_PER_HZ / 8;
+}
+
+int arim_arq_deflate_level()
+{
+    double link;
+    int level;
+
+    /* pick the best level that still compresses at least CPU_SHARE times
+       faster than the compressed data can be sent over the ARQ link */
+    link = arim_arq_deflate_link();
+    pthread_mutex_lock(&mutex_zstats);
+    for (level = Z_BEST_COMPRESSION; level > Z_BEST_SPEED; level--) {
+        if (zstats[level].rate * zstats[level].ratio >= link * ARQ_DEFLATE_CPU_SHARE)
+            break;
+    }
+    pthread_mutex_unlock(&mutex_zstats);
+    return level;
+}
+
+int arim_arq_deflate_keeps_up()
+{
+    double link;
+    int result;
+
+    /* false if even the fastest level is too slow for the link,
+       as on a station short on CPU */
+    link = arim_arq_deflate_link();
+    pthread_mutex_lock(&mutex_zstats);
+    result = zstats[Z_BEST_SPEED].rate * zstats[Z_BEST_SPEED].ratio >= link * ARQ_DEFLATE_CPU_SHARE;
+    pthread_mutex_unlock(&mutex_zstats);
+    return result;
+}
+
+int arim_arq_deflate_init(ARQ_DEFLATE *ad, FILE *out, unsigned char *buf,
+                          size_t bufsize, size_t max, int zdict)
+{
+    char linebuf[MAX_LOG_LINE_SIZE];
+    const unsigned char *dict;
+    size_t size;
+
+    /* compressed payload goes to out if not NULL, otherwise to buf,
+       primed with preset dictionary version zdict if not 0 */
+    memset(ad, 0, sizeof(ARQ_DEFLATE));
+    ad->out = out;
+    ad->buf = buf;
+    ad->bufsize = bufsize;
+    ad->max = max;
+    ad->cs = 0xFFFF;
+    ad->level = arim_arq_deflate_level();
+    ad->zs.zalloc = Z_NULL;
+    ad->zs.zfree = Z_NULL;
+    ad->zs.opaque = Z_NULL;
+    if (deflateInit(&ad->zs, ad->level) != Z_OK)
+        return 0;
+    dict = arim_arq_zdict_get(zdict, &size);
+    if (dict && deflateSetDictionary(&ad->zs, dict, size) != Z_OK) {
+        deflateEnd(&ad->zs);
+        return 0;
+    }
+    clock_gettime(CLOCK_THREAD_CPUTIME_ID, &ad->start);
+    if (dict)
+        snprintf(linebuf, sizeof(linebuf),
+                 "ARQ: Compressing payload at zlib level %d, dictionary v%d", ad->level, zdict);
+    else
+        snprintf(linebuf, sizeof(linebuf), "ARQ: Compressing payload at zlib level %d", ad->level);
+    bufq_queue_debug_log(linebuf);
+    return 1;
+}
+
+int arim_arq_deflate_write(ARQ_DEFLATE *ad, const void *data, size_t len, int finish)
+{
+    unsigned char outbuf[ARQ_DEFLATE_BLOCK_SIZE], *next;
+    size_t n;
+    int zret;
+
+    /* compress len bytes of data, flushing the stream if finish is set.
+       Returns 1 on success, 0 if the compressed size exceeds the limit
+       or the sink buffer or -1 on error */
+    ad->zs.avail_in = len;
+    ad->zs.next_in = (Bytef *)data;
+    do {
+        if (ad->out) {
+            next = outbuf;
+            n = sizeof(outbuf);
+        } else {
+            next = ad->buf + ad->cnt;
+            n = ad->bufsize - ad->cnt;
+            if (!n)
+                return 0;
+        }
+        ad->zs.next_out = next;
+        ad->zs.avail_out = n;
+        zret = deflate(&ad->zs, finish ? Z_FINISH : Z_NO_FLUSH);
+        if (zret == Z_STREAM_ERROR)
+            return -1;
+        n -= ad->zs.avail_out;
+        if (ad->out && fwrite(outbuf, 1, n, ad->out) != n)
+            return -1;
+        ad->cs = ccitt_crc16_update(ad->cs, next, n);
+        ad->cnt += n;
+        if (ad->cnt > ad->max)
+            return 0;
+    } while (zret != Z_STREAM_END && (finish || ad->zs.avail_out == 0));
+    return 1;
+}
+
+void arim_arq_deflate_end(ARQ_DEFLATE *ad)
+{
+    struct timespec stop;
+    double secs, rate, ratio;
+
+    /* fold the cost of this run into the figures for its level */
+    clock_gettime(CLOCK_THREAD_CPUTIME_ID, &stop);
+    secs = (stop.tv_sec - ad->start.tv_sec) + (stop.tv_nsec - ad->start.tv_nsec) / 1e9;
+    if (ad->zs.total_in >= ARQ_DEFLATE_MIN_SAMPLE && secs > 0) {
+        rate = ad->zs.total_in / secs;
+        ratio = (double)ad->zs.total_out / ad->zs.total_in;
+        pthread_mutex_lock(&mutex_zstats);
+        zstats[ad->level].rate = (3 * zstats[ad->level].rate + rate) / 4;
+        zstats[ad->level].ratio = (3 * zstats[ad->level].ratio + ratio) / 4;
+        pthread_mutex_unlock(&mutex_zstats);
+    }
+    deflateEnd(&ad->zs);
+}
+
+unsigned int arim_arq_deflate_check(const ARQ_DEFLATE *ad)
+{
+    return ad->cnt ? ccitt_crc16_final(ad->cs) : ccitt_crc16(NULL, 0);
+}
+
@@ -0,0 +1,54 @@
+/***********************************************************************
+
+    ARIM Amateur Radio Instant Messaging program for the ARDOP TNC.
+
+    Copyright (C) 2016-2021 Robert Cunnings NW8L
+
+    This file is part of the ARIM messaging program.
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+*************************************************************************/
+
+
+#ifndef _ARIM_ARQ_DEFLATE_H_INCLUDED_
+#define _ARIM_ARQ_DEFLATE_H_INCLUDED_
+
+#include <stdio.h>
+#include <time.h>
+#include "zlib.h"
+
+/* incremental compressor for -z payloads, writing either to a file
+   or to a fixed buffer, with the zlib level picked for the link */
+typedef struct arq_deflate {
+    z_stream zs;
+    int level;              /* zlib level in use */
+    FILE *out;              /* sink file, or NULL to use buf */
+    unsigned char *buf;     /* sink buffer if out is NULL */
+    size_t bufsize;
+    size_t max;             /* limit on size of compressed payload */
+    size_t cnt;             /* count of compressed bytes so far */
+    unsigned int cs;        /* running checksum of compressed bytes */
+    struct timespec start;  /* thread CPU time at start */
+} ARQ_DEFLATE;
+
+extern int arim_arq_deflate_level(void);
+extern int arim_arq_deflate_keeps_up(void);
+extern int arim_arq_deflate_init(ARQ_DEFLATE *ad, FILE *out, unsigned char *buf,
+                                 size_t bufsize, size_t max, int zdict);
+extern int arim_arq_deflate_write(ARQ_DEFLATE *ad, const void *data, size_t len, int finish);
+extern void arim_arq_deflate_end(ARQ_DEFLATE *ad);
+extern unsigned int arim_arq_deflate_check(const ARQ_DEFLATE *ad);
+
+#endif
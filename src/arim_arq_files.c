@@ -29,6 +29,7 @@
 #include <sys/stat.h>
 #include <errno.h>
 #include <libgen.h>
+#include <unistd.h>
 #include "main.h"
 #include "ini.h"
 #include "bufq.h"
@@ -43,20 +44,81 @@
 #include "datathread.h"
 #include "arim_arq.h"
 #include "arim_arq_auth.h"
+#include "arim_arq_resume.h"
+#include "arim_arq_codec.h"
+#include "arim_arq_hash.h"
+#include "arim_arq_sync.h"
 
-static int zoption, send_done;
+#define FILE_STREAM_BLOCK_SIZE  4096
+
+static int zoption, codec, want, send_done;
 static FILEQUEUEITEM file_in;
 static FILEQUEUEITEM file_out;
 static size_t file_in_cnt, file_out_cnt, flistsize;
 static char flistbuf[MAX_UNCOMP_DATA_SIZE+1];
+/* ARQ files are streamed through these rather than held in file_in/file_out */
+static FILE *file_out_fp;
+static size_t file_out_offset, resume_offset;
+static unsigned int resume_check;
+static char want_hash[ARQ_HASH_B64_SIZE];
+static int delta, sync_in, sync_out, sync_delta;
+static unsigned char sync_sig[ARQ_SYNC_SIG_MAX];
+static size_t sync_sig_len;
+static char sync_name[MAX_PATH_SIZE], sync_path[MAX_DIR_PATH_SIZE];
+static FILE *file_in_fp;
+static char file_in_dpath[MAX_PATH_SIZE], file_in_call[TNC_MYCALL_SIZE];
+static unsigned int file_in_cs;
+static pthread_mutex_t mutex_file_in = PTHREAD_MUTEX_INITIALIZER;
+
+static int arim_arq_files_open_payload(FILE **fpp, size_t max, size_t *size, unsigned int *check)
+{
+    FILE *zfp;
+    unsigned char inbuf[FILE_STREAM_BLOCK_SIZE];
+    size_t len, cnt = 0;
+    unsigned int cs = 0xFFFF;
+    int result = 1;
+
+    /* read the file at *fpp in blocks to get the size and checksum of the
+       payload, encoding into a temp file first if -z option invoked.
+       Returns 1 with *fpp rewound to the payload, 0 if the payload size
+       exceeds max or -1 on error, in which case *fpp is closed */
+    if (zoption) {
+        zfp = tmpfile();
+        result = zfp ? arim_arq_codec_encode_file(codec, *fpp, zfp, max, &cnt, &cs) : -1;
+        fclose(*fpp);
+        *fpp = zfp;
+    } else {
+        do {
+            len = fread(inbuf, 1, sizeof(inbuf), *fpp);
+            if (ferror(*fpp)) {
+                result = -1;
+                break;
+            }
+            cs = ccitt_crc16_update(cs, inbuf, len);
+            cnt += len;
+            if (cnt > max)
+                result = 0;
+        } while (result == 1 && !feof(*fpp));
+        cs = cnt ? ccitt_crc16_final(cs) : ccitt_crc16(NULL, 0);
+    }
+    if (result != 1) {
+        if (*fpp)
+            fclose(*fpp);
+        *fpp = NULL;
+        return result;
+    }
+    rewind(*fpp);
+    *size = cnt;
+    *check = cs;
+    return 1;
+}
 
 int arim_arq_files_send_flist(const char *dir)
 {
     char linebuf[MAX_LOG_LINE_SIZE], databuf[MIN_DATA_BUF_SIZE];
+    char zflag[ARQ_CODEC_FLAG_SIZE];
     size_t max;
     int numch, result;
-    z_stream zs;
-    int zret;
 
     max = atoi(g_arim_settings.max_file_size);
     if (max <= 0) {
@@ -108,48 +170,20 @@ int arim_arq_files_send_flist(const char *dir)
         return 0;
     }
     snprintf(file_out.path, sizeof(file_out.path), "%s", dir ? dir : "");
-    /* compress file listing if -z option invoked */
+    /* compress file listing if -z option invoked, with the codec asked
+       for or the best one supported by both stations */
+    codec = ARQ_CODEC_NONE;
     if (zoption) {
-        zs.zalloc = Z_NULL;
-        zs.zfree = Z_NULL;
-        zs.opaque = Z_NULL;
-        zs.avail_in = flistsize;
-        zs.next_in = (Bytef *)flistbuf;
-        zs.avail_out = sizeof(file_out.data);
-        zs.next_out = (Bytef *)file_out.data;
-        zret = deflateInit(&zs, Z_BEST_COMPRESSION);
-        if (zret == Z_OK) {
-            zret = deflate(&zs, Z_FINISH);
-            if (zret != Z_STREAM_END) {
-                snprintf(linebuf, sizeof(linebuf), "/ERROR Compressed file listing exceeds size limit");
-                arim_arq_send_remote(linebuf);
-                numch = snprintf(linebuf, sizeof(linebuf),
-                                 "ARQ: File listing upload %s failed, compression error",
-                                     dir ? dir : "(root)");
-                if (numch >= sizeof(linebuf))
-                    ui_truncate_line(linebuf, sizeof(linebuf));
-                bufq_queue_debug_log(linebuf);
-                return 0;
-            }
-            deflateEnd(&zs);
-            file_out.size = zs.total_out;
-            /* test file size */
-            if (file_out.size > max) {
-                snprintf(linebuf, sizeof(linebuf), "/ERROR Compressed file listing exceeds size limit");
-                arim_arq_send_remote(linebuf);
-                numch = snprintf(linebuf, sizeof(linebuf),
-                                 "ARQ: File listing upload %s failed, compressed size exceeds limit", dir ? dir : "(root)");
-                if (numch >= sizeof(linebuf))
-                    ui_truncate_line(linebuf, sizeof(linebuf));
-                bufq_queue_debug_log(linebuf);
-                return 0;
-            }
-        } else {
-            snprintf(linebuf, sizeof(linebuf), "/ERROR Cannot send file listing");
+        if (max > sizeof(file_out.data))
+            max = sizeof(file_out.data);
+        result = arim_arq_codec_encode(want, flistbuf, flistsize, file_out.data, max,
+                                       &file_out.size, &codec);
+        if (result != 1) {
+            snprintf(linebuf, sizeof(linebuf), "/ERROR Compressed file listing exceeds size limit");
             arim_arq_send_remote(linebuf);
             numch = snprintf(linebuf, sizeof(linebuf),
-                             "ARQ: File listing upload %s failed, compression init error",
-                                 dir ? dir : "(root)");
+                             "ARQ: File listing upload %s failed, %s", dir ? dir : "(root)",
+                                 result ? "compression error" : "compressed size exceeds limit");
             if (numch >= sizeof(linebuf))
                 ui_truncate_line(linebuf, sizeof(linebuf));
             bufq_queue_debug_log(linebuf);
@@ -161,13 +195,13 @@ int arim_arq_files_send_flist(const char *dir)
     }
     file_out.check = ccitt_crc16(file_out.data, file_out.size);
     /* enqueue command for TNC */
+    arim_arq_codec_flag(codec, zflag, sizeof(zflag));
     if (dir)
-        snprintf((char *)databuf, sizeof(databuf), "%s %s %zu %04X",
-                 zoption ? "/FLPUT -z" : "/FLPUT",
-                    file_out.path, file_out.size, file_out.check);
+        snprintf((char *)databuf, sizeof(databuf), "/FLPUT%s %s %zu %04X",
+                 zflag, file_out.path, file_out.size, file_out.check);
     else
-        snprintf((char *)databuf, sizeof(databuf), "%s %zu %04X",
-                 zoption ? "/FLPUT -z" : "/FLPUT", file_out.size, file_out.check);
+        snprintf((char *)databuf, sizeof(databuf), "/FLPUT%s %zu %04X",
+                 zflag, file_out.size, file_out.check);
     arim_arq_send_remote(databuf);
     /* initialize count and start progress meter */
     file_out_cnt = 0;
@@ -180,9 +214,11 @@ int arim_arq_files_flist_on_send_cmd()
     char linebuf[MAX_LOG_LINE_SIZE];
     int numch;
 
-    pthread_mutex_lock(&mutex_file_out);
-    fileq_push(&g_file_out_q, &file_out);
-    pthread_mutex_unlock(&mutex_file_out);
+    if (!bufq_queue_file_out(&file_out)) {
+        bufq_queue_debug_log("ARQ: File listing upload failed, outbound queue full");
+        arim_on_event(EV_ARQ_FILE_ERROR, 0);
+        return 0;
+    }
     numch = snprintf(linebuf, sizeof(linebuf),
                      "ARQ: File listing upload for %s buffered for sending",
                          *file_out.path ? file_out.path : "(root)");
@@ -247,10 +283,8 @@ size_t arim_arq_files_flist_on_send_buffer(size_t size)
 int arim_arq_files_flist_on_rcv_frame(const char *data, size_t size)
 {
     char databuf[MIN_DATA_BUF_SIZE], linebuf[MAX_LOG_LINE_SIZE];
-    int numch;
+    int numch, result;
     unsigned int check;
-    z_stream zs;
-    int zret;
 
     /* buffer data, increment count of bytes */
     if (file_in_cnt + size > sizeof(file_in.data)) {
@@ -309,34 +343,13 @@ int arim_arq_files_flist_on_rcv_frame(const char *data, size_t size)
             return 0;
         }
         if (zoption) {
-            zs.zalloc = Z_NULL;
-            zs.zfree = Z_NULL;
-            zs.opaque = Z_NULL;
-            zs.avail_in = file_in.size;
-            zs.next_in = file_in.data;
-            zs.avail_out = sizeof(flistbuf);
-            zs.next_out = (Bytef *)flistbuf;
-            zret = inflateInit(&zs);
-            if (zret == Z_OK) {
-                zret = inflate(&zs, Z_FINISH);
-                inflateEnd(&zs);
-                if (zret != Z_STREAM_END) {
-                    numch = snprintf(linebuf, sizeof(linebuf),
-                                     "ARQ: File download %s failed, decompression failed",
-                                         file_in.name);
-                    if (numch >= sizeof(linebuf))
-                        ui_truncate_line(linebuf, sizeof(linebuf));
-                    bufq_queue_debug_log(linebuf);
-                    snprintf(linebuf, sizeof(linebuf), "/ERROR Decompression failed");
-                    arim_arq_send_remote(linebuf);
-                    arim_on_event(EV_ARQ_FILE_ERROR, 0);
-                    return 0;
-                }
-                flistsize = zs.total_out;
-            } else {
+            /* leave room for null termination */
+            result = arim_arq_codec_decode(codec, file_in.data, file_in.size,
+                                           (unsigned char *)flistbuf, sizeof(flistbuf) - 1, &flistsize);
+            if (result != 1) {
                 numch = snprintf(linebuf, sizeof(linebuf),
-                                 "ARQ: File download %s failed, decompression initialization error",
-                                    file_in.name);
+                                 "ARQ: File download %s failed, decompression failed",
+                                     file_in.name);
                 if (numch >= sizeof(linebuf))
                     ui_truncate_line(linebuf, sizeof(linebuf));
                 bufq_queue_debug_log(linebuf);
@@ -360,10 +373,12 @@ int arim_arq_files_flist_on_rcv_frame(const char *data, size_t size)
         bufq_queue_debug_log(linebuf);
         if (*file_in.path)
             snprintf(databuf, sizeof(databuf),
-                     "/OK Received listing of %s %zu %04X", file_in.path, file_in_cnt, check);
+                     "/OK Received listing of %s %zu %04X%s", file_in.path,
+                         file_in_cnt, check, arim_arq_codec_advert());
         else
             snprintf(databuf, sizeof(databuf),
-                     "/OK Received listing %zu %04X", file_in_cnt, check);
+                     "/OK Received listing %zu %04X%s",
+                         file_in_cnt, check, arim_arq_codec_advert());
         arim_arq_send_remote(databuf);
         arim_on_event(EV_ARQ_FLIST_RCV_DONE, 0);
     }
@@ -382,6 +397,7 @@ int arim_arq_files_on_flput(char *cmd, size_t size, char *eol)
     int numch;
 
     zoption = 0;
+    codec = ARQ_CODEC_NONE;
     /* inbound file listing, get parameters */
     p_size = p_check = p_path = NULL;
     s = cmd + 7;
@@ -389,10 +405,20 @@ int arim_arq_files_on_flput(char *cmd, size_t size, char *eol)
         ++s;
     if (*s && (s == strstr(s, "-z"))) {
         zoption = 1;
-        s += 2;
+        /* -z<codec>, encoded with the codec named */
+        codec = arim_arq_codec_parse(&s);
         while (*s && (*s == ' ' || *s == '/'))
             ++s;
     }
+    if (codec < 0) {
+        snprintf(linebuf, sizeof(linebuf),
+                 "ARQ: File listing download failed, unknown codec");
+        bufq_queue_debug_log(linebuf);
+        snprintf(linebuf, sizeof(linebuf), "/ERROR Unknown codec");
+        arim_arq_send_remote(linebuf);
+        arim_on_event(EV_ARQ_FILE_ERROR, 0);
+        return 0;
+    }
     if (*s && eol) {
         /* check for checksum argument */
         e = eol - 1;
@@ -475,6 +501,7 @@ int arim_arq_files_on_flget(char *cmd, size_t size, char *eol)
     int result;
 
     zoption = 0;
+    want = ARQ_CODEC_NONE;
     p_path = NULL;
     /* empty outbound data buffer before handling file listing request */
     while (arim_get_buffer_cnt() > 0)
@@ -485,7 +512,10 @@ int arim_arq_files_on_flget(char *cmd, size_t size, char *eol)
         ++s;
     if (*s && (s == strstr(s, "-z"))) {
         zoption = 1;
-        s += 2;
+        /* -z<codec> asks for a codec, plain -z leaves it to us */
+        want = arim_arq_codec_parse(&s);
+        if (want == ARQ_CODEC_ZLIB || want < 0)
+            want = ARQ_CODEC_NONE;
         while (*s && (*s == ' ' || *s == '/'))
             ++s;
     }
@@ -545,11 +575,9 @@ int arim_arq_files_send_dyn_file(const char *fn, const char *destdir, int is_loc
     FILE *fp;
     char cmd_line[MAX_CMD_SIZE], cmd[MAX_CMD_SIZE];
     char linebuf[MAX_LOG_LINE_SIZE], databuf[MIN_DATA_BUF_SIZE];
-    char filebuf[MAX_UNCOMP_DATA_SIZE+1];
+    char filebuf[MAX_UNCOMP_DATA_SIZE+1], zflag[ARQ_CODEC_FLAG_SIZE];
     size_t max, len, filesize;
-    int i, numch;
-    z_stream zs;
-    int zret;
+    int i, numch, result;
 
     /* check for dynamic file name */
     len = strlen(fn);
@@ -617,61 +645,24 @@ int arim_arq_files_send_dyn_file(const char *fn, const char *destdir, int is_loc
         bufq_queue_debug_log(linebuf);
         return -1;
     }
-    /* compress file if -z option invoked */
+    /* compress file if -z option invoked, with the codec asked
+       for or the best one supported by both stations */
+    codec = ARQ_CODEC_NONE;
     if (zoption) {
-        zs.zalloc = Z_NULL;
-        zs.zfree = Z_NULL;
-        zs.opaque = Z_NULL;
-        zs.avail_in = filesize;
-        zs.next_in = (Bytef *)filebuf;
-        zs.avail_out = sizeof(file_out.data);
-        zs.next_out = (Bytef *)file_out.data;
-        zret = deflateInit(&zs, Z_BEST_COMPRESSION);
-        if (zret == Z_OK) {
-            zret = deflate(&zs, Z_FINISH);
-            if (zret != Z_STREAM_END) {
-                if (is_local) {
-                    ui_show_dialog("\tCannot send file:\n"
-                                   "\tcompression failed.\n \n\t[O]k", "oO \n");
-                } else {
-                    snprintf(linebuf, sizeof(linebuf), "/ERROR Compressed file exceeds size limit.");
-                    arim_arq_send_remote(linebuf);
-                }
-                numch = snprintf(linebuf, sizeof(linebuf),
-                                 "ARQ: File upload %s failed, compression error", fn);
-                if (numch >= sizeof(linebuf))
-                    ui_truncate_line(linebuf, sizeof(linebuf));
-                bufq_queue_debug_log(linebuf);
-                return -1;
-            }
-            deflateEnd(&zs);
-            file_out.size = zs.total_out;
-            /* test file size */
-            if (file_out.size > max) {
-                if (is_local) {
-                    ui_show_dialog("\tCannot send file:\n"
-                                   "\tcompression file exceeds size limit.\n \n\t[O]k", "oO \n");
-                } else {
-                    snprintf(linebuf, sizeof(linebuf), "/ERROR Compressed file size exceeds limit");
-                    arim_arq_send_remote(linebuf);
-                }
-                numch = snprintf(linebuf, sizeof(linebuf),
-                                 "ARQ: File upload %s failed, compressed size exceeds limit", fn);
-                if (numch >= sizeof(linebuf))
-                    ui_truncate_line(linebuf, sizeof(linebuf));
-                bufq_queue_debug_log(linebuf);
-                return -1;
-            }
-        } else {
+        if (max > sizeof(file_out.data))
+            max = sizeof(file_out.data);
+        result = arim_arq_codec_encode(want, filebuf, filesize, file_out.data, max,
+                                       &file_out.size, &codec);
+        if (result != 1) {
             if (is_local) {
                 ui_show_dialog("\tCannot send file:\n"
-                               "\tcompression failed.\n \n\t[O]k", "oO \n");
+                               "\tcompressed file exceeds size limit.\n \n\t[O]k", "oO \n");
             } else {
-                snprintf(linebuf, sizeof(linebuf), "/ERROR Cannot open file");
+                snprintf(linebuf, sizeof(linebuf), "/ERROR Compressed file size exceeds limit");
                 arim_arq_send_remote(linebuf);
             }
-            numch = snprintf(linebuf, sizeof(linebuf),
-                             "ARQ: File upload %s failed, compression init error", fn);
+            numch = snprintf(linebuf, sizeof(linebuf), "ARQ: File upload %s failed, %s", fn,
+                             result ? "compression error" : "compressed size exceeds limit");
             if (numch >= sizeof(linebuf))
                 ui_truncate_line(linebuf, sizeof(linebuf));
             bufq_queue_debug_log(linebuf);
@@ -685,14 +676,13 @@ int arim_arq_files_send_dyn_file(const char *fn, const char *destdir, int is_loc
     snprintf(file_out.path, sizeof(file_out.path), "%s", destdir ? destdir : "");
     file_out.check = ccitt_crc16(file_out.data, file_out.size);
     /* enqueue command for TNC */
+    arim_arq_codec_flag(codec, zflag, sizeof(zflag));
     if (destdir)
-        snprintf(databuf, sizeof(databuf), "%s %s %zu %04X > %s",
-                 zoption ? "/FPUT -z" : "/FPUT",
-                     file_out.name, file_out.size, file_out.check, file_out.path);
+        snprintf(databuf, sizeof(databuf), "/FPUT%s %s %zu %04X > %s",
+                 zflag, file_out.name, file_out.size, file_out.check, file_out.path);
     else
-        snprintf(databuf, sizeof(databuf), "%s %s %zu %04X",
-                 zoption ? "/FPUT -z" : "/FPUT",
-                     file_out.name, file_out.size, file_out.check);
+        snprintf(databuf, sizeof(databuf), "/FPUT%s %s %zu %04X",
+                 zflag, file_out.name, file_out.size, file_out.check);
     len = arim_arq_send_remote(databuf);
     /* initialize count and start progress meter */
     file_out_cnt = 0;
@@ -705,12 +695,15 @@ int arim_arq_files_send_file(const char *fn, const char *destdir, int is_local)
     FILE *fp;
     char fpath[MAX_PATH_SIZE], dpath[MAX_PATH_SIZE];
     char linebuf[MAX_LOG_LINE_SIZE], databuf[MIN_DATA_BUF_SIZE];
-    char filebuf[MAX_UNCOMP_DATA_SIZE+1], remote_call[TNC_MYCALL_SIZE];
-    size_t max, filesize;
-    int numch, result;
-    z_stream zs;
-    int zret;
+    char remote_call[TNC_MYCALL_SIZE], resume[32], zflag[ARQ_CODEC_FLAG_SIZE];
+    char hash[ARQ_HASH_B64_SIZE], dflag[4];
+    FILE *dfp;
+    size_t max, literal, matched;
+    int numch, result, sync;
 
+    /* sending the delta for a /FSYNC request if set */
+    sync = sync_delta;
+    sync_delta = sync_out = 0;
     max = atoi(g_arim_settings.max_file_size);
     if (max <= 0) {
         if (is_local) {
@@ -727,6 +720,12 @@ int arim_arq_files_send_file(const char *fn, const char *destdir, int is_local)
         bufq_queue_debug_log(linebuf);
         return 0;
     }
+    if (file_out_fp) {
+        /* previous upload never got under way */
+        fclose(file_out_fp);
+        file_out_fp = NULL;
+    }
+    file_out_offset = 0;
     result = arim_arq_files_send_dyn_file(fn, destdir, is_local);
     if (result) {
         /* result may be 1 for success, -1 for error, 0 for no match */
@@ -802,12 +801,59 @@ int arim_arq_files_send_file(const char *fn, const char *destdir, int is_local)
         bufq_queue_debug_log(linebuf);
         return 0;
     }
-    /* read into buffer, will be sent later by arim_arq_files_on_send_cmd()
-       file will be truncated if larger than buffer */
-    filesize = fread(filebuf, 1, sizeof(filebuf), fp);
-    fclose(fp);
-    /* test size of file */
-    if (filesize > MAX_UNCOMP_DATA_SIZE || (!zoption && filesize > max)) {
+    if (!is_local && want_hash[0] && arim_arq_hash_file(fpath, hash, sizeof(hash)) &&
+        !strcmp(hash, want_hash)) {
+        /* remote station already has this file, tell it so instead of sending it */
+        fclose(fp);
+        want_hash[0] = '\0';
+        snprintf(dpath, sizeof(dpath), "%s", fn);
+        numch = snprintf(linebuf, sizeof(linebuf), "/OK %s unchanged%s",
+                         basename(dpath), arim_arq_codec_advert());
+        if (numch >= sizeof(linebuf))
+            ui_truncate_line(linebuf, sizeof(linebuf));
+        arim_arq_send_remote(linebuf);
+        numch = snprintf(linebuf, sizeof(linebuf),
+                         "ARQ: File upload %s skipped, remote copy unchanged", fn);
+        if (numch >= sizeof(linebuf))
+            ui_truncate_line(linebuf, sizeof(linebuf));
+        bufq_queue_debug_log(linebuf);
+        return 2;
+    }
+    want_hash[0] = '\0';
+    if (sync) {
+        /* send only what the remote station's old copy lacks */
+        dfp = tmpfile();
+        result = dfp ? arim_arq_sync_delta(sync_sig, sync_sig_len, fp, dfp, &literal, &matched) : 0;
+        fclose(fp);
+        if (result != 1) {
+            if (dfp)
+                fclose(dfp);
+            snprintf(linebuf, sizeof(linebuf), "/ERROR %s",
+                     result < 0 ? "Bad block sums" : "Cannot sync file");
+            arim_arq_send_remote(linebuf);
+            numch = snprintf(linebuf, sizeof(linebuf),
+                             "ARQ: File sync %s failed, %s", fn,
+                                 result < 0 ? "bad block sums" : "delta write error");
+            if (numch >= sizeof(linebuf))
+                ui_truncate_line(linebuf, sizeof(linebuf));
+            bufq_queue_debug_log(linebuf);
+            return 0;
+        }
+        rewind(dfp);
+        fp = dfp;
+        numch = snprintf(linebuf, sizeof(linebuf),
+                         "ARQ: File sync %s, %zu literal bytes and %zu blocks matched",
+                             fn, literal, matched);
+        if (numch >= sizeof(linebuf))
+            ui_truncate_line(linebuf, sizeof(linebuf));
+        bufq_queue_debug_log(linebuf);
+    }
+    /* size and checksum the file, it will be read from disk in blocks
+       as the TNC buffer drains once sent by arim_arq_files_on_send_cmd() */
+    max = atoi(g_arim_settings.max_arq_file_size);
+    codec = zoption ? arim_arq_codec_pick_stream(want) : ARQ_CODEC_NONE;
+    result = arim_arq_files_open_payload(&fp, max, &file_out.size, &file_out.check);
+    if (result == 0) {
         if (is_local) {
             ui_show_dialog("\tCannot send file:\n"
                            "\tfile size exceeds limit.\n \n\t[O]k", "oO \n");
@@ -821,92 +867,54 @@ int arim_arq_files_send_file(const char *fn, const char *destdir, int is_local)
             ui_truncate_line(linebuf, sizeof(linebuf));
         bufq_queue_debug_log(linebuf);
         return 0;
-    }
-    /* compress file if -z option invoked */
-    if (zoption) {
-        zs.zalloc = Z_NULL;
-        zs.zfree = Z_NULL;
-        zs.opaque = Z_NULL;
-        zs.avail_in = filesize;
-        zs.next_in = (Bytef *)filebuf;
-        zs.avail_out = sizeof(file_out.data);
-        zs.next_out = (Bytef *)file_out.data;
-        zret = deflateInit(&zs, Z_BEST_COMPRESSION);
-        if (zret == Z_OK) {
-            zret = deflate(&zs, Z_FINISH);
-            if (zret != Z_STREAM_END) {
-                if (is_local) {
-                    ui_show_dialog("\tCannot send file:\n"
-                                   "\tcompression failed.\n \n\t[O]k", "oO \n");
-                } else {
-                    snprintf(linebuf, sizeof(linebuf), "/ERROR Cannot open file");
-                    arim_arq_send_remote(linebuf);
-                }
-                numch = snprintf(linebuf, sizeof(linebuf),
-                                 "ARQ: File upload %s failed, compression error", fn);
-                if (numch >= sizeof(linebuf))
-                    ui_truncate_line(linebuf, sizeof(linebuf));
-                bufq_queue_debug_log(linebuf);
-                return 0;
-            }
-            deflateEnd(&zs);
-            file_out.size = zs.total_out;
-            /* test file size */
-            if (file_out.size > max) {
-                if (is_local) {
-                    ui_show_dialog("\tCannot send file:\n"
-                                   "\tcompression file exceeds size limit.\n \n\t[O]k", "oO \n");
-                } else {
-                    snprintf(linebuf, sizeof(linebuf), "/ERROR Compressed file size exceeds limit");
-                    arim_arq_send_remote(linebuf);
-                }
-                numch = snprintf(linebuf, sizeof(linebuf),
-                                 "ARQ: File upload %s failed, compressed size exceeds limit", fn);
-                if (numch >= sizeof(linebuf))
-                    ui_truncate_line(linebuf, sizeof(linebuf));
-                bufq_queue_debug_log(linebuf);
-                return 0;
-            }
+    } else if (result < 0) {
+        if (is_local) {
+            ui_show_dialog("\tCannot send file:\n"
+                           "\tfile read or compression failed.\n \n\t[O]k", "oO \n");
         } else {
-            if (is_local) {
-                ui_show_dialog("\tCannot send file:\n"
-                               "\tcompression failed.\n \n\t[O]k", "oO \n");
-            } else {
-                snprintf(linebuf, sizeof(linebuf), "/ERROR Cannot open file");
-                arim_arq_send_remote(linebuf);
-            }
-            numch = snprintf(linebuf, sizeof(linebuf),
-                             "ARQ: File upload %s failed, compression init error", fn);
-            if (numch >= sizeof(linebuf))
-                ui_truncate_line(linebuf, sizeof(linebuf));
-            bufq_queue_debug_log(linebuf);
-            return 0;
+            snprintf(linebuf, sizeof(linebuf), "/ERROR Cannot open file");
+            arim_arq_send_remote(linebuf);
         }
-    } else {
-        memcpy(file_out.data, filebuf, filesize);
-        file_out.size = filesize;
+        numch = snprintf(linebuf, sizeof(linebuf),
+                         "ARQ: File upload %s failed, read or compression error", fn);
+        if (numch >= sizeof(linebuf))
+            ui_truncate_line(linebuf, sizeof(linebuf));
+        bufq_queue_debug_log(linebuf);
+        return 0;
     }
+    /* skip what the remote station already has if resuming, but only if
+       the file is unchanged since its partial download */
+    if (resume_offset && resume_check == file_out.check &&
+        resume_offset < file_out.size && !fseek(fp, resume_offset, SEEK_SET))
+        file_out_offset = resume_offset;
+    resume_offset = resume_check = 0;
+    file_out_fp = fp;
     snprintf(fpath, sizeof(fpath), "%s", fn);
     snprintf(file_out.name, sizeof(file_out.name), "%s", basename(fpath));
     snprintf(file_out.path, sizeof(file_out.path), "%s", destdir ? destdir : "");
-    file_out.check = ccitt_crc16(file_out.data, file_out.size);
-    /* enqueue command for TNC */
+    /* enqueue command for TNC, with offset of data sent if resuming */
+    if (file_out_offset)
+        snprintf(resume, sizeof(resume), " @%zu", file_out_offset);
+    else
+        resume[0] = '\0';
+    arim_arq_codec_flag(codec, zflag, sizeof(zflag));
+    snprintf(dflag, sizeof(dflag), "%s", sync ? " -d" : "");
     if (destdir)
-        snprintf(databuf, sizeof(databuf), "%s %s %zu %04X > %s",
-                 zoption ? "/FPUT -z" : "/FPUT",
-                     file_out.name, file_out.size, file_out.check, file_out.path);
+        snprintf(databuf, sizeof(databuf), "/FPUT%s%s%s %s %zu %04X > %s",
+                 dflag, zflag, resume, file_out.name, file_out.size, file_out.check, file_out.path);
     else
-        snprintf(databuf, sizeof(databuf), "%s %s %zu %04X",
-                 zoption ? "/FPUT -z" : "/FPUT",
-                     file_out.name, file_out.size, file_out.check);
+        snprintf(databuf, sizeof(databuf), "/FPUT%s%s%s %s %zu %04X",
+                 dflag, zflag, resume, file_out.name, file_out.size, file_out.check);
     arim_arq_send_remote(databuf);
     /* initialize count and start progress meter */
     file_out_cnt = 0;
     ui_status_xfer_start(0, file_out.size, STATUS_XFER_DIR_UP);
+    if (file_out_offset)
+        ui_status_xfer_update(file_out_offset);
     /* initialize file history entry */
     arim_copy_remote_call(remote_call, sizeof(remote_call));
     numch = snprintf(linebuf, MAX_FTABLE_ROW_SIZE,
-             "O%c%-12s%6zu%04X%s", zoption ? 'Z' : ' ',
+             "O%c%-12s%8zu%04X%s", sync ? ARQ_SYNC_HIST_CODE : arim_arq_codec_hist_code(codec),
                  remote_call, file_out.size, file_out.check, fpath);
     if (numch >= MAX_FTABLE_ROW_SIZE)
         ui_truncate_line(linebuf, MAX_FTABLE_ROW_SIZE);
@@ -914,16 +922,85 @@ int arim_arq_files_send_file(const char *fn, const char *destdir, int is_local)
     return 1;
 }
 
-int arim_arq_files_on_send_cmd()
+void arim_arq_files_on_ok(const char *cmd)
 {
     char linebuf[MAX_LOG_LINE_SIZE];
+    const char *s;
+    size_t offset = 0;
+    int numch;
+
+    /* remote station is ready for the file named in our /FPUT. If it has
+       part of the file already, its /OK gives the offset to resume from */
+    s = cmd + 3;
+    while (*s && *s == ' ')
+        ++s;
+    if (*s == '@' && 1 == sscanf(s + 1, "%zu", &offset) && file_out_fp &&
+        offset < file_out.size && !fseek(file_out_fp, offset, SEEK_SET)) {
+        file_out_offset = offset;
+        ui_status_xfer_update(offset);
+        numch = snprintf(linebuf, sizeof(linebuf),
+                         "ARQ: File upload %s resuming at byte %zu", file_out.name, offset);
+        if (numch >= sizeof(linebuf))
+            ui_truncate_line(linebuf, sizeof(linebuf));
+        bufq_queue_debug_log(linebuf);
+    }
+}
+
+int arim_arq_files_on_unchanged(const char *cmd)
+{
+    char linebuf[MAX_LOG_LINE_SIZE], name[MAX_PATH_SIZE];
+    const char *s, *e;
     int numch;
 
-    pthread_mutex_lock(&mutex_file_out);
-    fileq_push(&g_file_out_q, &file_out);
-    pthread_mutex_unlock(&mutex_file_out);
+    /* remote station answered our /FGET with "/OK <name> unchanged"
+       because the hash of our copy matches the file it would send */
+    s = cmd + 3;
+    while (*s && *s == ' ')
+        ++s;
+    e = strstr(s, " unchanged");
+    if (!e || e == s)
+        return 0;
+    snprintf(name, sizeof(name), "%.*s", (int)(e - s), s);
     numch = snprintf(linebuf, sizeof(linebuf),
-                     "ARQ: File upload %s buffered for sending", file_out.name);
+                     "ARQ: File download %s skipped, local copy unchanged", name);
+    if (numch >= sizeof(linebuf))
+        ui_truncate_line(linebuf, sizeof(linebuf));
+    bufq_queue_debug_log(linebuf);
+    return 1;
+}
+
+int arim_arq_files_on_send_cmd()
+{
+    char linebuf[MAX_LOG_LINE_SIZE];
+    size_t size;
+    int numch, result;
+
+    /* the data thread takes ownership of the file being streamed,
+       and sends only what the remote station doesn't have already */
+    size = file_out.size;
+    file_out.size -= file_out_offset;
+    file_out.fp = file_out_fp;
+    file_out_fp = NULL;
+    result = bufq_queue_file_out(&file_out);
+    file_out.fp = NULL;
+    file_out.size = size;
+    if (!result) {
+        /* the queue has closed the file */
+        numch = snprintf(linebuf, sizeof(linebuf),
+                         "ARQ: File upload %s failed, outbound queue full", file_out.name);
+        if (numch >= sizeof(linebuf))
+            ui_truncate_line(linebuf, sizeof(linebuf));
+        bufq_queue_debug_log(linebuf);
+        arim_on_event(EV_ARQ_FILE_ERROR, 0);
+        return 0;
+    }
+    if (file_out_offset)
+        numch = snprintf(linebuf, sizeof(linebuf),
+                         "ARQ: File upload %s buffered for sending from byte %zu",
+                             file_out.name, file_out_offset);
+    else
+        numch = snprintf(linebuf, sizeof(linebuf),
+                         "ARQ: File upload %s buffered for sending", file_out.name);
     if (numch >= sizeof(linebuf))
         ui_truncate_line(linebuf, sizeof(linebuf));
     bufq_queue_debug_log(linebuf);
@@ -954,20 +1031,20 @@ size_t arim_arq_files_on_send_buffer(size_t size)
         prev_file_out_cnt = file_out_cnt;
         numch = snprintf(linebuf, sizeof(linebuf),
                          "ARQ: File upload %s sending %zu of %zu bytes",
-                            file_out.name, file_out_cnt, file_out.size);
+                            file_out.name, file_out_offset + file_out_cnt, file_out.size);
         if (numch >= sizeof(linebuf))
             ui_truncate_line(linebuf, sizeof(linebuf));
         bufq_queue_debug_log(linebuf);
         numch = snprintf(linebuf, sizeof(linebuf), "<< [@] %s %zu of %zu bytes",
-                         file_out.name, file_out_cnt, file_out.size);
+                         file_out.name, file_out_offset + file_out_cnt, file_out.size);
         if (numch >= sizeof(linebuf))
             ui_truncate_line(linebuf, sizeof(linebuf));
         bufq_queue_traffic_log(linebuf);
         bufq_queue_data_in(linebuf);
         /* update progress meter */
-        ui_status_xfer_update(file_out_cnt);
+        ui_status_xfer_update(file_out_offset + file_out_cnt);
         /* if done, re-arm for next upload */
-        if (file_out_cnt == file_out.size) {
+        if (file_out_offset + file_out_cnt == file_out.size) {
             send_done = 1;
             prev_size = -1;
             prev_file_out_cnt = 0;
@@ -977,73 +1054,260 @@ size_t arim_arq_files_on_send_buffer(size_t size)
     return 1;
 }
 
-int arim_arq_files_on_rcv_frame(const char *data, size_t size)
+static void arim_arq_files_discard_rcv()
+{
+    /* abandon inbound file, removing its partial file and journal */
+    pthread_mutex_lock(&mutex_file_in);
+    if (file_in_fp) {
+        fclose(file_in_fp);
+        file_in_fp = NULL;
+        arim_arq_resume_remove(file_in_dpath, file_in_call, file_in.name);
+    }
+    pthread_mutex_unlock(&mutex_file_in);
+}
+
+static void arim_arq_files_suspend_rcv()
+{
+    /* transfer interrupted, keep partial file and journal for resuming */
+    pthread_mutex_lock(&mutex_file_in);
+    if (file_in_fp) {
+        fclose(file_in_fp);
+        file_in_fp = NULL;
+        if (!arim_arq_resume_enabled())
+            arim_arq_resume_remove(file_in_dpath, file_in_call, file_in.name);
+    }
+    pthread_mutex_unlock(&mutex_file_in);
+}
+
+static int arim_arq_files_open_rcv(const char *dpath)
+{
+    char fpath[MAX_PATH_SIZE*2];
+
+    /* inbound payload goes to a partial file next to its destination,
+       moved into place once verified so a partial file is never seen
+       there. If resuming, append to the bytes already received */
+    pthread_mutex_lock(&mutex_file_in);
+    snprintf(file_in_dpath, sizeof(file_in_dpath), "%s", dpath);
+    arim_arq_resume_path(fpath, sizeof(fpath), dpath, file_in_call,
+                         file_in.name, ARQ_RESUME_PART_EXT);
+    if (file_in_cnt) {
+        file_in_fp = fopen(fpath, "r+");
+        if (file_in_fp && (ftruncate(fileno(file_in_fp), file_in_cnt) ||
+                           fseek(file_in_fp, file_in_cnt, SEEK_SET))) {
+            fclose(file_in_fp);
+            file_in_fp = NULL;
+        }
+    } else {
+        file_in_fp = fopen(fpath, "w+");
+        file_in_cs = 0xFFFF;
+    }
+    pthread_mutex_unlock(&mutex_file_in);
+    return (file_in_fp != NULL);
+}
+
+static int arim_arq_files_write_rcv(const char *data, size_t size)
+{
+    ARQ_RESUME jnl;
+    int result = 1;
+
+    /* append to partial file and journal the new count of bytes */
+    pthread_mutex_lock(&mutex_file_in);
+    if (!file_in_fp || fwrite(data, 1, size, file_in_fp) != size ||
+        fflush(file_in_fp)) {
+        result = 0;
+    } else {
+        file_in_cs = ccitt_crc16_update(file_in_cs, (const unsigned char *)data, size);
+        if (arim_arq_resume_enabled()) {
+            jnl.size = file_in.size;
+            jnl.check = file_in.check;
+            jnl.codec = codec;
+            jnl.offset = file_in_cnt + size;
+            jnl.cs = file_in_cs;
+            arim_arq_resume_save(&jnl, file_in_dpath, file_in_call, file_in.name);
+        }
+    }
+    pthread_mutex_unlock(&mutex_file_in);
+    return result;
+}
+
+static int arim_arq_files_patch_rcv(const char *fpath, FILE *in, FILE *out, size_t max)
+{
+    FILE *base, *dfp;
+    int result = 1;
+
+    /* rebuild the file at fpath from the /FSYNC delta at in, decoding
+       the delta first if -z option invoked. Returns 1 on success, 0 on
+       write error or -1 if the delta is bad or does not fit our copy */
+    base = fopen(fpath, "r");
+    if (!base)
+        return -1;
+    dfp = in;
+    if (zoption) {
+        dfp = tmpfile();
+        result = dfp ? arim_arq_codec_decode_file(codec, in, dfp, max) : 0;
+        if (dfp)
+            rewind(dfp);
+    }
+    if (result == 1)
+        result = arim_arq_sync_patch(base, dfp, out, max);
+    if (dfp && dfp != in)
+        fclose(dfp);
+    fclose(base);
+    return result;
+}
+
+static int arim_arq_files_finish_rcv(const char *fpath, size_t max)
 {
     FILE *fp;
-    DIR *dirp;
-    char fpath[MAX_PATH_SIZE*2], dpath[MAX_PATH_SIZE];
-    char linebuf[MAX_LOG_LINE_SIZE], databuf[MIN_DATA_BUF_SIZE];
-    char remote_call[TNC_MYCALL_SIZE];
-    int numch;
-    unsigned int check;
-    z_stream zs;
-    char zbuffer[MAX_UNCOMP_DATA_SIZE];
-    int zret;
+    char ppath[MAX_PATH_SIZE*2], tpath[MAX_PATH_SIZE*2];
+    int fd, result = 1;
 
-    /* buffer data, increment count of bytes */
-    if (file_in_cnt + size > sizeof(file_in.data)) {
-        /* overflow */
-        numch = snprintf(linebuf, sizeof(linebuf),
-                         "ARQ: File download %s failed, buffer overflow %zu",
-                             file_in.name, file_in_cnt + size);
-        if (numch >= sizeof(linebuf))
-            ui_truncate_line(linebuf, sizeof(linebuf));
-        bufq_queue_debug_log(linebuf);
-        snprintf(linebuf, sizeof(linebuf), "/ERROR Buffer overflow");
-        arim_arq_send_remote(linebuf);
-        arim_on_event(EV_ARQ_FILE_ERROR, 0);
+    /* move completed payload into place, decompressing it first if -z
+       option invoked or applying it to our old copy if a delta. Returns
+       1 on success, 0 on write error or -1 if the payload data is bad */
+    pthread_mutex_lock(&mutex_file_in);
+    if (!file_in_fp) {
+        pthread_mutex_unlock(&mutex_file_in);
         return 0;
     }
-    memcpy(file_in.data + file_in_cnt, data, size);
+    arim_arq_resume_path(ppath, sizeof(ppath), file_in_dpath, file_in_call,
+                         file_in.name, ARQ_RESUME_PART_EXT);
+    if (zoption || delta) {
+        rewind(file_in_fp);
+        snprintf(tpath, sizeof(tpath), "%s/.%s.XXXXXX", file_in_dpath, file_in.name);
+        fd = mkstemp(tpath);
+        fp = (fd == -1) ? NULL : fdopen(fd, "w");
+        if (fp) {
+            fchmod(fd, S_IRUSR|S_IWUSR|S_IRGRP|S_IROTH);
+            if (delta)
+                result = arim_arq_files_patch_rcv(fpath, file_in_fp, fp, max);
+            else
+                result = arim_arq_codec_decode_file(codec, file_in_fp, fp, max);
+            if (fflush(fp) || fsync(fd))
+                result = 0;
+            if (fclose(fp))
+                result = 0;
+            if (result == 1 && rename(tpath, fpath) == -1)
+                result = 0;
+            if (result != 1)
+                unlink(tpath);
+        } else {
+            if (fd != -1) {
+                close(fd);
+                unlink(tpath);
+            }
+            result = 0;
+        }
+        fclose(file_in_fp);
+    } else {
+        if (fflush(file_in_fp) || fsync(fileno(file_in_fp)))
+            result = 0;
+        if (fclose(file_in_fp))
+            result = 0;
+        if (result == 1 && rename(ppath, fpath) == -1)
+            result = 0;
+    }
+    file_in_fp = NULL;
+    arim_arq_resume_remove(file_in_dpath, file_in_call, file_in.name);
+    pthread_mutex_unlock(&mutex_file_in);
+    return result;
+}
+
+static size_t arim_arq_files_resume_point()
+{
+    ARQ_RESUME jnl;
+    char dpath[MAX_PATH_SIZE];
+
+    /* check for a partial download of this file from the remote station,
+       returning the count of bytes already received or 0 to start over */
+    snprintf(dpath, sizeof(dpath), "%s/%s", g_arim_settings.files_dir, file_in.path);
+    arim_arq_resume_purge(dpath);
+    if (arim_arq_resume_load(&jnl, dpath, file_in_call, file_in.name)) {
+        if (jnl.size == file_in.size && jnl.check == file_in.check &&
+            jnl.codec == codec) {
+            file_in_cs = jnl.cs;
+            return jnl.offset;
+        }
+        /* file has changed at the remote station */
+        arim_arq_resume_remove(dpath, file_in_call, file_in.name);
+    }
+    return 0;
+}
+
+void arim_arq_files_on_abort()
+{
+    /* connection closed or canceled, release files of any transfer in progress */
+    sync_in = sync_out = sync_delta = 0;
+    arim_arq_files_suspend_rcv();
+    if (file_out_fp) {
+        fclose(file_out_fp);
+        file_out_fp = NULL;
+    }
+}
+
+static int arim_arq_files_sync_on_rcv_frame(const char *data, size_t size)
+{
+    char linebuf[MAX_LOG_LINE_SIZE];
+    unsigned int check;
+    int numch, result;
+
+    /* block sums of the remote station's old copy, for our /FSYNC delta */
+    if (size > file_in.size - file_in_cnt)
+        size = file_in.size - file_in_cnt;
+    memcpy(sync_sig + file_in_cnt, data, size);
+    file_in_cs = ccitt_crc16_update(file_in_cs, (const unsigned char *)data, size);
     file_in_cnt += size;
     numch = snprintf(linebuf, sizeof(linebuf),
-                     "ARQ: File download %s reading %zu of %zu bytes",
-                         file_in.name, file_in_cnt, file_in.size);
+                     "ARQ: File sync %s reading %zu of %zu bytes of block sums",
+                         sync_name, file_in_cnt, file_in.size);
     if (numch >= sizeof(linebuf))
         ui_truncate_line(linebuf, sizeof(linebuf));
     bufq_queue_debug_log(linebuf);
-    numch = snprintf(linebuf, sizeof(linebuf), ">> [@] %s %zu of %zu bytes",
-                     file_in.name, file_in_cnt, file_in.size);
-    if (numch >= sizeof(linebuf))
-        ui_truncate_line(linebuf, sizeof(linebuf));
-    bufq_queue_traffic_log(linebuf);
-    bufq_queue_data_in(linebuf);
-    /* update progress meter */
     ui_status_xfer_update(file_in_cnt);
     arim_on_event(EV_ARQ_FILE_RCV_FRAME, 0);
-    if (file_in_cnt >= file_in.size) {
-        /* if excess data, take most recent file_in.size bytes */
-        if (file_in_cnt > file_in.size) {
-            memmove(file_in.data, file_in.data + (file_in_cnt - file_in.size),
-                                                  file_in_cnt - file_in.size);
-            file_in_cnt = file_in.size;
-        }
-        /* verify checksum */
-        check = ccitt_crc16(file_in.data, file_in.size);
-        if (file_in.check != check) {
-            numch = snprintf(linebuf, sizeof(linebuf),
-                             "ARQ: File download %s failed, bad checksum %04X",
-                                 file_in.name, check);
-            if (numch >= sizeof(linebuf))
-                ui_truncate_line(linebuf, sizeof(linebuf));
-            bufq_queue_debug_log(linebuf);
-            snprintf(linebuf, sizeof(linebuf), "/ERROR Bad checksum");
-            arim_arq_send_remote(linebuf);
-            arim_on_event(EV_ARQ_FILE_ERROR, 0);
-            return 0;
-        }
-        /* make sure access to directory is allowed */
-        snprintf(dpath, sizeof(dpath), "%s/%s", g_arim_settings.files_dir, file_in.path);
+    if (file_in_cnt < file_in.size)
+        return 1;
+    sync_in = 0;
+    check = file_in_cnt ? ccitt_crc16_final(file_in_cs) : ccitt_crc16(NULL, 0);
+    if (file_in.check != check) {
+        numch = snprintf(linebuf, sizeof(linebuf),
+                         "ARQ: File sync %s failed, bad checksum %04X", sync_name, check);
+        if (numch >= sizeof(linebuf))
+            ui_truncate_line(linebuf, sizeof(linebuf));
+        bufq_queue_debug_log(linebuf);
+        snprintf(linebuf, sizeof(linebuf), "/ERROR Bad checksum");
+        arim_arq_send_remote(linebuf);
+        arim_on_event(EV_ARQ_FILE_ERROR, 0);
+        return 0;
+    }
+    /* acknowledge the block sums and send the delta */
+    snprintf(linebuf, sizeof(linebuf), "/OK %zu %04X", file_in_cnt, check);
+    arim_arq_send_remote(linebuf);
+    sync_sig_len = file_in_cnt;
+    sync_delta = 1;
+    result = arim_arq_files_send_file(sync_name, sync_path[0] ? sync_path : NULL, 0);
+    if (result == 1)
+        arim_on_event(EV_ARQ_FILE_SEND_CMD, 0);
+    else
+        arim_on_event(EV_ARQ_FILE_ERROR, 0);
+    return (result == 1);
+}
+
+int arim_arq_files_on_rcv_frame(const char *data, size_t size)
+{
+    DIR *dirp;
+    char fpath[MAX_PATH_SIZE*2], dpath[MAX_PATH_SIZE];
+    char linebuf[MAX_LOG_LINE_SIZE], databuf[MIN_DATA_BUF_SIZE];
+    char remote_call[TNC_MYCALL_SIZE];
+    size_t max;
+    int numch, result;
+    unsigned int check;
+
+    if (sync_in)
+        return arim_arq_files_sync_on_rcv_frame(data, size);
+    snprintf(dpath, sizeof(dpath), "%s/%s", g_arim_settings.files_dir, file_in.path);
+    if (!file_in_fp) {
+        /* first frame, make sure access to directory is allowed */
         snprintf(fpath, sizeof(fpath), "%s/%s", g_arim_settings.files_dir, DEFAULT_DOWNLOAD_DIR);
         if ((strstr(file_in.path, "..") || strstr(file_in.name, "..")) ||
             (strcmp(dpath, fpath) &&
@@ -1079,53 +1343,7 @@ int arim_arq_files_on_rcv_frame(const char *data, size_t size)
         } else {
             closedir(dirp);
         }
-        if (zoption) {
-            zs.zalloc = Z_NULL;
-            zs.zfree = Z_NULL;
-            zs.opaque = Z_NULL;
-            zs.avail_in = file_in.size;
-            zs.next_in = file_in.data;
-            zs.avail_out = sizeof(zbuffer);
-            zs.next_out = (Bytef *)zbuffer;
-            zret = inflateInit(&zs);
-            if (zret == Z_OK) {
-                zret = inflate(&zs, Z_FINISH);
-                inflateEnd(&zs);
-                if (zret != Z_STREAM_END) {
-                    numch = snprintf(linebuf, sizeof(linebuf),
-                                     "ARQ: File download %s failed, decompression failed",
-                                         file_in.name);
-                    if (numch >= sizeof(linebuf))
-                        ui_truncate_line(linebuf, sizeof(linebuf));
-                    bufq_queue_debug_log(linebuf);
-                    snprintf(linebuf, sizeof(linebuf), "/ERROR Decompression failed");
-                    arim_arq_send_remote(linebuf);
-                    arim_on_event(EV_ARQ_FILE_ERROR, 0);
-                    return 0;
-                }
-            } else {
-                numch = snprintf(linebuf, sizeof(linebuf),
-                                 "ARQ: File download %s failed, decompression initialization error",
-                                    file_in.name);
-                if (numch >= sizeof(linebuf))
-                    ui_truncate_line(linebuf, sizeof(linebuf));
-                bufq_queue_debug_log(linebuf);
-                snprintf(linebuf, sizeof(linebuf), "/ERROR Decompression failed");
-                arim_arq_send_remote(linebuf);
-                arim_on_event(EV_ARQ_FILE_ERROR, 0);
-                return 0;
-            }
-        }
-        /* now write file */
-        snprintf(fpath, sizeof(fpath), "%s/%s", dpath, file_in.name);
-        fp = fopen(fpath, "w");
-        if (fp != NULL) {
-            if (!zoption)
-                fwrite(file_in.data, 1, file_in.size, fp);
-            else
-                fwrite(zbuffer, 1, zs.total_out, fp);
-            fclose(fp);
-        } else {
+        if (!arim_arq_files_open_rcv(dpath)) {
             numch = snprintf(linebuf, sizeof(linebuf),
                              "ARQ: File download %s failed, file open error", file_in.name);
             if (numch >= sizeof(linebuf))
@@ -1136,22 +1354,95 @@ int arim_arq_files_on_rcv_frame(const char *data, size_t size)
             arim_on_event(EV_ARQ_FILE_ERROR, 0);
             return 0;
         }
-        /* success */
+    }
+    /* write data to partial file, ignoring any excess, increment count of bytes */
+    if (size > file_in.size - file_in_cnt)
+        size = file_in.size - file_in_cnt;
+    if (!arim_arq_files_write_rcv(data, size)) {
+        arim_arq_files_discard_rcv();
         numch = snprintf(linebuf, sizeof(linebuf),
-                         "ARQ: Saved %s file %s %zu bytes, checksum %04X",
-                               zoption ? "compressed" : "uncompressed",
-                                   file_in.name, file_in_cnt, check);
+                         "ARQ: File download %s failed, file write error", file_in.name);
+        if (numch >= sizeof(linebuf))
+            ui_truncate_line(linebuf, sizeof(linebuf));
+        bufq_queue_debug_log(linebuf);
+        snprintf(linebuf, sizeof(linebuf), "/ERROR Cannot write file");
+        arim_arq_send_remote(linebuf);
+        arim_on_event(EV_ARQ_FILE_ERROR, 0);
+        return 0;
+    }
+    file_in_cnt += size;
+    numch = snprintf(linebuf, sizeof(linebuf),
+                     "ARQ: File download %s reading %zu of %zu bytes",
+                         file_in.name, file_in_cnt, file_in.size);
+    if (numch >= sizeof(linebuf))
+        ui_truncate_line(linebuf, sizeof(linebuf));
+    bufq_queue_debug_log(linebuf);
+    numch = snprintf(linebuf, sizeof(linebuf), ">> [@] %s %zu of %zu bytes",
+                     file_in.name, file_in_cnt, file_in.size);
+    if (numch >= sizeof(linebuf))
+        ui_truncate_line(linebuf, sizeof(linebuf));
+    bufq_queue_traffic_log(linebuf);
+    bufq_queue_data_in(linebuf);
+    /* update progress meter */
+    ui_status_xfer_update(file_in_cnt);
+    arim_on_event(EV_ARQ_FILE_RCV_FRAME, 0);
+    if (file_in_cnt >= file_in.size) {
+        /* verify checksum */
+        check = file_in_cnt ? ccitt_crc16_final(file_in_cs) : ccitt_crc16(NULL, 0);
+        if (file_in.check != check) {
+            arim_arq_files_discard_rcv();
+            numch = snprintf(linebuf, sizeof(linebuf),
+                             "ARQ: File download %s failed, bad checksum %04X",
+                                 file_in.name, check);
+            if (numch >= sizeof(linebuf))
+                ui_truncate_line(linebuf, sizeof(linebuf));
+            bufq_queue_debug_log(linebuf);
+            snprintf(linebuf, sizeof(linebuf), "/ERROR Bad checksum");
+            arim_arq_send_remote(linebuf);
+            arim_on_event(EV_ARQ_FILE_ERROR, 0);
+            return 0;
+        }
+        /* now move file into place */
+        snprintf(fpath, sizeof(fpath), "%s/%s", dpath, file_in.name);
+        max = atoi(g_arim_settings.max_arq_file_size);
+        result = arim_arq_files_finish_rcv(fpath, max);
+        if (result != 1) {
+            numch = snprintf(linebuf, sizeof(linebuf),
+                             "ARQ: File download %s failed, %s", file_in.name,
+                                 result ? (delta ? "delta does not fit local copy" :
+                                     "decompression failed") : "file write error");
+            if (numch >= sizeof(linebuf))
+                ui_truncate_line(linebuf, sizeof(linebuf));
+            bufq_queue_debug_log(linebuf);
+            snprintf(linebuf, sizeof(linebuf), "/ERROR %s",
+                         result ? (delta ? "Sync failed" : "Decompression failed") :
+                             "Cannot write file");
+            arim_arq_send_remote(linebuf);
+            arim_on_event(EV_ARQ_FILE_ERROR, 0);
+            return 0;
+        }
+        /* success */
+        if (delta)
+            numch = snprintf(linebuf, sizeof(linebuf),
+                             "ARQ: Synced file %s from %zu byte delta, checksum %04X",
+                                 file_in.name, file_in_cnt, check);
+        else
+            numch = snprintf(linebuf, sizeof(linebuf),
+                             "ARQ: Saved %s file %s %zu bytes, checksum %04X",
+                                   zoption ? "compressed" : "uncompressed",
+                                       file_in.name, file_in_cnt, check);
         if (numch >= sizeof(linebuf))
             ui_truncate_line(linebuf, sizeof(linebuf));
         bufq_queue_debug_log(linebuf);
         snprintf(databuf, sizeof(databuf),
-                 "/OK %s %zu %04X saved", file_in.name, file_in_cnt, check);
+                 "/OK %s %zu %04X saved%s", file_in.name,
+                     file_in_cnt, check, arim_arq_codec_advert());
         arim_arq_send_remote(databuf);
         arim_on_event(EV_ARQ_FILE_RCV_DONE, 0);
         /* update file history list */
         arim_copy_remote_call(remote_call, sizeof(remote_call));
         numch = snprintf(linebuf, MAX_FTABLE_ROW_SIZE,
-                 "I%c%-12s%6zu%04X%s/%s", zoption ? 'Z' : ' ',
+                 "I%c%-12s%8zu%04X%s/%s", delta ? ARQ_SYNC_HIST_CODE : arim_arq_codec_hist_code(codec),
                      remote_call, file_in.size, file_in.check, file_in.path, file_in.name);
         if (numch >= MAX_FTABLE_ROW_SIZE)
             ui_truncate_line(linebuf, MAX_FTABLE_ROW_SIZE);
@@ -1168,7 +1459,10 @@ int arim_arq_files_on_fget(char *cmd, size_t size, char *eol)
     int result;
 
     zoption = 0;
+    want = ARQ_CODEC_NONE;
     p_path = NULL;
+    resume_offset = resume_check = 0;
+    want_hash[0] = '\0';
     /* empty outbound data buffer before handling file request */
     while (arim_get_buffer_cnt() > 0)
         sleep(1);
@@ -1178,10 +1472,24 @@ int arim_arq_files_on_fget(char *cmd, size_t size, char *eol)
         ++s;
     if (*s && (s == strstr(s, "-z"))) {
         zoption = 1;
-        s += 2;
+        /* -z<codec> asks for a codec, plain -z leaves it to us */
+        want = arim_arq_codec_parse(&s);
+        if (want == ARQ_CODEC_ZLIB || want < 0)
+            want = ARQ_CODEC_NONE;
+        while (*s && *s == ' ')
+            ++s;
+    }
+    if (*s == '@') {
+        /* resume request, offset and checksum of partial download */
+        if (2 != sscanf(s + 1, "%zu:%x", &resume_offset, &resume_check))
+            resume_offset = resume_check = 0;
+        while (*s && *s != ' ')
+            ++s;
         while (*s && *s == ' ')
             ++s;
     }
+    /* hash of the copy the remote station has already, if any */
+    arim_arq_hash_parse(&s, want_hash, sizeof(want_hash));
     p_name = s;
     if (*p_name && eol) {
         /* trim trailing spaces */
@@ -1252,19 +1560,21 @@ int arim_arq_files_on_fget(char *cmd, size_t size, char *eol)
             } else {
                 /* no auth required or session previously authenticated */
                 result = arim_arq_files_send_file(p_name, p_path, 0);
-                /* if successful returns 1, otherwise -1 or 0 */
+                /* if successful returns 1, 2 if remote copy is
+                   unchanged, otherwise -1 or 0 */
                 if (result == 1)
                     arim_on_event(EV_ARQ_FILE_SEND_CMD, 0);
-                else
+                else if (result != 2)
                     arim_on_event(EV_ARQ_FILE_ERROR, 0);
             }
         } else {
             /* file located in root shared file dir */
             result = arim_arq_files_send_file(p_name, p_path, 0);
-            /* if successful returns 1, otherwise -1 or 0 */
+            /* if successful returns 1, 2 if remote copy is
+               unchanged, otherwise -1 or 0 */
             if (result == 1)
                 arim_on_event(EV_ARQ_FILE_SEND_CMD, 0);
-            else
+            else if (result != 2)
                 arim_on_event(EV_ARQ_FILE_ERROR, 0);
         }
     } else {
@@ -1282,17 +1592,54 @@ int arim_arq_files_on_fput(char *cmd, size_t size, char *eol, int arq_cs_role)
     char *p_check, *p_name, *p_path, *p_size, *s, *e;
     char linebuf[MAX_LOG_LINE_SIZE], remote_call[TNC_MYCALL_SIZE];
     char dpath[MAX_PATH_SIZE];
+    size_t offset = 0;
     int numch;
 
-    zoption = 0;
+    zoption = delta = sync_in = 0;
+    codec = ARQ_CODEC_NONE;
     /* inbound file transfer, get parameters */
     p_size = p_check = p_path = NULL;
     s = cmd + 6;
     while (*s && *s == ' ')
         ++s;
+    if (s == strstr(s, "-d ")) {
+        /* delta against our old copy, answering our /FSYNC */
+        delta = 1;
+        s += 3;
+        while (*s && *s == ' ')
+            ++s;
+    }
     if (*s && (s == strstr(s, "-z"))) {
         zoption = 1;
-        s += 2;
+        /* -z<codec>, encoded with the codec named */
+        codec = arim_arq_codec_parse(&s);
+        while (*s && *s == ' ')
+            ++s;
+    }
+    if (codec < 0) {
+        snprintf(linebuf, sizeof(linebuf),
+                 "ARQ: File download failed, unknown codec");
+        bufq_queue_debug_log(linebuf);
+        snprintf(linebuf, sizeof(linebuf), "/ERROR Unknown codec");
+        arim_arq_send_remote(linebuf);
+        arim_on_event(EV_ARQ_FILE_ERROR, 0);
+        return 0;
+    }
+    if (delta && arq_cs_role == ARQ_SERVER_STN) {
+        snprintf(linebuf, sizeof(linebuf),
+                 "ARQ: File download failed, delta not requested");
+        bufq_queue_debug_log(linebuf);
+        snprintf(linebuf, sizeof(linebuf), "/ERROR Delta not requested");
+        arim_arq_send_remote(linebuf);
+        arim_on_event(EV_ARQ_FILE_ERROR, 0);
+        return 0;
+    }
+    if (*s == '@') {
+        /* sender is resuming a partial download at this offset */
+        if (1 != sscanf(s + 1, "%zu", &offset))
+            offset = 0;
+        while (*s && *s != ' ')
+            ++s;
         while (*s && *s == ' ')
             ++s;
     }
@@ -1353,12 +1700,26 @@ int arim_arq_files_on_fput(char *cmd, size_t size, char *eol, int arq_cs_role)
             --e;
         }
         if (p_size && p_check) {
+            /* set aside what's left of any earlier download */
+            arim_arq_files_suspend_rcv();
+            arim_copy_remote_call(file_in_call, sizeof(file_in_call));
             snprintf(file_in.name, sizeof(file_in.name), "%s", basename(p_name));
             snprintf(file_in.path, sizeof(file_in.path), "%s",
                          p_path ? p_path : DEFAULT_DOWNLOAD_DIR);
             file_in.size = atoi(p_size);
             if (1 != sscanf(p_check, "%x", &file_in.check))
                 file_in.check = 0;
+            if (file_in.size > atoi(g_arim_settings.max_arq_file_size)) {
+                numch = snprintf(linebuf, sizeof(linebuf),
+                                 "ARQ: File download %s failed, size exceeds limit", file_in.name);
+                if (numch >= sizeof(linebuf))
+                    ui_truncate_line(linebuf, sizeof(linebuf));
+                bufq_queue_debug_log(linebuf);
+                snprintf(linebuf, sizeof(linebuf), "/ERROR File size exceeds limit");
+                arim_arq_send_remote(linebuf);
+                arim_on_event(EV_ARQ_FILE_ERROR, 0);
+                return 0;
+            }
             if (arq_cs_role == ARQ_SERVER_STN) {
                 if (p_path) {
                     snprintf(dpath, sizeof(dpath), "%s/%s", g_arim_settings.files_dir, p_path);
@@ -1386,8 +1747,14 @@ int arim_arq_files_on_fput(char *cmd, size_t size, char *eol, int arq_cs_role)
                             arim_arq_send_remote(linebuf);
                         }
                     } else {
-                        /* no auth required or session previously authenticated */
-                        snprintf(linebuf, sizeof(linebuf), "/OK");
+                        /* no auth required or session previously authenticated,
+                           ask for the rest of the file if partly received already */
+                        file_in_cnt = arim_arq_files_resume_point();
+                        if (file_in_cnt)
+                            snprintf(linebuf, sizeof(linebuf), "/OK @%zu%s",
+                                     file_in_cnt, arim_arq_codec_advert());
+                        else
+                            snprintf(linebuf, sizeof(linebuf), "/OK%s", arim_arq_codec_advert());
                         arim_arq_send_remote(linebuf);
                         arim_on_event(EV_ARQ_FILE_RCV_WAIT_OK, 0);
                         numch = snprintf(linebuf, sizeof(linebuf),
@@ -1396,15 +1763,21 @@ int arim_arq_files_on_fput(char *cmd, size_t size, char *eol, int arq_cs_role)
                         if (numch >= sizeof(linebuf))
                             ui_truncate_line(linebuf, sizeof(linebuf));
                         bufq_queue_debug_log(linebuf);
-                        /* initialize count and start progress meter */
-                        file_in_cnt = 0;
+                        /* start progress meter */
                         ui_status_xfer_start(0, file_in.size, STATUS_XFER_DIR_DOWN);
+                        ui_status_xfer_update(file_in_cnt);
                         /* start timer for file history list */
                         bufq_queue_ftable("S");
                     }
                 } else {
-                    /* file located in root shared file dir */
-                    snprintf(linebuf, sizeof(linebuf), "/OK");
+                    /* file located in root shared file dir, ask for the
+                       rest of the file if partly received already */
+                    file_in_cnt = arim_arq_files_resume_point();
+                    if (file_in_cnt)
+                        snprintf(linebuf, sizeof(linebuf), "/OK @%zu%s",
+                                     file_in_cnt, arim_arq_codec_advert());
+                    else
+                        snprintf(linebuf, sizeof(linebuf), "/OK%s", arim_arq_codec_advert());
                     arim_arq_send_remote(linebuf);
                     arim_on_event(EV_ARQ_FILE_RCV_WAIT_OK, 0);
                     numch = snprintf(linebuf, sizeof(linebuf),
@@ -1413,14 +1786,35 @@ int arim_arq_files_on_fput(char *cmd, size_t size, char *eol, int arq_cs_role)
                     if (numch >= sizeof(linebuf))
                         ui_truncate_line(linebuf, sizeof(linebuf));
                     bufq_queue_debug_log(linebuf);
-                    /* initialize count and start progress meter */
-                    file_in_cnt = 0;
+                    /* start progress meter */
                     ui_status_xfer_start(0, file_in.size, STATUS_XFER_DIR_DOWN);
+                    ui_status_xfer_update(file_in_cnt);
                     /* start timer for file history list */
                     bufq_queue_ftable("S");
                 }
             } else {
-                /* data arriving next if role is is 'client' */
+                /* data arriving next if role is is 'client'. If the sender
+                   is resuming, the partial download must match the offset */
+                file_in_cnt = arim_arq_files_resume_point();
+                if (file_in_cnt != offset) {
+                    /* sender starts over if the file has changed */
+                    snprintf(dpath, sizeof(dpath), "%s/%s",
+                             g_arim_settings.files_dir, file_in.path);
+                    arim_arq_resume_remove(dpath, file_in_call, file_in.name);
+                    file_in_cnt = 0;
+                }
+                if (file_in_cnt != offset) {
+                    numch = snprintf(linebuf, sizeof(linebuf),
+                                     "ARQ: File download %s failed, cannot resume at byte %zu",
+                                         file_in.name, offset);
+                    if (numch >= sizeof(linebuf))
+                        ui_truncate_line(linebuf, sizeof(linebuf));
+                    bufq_queue_debug_log(linebuf);
+                    snprintf(linebuf, sizeof(linebuf), "/ERROR Cannot resume");
+                    arim_arq_send_remote(linebuf);
+                    arim_on_event(EV_ARQ_FILE_ERROR, 0);
+                    return 0;
+                }
                 arim_on_event(EV_ARQ_FILE_RCV, 0);
                 numch = snprintf(linebuf, sizeof(linebuf),
                                  "ARQ: File download %s to %s %zu %04X started",
@@ -1428,9 +1822,9 @@ int arim_arq_files_on_fput(char *cmd, size_t size, char *eol, int arq_cs_role)
                 if (numch >= sizeof(linebuf))
                     ui_truncate_line(linebuf, sizeof(linebuf));
                 bufq_queue_debug_log(linebuf);
-                /* initialize count and start progress meter */
-                file_in_cnt = 0;
+                /* start progress meter */
                 ui_status_xfer_start(0, file_in.size, STATUS_XFER_DIR_DOWN);
+                ui_status_xfer_update(file_in_cnt);
                 /* cache any data remaining */
                 if ((cmd + size) > eol) {
                     arim_arq_files_on_rcv_frame(eol, size - (eol - cmd));
@@ -1462,10 +1856,14 @@ int arim_arq_files_on_fput(char *cmd, size_t size, char *eol, int arq_cs_role)
 int arim_arq_files_on_client_fget(const char *cmd, const char *fn, const char *destdir, int use_zoption)
 {
     /* called from cmd processor when user issues /FGET at prompt */
-    char linebuf[MAX_LOG_LINE_SIZE];
-    char fpath[MAX_PATH_SIZE];
-    char *e, *f;
+    ARQ_RESUME jnl;
+    char linebuf[MAX_LOG_LINE_SIZE], cmdbuf[MAX_CMD_SIZE];
+    char fpath[MAX_PATH_SIZE], dpath[MAX_PATH_SIZE*2], dest[MAX_DIR_PATH_SIZE];
+    char fname[MAX_PATH_SIZE], lpath[MAX_PATH_SIZE*3], remote_call[TNC_MYCALL_SIZE];
+    char resume[32], zflag[ARQ_CODEC_FLAG_SIZE], hash[ARQ_HASH_B64_SIZE+2];
+    char *e, *f, *d;
     size_t len;
+    int request, numch;
 
     snprintf(fpath, sizeof(fpath), "%s", fn);
     /* replace stray '>' characters in file name string */
@@ -1492,12 +1890,338 @@ int arim_arq_files_on_client_fget(const char *cmd, const char *fn, const char *d
         bufq_queue_debug_log(linebuf);
         return 0;
     }
+    /* if part of the file was received from this station before, ask for
+       the rest of it. The checksum lets the sender tell if it has changed */
+    d = NULL;
+    if (destdir) {
+        snprintf(dest, sizeof(dest), "%s", destdir);
+        d = dest;
+        while (*d && (*d == ' ' || *d == '/'))
+            ++d;
+        e = d + strlen(d);
+        while (e > d && *(e - 1) == ' ')
+            *--e = '\0';
+        if (!strlen(d))
+            d = NULL;
+    }
+    snprintf(dpath, sizeof(dpath), "%s/%s", g_arim_settings.files_dir,
+             d ? d : DEFAULT_DOWNLOAD_DIR);
+    arim_copy_remote_call(remote_call, sizeof(remote_call));
+    snprintf(fname, sizeof(fname), "%s", f);
+    if (arim_arq_resume_load(&jnl, dpath, remote_call, basename(fname)) &&
+        (jnl.codec != ARQ_CODEC_NONE) == (use_zoption != 0))
+        snprintf(resume, sizeof(resume), " @%zu:%04X", jnl.offset, jnl.check);
+    else
+        resume[0] = '\0';
+    /* if a copy was downloaded before, send its hash so the remote
+       station can skip the transfer if the file has not changed. Older
+       stations would take the token for the file name, so only do this
+       once the remote station has advertised support for it */
+    snprintf(lpath, sizeof(lpath), "%s/%s", dpath, basename(fname));
+    hash[0] = ' ';
+    hash[1] = ARQ_HASH_TOKEN;
+    if (!arim_arq_codec_peer_feature(ARQ_FEATURE_HASH) ||
+        !arim_arq_hash_file(lpath, hash + 2, sizeof(hash) - 2))
+        hash[0] = '\0';
+    /* ask for the codec set by arq-codec if the remote station supports it */
+    request = use_zoption ? arim_arq_codec_request() : ARQ_CODEC_NONE;
+    arim_arq_codec_flag(request, zflag, sizeof(zflag));
+    if (resume[0] || hash[0] || request != (use_zoption ? ARQ_CODEC_ZLIB : ARQ_CODEC_NONE)) {
+        if (d)
+            numch = snprintf(cmdbuf, sizeof(cmdbuf), "/FGET%s%s%s %s > %s", zflag, resume, hash, f, d);
+        else
+            numch = snprintf(cmdbuf, sizeof(cmdbuf), "/FGET%s%s%s %s", zflag, resume, hash, f);
+        /* a long file name may leave no room for the extra tokens, send
+           the command as typed then rather than cut the name short */
+        if (numch < sizeof(cmdbuf))
+            cmd = cmdbuf;
+    }
     arim_arq_auth_set_ha2_info("FGET", f);
     arim_arq_send_remote(cmd);
     arim_on_event(EV_ARQ_FILE_RCV_WAIT, 0);
     return 1;
 }
 
+int arim_arq_files_on_fsync(char *cmd, size_t size, char *eol)
+{
+    char *p_check, *p_name, *p_path, *p_size, *s, *e;
+    char linebuf[MAX_LOG_LINE_SIZE], remote_call[TNC_MYCALL_SIZE];
+    char dpath[MAX_PATH_SIZE], add_file_dir[MAX_DIR_PATH_SIZE];
+    int numch;
+
+    zoption = sync_in = 0;
+    want = ARQ_CODEC_NONE;
+    resume_offset = resume_check = 0;
+    want_hash[0] = '\0';
+    /* empty outbound data buffer before handling file request */
+    while (arim_get_buffer_cnt() > 0)
+        sleep(1);
+    /* parse the parameters, the codec wanted for the delta
+       and size and checksum of the block sums that follow */
+    p_size = p_check = p_path = NULL;
+    s = cmd + 7;
+    while (*s && *s == ' ')
+        ++s;
+    if (*s && (s == strstr(s, "-z"))) {
+        zoption = 1;
+        want = arim_arq_codec_parse(&s);
+        if (want == ARQ_CODEC_ZLIB || want < 0)
+            want = ARQ_CODEC_NONE;
+        while (*s && *s == ' ')
+            ++s;
+    }
+    p_name = s;
+    if (*p_name && eol) {
+        /* check for destination dir argument */
+        e = eol - 1;
+        while (e > p_name && (*e == ' ' || *e == '\0')) {
+            *e = '\0';
+            --e;
+        }
+        s = e;
+        while (s > p_name && *s != '>')
+            --s;
+        if (*s == '>') {
+            /* found a path, trim leading spaces */
+            *s = '\0';
+            e = s - 1;
+            ++s;
+            while (*s && *s == ' ')
+                ++s;
+            /* ignore leading '/' */
+            if (*s == '/')
+                ++s;
+            p_path = s;
+            /* ignore empty result */
+            if (!strlen(p_path))
+                p_path = NULL;
+        }
+        while (e > p_name && *e == ' ')
+            --e;
+        while (e > p_name && *e != ' ')
+            --e;
+        if (e > p_name) {
+            /* at start of checksum */
+            p_check = e + 1;
+            *e = '\0';
+            while (e > p_name && *e == ' ')
+                --e;
+            while (e > p_name && *e != ' ') {
+                --e;
+            }
+            if (e > p_name) {
+                /* at start of size */
+                p_size = e + 1;
+                *e = '\0';
+            }
+        }
+        /* trim trailing spaces from file name */
+        while (e > p_name && *e == ' ') {
+            *e = '\0';
+            --e;
+        }
+    }
+    if (!p_size || !p_check || atoi(p_size) < ARQ_SYNC_SIG_HDR_SIZE ||
+        atoi(p_size) > ARQ_SYNC_SIG_MAX) {
+        snprintf(linebuf, sizeof(linebuf), "ARQ: Bad /FSYNC parameters");
+        bufq_queue_debug_log(linebuf);
+        snprintf(linebuf, sizeof(linebuf), "/ERROR Bad sync request");
+        arim_arq_send_remote(linebuf);
+        arim_on_event(EV_ARQ_FILE_ERROR, 0);
+        return 0;
+    }
+    /* check for directory component in name */
+    snprintf(add_file_dir, sizeof(add_file_dir), "%s", p_name);
+    e = add_file_dir + strlen(add_file_dir);
+    while (e > add_file_dir && *e != '/')
+        --e;
+    *e = '\0';
+    if (e > add_file_dir) {
+        snprintf(dpath, sizeof(dpath), "%s/%s", g_arim_settings.files_dir, add_file_dir);
+        if (!ini_check_ac_files_dir(dpath) && !ini_check_add_files_dir(dpath)) {
+            /* directory not found */
+            snprintf(linebuf, sizeof(linebuf),
+                     "ARQ: File sync %s failed, file not found", p_name);
+            bufq_queue_debug_log(linebuf);
+            snprintf(linebuf, sizeof(linebuf), "/ERROR File not found");
+            arim_arq_send_remote(linebuf);
+            arim_on_event(EV_ARQ_FILE_ERROR, 0);
+            return 0;
+        }
+        /* check to see if this is an access controlled dir */
+        if (ini_check_ac_files_dir(dpath) && !arim_arq_auth_get_status()) {
+            /* auth required, send /A1 challenge */
+            arim_copy_remote_call(remote_call, sizeof(remote_call));
+            if (arim_arq_auth_on_send_a1(remote_call, "FGET", p_name)) {
+                arim_on_event(EV_ARQ_AUTH_SEND_CMD, 1);
+            } else {
+                /* no access for remote call, send /EAUTH response */
+                snprintf(linebuf, sizeof(linebuf), "/EAUTH");
+                arim_arq_send_remote(linebuf);
+            }
+            return 1;
+        }
+    }
+    /* ready for the block sums, the delta is sent once they arrive */
+    arim_arq_files_suspend_rcv();
+    snprintf(sync_name, sizeof(sync_name), "%s", p_name);
+    snprintf(sync_path, sizeof(sync_path), "%s", p_path ? p_path : "");
+    file_in.size = atoi(p_size);
+    if (1 != sscanf(p_check, "%x", &file_in.check))
+        file_in.check = 0;
+    file_in_cnt = 0;
+    file_in_cs = 0xFFFF;
+    sync_in = 1;
+    snprintf(linebuf, sizeof(linebuf), "/OK%s", arim_arq_codec_advert());
+    arim_arq_send_remote(linebuf);
+    arim_on_event(EV_ARQ_FILE_RCV_WAIT_OK, 0);
+    numch = snprintf(linebuf, sizeof(linebuf),
+                     "ARQ: File sync %s %zu %04X sending OK",
+                         sync_name, file_in.size, file_in.check);
+    if (numch >= sizeof(linebuf))
+        ui_truncate_line(linebuf, sizeof(linebuf));
+    bufq_queue_debug_log(linebuf);
+    /* start progress meter */
+    ui_status_xfer_start(0, file_in.size, STATUS_XFER_DIR_DOWN);
+    return 1;
+}
+
+int arim_arq_files_on_client_fsync(const char *fn, const char *destdir, int use_zoption)
+{
+    /* called from cmd processor when user issues /FSYNC at prompt */
+    FILE *fp, *sfp;
+    char linebuf[MAX_LOG_LINE_SIZE], cmdbuf[MAX_CMD_SIZE];
+    char fpath[MAX_PATH_SIZE], dpath[MAX_PATH_SIZE*2], dest[MAX_DIR_PATH_SIZE];
+    char fname[MAX_PATH_SIZE], lpath[MAX_PATH_SIZE*3], zflag[ARQ_CODEC_FLAG_SIZE];
+    char *e, *f, *d;
+    size_t len;
+    int numch, result, toolong = 0;
+
+    snprintf(fpath, sizeof(fpath), "%s", fn);
+    /* replace stray '>' characters in file name string */
+    f = strstr(fpath, ">");
+    while (f) {
+        *f = ' ';
+        f = strstr(fpath, ">");
+    }
+    /* trim leading and trailing spaces */
+    f = fpath;
+    while (*f && *f == ' ')
+        ++f;
+    len = strlen(fpath);
+    e = &fpath[len - 1];
+    while (e > f && *e == ' ') {
+        *e = '\0';
+        --e;
+    }
+    if (!strlen(f)) {
+        ui_show_dialog("\tCannot sync file:\n"
+                       "\tbad file name or path.\n \n\t[O]k", "oO \n");
+        snprintf(linebuf, sizeof(linebuf),
+                 "ARQ: File sync failed, bad file name or path");
+        bufq_queue_debug_log(linebuf);
+        return 0;
+    }
+    d = NULL;
+    if (destdir) {
+        snprintf(dest, sizeof(dest), "%s", destdir);
+        d = dest;
+        while (*d && (*d == ' ' || *d == '/'))
+            ++d;
+        e = d + strlen(d);
+        while (e > d && *(e - 1) == ' ')
+            *--e = '\0';
+        if (!strlen(d))
+            d = NULL;
+    }
+    /* sums of the blocks of our old copy let the remote station
+       send only what has changed since it was downloaded */
+    snprintf(dpath, sizeof(dpath), "%s/%s", g_arim_settings.files_dir,
+             d ? d : DEFAULT_DOWNLOAD_DIR);
+    snprintf(fname, sizeof(fname), "%s", f);
+    snprintf(lpath, sizeof(lpath), "%s/%s", dpath, basename(fname));
+    result = 0;
+    sfp = NULL;
+    /* stations without /FSYNC don't advertise it, download from them instead */
+    fp = arim_arq_codec_peer_feature(ARQ_FEATURE_SYNC) ? fopen(lpath, "r") : NULL;
+    if (fp) {
+        sfp = tmpfile();
+        if (sfp && arim_arq_sync_signature(fp, sfp)) {
+            rewind(sfp);
+            if (file_out_fp) {
+                /* previous upload never got under way */
+                fclose(file_out_fp);
+                file_out_fp = NULL;
+            }
+            zoption = 0;
+            codec = ARQ_CODEC_NONE;
+            result = arim_arq_files_open_payload(&sfp, ARQ_SYNC_SIG_MAX,
+                                                 &file_out.size, &file_out.check);
+        }
+        fclose(fp);
+    }
+    if (result == 1) {
+        /* ask for the delta with the codec set by arq-codec */
+        arim_arq_codec_flag(use_zoption ? arim_arq_codec_request() : ARQ_CODEC_NONE,
+                            zflag, sizeof(zflag));
+        if (d)
+            numch = snprintf(cmdbuf, sizeof(cmdbuf), "/FSYNC%s %s %zu %04X > %s",
+                             zflag, f, file_out.size, file_out.check, d);
+        else
+            numch = snprintf(cmdbuf, sizeof(cmdbuf), "/FSYNC%s %s %zu %04X",
+                             zflag, f, file_out.size, file_out.check);
+        toolong = (numch >= sizeof(cmdbuf));
+        if (toolong)
+            result = 0; /* no room for the size and check, can't sync */
+    }
+    if (result != 1) {
+        /* no old copy to sync with, download the whole file */
+        if (sfp)
+            fclose(sfp);
+        numch = snprintf(linebuf, sizeof(linebuf),
+                         "ARQ: File sync %s, %s, downloading whole file", f,
+                         !arim_arq_codec_peer_feature(ARQ_FEATURE_SYNC) ?
+                             "not supported by remote station" : toolong ?
+                             "file name too long" : "no usable local copy");
+        if (numch >= sizeof(linebuf))
+            ui_truncate_line(linebuf, sizeof(linebuf));
+        bufq_queue_debug_log(linebuf);
+        /* no longer than the /FSYNC command as typed, so it fits */
+        if (d)
+            numch = snprintf(cmdbuf, sizeof(cmdbuf), "/FGET%s %s > %s", use_zoption ? " -z" : "", f, d);
+        else
+            numch = snprintf(cmdbuf, sizeof(cmdbuf), "/FGET%s %s", use_zoption ? " -z" : "", f);
+        if (numch >= sizeof(cmdbuf))
+            return 0;
+        return arim_arq_files_on_client_fget(cmdbuf, f, d, use_zoption);
+    }
+    file_out_fp = sfp;
+    file_out_offset = 0;
+    snprintf(file_out.name, sizeof(file_out.name), "%s", basename(fname));
+    file_out.path[0] = '\0';
+    arim_arq_auth_set_ha2_info("FGET", f);
+    arim_arq_send_remote(cmdbuf);
+    sync_out = 1;
+    numch = snprintf(linebuf, sizeof(linebuf),
+                     "ARQ: File sync %s, sending %zu bytes of block sums", f, file_out.size);
+    if (numch >= sizeof(linebuf))
+        ui_truncate_line(linebuf, sizeof(linebuf));
+    bufq_queue_debug_log(linebuf);
+    file_out_cnt = 0;
+    ui_status_xfer_start(0, file_out.size, STATUS_XFER_DIR_UP);
+    arim_on_event(EV_ARQ_FILE_SEND_CMD_CLIENT, 0);
+    return 1;
+}
+
+int arim_arq_files_on_sync_ok()
+{
+    /* remote station acknowledged our /FSYNC block sums, delta comes next */
+    if (!sync_out)
+        return 0;
+    sync_out = 0;
+    return 1;
+}
+
 int arim_arq_files_on_client_fput(const char *fn, const char *destdir, int use_zoption)
 {
     /* called from cmd processor when user issues /FPUT at prompt */
@@ -1507,6 +2231,7 @@ int arim_arq_files_on_client_fput(const char *fn, const char *destdir, int use_z
     size_t len;
 
     zoption = use_zoption;
+    want = ARQ_CODEC_NONE;
     snprintf(fpath, sizeof(fpath), "%s", fn);
     /* replace stray '>' characters in file name string */
     f = strstr(fpath, ">");
@@ -25,11 +25,16 @@
 #define _ARIM_ARQ_FILES_H_INCLUDED_
 
 extern int arim_arq_files_on_send_cmd(void);
+extern void arim_arq_files_on_ok(const char *cmd);
+extern int arim_arq_files_on_unchanged(const char *cmd);
+extern int arim_arq_files_on_sync_ok(void);
 extern int arim_arq_files_on_fput(char *cmd, size_t size, char *eol, int arq_cs_role);
 extern int arim_arq_files_on_fget(char *cmd, size_t size, char *eol);
+extern int arim_arq_files_on_fsync(char *cmd, size_t size, char *eol);
 extern int arim_arq_files_on_flput(char *cmd, size_t size, char *eol);
 extern int arim_arq_files_on_flget(char *cmd, size_t size, char *eol);
 extern int arim_arq_files_on_client_fget(const char *cmd, const char *fn, const char *destdir, int use_zoption);
+extern int arim_arq_files_on_client_fsync(const char *fn, const char *destdir, int use_zoption);
 extern int arim_arq_files_on_client_fput(const char *fn, const char *destdir, int use_zoption);
 extern int arim_arq_files_on_client_flget(const char *cmd, const char *destdir, int use_zoption);
 extern int arim_arq_files_on_client_flist(const char *cmd);
@@ -41,6 +46,7 @@ extern int arim_arq_files_flist_on_rcv_frame(const char *data, size_t size);
 extern int arim_arq_files_flist_on_send_cmd(void);
 extern size_t arim_arq_files_flist_on_send_buffer(size_t size);
 extern void arim_arq_files_on_flget_done(void);
+extern void arim_arq_files_on_abort(void);
 
 #endif
 
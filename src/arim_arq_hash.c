@@ -0,0 +1,157 @@
+/***********************************************************************
+
+    ARIM Amateur Radio Instant Messaging program for the ARDOP TNC.
+
+    Copyright (C) 2016-2021 Robert Cunnings NW8L
+
+    This file is part of the ARIM messaging program.
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+*************************************************************************/
+
+
+
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include <pthread.h>
+#include <sys/stat.h>
+#include "main.h"
+#include "blake2.h"
+#include "auth.h"
+#include "arim_arq_hash.h"
+
+/* content hashes of shared and downloaded files, keyed by path and
+   stat data so a file is only hashed again after it changes. Both
+   timestamps are compared to the nanosecond, since a same-size edit
+   can land within the second the file was last hashed */
+typedef struct arq_hash_entry {
+    char path[MAX_PATH_SIZE];
+    struct timespec mtime;
+    struct timespec ctime;
+    off_t size;
+    ino_t ino;
+    unsigned long used;
+    unsigned char digest[ARQ_HASH_SIZE];
+} ARQ_HASH_ENTRY;
+
+static ARQ_HASH_ENTRY hash_cache[ARQ_HASH_CACHE_SIZE];
+static unsigned long hash_clock;
+static pthread_mutex_t mutex_hash = PTHREAD_MUTEX_INITIALIZER;
+
+static int arim_arq_hash_same_time(const struct timespec *a, const struct timespec *b)
+{
+    return (a->tv_sec == b->tv_sec && a->tv_nsec == b->tv_nsec);
+}
+
+static int arim_arq_hash_lookup(const char *fpath, const struct stat *st,
+                                unsigned char *digest)
+{
+    int i, result = 0;
+
+    pthread_mutex_lock(&mutex_hash);
+    for (i = 0; i < ARQ_HASH_CACHE_SIZE; i++) {
+        if (hash_cache[i].used && !strcmp(hash_cache[i].path, fpath) &&
+            arim_arq_hash_same_time(&hash_cache[i].mtime, &st->st_mtim) &&
+            arim_arq_hash_same_time(&hash_cache[i].ctime, &st->st_ctim) &&
+            hash_cache[i].size == st->st_size && hash_cache[i].ino == st->st_ino) {
+            memcpy(digest, hash_cache[i].digest, ARQ_HASH_SIZE);
+            hash_cache[i].used = ++hash_clock;
+            result = 1;
+            break;
+        }
+    }
+    pthread_mutex_unlock(&mutex_hash);
+    return result;
+}
+
+static void arim_arq_hash_store(const char *fpath, const struct stat *st,
+                                const unsigned char *digest)
+{
+    int i, slot = 0;
+
+    /* a file changed within the current second may change again without
+       its coarse timestamps moving, so don't trust it to the cache yet */
+    if (st->st_mtim.tv_sec >= time(NULL) || st->st_ctim.tv_sec >= time(NULL))
+        return;
+    pthread_mutex_lock(&mutex_hash);
+    /* reuse the entry for this path if any, else the least recently used */
+    for (i = 0; i < ARQ_HASH_CACHE_SIZE; i++) {
+        if (hash_cache[i].used && !strcmp(hash_cache[i].path, fpath)) {
+            slot = i;
+            break;
+        }
+        if (hash_cache[i].used < hash_cache[slot].used)
+            slot = i;
+    }
+    snprintf(hash_cache[slot].path, sizeof(hash_cache[slot].path), "%s", fpath);
+    hash_cache[slot].mtime = st->st_mtim;
+    hash_cache[slot].ctime = st->st_ctim;
+    hash_cache[slot].size = st->st_size;
+    hash_cache[slot].ino = st->st_ino;
+    hash_cache[slot].used = ++hash_clock;
+    memcpy(hash_cache[slot].digest, digest, ARQ_HASH_SIZE);
+    pthread_mutex_unlock(&mutex_hash);
+}
+
+int arim_arq_hash_file(const char *fpath, char *b64, size_t size)
+{
+    FILE *fp;
+    blake2s_state S;
+    struct stat st;
+    unsigned char buf[4096], digest[ARQ_HASH_SIZE];
+    size_t len;
+    int err;
+
+    if (stat(fpath, &st) || !S_ISREG(st.st_mode))
+        return 0;
+    if (!arim_arq_hash_lookup(fpath, &st, digest)) {
+        fp = fopen(fpath, "r");
+        if (!fp)
+            return 0;
+        blake2s_init(&S, ARQ_HASH_SIZE);
+        while ((len = fread(buf, 1, sizeof(buf), fp)) > 0)
+            blake2s_update(&S, buf, len);
+        err = ferror(fp);
+        fclose(fp);
+        if (err)
+            return 0;
+        blake2s_final(&S, digest, ARQ_HASH_SIZE);
+        arim_arq_hash_store(fpath, &st, digest);
+    }
+    return (NULL != auth_base64_encode(digest, ARQ_HASH_SIZE, b64, size));
+}
+
+int arim_arq_hash_parse(char **s, char *b64, size_t size)
+{
+    size_t len = 0;
+    char *p;
+
+    /* '#' token of /FGET carrying hash of requester's copy of the file */
+    p = *s;
+    if (*p != ARQ_HASH_TOKEN)
+        return 0;
+    ++p;
+    while (*p && *p != ' ') {
+        if (len + 1 < size)
+            b64[len++] = *p;
+        ++p;
+    }
+    b64[len] = '\0';
+    while (*p && *p == ' ')
+        ++p;
+    *s = p;
+    return (len > 0);
+}
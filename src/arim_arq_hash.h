@@ -0,0 +1,37 @@
+/***********************************************************************
+
+    ARIM Amateur Radio Instant Messaging program for the ARDOP TNC.
+
+    Copyright (C) 2016-2021 Robert Cunnings NW8L
+
+    This file is part of the ARIM messaging program.
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+*************************************************************************/
+
+
+
+#ifndef _ARIM_ARQ_HASH_H_INCLUDED_
+#define _ARIM_ARQ_HASH_H_INCLUDED_
+
+#define ARQ_HASH_SIZE           18      /* BLAKE2s digest bytes, no base64 padding */
+#define ARQ_HASH_B64_SIZE       32      /* base64 digest plus terminator */
+#define ARQ_HASH_CACHE_SIZE     32
+#define ARQ_HASH_TOKEN          '#'
+
+extern int arim_arq_hash_file(const char *fpath, char *b64, size_t size);
+extern int arim_arq_hash_parse(char **s, char *b64, size_t size);
+
+#endif
@@ -0,0 +1,234 @@
+/***********************************************************************
+
+    ARIM Amateur Radio Instant Messaging program for the ARDOP TNC.
+
+    Copyright (C) 2016-2021 Robert Cunnings NW8L
+
+    This file is part of the ARIM messaging program.
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+*************************************************************************/
+
+
+
+#include <string.h>
+#include "arim_arq_lz.h"
+
+/* Byte oriented LZ77 for stations short on CPU, trading ratio for speed.
+   Each control byte in a block body is either a literal run or a match:
+
+     000LLLLL                     L+1 literal bytes follow
+     LLLOOOOO OOOOOOOO            match of L+2 bytes at distance O+1
+     111OOOOO LLLLLLLL OOOOOOOO   match of L+9 bytes at distance O+1
+
+   so matches reach back up to 8192 bytes and run up to 264 bytes */
+#define LZ_HASH_BITS    13
+#define LZ_MAX_LIT      32
+#define LZ_MAX_OFF      8192
+#define LZ_MAX_REF      (7+255+2)
+
+static unsigned int lz_hash(const unsigned char *p)
+{
+    unsigned int v = (p[0] << 16) | (p[1] << 8) | p[2];
+
+    return (v * 2654435761U) >> (32 - LZ_HASH_BITS);
+}
+
+static int lz_literals(const unsigned char *p, size_t n, unsigned char *out,
+                       size_t outsize, size_t *op)
+{
+    size_t run;
+
+    while (n) {
+        run = n > LZ_MAX_LIT ? LZ_MAX_LIT : n;
+        if (*op + 1 + run > outsize)
+            return 0;
+        out[(*op)++] = run - 1;
+        memcpy(out + *op, p, run);
+        *op += run;
+        p += run;
+        n -= run;
+    }
+    return 1;
+}
+
+static size_t lz_compress(const unsigned char *in, size_t len,
+                          unsigned char *out, size_t outsize)
+{
+    /* positions + 1 of recent 3 byte sequences, 0 if none */
+    unsigned short htab[1 << LZ_HASH_BITS];
+    size_t ip = 0, anchor = 0, op = 0, ref, off, mlen, maxlen, k;
+
+    /* returns size of compressed data, or 0 if it exceeds outsize */
+    memset(htab, 0, sizeof(htab));
+    while (ip + 2 < len) {
+        k = lz_hash(in + ip);
+        ref = htab[k];
+        htab[k] = ip + 1;
+        if (ref && ip - ref < LZ_MAX_OFF && !memcmp(in + ref - 1, in + ip, 3)) {
+            --ref;
+            off = ip - ref - 1;
+            maxlen = len - ip > LZ_MAX_REF ? LZ_MAX_REF : len - ip;
+            mlen = 3;
+            while (mlen < maxlen && in[ref + mlen] == in[ip + mlen])
+                ++mlen;
+            if (!lz_literals(in + anchor, ip - anchor, out, outsize, &op))
+                return 0;
+            if (op + 3 > outsize)
+                return 0;
+            if (mlen - 2 < 7) {
+                out[op++] = ((mlen - 2) << 5) | (off >> 8);
+            } else {
+                out[op++] = (7 << 5) | (off >> 8);
+                out[op++] = mlen - 9;
+            }
+            out[op++] = off & 0xFF;
+            /* index the sequences inside the match too */
+            for (k = ip + 1; k < ip + mlen && k + 2 < len; k++)
+                htab[lz_hash(in + k)] = k + 1;
+            ip += mlen;
+            anchor = ip;
+        } else {
+            ++ip;
+        }
+    }
+    if (!lz_literals(in + anchor, len - anchor, out, outsize, &op))
+        return 0;
+    return op;
+}
+
+static int lz_decompress(const unsigned char *in, size_t len,
+                         unsigned char *out, size_t rawlen)
+{
+    size_t ip = 0, op = 0, n, off;
+    unsigned int c;
+
+    /* returns 1 if body decodes to exactly rawlen bytes, otherwise 0 */
+    while (ip < len) {
+        c = in[ip++];
+        if (c < LZ_MAX_LIT) {
+            n = c + 1;
+            if (ip + n > len || op + n > rawlen)
+                return 0;
+            memcpy(out + op, in + ip, n);
+            ip += n;
+            op += n;
+        } else {
+            n = c >> 5;
+            if (n == 7) {
+                if (ip >= len)
+                    return 0;
+                n += in[ip++];
+            }
+            n += 2;
+            if (ip >= len)
+                return 0;
+            off = (((c & 0x1F) << 8) | in[ip++]) + 1;
+            if (off > op || op + n > rawlen)
+                return 0;
+            /* byte at a time, source and destination may overlap */
+            while (n--) {
+                out[op] = out[op - off];
+                ++op;
+            }
+        }
+    }
+    return op == rawlen;
+}
+
+size_t arim_arq_lz_block(const unsigned char *in, size_t len, unsigned char *out)
+{
+    size_t n;
+
+    /* encode len bytes (at most ARQ_LZ_BLOCK_SIZE) as a block at out,
+       which must hold ARQ_LZ_BLOCK_MAX bytes. Data that doesn't compress
+       is stored as is, signalled by a body the same size as the data */
+    n = len > 1 ? lz_compress(in, len, out + ARQ_LZ_HDR_SIZE, len - 1) : 0;
+    if (!n) {
+        memcpy(out + ARQ_LZ_HDR_SIZE, in, len);
+        n = len;
+    }
+    out[0] = (len >> 8) & 0xFF;
+    out[1] = len & 0xFF;
+    out[2] = (n >> 8) & 0xFF;
+    out[3] = n & 0xFF;
+    return ARQ_LZ_HDR_SIZE + n;
+}
+
+int arim_arq_lz_block_hdr(const unsigned char *hdr, size_t *rawlen, size_t *bodylen)
+{
+    /* returns 1 if block header is valid, otherwise 0 */
+    *rawlen = (hdr[0] << 8) | hdr[1];
+    *bodylen = (hdr[2] << 8) | hdr[3];
+    return *rawlen && *rawlen <= ARQ_LZ_BLOCK_SIZE && *bodylen && *bodylen <= *rawlen;
+}
+
+int arim_arq_lz_unblock(const unsigned char *body, size_t bodylen,
+                        unsigned char *out, size_t rawlen)
+{
+    /* returns 1 on success, 0 if the block is bad */
+    if (bodylen == rawlen) {
+        memcpy(out, body, rawlen);
+        return 1;
+    }
+    return lz_decompress(body, bodylen, out, rawlen);
+}
+
+int arim_arq_lz_compress(const void *in, size_t len, unsigned char *out,
+                         size_t outsize, size_t *outlen)
+{
+    unsigned char block[ARQ_LZ_BLOCK_MAX];
+    const unsigned char *p = in;
+    size_t n, cnt = 0;
+
+    /* returns 1 on success or 0 if the result exceeds outsize */
+    while (len) {
+        n = len > ARQ_LZ_BLOCK_SIZE ? ARQ_LZ_BLOCK_SIZE : len;
+        n = arim_arq_lz_block(p, n, block);
+        if (cnt + n > outsize)
+            return 0;
+        memcpy(out + cnt, block, n);
+        cnt += n;
+        n = (block[0] << 8) | block[1];
+        p += n;
+        len -= n;
+    }
+    *outlen = cnt;
+    return 1;
+}
+
+int arim_arq_lz_decompress(const unsigned char *in, size_t len, unsigned char *out,
+                           size_t outsize, size_t *outlen)
+{
+    size_t rawlen, bodylen, cnt = 0;
+
+    /* returns 1 on success, 0 if the result exceeds outsize
+       or -1 if the compressed data is bad */
+    while (len) {
+        if (len < ARQ_LZ_HDR_SIZE || !arim_arq_lz_block_hdr(in, &rawlen, &bodylen) ||
+            len < ARQ_LZ_HDR_SIZE + bodylen)
+            return -1;
+        if (cnt + rawlen > outsize)
+            return 0;
+        if (!arim_arq_lz_unblock(in + ARQ_LZ_HDR_SIZE, bodylen, out + cnt, rawlen))
+            return -1;
+        cnt += rawlen;
+        in += ARQ_LZ_HDR_SIZE + bodylen;
+        len -= ARQ_LZ_HDR_SIZE + bodylen;
+    }
+    *outlen = cnt;
+    return 1;
+}
+
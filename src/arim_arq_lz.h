@@ -0,0 +1,47 @@
+/***********************************************************************
+
+    ARIM Amateur Radio Instant Messaging program for the ARDOP TNC.
+
+    Copyright (C) 2016-2021 Robert Cunnings NW8L
+
+    This file is part of the ARIM messaging program.
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+*************************************************************************/
+
+
+
+#ifndef _ARIM_ARQ_LZ_H_INCLUDED_
+#define _ARIM_ARQ_LZ_H_INCLUDED_
+
+#include <stddef.h>
+
+/* -zlz payloads are a series of blocks, each a 4 byte header giving
+   the uncompressed and stored sizes followed by the block body */
+#define ARQ_LZ_BLOCK_SIZE       16384
+#define ARQ_LZ_HDR_SIZE         4
+#define ARQ_LZ_BLOCK_MAX        (ARQ_LZ_HDR_SIZE+ARQ_LZ_BLOCK_SIZE)
+
+extern size_t arim_arq_lz_block(const unsigned char *in, size_t len, unsigned char *out);
+extern int arim_arq_lz_block_hdr(const unsigned char *hdr, size_t *rawlen, size_t *bodylen);
+extern int arim_arq_lz_unblock(const unsigned char *body, size_t bodylen,
+                               unsigned char *out, size_t rawlen);
+extern int arim_arq_lz_compress(const void *in, size_t len, unsigned char *out,
+                                size_t outsize, size_t *outlen);
+extern int arim_arq_lz_decompress(const unsigned char *in, size_t len, unsigned char *out,
+                                  size_t outsize, size_t *outlen);
+
+#endif
+
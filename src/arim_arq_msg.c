@@ -41,60 +41,54 @@
 #include "arim_arq.h"
 #include "arim_arq_auth.h"
 #include "arim_arq_msg.h"
+#include "arim_arq_codec.h"
 #include "auth.h"
 
 static MSGQUEUEITEM msg_in;
 static MSGQUEUEITEM msg_out;
 static size_t msg_in_cnt, msg_out_cnt;
 static char headers[MAX_MGET_HEADERS][MAX_MBOX_HDR_SIZE];
-static int zoption, num_msgs, next_msg, send_done;
+static char batch[MAX_MGET_HEADERS][MAX_UNCOMP_DATA_SIZE];
+static int zoption, codec, batch_zoption, batch_want, num_msgs, next_msg, send_done;
 
 int arim_arq_msg_on_send_cmd(const char *data, int use_zoption)
 {
-    char linebuf[MAX_LOG_LINE_SIZE];
-    z_stream zs;
-    int zret;
+    char linebuf[MAX_LOG_LINE_SIZE], zflag[ARQ_CODEC_FLAG_SIZE];
+    int result;
 
     zoption = use_zoption;
+    codec = ARQ_CODEC_NONE;
     /* copy into buffer, will be sent later by arim_arq_msg_on_send_cmd() */
     if (zoption) {
-        zs.zalloc = Z_NULL;
-        zs.zfree = Z_NULL;
-        zs.opaque = Z_NULL;
-        zs.avail_in = strlen(data);
-        zs.next_in = (Bytef *)data;
-        zs.avail_out = sizeof(msg_out.data);
-        zs.next_out = (Bytef *)msg_out.data;
-        zret = deflateInit(&zs, Z_BEST_COMPRESSION);
-        if (zret == Z_OK) {
-            zret = deflate(&zs, Z_FINISH);
-            deflateEnd(&zs);
-            if (zret != Z_STREAM_END) {
-                ui_show_dialog("\tCannot send message:\n"
-                               "\tcompression failed.\n \n\t[O]k", "oO \n");
-                snprintf(linebuf, sizeof(linebuf),
-                                "ARQ: Message upload failed, compression error");
-                bufq_queue_debug_log(linebuf);
-                return 0;
-            }
-            msg_out.size = zs.total_out;
-        } else {
+        /* codec asked for by /MGET applies to its batch only */
+        result = arim_arq_codec_encode(num_msgs ? batch_want : ARQ_CODEC_NONE,
+                                       data, strlen(data), (unsigned char *)msg_out.data,
+                                       sizeof(msg_out.data), &msg_out.size, &codec);
+        if (result == 0 && strlen(data) < sizeof(msg_out.data)) {
+            /* message doesn't compress, so send it as is */
+            snprintf(linebuf, sizeof(linebuf),
+                            "ARQ: Message does not compress, sending uncompressed");
+            bufq_queue_debug_log(linebuf);
+            zoption = 0;
+            codec = ARQ_CODEC_NONE;
+        } else if (result != 1) {
             ui_show_dialog("\tCannot send message:\n"
                            "\tcompression failed.\n \n\t[O]k", "oO \n");
             snprintf(linebuf, sizeof(linebuf),
-                            "ARQ: Message upload failed, compression init error");
+                            "ARQ: Message upload failed, compression error");
             bufq_queue_debug_log(linebuf);
             return 0;
         }
-    } else {
+    }
+    if (!zoption) {
         snprintf(msg_out.data, sizeof(msg_out.data), "%s", data);
         msg_out.size = strlen(msg_out.data);
     }
     msg_out.check = ccitt_crc16((unsigned char *)msg_out.data, msg_out.size);
     arim_copy_remote_call(msg_out.call, sizeof(msg_out.call));
     /* enqueue command for TNC */
-    snprintf(linebuf, sizeof(linebuf),
-        "%s %s %zu %04X", zoption ? "/MPUT -z" : "/MPUT",
+    snprintf(linebuf, sizeof(linebuf), "/MPUT%s %s %zu %04X",
+        arim_arq_codec_flag(codec, zflag, sizeof(zflag)),
             msg_out.call, msg_out.size, msg_out.check);
     arim_arq_send_remote(linebuf);
     /* initialize count and start progress meter */
@@ -109,9 +103,11 @@ int arim_arq_msg_on_send_msg()
 {
     char linebuf[MAX_LOG_LINE_SIZE];
 
-    pthread_mutex_lock(&mutex_msg_out);
-    msgq_push(&g_msg_out_q, &msg_out);
-    pthread_mutex_unlock(&mutex_msg_out);
+    if (!bufq_queue_msg_out(&msg_out)) {
+        bufq_queue_debug_log("ARQ: Message upload failed, outbound queue full");
+        arim_on_event(EV_ARQ_MSG_ERROR, 0);
+        return 0;
+    }
     snprintf(linebuf, sizeof(linebuf), "ARQ: Message upload buffered for sending");
     bufq_queue_debug_log(linebuf);
     send_done = 0;
@@ -164,9 +160,9 @@ int arim_arq_msg_on_rcv_frame(const char *data, size_t size)
     char remote_call[TNC_MYCALL_SIZE], target_call[TNC_MYCALL_SIZE];
     char *hdr, linebuf[MAX_LOG_LINE_SIZE];
     unsigned int check;
-    z_stream zs;
     char zbuffer[MAX_UNCOMP_DATA_SIZE];
-    int zret;
+    size_t len;
+    int result;
 
     /* buffer data, increment count of bytes */
     if (msg_in_cnt + size > sizeof(msg_in.data)) {
@@ -214,36 +210,21 @@ int arim_arq_msg_on_rcv_frame(const char *data, size_t size)
             return 0;
         }
         if (zoption) {
-            zs.zalloc = Z_NULL;
-            zs.zfree = Z_NULL;
-            zs.opaque = Z_NULL;
-            zs.avail_in = msg_in.size;
-            zs.next_in = (Bytef *)msg_in.data;
-            zs.avail_out = sizeof(zbuffer) - 1; /* leave room for null termination */
-            zs.next_out = (Bytef *)zbuffer;
-            zret = inflateInit(&zs);
-            if (zret == Z_OK) {
-                zret = inflate(&zs, Z_FINISH);
-                inflateEnd(&zs);
-                if (zret != Z_STREAM_END) {
-                    snprintf(linebuf, sizeof(linebuf),
-                        "ARQ: Message download failed, decompression error");
-                    bufq_queue_debug_log(linebuf);
-                    snprintf(linebuf, sizeof(linebuf), "/ERROR Message size exceeds limit");
-                    arim_arq_send_remote(linebuf);
-                    arim_on_event(EV_ARQ_MSG_ERROR, 0);
-                    return 0;
-                }
-            } else {
+            /* leave room for null termination */
+            result = arim_arq_codec_decode(codec, (unsigned char *)msg_in.data, msg_in.size,
+                                           (unsigned char *)zbuffer, sizeof(zbuffer) - 1, &len);
+            if (result != 1) {
                 snprintf(linebuf, sizeof(linebuf),
-                    "ARQ: Message download failed, decompression initialization error");
+                    "ARQ: Message download failed, %s",
+                        result ? "decompression error" : "decompressed size exceeds limit");
                 bufq_queue_debug_log(linebuf);
-                snprintf(linebuf, sizeof(linebuf), "/ERROR Decompression failed");
+                snprintf(linebuf, sizeof(linebuf), "/ERROR %s",
+                    result ? "Decompression failed" : "Message size exceeds limit");
                 arim_arq_send_remote(linebuf);
                 arim_on_event(EV_ARQ_MSG_ERROR, 0);
                 return 0;
             }
-            msg_in.size = zs.total_out;
+            msg_in.size = len;
             zbuffer[msg_in.size] = '\0'; /* restore terminating null */
             msg_in.check = ccitt_crc16((unsigned char *)zbuffer, msg_in.size);
         }
@@ -263,15 +244,13 @@ int arim_arq_msg_on_rcv_frame(const char *data, size_t size)
             return 0;
         }
         /* add message header to recents list */
-        pthread_mutex_lock(&mutex_recents);
-        cmdq_push(&g_recents_q, hdr);
-        pthread_mutex_unlock(&mutex_recents);
+        bufq_queue_recents(hdr);
         snprintf(linebuf, sizeof(linebuf),
             "ARQ: Saved %s message %zu bytes, checksum %04X",
                zoption ? "compressed" : "uncompressed",  msg_in_cnt, check);
         bufq_queue_debug_log(linebuf);
         snprintf(linebuf, sizeof(linebuf),
-            "/OK Message %zu %04X saved", msg_in_cnt, check);
+            "/OK Message %zu %04X saved%s", msg_in_cnt, check, arim_arq_codec_advert());
         arim_arq_send_remote(linebuf);
         arim_on_event(EV_ARQ_MSG_RCV_DONE, 0);
     }
@@ -280,79 +259,74 @@ int arim_arq_msg_on_rcv_frame(const char *data, size_t size)
 
 int arim_arq_msg_on_send_first(const char *remote_call, int max_msgs)
 {
-    char linebuf[MAX_LOG_LINE_SIZE], msgbuffer[MAX_UNCOMP_DATA_SIZE];
+    char linebuf[MAX_LOG_LINE_SIZE];
 
     next_msg = 0;
     if (max_msgs > MAX_MGET_HEADERS || max_msgs == 0)
         max_msgs = MAX_MGET_HEADERS;
-    /* get up to max_msgs message headers To: remote_call */
-    num_msgs = mbox_get_headers_to(headers, max_msgs,
-                                       MBOX_OUTBOX_FNAME, remote_call);
+    /* read up to max_msgs messages To: remote_call in one pass; they stay
+       in the outbox until the remote station has acknowledged all of them */
+    num_msgs = mbox_get_msgs_to(headers, batch[0], sizeof(batch[0]), max_msgs,
+                                    MBOX_OUTBOX_FNAME, remote_call);
     if (!num_msgs)
         return 0;
-    if (mbox_get_msg(msgbuffer, sizeof(msgbuffer),
-                        MBOX_OUTBOX_FNAME, headers[next_msg], 0)) {
-        snprintf(linebuf, sizeof(linebuf),
-            "ARQ: Sending message %d of %d, [%s]",
-                next_msg + 1, num_msgs, headers[next_msg]);
-        bufq_queue_debug_log(linebuf);
-        arim_arq_msg_on_send_cmd(msgbuffer, zoption);
-        return 1;
-    } else {
-        snprintf(linebuf, sizeof(linebuf), "/ERROR Cannot find message");
-        arim_arq_send_remote(linebuf);
-        snprintf(linebuf, sizeof(linebuf),
-            "ARQ: Failed to read message %d of %d, %s",
-                next_msg, num_msgs, headers[next_msg]);
-        bufq_queue_debug_log(linebuf);
-    }
-    /* failed, reset counters */
-    num_msgs = next_msg = 0;
-    return 0;
+    /* a message sent uncompressed mustn't change the rest of the batch */
+    batch_zoption = zoption;
+    snprintf(linebuf, sizeof(linebuf),
+        "ARQ: Sending message %d of %d, [%s]",
+            next_msg + 1, num_msgs, headers[next_msg]);
+    bufq_queue_debug_log(linebuf);
+    arim_arq_msg_on_send_cmd(batch[next_msg], batch_zoption);
+    return 1;
 }
 
 int arim_arq_msg_on_send_next()
 {
-    char linebuf[MAX_LOG_LINE_SIZE], msgbuffer[MAX_UNCOMP_DATA_SIZE];
+    char linebuf[MAX_LOG_LINE_SIZE];
+    int cnt;
 
-    /* send next message if available */
+    /* previous message acknowledged, send next one if available */
     if (next_msg < num_msgs) {
-        /* delete previous message from mbox */
-        if (!mbox_delete_msg(MBOX_OUTBOX_FNAME, headers[next_msg])) {
-            /* log, but don't stop if deletion fails */
+        ++next_msg;
+        if (next_msg < num_msgs) {
             snprintf(linebuf, sizeof(linebuf),
-                "ARQ: Failed to delete message %d of %d, %s", next_msg, num_msgs, headers[next_msg]);
+                "ARQ: Sending message %d of %d, [%s]", next_msg + 1, num_msgs, headers[next_msg]);
             bufq_queue_debug_log(linebuf);
+            arim_arq_msg_on_send_cmd(batch[next_msg], batch_zoption);
+            return 1;
         }
-        ++next_msg;
-        if (next_msg < num_msgs) {
-            if (mbox_get_msg(msgbuffer, sizeof(msgbuffer),
-                        MBOX_OUTBOX_FNAME, headers[next_msg], 0)) {
-                snprintf(linebuf, sizeof(linebuf),
-                    "ARQ: Sending message %d of %d, [%s]", next_msg + 1, num_msgs, headers[next_msg]);
-                bufq_queue_debug_log(linebuf);
-                arim_arq_msg_on_send_cmd(msgbuffer, zoption);
-                return 1;
-            } else {
-                /* failed to read message, send /ERROR response */
-                snprintf(linebuf, sizeof(linebuf), "/ERROR Cannot find message");
-                arim_arq_send_remote(linebuf);
-                snprintf(linebuf, sizeof(linebuf),
-                    "ARQ: Failed to read message %d of %d, %s", next_msg, num_msgs, headers[next_msg]);
-                bufq_queue_debug_log(linebuf);
-            }
-        } else {
-            /* all done */
+        /* all done, commit the batch by deleting it from the outbox */
+        cnt = mbox_delete_msgs(MBOX_OUTBOX_FNAME, headers, num_msgs);
+        if (cnt < num_msgs) {
+            /* log, but don't fail the transfer if deletion fails */
             snprintf(linebuf, sizeof(linebuf),
-                "/OK Done, %d of %d messages", next_msg, num_msgs);
-            arim_arq_send_remote(linebuf);
+                "ARQ: Failed to delete %d of %d sent messages", num_msgs - cnt, num_msgs);
+            bufq_queue_debug_log(linebuf);
         }
+        snprintf(linebuf, sizeof(linebuf),
+            "/OK Done, %d of %d messages", next_msg, num_msgs);
+        arim_arq_send_remote(linebuf);
     }
     /* done, reset counters */
     num_msgs = next_msg = 0;
     return 0;
 }
 
+int arim_arq_msg_on_send_cancel()
+{
+    char linebuf[MAX_LOG_LINE_SIZE];
+
+    /* batch not acknowledged in full, leave it in the outbox */
+    if (next_msg < num_msgs) {
+        snprintf(linebuf, sizeof(linebuf),
+            "ARQ: Message transfer stopped after %d of %d, messages kept in outbox",
+                next_msg, num_msgs);
+        bufq_queue_debug_log(linebuf);
+    }
+    num_msgs = next_msg = 0;
+    return 1;
+}
+
 int arim_arq_msg_on_mget(char *cmd, size_t size, char *eol)
 {
     char *p_args, *s, *e;
@@ -360,6 +334,7 @@ int arim_arq_msg_on_mget(char *cmd, size_t size, char *eol)
     int result, num_msgs = 0;
 
     zoption = 0;
+    batch_want = ARQ_CODEC_NONE;
     p_args = NULL;
     /* empty outbound data buffer before handling file request */
     while (arim_get_buffer_cnt() > 0)
@@ -370,7 +345,10 @@ int arim_arq_msg_on_mget(char *cmd, size_t size, char *eol)
         ++s;
     if (*s && (s == strstr(s, "-z"))) {
         zoption = 1;
-        s += 2;
+        /* -z<codec> asks for a codec, plain -z leaves it to us */
+        batch_want = arim_arq_codec_parse(&s);
+        if (batch_want == ARQ_CODEC_ZLIB || batch_want < 0)
+            batch_want = ARQ_CODEC_NONE;
         while (*s && *s == ' ')
             ++s;
     }
@@ -412,6 +390,7 @@ int arim_arq_msg_on_mput(char *cmd, size_t size, char *eol)
     char linebuf[MAX_LOG_LINE_SIZE];
 
     zoption = 0;
+    codec = ARQ_CODEC_NONE;
     /* inbound message transfer, get parameters */
     p_size = p_check = 0;
     e = cmd + 6;
@@ -419,10 +398,20 @@ int arim_arq_msg_on_mput(char *cmd, size_t size, char *eol)
         ++e;
     if (*e && (e == strstr(e, "-z"))) {
         zoption = 1;
-        e += 2;
+        /* -z<codec>, encoded with the codec named */
+        codec = arim_arq_codec_parse(&e);
         while (*e && *e == ' ')
             ++e;
     }
+    if (codec < 0) {
+        snprintf(linebuf, sizeof(linebuf),
+            "ARQ: Message download failed, unknown codec");
+        bufq_queue_debug_log(linebuf);
+        snprintf(linebuf, sizeof(linebuf), "/ERROR Unknown codec");
+        arim_arq_send_remote(linebuf);
+        arim_on_event(EV_ARQ_MSG_ERROR, 0);
+        return 1;
+    }
     p_name = e;
     if (*p_name) {
         while (*e && *e != ' ') {
@@ -481,38 +470,20 @@ int arim_arq_msg_on_mput(char *cmd, size_t size, char *eol)
 int arim_arq_msg_on_ok()
 {
     char linebuf[MAX_LOG_LINE_SIZE];
-    z_stream zs;
     char zbuffer[MAX_UNCOMP_DATA_SIZE];
-    int zret;
+    size_t len;
 
     if (zoption) {
-        zs.zalloc = Z_NULL;
-        zs.zfree = Z_NULL;
-        zs.opaque = Z_NULL;
-        zs.avail_in = msg_out.size;
-        zs.next_in = (Bytef *)msg_out.data;
-        zs.avail_out = sizeof(zbuffer);
-        zs.next_out = (Bytef *)zbuffer;
-        zret = inflateInit(&zs);
-        if (zret == Z_OK) {
-            zret = inflate(&zs, Z_FINISH);
-            inflateEnd(&zs);
-            if (zret != Z_STREAM_END) {
-                snprintf(linebuf, sizeof(linebuf),
-                    "ARQ: Unable to save sent message, decompression failed");
-                bufq_queue_debug_log(linebuf);
-                return 0;
-            } else {
-                msg_out.size = zs.total_out;
-                zbuffer[msg_out.size] = '\0';
-                msg_out.check = ccitt_crc16((unsigned char *)zbuffer, msg_out.size);
-            }
-        } else {
+        if (arim_arq_codec_decode(codec, (unsigned char *)msg_out.data, msg_out.size,
+                                  (unsigned char *)zbuffer, sizeof(zbuffer) - 1, &len) != 1) {
             snprintf(linebuf, sizeof(linebuf),
-                "ARQ: Unable to save sent message, decompression init error");
+                "ARQ: Unable to save sent message, decompression failed");
             bufq_queue_debug_log(linebuf);
             return 0;
         }
+        msg_out.size = len;
+        zbuffer[msg_out.size] = '\0';
+        msg_out.check = ccitt_crc16((unsigned char *)zbuffer, msg_out.size);
     }
     /* store message to sent messages mailbox */
     arim_copy_mycall(linebuf, sizeof(linebuf));
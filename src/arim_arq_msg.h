@@ -40,6 +40,7 @@ extern int arim_arq_msg_on_client_mget(const char *cmd,
 extern int arim_arq_msg_on_mget(char *cmd, size_t size, char *eol);
 extern int arim_arq_msg_on_send_first(const char *remote_call, int max_msgs);
 extern int arim_arq_msg_on_send_next(void);
+extern int arim_arq_msg_on_send_cancel(void);
 
 #endif
 
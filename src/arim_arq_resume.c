@@ -0,0 +1,168 @@
+/***********************************************************************
+
+    ARIM Amateur Radio Instant Messaging program for the ARDOP TNC.
+
+    Copyright (C) 2016-2021 Robert Cunnings NW8L
+
+    This file is part of the ARIM messaging program.
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+*************************************************************************/
+
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <dirent.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include "main.h"
+#include "ini.h"
+#include "bufq.h"
+#include "ui.h"
+#include "arim_arq_resume.h"
+
+int arim_arq_resume_enabled()
+{
+    return (atoi(g_arim_settings.resume_max_days) > 0);
+}
+
+void arim_arq_resume_path(char *buf, size_t bufsize, const char *dpath,
+                          const char *call, const char *name, const char *ext)
+{
+    char *p, scall[TNC_MYCALL_SIZE];
+
+    /* hidden file next to the destination, call signs may contain '/' */
+    snprintf(scall, sizeof(scall), "%s", call);
+    for (p = scall; *p; p++) {
+        if (*p == '/')
+            *p = '_';
+    }
+    snprintf(buf, bufsize, "%s/.%s.%s%s", dpath, name, scall, ext);
+}
+
+int arim_arq_resume_load(ARQ_RESUME *jnl, const char *dpath,
+                         const char *call, const char *name)
+{
+    FILE *fp;
+    struct stat stats;
+    char fpath[MAX_PATH_SIZE*2], linebuf[MAX_LOG_LINE_SIZE];
+    int numch, result = 0;
+
+    if (!arim_arq_resume_enabled())
+        return 0;
+    arim_arq_resume_path(fpath, sizeof(fpath), dpath, call, name, ARQ_RESUME_JNL_EXT);
+    fp = fopen(fpath, "r");
+    if (!fp)
+        return 0;
+    if (5 == fscanf(fp, "%zu %x %d %zu %x", &jnl->size, &jnl->check,
+                    &jnl->codec, &jnl->offset, &jnl->cs)) {
+        /* partial file must hold at least the journaled count of bytes */
+        arim_arq_resume_path(fpath, sizeof(fpath), dpath, call, name, ARQ_RESUME_PART_EXT);
+        if (stat(fpath, &stats) == 0 && (size_t)stats.st_size >= jnl->offset &&
+            jnl->offset > 0 && jnl->offset < jnl->size)
+            result = 1;
+    }
+    fclose(fp);
+    if (!result) {
+        arim_arq_resume_remove(dpath, call, name);
+        return 0;
+    }
+    numch = snprintf(linebuf, sizeof(linebuf),
+                     "ARQ: Found partial download %s from %s, %zu of %zu bytes",
+                         name, call, jnl->offset, jnl->size);
+    if (numch >= sizeof(linebuf))
+        ui_truncate_line(linebuf, sizeof(linebuf));
+    bufq_queue_debug_log(linebuf);
+    return 1;
+}
+
+int arim_arq_resume_save(const ARQ_RESUME *jnl, const char *dpath,
+                         const char *call, const char *name)
+{
+    FILE *fp;
+    char fpath[MAX_PATH_SIZE*2], tpath[MAX_PATH_SIZE*2+4];
+    int result;
+
+    /* write a new journal and rename it over the old one, so a crash
+       leaves either the previous or the current count of bytes */
+    arim_arq_resume_path(fpath, sizeof(fpath), dpath, call, name, ARQ_RESUME_JNL_EXT);
+    snprintf(tpath, sizeof(tpath), "%s.tmp", fpath);
+    fp = fopen(tpath, "w");
+    if (!fp)
+        return 0;
+    fprintf(fp, "%zu %04X %d %zu %04X\n", jnl->size, jnl->check,
+            jnl->codec, jnl->offset, jnl->cs);
+    result = (fclose(fp) == 0);
+    if (result && rename(tpath, fpath) == -1)
+        result = 0;
+    if (!result)
+        unlink(tpath);
+    return result;
+}
+
+void arim_arq_resume_remove(const char *dpath, const char *call, const char *name)
+{
+    char fpath[MAX_PATH_SIZE*2];
+
+    arim_arq_resume_path(fpath, sizeof(fpath), dpath, call, name, ARQ_RESUME_JNL_EXT);
+    unlink(fpath);
+    arim_arq_resume_path(fpath, sizeof(fpath), dpath, call, name, ARQ_RESUME_PART_EXT);
+    unlink(fpath);
+}
+
+void arim_arq_resume_purge(const char *dpath)
+{
+    DIR *dirp;
+    struct dirent *dent;
+    struct stat stats;
+    char fpath[MAX_PATH_SIZE*2], linebuf[MAX_LOG_LINE_SIZE];
+    size_t len, elen;
+    time_t cutoff;
+    int days, numch;
+
+    /* partial files and journals not touched within resume-max-days are
+       stale, the sender has likely moved on */
+    days = atoi(g_arim_settings.resume_max_days);
+    if (days <= 0)
+        return;
+    cutoff = time(NULL) - (time_t)days * 24 * 60 * 60;
+    dirp = opendir(dpath);
+    if (!dirp)
+        return;
+    while ((dent = readdir(dirp))) {
+        if (dent->d_name[0] != '.')
+            continue;
+        len = strlen(dent->d_name);
+        elen = strlen(ARQ_RESUME_PART_EXT);
+        if (len <= elen || strcmp(dent->d_name + len - elen, ARQ_RESUME_PART_EXT)) {
+            elen = strlen(ARQ_RESUME_JNL_EXT);
+            if (len <= elen || strcmp(dent->d_name + len - elen, ARQ_RESUME_JNL_EXT))
+                continue;
+        }
+        snprintf(fpath, sizeof(fpath), "%s/%s", dpath, dent->d_name);
+        if (stat(fpath, &stats) == 0 && S_ISREG(stats.st_mode) &&
+            stats.st_mtime < cutoff) {
+            unlink(fpath);
+            numch = snprintf(linebuf, sizeof(linebuf),
+                             "ARQ: Removed stale partial download file %s", fpath);
+            if (numch >= sizeof(linebuf))
+                ui_truncate_line(linebuf, sizeof(linebuf));
+            bufq_queue_debug_log(linebuf);
+        }
+    }
+    closedir(dirp);
+}
@@ -0,0 +1,51 @@
+/***********************************************************************
+
+    ARIM Amateur Radio Instant Messaging program for the ARDOP TNC.
+
+    Copyright (C) 2016-2021 Robert Cunnings NW8L
+
+    This file is part of the ARIM messaging program.
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+*************************************************************************/
+
+
+#ifndef _ARIM_ARQ_RESUME_H_INCLUDED_
+#define _ARIM_ARQ_RESUME_H_INCLUDED_
+
+#define ARQ_RESUME_PART_EXT     ".part"
+#define ARQ_RESUME_JNL_EXT      ".jnl"
+
+/* journal kept beside a partially received ARQ file, keyed by
+   destination dir, file name and remote call sign */
+typedef struct arq_resume {
+    size_t size;            /* size of payload being received */
+    unsigned int check;     /* sender's checksum of whole payload */
+    int codec;              /* codec of payload, ARQ_CODEC_NONE if raw */
+    size_t offset;          /* count of payload bytes received so far */
+    unsigned int cs;        /* running checksum of bytes received so far */
+} ARQ_RESUME;
+
+extern int arim_arq_resume_enabled(void);
+extern void arim_arq_resume_path(char *buf, size_t bufsize, const char *dpath,
+                                 const char *call, const char *name, const char *ext);
+extern int arim_arq_resume_load(ARQ_RESUME *jnl, const char *dpath,
+                                const char *call, const char *name);
+extern int arim_arq_resume_save(const ARQ_RESUME *jnl, const char *dpath,
+                                const char *call, const char *name);
+extern void arim_arq_resume_remove(const char *dpath, const char *call, const char *name);
+extern void arim_arq_resume_purge(const char *dpath);
+
+#endif
@@ -0,0 +1,442 @@
+/***********************************************************************
+
+    ARIM Amateur Radio Instant Messaging program for the ARDOP TNC.
+
+    Copyright (C) 2016-2021 Robert Cunnings NW8L
+
+    This file is part of the ARIM messaging program.
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+*************************************************************************/
+
+
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include "blake2.h"
+#include "arim_arq_hash.h"
+#include "arim_arq_sync.h"
+
+/*
+ * Block-level delta transfer for /FSYNC, after rsync. The station with the
+ * old copy of a file sends its block size and length, then a weak rolling
+ * checksum and a truncated BLAKE2s hash of each block of the old copy:
+ *
+ *   [block size:4][old size:4] { [weak:4][strong:6] } ...
+ *
+ * The station with the new copy slides a block-sized window over it,
+ * looks up the weak sum of the window and confirms a hit with the strong
+ * hash. It replies with a delta:
+ *
+ *   [block size:4][new size:4][BLAKE2s of new copy:ARQ_HASH_SIZE] { op } 0
+ *
+ * where op is 1 [len:2] followed by len literal bytes, or 2 [block:2]
+ * [count:2] to copy count consecutive blocks of the old copy. Fields are
+ * big-endian. The receiver checks the size and hash of the rebuilt file.
+ */
+
+#define SYNC_OP_END             0
+#define SYNC_OP_LITERAL         1
+#define SYNC_OP_COPY            2
+#define SYNC_MAX_LITERAL        65535
+#define SYNC_MAX_RUN            65535
+#define SYNC_DELTA_HDR_SIZE     (8+ARQ_HASH_SIZE)
+#define SYNC_HASH_BITS          12
+#define SYNC_MIN_BUF_SIZE       65536
+
+typedef struct sync_out {
+    FILE *fp;
+    int run_start, run_count;
+    size_t literal, matched;
+    int err;
+} SYNC_OUT;
+
+static void sync_put16(unsigned char *p, unsigned int v)
+{
+    p[0] = (v >> 8) & 0xFF;
+    p[1] = v & 0xFF;
+}
+
+static void sync_put32(unsigned char *p, unsigned int v)
+{
+    sync_put16(p, v >> 16);
+    sync_put16(p + 2, v);
+}
+
+static unsigned int sync_get16(const unsigned char *p)
+{
+    return (p[0] << 8) | p[1];
+}
+
+static unsigned int sync_get32(const unsigned char *p)
+{
+    return (sync_get16(p) << 16) | sync_get16(p + 2);
+}
+
+static unsigned int sync_weak(const unsigned char *p, size_t len)
+{
+    unsigned int a = 0, b = 0;
+    size_t i;
+
+    /* rsync's rolling checksum, sum of bytes in low half and sum
+       of bytes weighted by distance from end of block in high half */
+    for (i = 0; i < len; i++) {
+        a += p[i];
+        b += (unsigned int)(len - i) * p[i];
+    }
+    return (a & 0xFFFF) | (b << 16);
+}
+
+static void sync_strong(const unsigned char *p, size_t len, unsigned char *out)
+{
+    blake2s(out, ARQ_SYNC_STRONG_SIZE, p, len, NULL, 0);
+}
+
+static unsigned int sync_hash(unsigned int weak)
+{
+    return (weak ^ (weak >> SYNC_HASH_BITS) ^ (weak >> 24)) & ((1 << SYNC_HASH_BITS) - 1);
+}
+
+static size_t sync_block_size(size_t size)
+{
+    size_t bs = ARQ_SYNC_MIN_BLOCK;
+
+    /* near sqrt(size * sum size) balances the signature against the
+       literal data resent around each edit, then grow to fit the limit */
+    while (bs < ARQ_SYNC_MAX_BLOCK && bs * bs < size * ARQ_SYNC_SUM_SIZE)
+        bs <<= 1;
+    while (bs < ARQ_SYNC_MAX_BLOCK && (size + bs - 1) / bs > ARQ_SYNC_MAX_BLOCKS)
+        bs <<= 1;
+    return bs;
+}
+
+static void sync_emit_run(SYNC_OUT *o)
+{
+    unsigned char op[5];
+
+    if (!o->run_count)
+        return;
+    op[0] = SYNC_OP_COPY;
+    sync_put16(op + 1, o->run_start);
+    sync_put16(op + 3, o->run_count);
+    if (fwrite(op, 1, sizeof(op), o->fp) != sizeof(op))
+        o->err = 1;
+    o->matched += o->run_count;
+    o->run_count = 0;
+}
+
+static void sync_emit_literal(SYNC_OUT *o, const unsigned char *p, size_t len)
+{
+    unsigned char op[3];
+    size_t n;
+
+    if (len)
+        sync_emit_run(o);
+    while (len) {
+        n = len > SYNC_MAX_LITERAL ? SYNC_MAX_LITERAL : len;
+        op[0] = SYNC_OP_LITERAL;
+        sync_put16(op + 1, n);
+        if (fwrite(op, 1, sizeof(op), o->fp) != sizeof(op) ||
+            fwrite(p, 1, n, o->fp) != n)
+            o->err = 1;
+        o->literal += n;
+        p += n;
+        len -= n;
+    }
+}
+
+static void sync_emit_copy(SYNC_OUT *o, int block)
+{
+    /* runs of consecutive blocks cost one op */
+    if (o->run_count && o->run_start + o->run_count == block &&
+        o->run_count < SYNC_MAX_RUN) {
+        ++o->run_count;
+        return;
+    }
+    sync_emit_run(o);
+    o->run_start = block;
+    o->run_count = 1;
+}
+
+int arim_arq_sync_signature(FILE *base, FILE *sig)
+{
+    struct stat st;
+    unsigned char *buf, hdr[ARQ_SYNC_SIG_HDR_SIZE], sum[ARQ_SYNC_SUM_SIZE];
+    size_t bs, size, len;
+    int result = 1;
+
+    /* write block sums of the old copy at base to sig. Returns 1 on
+       success, 0 on error or if the file is too large to sync */
+    if (fstat(fileno(base), &st))
+        return 0;
+    size = st.st_size;
+    bs = sync_block_size(size);
+    if ((size + bs - 1) / bs > ARQ_SYNC_MAX_BLOCKS)
+        return 0;
+    buf = malloc(bs);
+    if (!buf)
+        return 0;
+    sync_put32(hdr, bs);
+    sync_put32(hdr + 4, size);
+    if (fwrite(hdr, 1, sizeof(hdr), sig) != sizeof(hdr))
+        result = 0;
+    while (result && (len = fread(buf, 1, bs, base)) > 0) {
+        sync_put32(sum, sync_weak(buf, len));
+        sync_strong(buf, len, sum + ARQ_SYNC_WEAK_SIZE);
+        if (fwrite(sum, 1, sizeof(sum), sig) != sizeof(sum))
+            result = 0;
+    }
+    if (ferror(base))
+        result = 0;
+    free(buf);
+    return result;
+}
+
+int arim_arq_sync_delta(const unsigned char *sig, size_t siglen, FILE *in,
+                        FILE *delta, size_t *literal, size_t *matched)
+{
+    SYNC_OUT o;
+    blake2s_state S;
+    const unsigned char *sums;
+    unsigned char *buf, hdr[SYNC_DELTA_HDR_SIZE], strong[ARQ_SYNC_STRONG_SIZE];
+    size_t bs, basesize, nblocks, taillen, cap, len;
+    size_t fill = 0, pos = 0, lit = 0, newsize = 0;
+    unsigned int a = 0, b = 0, weak, c;
+    int head[1 << SYNC_HASH_BITS], *next;
+    int i, have_sum = 0, have_strong, eof = 0, result = 1;
+    long start;
+
+    /* write to delta what the holder of the old copy described by sig
+       needs to rebuild the file at in. Returns 1 on success, 0 on error
+       or -1 if sig is malformed */
+    if (siglen < ARQ_SYNC_SIG_HDR_SIZE)
+        return -1;
+    bs = sync_get32(sig);
+    basesize = sync_get32(sig + 4);
+    if (bs < ARQ_SYNC_MIN_BLOCK || bs > ARQ_SYNC_MAX_BLOCK)
+        return -1;
+    nblocks = (basesize + bs - 1) / bs;
+    if (nblocks > ARQ_SYNC_MAX_BLOCKS ||
+        siglen != ARQ_SYNC_SIG_HDR_SIZE + nblocks * ARQ_SYNC_SUM_SIZE)
+        return -1;
+    sums = sig + ARQ_SYNC_SIG_HDR_SIZE;
+    taillen = basesize % bs;
+    cap = bs * 4 < SYNC_MIN_BUF_SIZE ? SYNC_MIN_BUF_SIZE : bs * 4;
+    buf = malloc(cap);
+    next = malloc((nblocks + 1) * sizeof(int));
+    if (!buf || !next) {
+        free(buf);
+        free(next);
+        return 0;
+    }
+    /* index whole blocks by weak sum, lowest block first in each chain.
+       A short last block can only match at the end of the file */
+    memset(head, 0xFF, sizeof(head));
+    for (i = nblocks - 1; i >= 0; i--) {
+        if (i == nblocks - 1 && taillen)
+            continue;
+        c = sync_hash(sync_get32(sums + i * ARQ_SYNC_SUM_SIZE));
+        next[i] = head[c];
+        head[c] = i;
+    }
+    memset(&o, 0, sizeof(o));
+    o.fp = delta;
+    /* header is filled in once the hash of the new copy is known */
+    start = ftell(delta);
+    memset(hdr, 0, sizeof(hdr));
+    if (start < 0 || fwrite(hdr, 1, sizeof(hdr), delta) != sizeof(hdr))
+        o.err = 1;
+    blake2s_init(&S, ARQ_HASH_SIZE);
+    while (!o.err) {
+        if (fill - pos < bs && !eof) {
+            /* window near end of buffer, flush pending literal and refill */
+            sync_emit_literal(&o, buf + lit, pos - lit);
+            memmove(buf, buf + pos, fill - pos);
+            fill -= pos;
+            pos = lit = 0;
+            len = fread(buf + fill, 1, cap - fill, in);
+            if (ferror(in)) {
+                result = 0;
+                break;
+            }
+            blake2s_update(&S, buf + fill, len);
+            fill += len;
+            newsize += len;
+            if (feof(in))
+                eof = 1;
+            continue;
+        }
+        if (fill - pos < bs)
+            break;
+        if (!have_sum) {
+            a = b = 0;
+            for (c = 0; c < bs; c++) {
+                a += buf[pos + c];
+                b += (bs - c) * buf[pos + c];
+            }
+            have_sum = 1;
+        }
+        weak = (a & 0xFFFF) | (b << 16);
+        have_strong = 0;
+        for (i = head[sync_hash(weak)]; i >= 0; i = next[i]) {
+            if (sync_get32(sums + i * ARQ_SYNC_SUM_SIZE) != weak)
+                continue;
+            if (!have_strong) {
+                sync_strong(buf + pos, bs, strong);
+                have_strong = 1;
+            }
+            if (!memcmp(strong, sums + i * ARQ_SYNC_SUM_SIZE + ARQ_SYNC_WEAK_SIZE,
+                        ARQ_SYNC_STRONG_SIZE))
+                break;
+        }
+        if (i >= 0) {
+            /* old copy has this block */
+            sync_emit_literal(&o, buf + lit, pos - lit);
+            sync_emit_copy(&o, i);
+            pos += bs;
+            lit = pos;
+            have_sum = 0;
+            continue;
+        }
+        /* no match, slide window one byte */
+        if (pos + bs < fill) {
+            a = a - buf[pos] + buf[pos + bs];
+            b = b - bs * buf[pos] + a;
+        } else {
+            have_sum = 0;
+        }
+        ++pos;
+    }
+    if (result == 1 && !o.err) {
+        /* what is left is shorter than a block, it may match the old tail */
+        if (taillen && fill - pos == taillen) {
+            i = nblocks - 1;
+            sync_strong(buf + pos, taillen, strong);
+            if (sync_weak(buf + pos, taillen) == sync_get32(sums + i * ARQ_SYNC_SUM_SIZE) &&
+                !memcmp(strong, sums + i * ARQ_SYNC_SUM_SIZE + ARQ_SYNC_WEAK_SIZE,
+                        ARQ_SYNC_STRONG_SIZE)) {
+                sync_emit_literal(&o, buf + lit, pos - lit);
+                sync_emit_copy(&o, i);
+                lit = pos = fill;
+            }
+        }
+        sync_emit_literal(&o, buf + lit, fill - lit);
+        sync_emit_run(&o);
+        hdr[0] = SYNC_OP_END;
+        if (fwrite(hdr, 1, 1, delta) != 1)
+            o.err = 1;
+        sync_put32(hdr, bs);
+        sync_put32(hdr + 4, newsize);
+        blake2s_final(&S, hdr + 8, ARQ_HASH_SIZE);
+        if (newsize > 0xFFFFFFFFUL || fseek(delta, start, SEEK_SET) ||
+            fwrite(hdr, 1, sizeof(hdr), delta) != sizeof(hdr) ||
+            fseek(delta, 0, SEEK_END))
+            o.err = 1;
+    }
+    if (o.err)
+        result = 0;
+    *literal = o.literal;
+    *matched = o.matched;
+    free(buf);
+    free(next);
+    return result;
+}
+
+static int sync_write(FILE *out, blake2s_state *S, const unsigned char *p, size_t len)
+{
+    blake2s_update(S, p, len);
+    return (fwrite(p, 1, len, out) == len);
+}
+
+int arim_arq_sync_patch(FILE *base, FILE *delta, FILE *out, size_t max)
+{
+    struct stat st;
+    blake2s_state S;
+    unsigned char *buf, hdr[SYNC_DELTA_HDR_SIZE], op[5], hash[ARQ_HASH_SIZE];
+    size_t bs, basesize, newsize, cnt = 0, len, n, off;
+    unsigned int block, count;
+    int result = 1;
+
+    /* rebuild the new copy of a file from the old copy at base and the
+       delta, writing it to out. Returns 1 on success, 0 on write error
+       or -1 if the delta is bad or does not fit the old copy */
+    if (fstat(fileno(base), &st))
+        return 0;
+    basesize = st.st_size;
+    if (fread(hdr, 1, sizeof(hdr), delta) != sizeof(hdr))
+        return -1;
+    bs = sync_get32(hdr);
+    newsize = sync_get32(hdr + 4);
+    if (bs < ARQ_SYNC_MIN_BLOCK || bs > ARQ_SYNC_MAX_BLOCK || newsize > max)
+        return -1;
+    buf = malloc(bs);
+    if (!buf)
+        return 0;
+    blake2s_init(&S, ARQ_HASH_SIZE);
+    while (result == 1) {
+        if (fread(op, 1, 1, delta) != 1) {
+            result = -1;
+        } else if (op[0] == SYNC_OP_END) {
+            break;
+        } else if (op[0] == SYNC_OP_LITERAL) {
+            if (fread(op + 1, 1, 2, delta) != 2) {
+                result = -1;
+                break;
+            }
+            len = sync_get16(op + 1);
+            while (result == 1 && len) {
+                n = len > bs ? bs : len;
+                if (fread(buf, 1, n, delta) != n || cnt + n > newsize)
+                    result = -1;
+                else if (!sync_write(out, &S, buf, n))
+                    result = 0;
+                cnt += n;
+                len -= n;
+            }
+        } else if (op[0] == SYNC_OP_COPY) {
+            if (fread(op + 1, 1, 4, delta) != 4) {
+                result = -1;
+                break;
+            }
+            block = sync_get16(op + 1);
+            count = sync_get16(op + 3);
+            while (result == 1 && count--) {
+                off = (size_t)block++ * bs;
+                if (off >= basesize) {
+                    result = -1;
+                    break;
+                }
+                n = basesize - off < bs ? basesize - off : bs;
+                if (fseek(base, off, SEEK_SET) || fread(buf, 1, n, base) != n ||
+                    cnt + n > newsize)
+                    result = -1;
+                else if (!sync_write(out, &S, buf, n))
+                    result = 0;
+                cnt += n;
+            }
+        } else {
+            result = -1;
+        }
+    }
+    if (result == 1) {
+        blake2s_final(&S, hash, ARQ_HASH_SIZE);
+        if (cnt != newsize || memcmp(hash, hdr + 8, ARQ_HASH_SIZE))
+            result = -1;
+    }
+    free(buf);
+    return result;
+}
@@ -0,0 +1,45 @@
+/***********************************************************************
+
+    ARIM Amateur Radio Instant Messaging program for the ARDOP TNC.
+
+    Copyright (C) 2016-2021 Robert Cunnings NW8L
+
+    This file is part of the ARIM messaging program.
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+*************************************************************************/
+
+
+
+#ifndef _ARIM_ARQ_SYNC_H_INCLUDED_
+#define _ARIM_ARQ_SYNC_H_INCLUDED_
+
+#define ARQ_SYNC_MIN_BLOCK      128
+#define ARQ_SYNC_MAX_BLOCK      65536
+#define ARQ_SYNC_MAX_BLOCKS     1024
+#define ARQ_SYNC_WEAK_SIZE      4
+#define ARQ_SYNC_STRONG_SIZE    6
+#define ARQ_SYNC_SUM_SIZE       (ARQ_SYNC_WEAK_SIZE+ARQ_SYNC_STRONG_SIZE)
+#define ARQ_SYNC_SIG_HDR_SIZE   8
+#define ARQ_SYNC_SIG_MAX        (ARQ_SYNC_SIG_HDR_SIZE+(ARQ_SYNC_MAX_BLOCKS*ARQ_SYNC_SUM_SIZE))
+#define ARQ_SYNC_HIST_CODE      'D'
+#define ARQ_SYNC_HIST_FLAG      "sync"
+
+extern int arim_arq_sync_signature(FILE *base, FILE *sig);
+extern int arim_arq_sync_delta(const unsigned char *sig, size_t siglen, FILE *in,
+                               FILE *delta, size_t *literal, size_t *matched);
+extern int arim_arq_sync_patch(FILE *base, FILE *delta, FILE *out, size_t max);
+
+#endif
@@ -0,0 +1,201 @@
+/***********************************************************************
+
+    ARIM Amateur Radio Instant Messaging program for the ARDOP TNC.
+
+    Copyright (C) 2016-2021 Robert Cunnings NW8L
+
+    This file is part of the ARIM messaging program.
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+*************************************************************************/
+
+
+
+#include <string.h>
+#include "arim_arq_text.h"
+
+/* Codebook coder for short text, where zlib's header, checksum and lack
+   of history cost more than they save. Printable ASCII and newline stand
+   for themselves, the other byte values below TEXT_LIT1 each stand for a
+   codebook string, and bytes that are neither are escaped: TEXT_LIT1 is
+   followed by one literal byte, TEXT_LITN by a count less one and up to
+   256 literal bytes. The codebook is part of the -ztx format, so it must
+   never change; a new codebook needs a new codec name */
+#define TEXT_LIT1       254
+#define TEXT_LITN       255
+#define TEXT_MAX_RUN    256
+
+static const char *const codebook[] = {
+    " the ", "the ", " the", "The ", " and ", " to ", " of ", " in ", " is ", " it ",
+    " for ", " you ", " on ", " at ", " be ", " are ", " have ", " with ", " this ",
+    " that ", " will ", " from ", " your ", " not ", " but ", " all ", " can ", " was ",
+    " we ", " me ", " my ", " if ", " or ", " as ", " so ", " do ", " up ", " an ",
+    " a ", "I ", "ing ", "ing", "tion", "ion", "ent", "ter", "ere", "her", "est", "ver",
+    "and", "for", "you", "ll ", "er ", "ed ", "es ", "ly ", "nt ", "e ", "s ", "t ",
+    "d ", "n ", "r ", "y ", "o ", " t", " a", " s", " w", " c", " b", " f", " m", " p",
+    " d", " h", " i", " o", " r", " n", " l", " e", " g", "th", "he", "in", "er", "an",
+    "re", "on", "at", "en", "nd", "ou", "es", "or", "ti", "te", "is", "it", "ar", "st",
+    "to", "nt", "ng", "se", "ha", "as", "ed", "le", "ve", "of", "me", "ne", "de",
+    ". ", ", ", ": ", "\n\n", ".\n",
+    "73", " 73", "73 de ", " de ", "Thanks", "thanks", "Hello", "Hi ", "please",
+    "message", "received", "weather", "station", "antenna", "frequency", "signal",
+    "report", "today", "tomorrow", " net", "check", "good", "QSO", "QTH", "QSL", "CQ",
+    "kHz", "MHz", "ARIM", "ARDOP", "Winlink", "00", "20", ":00", "UTC",
+};
+
+#define TEXT_CODEBOOK_CNT   (sizeof(codebook)/sizeof(codebook[0]))
+
+static int text_is_plain(unsigned int c)
+{
+    return (c >= ' ' && c <= '~') || c == '\n';
+}
+
+static unsigned int text_code(size_t i)
+{
+    /* codebook index to byte, skipping plain bytes */
+    if (i < '\n')
+        return i;
+    if (i < ' ' - 1)
+        return i + 1;
+    return i - (' ' - 1) + 0x7F;
+}
+
+static int text_index(unsigned int c)
+{
+    /* byte to codebook index, -1 if not a codebook byte */
+    if (text_is_plain(c) || c >= TEXT_LIT1)
+        return -1;
+    if (c < '\n')
+        return c;
+    if (c < ' ')
+        return c - 1;
+    return c - 0x7F + (' ' - 1);
+}
+
+static int text_literals(const unsigned char *p, size_t n, unsigned char *out,
+                         size_t outsize, size_t *op)
+{
+    size_t run;
+
+    while (n) {
+        run = n > TEXT_MAX_RUN ? TEXT_MAX_RUN : n;
+        if (*op + (run == 1 ? 2 : 2 + run) > outsize)
+            return 0;
+        if (run == 1) {
+            out[(*op)++] = TEXT_LIT1;
+        } else {
+            out[(*op)++] = TEXT_LITN;
+            out[(*op)++] = run - 1;
+        }
+        memcpy(out + *op, p, run);
+        *op += run;
+        p += run;
+        n -= run;
+    }
+    return 1;
+}
+
+int arim_arq_text_compress(const void *in, size_t len, unsigned char *out,
+                           size_t outsize, size_t *outlen)
+{
+    const unsigned char *p = in;
+    const char *s;
+    short head[256], next[TEXT_CODEBOOK_CNT];
+    size_t ip = 0, op = 0, lit = 0, j, best, bestlen;
+    int i;
+
+    /* greedy longest match against the codebook, with the entries
+       chained by first byte. Returns 1 on success or 0 if the
+       result exceeds outsize */
+    memset(head, -1, sizeof(head));
+    for (i = TEXT_CODEBOOK_CNT - 1; i >= 0; i--) {
+        next[i] = head[(unsigned char)codebook[i][0]];
+        head[(unsigned char)codebook[i][0]] = i;
+    }
+    while (ip < len) {
+        bestlen = best = 0;
+        for (i = head[p[ip]]; i >= 0; i = next[i]) {
+            s = codebook[i];
+            for (j = 0; s[j] && ip + j < len && (unsigned char)s[j] == p[ip + j]; j++)
+                ;
+            if (!s[j] && j > bestlen) {
+                bestlen = j;
+                best = i;
+            }
+        }
+        if (bestlen < 2 && text_is_plain(p[ip])) {
+            bestlen = 0;
+            best = p[ip];
+        } else if (!bestlen) {
+            ++lit;
+            ++ip;
+            continue;
+        } else {
+            best = text_code(best);
+        }
+        if (!text_literals(p + ip - lit, lit, out, outsize, &op) || op >= outsize)
+            return 0;
+        lit = 0;
+        out[op++] = best;
+        ip += bestlen ? bestlen : 1;
+    }
+    if (!text_literals(p + ip - lit, lit, out, outsize, &op))
+        return 0;
+    *outlen = op;
+    return 1;
+}
+
+int arim_arq_text_decompress(const unsigned char *in, size_t len, unsigned char *out,
+                             size_t outsize, size_t *outlen)
+{
+    size_t ip = 0, op = 0, n;
+    int i;
+
+    /* returns 1 on success, 0 if the result exceeds outsize
+       or -1 if the compressed data is bad */
+    while (ip < len) {
+        if (text_is_plain(in[ip])) {
+            if (op >= outsize)
+                return 0;
+            out[op++] = in[ip++];
+        } else if (in[ip] >= TEXT_LIT1) {
+            n = 1;
+            if (in[ip++] == TEXT_LITN) {
+                if (ip >= len)
+                    return -1;
+                n = in[ip++] + 1;
+            }
+            if (ip + n > len)
+                return -1;
+            if (op + n > outsize)
+                return 0;
+            memcpy(out + op, in + ip, n);
+            ip += n;
+            op += n;
+        } else {
+            i = text_index(in[ip++]);
+            if ((size_t)i >= TEXT_CODEBOOK_CNT)
+                return -1;
+            n = strlen(codebook[i]);
+            if (op + n > outsize)
+                return 0;
+            memcpy(out + op, codebook[i], n);
+            op += n;
+        }
+    }
+    *outlen = op;
+    return 1;
+}
+
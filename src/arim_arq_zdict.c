@@ -0,0 +1,91 @@
+/***********************************************************************
+
+    ARIM Amateur Radio Instant Messaging program for the ARDOP TNC.
+
+    Copyright (C) 2016-2021 Robert Cunnings NW8L
+
+    This file is part of the ARIM messaging program.
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+*************************************************************************/
+
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "arim_arq_zdict.h"
+
+/* Preset dictionaries for -zN payloads. A published version must never
+   change, since both stations have to hold the same bytes to inflate;
+   add a new version instead (see arim-zdict). zlib finds matches nearer
+   the end of a dictionary more cheaply, so the commonest strings go last */
+static const char zdict_v1[] =
+    "Jan Feb Mar Apr May Jun Jul Aug Sep Oct Nov Dec "
+    "Sun Mon Tue Wed Thu Fri Sat "
+    "http://www. https://www. .com .org .net "
+    "kHz MHz USB LSB SSB PSK FT8 CW "
+    "80m 40m 30m 20m 17m 15m 10m 6m 2m "
+    "frequency antenna dipole vertical power watts QRP QRO "
+    "propagation band conditions noise signal report SNR "
+    "ARDOP Winlink VARA Pat ARIM net check-in checkins "
+    "schedule sked tomorrow tonight today this evening morning "
+    "please let me know if you can copy "
+    "weather emergency EMCOMM ARES RACES traffic "
+    "Message received, thanks. "
+    "QTH QSL QSO QSY QRZ QRM QRN QSB RST CQ DE de "
+    "grid square is my name is here in "
+    "Good morning Good evening Hello Hi "
+    "Thanks for the contact. Thank you tnx TNX "
+    "Best regards, Regards, Cheers, "
+    "73 de 73, 73! 73\n"
+    "Subject: Date: "
+    "Received: from  by ; "
+    "\nFrom: \nTo: \n";
+
+static const struct {
+    const char *data;
+    size_t size;
+} zdicts[ARQ_ZDICT_VERSION+1] = {
+    { NULL, 0 },
+    { zdict_v1, sizeof(zdict_v1) - 1 },
+};
+
+const unsigned char *arim_arq_zdict_get(int version, size_t *size)
+{
+    if (version < 1 || version > ARQ_ZDICT_VERSION)
+        return NULL;
+    if (size)
+        *size = zdicts[version].size;
+    return (const unsigned char *)zdicts[version].data;
+}
+
+int arim_arq_zdict_inflate(z_stream *zs, int flush, int zdict)
+{
+    const unsigned char *dict;
+    size_t size;
+    int zret;
+
+    /* inflate, supplying preset dictionary when the stream asks for it;
+       zlib rejects the dictionary if its id doesn't match the stream's */
+    zret = inflate(zs, flush);
+    if (zret == Z_NEED_DICT) {
+        dict = arim_arq_zdict_get(zdict, &size);
+        if (!dict || inflateSetDictionary(zs, dict, size) != Z_OK)
+            return Z_DATA_ERROR;
+        zret = inflate(zs, flush);
+    }
+    return zret;
+}
+
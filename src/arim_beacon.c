@@ -34,6 +34,7 @@
 #include "ui_tnc_data_win.h"
 #include "bufq.h"
 #include "util.h"
+#include "tnc_state.h"
 
 int g_btime;
 
@@ -49,13 +50,11 @@ int arim_beacon_send()
 
     if (!arim_is_idle() || !arim_tnc_is_idle())
         return 0;
-    bufq_queue_data_out(beaconstr);
+    if (!bufq_queue_data_out(beaconstr))
+        return 0;
     len = strlen(beaconstr);
     /* prime buffer count because update from TNC not immediate */
-    pthread_mutex_lock(&mutex_tnc_set);
-    snprintf(g_tnc_settings[g_cur_tnc].buffer,
-        sizeof(g_tnc_settings[g_cur_tnc].buffer), "%zu", len);
-    pthread_mutex_unlock(&mutex_tnc_set);
+    tnc_state_set_buffer(len);
     arim_on_event(EV_SEND_BCN, 0);
     return 1;
 }
@@ -0,0 +1,277 @@
+/***********************************************************************
+
+    ARIM Amateur Radio Instant Messaging program for the ARDOP TNC.
+
+    Copyright (C) 2016-2021 Robert Cunnings NW8L
+
+    This file is part of the ARIM messaging program.
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+*************************************************************************/
+
+
+/* arim-mboxbench: time message lookups in mailboxes of 1k, 10k and
+   100k messages (or the counts given), by a full scan of the mbox file
+   as arim did before mailboxes were indexed and through the sidecar
+   index, cold, loaded from the .idx file and caught up after the
+   mailbox grows. Not installed, run from the build directory, e.g.
+
+     arim-mboxbench
+     arim-mboxbench -k 5000 50000                                    */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <time.h>
+#include <pthread.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+#include "main.h"
+#include "ini.h"
+#include "mbox.h"
+
+#define MBOXBENCH_FNAME     "bench.mbox"
+#define MBOXBENCH_LOOKUPS   1000
+#define MBOXBENCH_FLAGS     100
+#define MBOXBENCH_MAX_CNT   10000000
+
+/* globals normally provided by the rest of arim */
+ARIM_SET g_arim_settings;
+UI_SET g_ui_settings;
+char g_arim_path[MAX_DIR_PATH_SIZE];
+pthread_mutex_t mutex_mbox = PTHREAD_MUTEX_INITIALIZER;
+pthread_mutex_t mutex_time = PTHREAD_MUTEX_INITIALIZER;
+int msg_view_restart;
+
+void bufq_queue_debug_log(const char *text)
+{
+}
+
+void ui_truncate_line(char *line, size_t size)
+{
+    line[size - 1] = '\0';
+}
+
+static const char *days[] = { "Sun", "Mon", "Tue", "Wed", "Thu", "Fri", "Sat" };
+static const char *months[] = {
+    "Jan", "Feb", "Mar", "Apr", "May", "Jun",
+    "Jul", "Aug", "Sep", "Oct", "Nov", "Dec",
+};
+
+static char (*hdrs)[MAX_MBOX_HDR_SIZE];
+static char msgbuf[MIN_MSG_BUF_SIZE];
+static int keep;
+
+static void usage()
+{
+    fprintf(stderr,
+        "usage: arim-mboxbench [-k] [count ...]\n"
+        "  builds a mailbox of each count of messages (default 1000, 10000\n"
+        "  and 100000) in a temporary directory and times finding a message\n"
+        "  in it by full scan and through the index. -k keeps the files\n");
+    exit(1);
+}
+
+static double now_ms()
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000.0 + ts.tv_nsec / 1000000.0;
+}
+
+static void make_hdr(char *hdr, size_t size, int n, int len)
+{
+    struct tm tm;
+    time_t t;
+    char date[32];
+
+    /* separators must be unique, so step the clock a second per message */
+    t = 1577836800 + n;
+    gmtime_r(&t, &tm);
+    snprintf(date, sizeof(date), "%s %s %2d %02d:%02d:%02d %d",
+             days[tm.tm_wday], months[tm.tm_mon], tm.tm_mday,
+             tm.tm_hour, tm.tm_min, tm.tm_sec, tm.tm_year + 1900);
+    snprintf(hdr, size, "From %-10s %s To %-10s %5d %04X ----",
+             n % 3 ? "W1AW" : "NW8L", date, n % 2 ? "K7ABC" : "N0CALL", len, n & 0xFFFF);
+}
+
+static int append_msg(FILE *fp, int n)
+{
+    char body[512];
+    int len;
+
+    len = snprintf(body, sizeof(body),
+                   "Net report %d: 14 check-ins, conditions fair on 3.5 MHz.\n"
+                   "Traffic: %d messages relayed, next net at %02d:00 UTC.\n"
+                   "73 de station %d\n", n, n % 17, n % 24, n);
+    make_hdr(hdrs[n], sizeof(hdrs[n]), n, len);
+    return fprintf(fp, "%s\nFrom: %s\nTo: %s\n\n%s\n\n", hdrs[n],
+                   n % 3 ? "W1AW" : "NW8L", n % 2 ? "K7ABC" : "N0CALL", body) > 0;
+}
+
+static double scan_msg(const char *fpath, const char *hdr)
+{
+    FILE *fp;
+    char line[MAX_MSG_LINE_SIZE];
+    size_t len, cnt = 0;
+    double t0;
+    int found = 0;
+
+    /* how arim found a message before mailboxes were indexed: read
+       every line of the file up to the separator, then the body */
+    t0 = now_ms();
+    fp = fopen(fpath, "r");
+    if (!fp)
+        return -1;
+    while (fgets(line, sizeof(line), fp)) {
+        if (found) {
+            if (!strncmp(line, "From ", 5))
+                break;
+            len = strlen(line);
+            if (cnt + len < sizeof(msgbuf)) {
+                memcpy(msgbuf + cnt, line, len);
+                cnt += len;
+            }
+        } else if (!strncmp(line, hdr, strlen(hdr))) {
+            found = 1;
+        }
+    }
+    fclose(fp);
+    return found ? now_ms() - t0 : -1;
+}
+
+static void run_child(const char *label, int cnt, int lookups)
+{
+    double t0, t1;
+    pid_t pid;
+    int i, status;
+
+    /* each phase runs in a fresh process, with no index in memory */
+    fflush(stdout);
+    pid = fork();
+    if (pid < 0) {
+        perror("arim-mboxbench: fork");
+        exit(1);
+    }
+    if (pid) {
+        waitpid(pid, &status, 0);
+        return;
+    }
+    t0 = now_ms();
+    if (!mbox_get_msg(msgbuf, sizeof(msgbuf), MBOXBENCH_FNAME, hdrs[cnt - 1], 0)) {
+        printf("  %-22s lookup failed\n", label);
+        exit(1);
+    }
+    t1 = now_ms();
+    printf("  %-22s %10.2f ms\n", label, t1 - t0);
+    if (!lookups)
+        exit(0);
+    srand(cnt);
+    t0 = now_ms();
+    for (i = 0; i < MBOXBENCH_LOOKUPS; i++)
+        mbox_get_msg(msgbuf, sizeof(msgbuf), MBOXBENCH_FNAME, hdrs[rand() % cnt], 0);
+    t1 = now_ms();
+    printf("  %-22s %10.3f ms\n", "indexed get, each", (t1 - t0) / MBOXBENCH_LOOKUPS);
+    t0 = now_ms();
+    for (i = 0; i < MBOXBENCH_FLAGS; i++)
+        mbox_set_flag(MBOXBENCH_FNAME, hdrs[rand() % cnt], 'R');
+    t1 = now_ms();
+    printf("  %-22s %10.3f ms\n", "indexed set flag, each", (t1 - t0) / MBOXBENCH_FLAGS);
+    exit(0);
+}
+
+static int bench(const char *dir, int cnt)
+{
+    FILE *fp;
+    struct stat st;
+    char fpath[MAX_PATH_SIZE], ipath[MAX_PATH_SIZE+8];
+    double t;
+    int i;
+
+    snprintf(fpath, sizeof(fpath), "%s/%s", dir, MBOXBENCH_FNAME);
+    snprintf(ipath, sizeof(ipath), "%s.idx", fpath);
+    unlink(ipath);
+    hdrs = realloc(hdrs, (cnt + 1) * sizeof(hdrs[0]));
+    if (!hdrs)
+        return 0;
+    fp = fopen(fpath, "w");
+    if (!fp)
+        return 0;
+    for (i = 0; i < cnt; i++) {
+        if (!append_msg(fp, i)) {
+            fclose(fp);
+            return 0;
+        }
+    }
+    fclose(fp);
+    if (stat(fpath, &st))
+        return 0;
+    printf("%d messages, %ld KB\n", cnt, (long)(st.st_size / 1024));
+    t = scan_msg(fpath, hdrs[cnt - 1]);
+    printf("  %-22s %10.2f ms\n", "full scan, last msg", t);
+    run_child("index build + get", cnt, 0);
+    run_child("index load + get", cnt, 1);
+    /* grow the mailbox by one message behind the index's back */
+    fp = fopen(fpath, "a");
+    if (!fp || !append_msg(fp, cnt))
+        return 0;
+    fclose(fp);
+    run_child("index catch up + get", cnt + 1, 0);
+    if (!keep) {
+        unlink(fpath);
+        unlink(ipath);
+    }
+    return 1;
+}
+
+int main(int argc, char *argv[])
+{
+    static const int defaults[] = { 1000, 10000, 100000 };
+    char dir[] = "/tmp/arim-mboxbench-XXXXXX";
+    int i, opt, cnt;
+
+    while ((opt = getopt(argc, argv, "k")) != -1) {
+        switch (opt) {
+        case 'k':
+            keep = 1;
+            break;
+        default:
+            usage();
+        }
+    }
+    if (!mkdtemp(dir)) {
+        perror("arim-mboxbench: mkdtemp");
+        return 1;
+    }
+    snprintf(mbox_dir_path, MAX_PATH_SIZE, "%s", dir);
+    snprintf(g_arim_settings.msg_trace_en, sizeof(g_arim_settings.msg_trace_en), "FALSE");
+    snprintf(g_ui_settings.utc_time, sizeof(g_ui_settings.utc_time), "TRUE");
+    for (i = optind; i < argc || (optind == argc && i - optind < 3); i++) {
+        cnt = (optind == argc) ? defaults[i - optind] : atoi(argv[i]);
+        if (cnt < 1 || cnt > MBOXBENCH_MAX_CNT)
+            usage();
+        if (!bench(dir, cnt)) {
+            fprintf(stderr, "arim-mboxbench: cannot write mailbox in %s\n", dir);
+            return 1;
+        }
+    }
+    if (!keep)
+        rmdir(dir);
+    else
+        printf("files kept in %s\n", dir);
+    return 0;
+}
@@ -98,7 +98,8 @@ int arim_send_msg(const char *msg, const char *to_call)
                     len,
                     check,
                     msg);
-    bufq_queue_data_out(msg_buffer);
+    if (!bufq_queue_data_out(msg_buffer))
+        return 0;
     if (arim_test_netcall(to_call)) {
         /* initialize arim_proto global */
         msg_len = len;
@@ -152,7 +153,8 @@ int arim_send_msg_pp()
                      len,
                      check,
                      prev_msg);
-    bufq_queue_data_out(msg_buffer);
+    if (!bufq_queue_data_out(msg_buffer))
+        return 0;
     /* set up for ACK wait and repeats */
     if (!strncasecmp(g_arim_settings.fecmode_downshift, "TRUE", 4))
         fecmode_downshift = 1;
@@ -191,9 +193,7 @@ int arim_recv_msg(const char *fm_call, const char *to_call,
             /* good checksum, store message into mbox, add to recents */
             hdr = mbox_add_msg(MBOX_INBOX_FNAME, fm_call, to_call, check, msg, 1);
             if (hdr != NULL) {
-                pthread_mutex_lock(&mutex_recents);
-                cmdq_push(&g_recents_q, hdr);
-                pthread_mutex_unlock(&mutex_recents);
+                bufq_queue_recents(hdr);
             }
             if (is_netcall) {
                 snprintf(buffer, sizeof(buffer), "6[M] %-10s ", fm_call);
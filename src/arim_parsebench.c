@@ -0,0 +1,371 @@
+/***********************************************************************
+
+    ARIM Amateur Radio Instant Messaging program for the ARDOP TNC.
+
+    Copyright (C) 2016-2021 Robert Cunnings NW8L
+
+    This file is part of the ARIM messaging program.
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+*************************************************************************/
+
+
+
+/* arim-parsebench: feed a corpus of ARIM frames through arim_on_data()
+   and time it. The frames are built with the same formats arim uses
+   to send messages, queries, responses, beacons and ACK/NAKs, with
+   real check values. Each frame is fed whole, several are packed into
+   one payload, each frame is split into payloads of 16 to 256 bytes,
+   and the packed stream is split at random points. The first two take
+   the in-place fast path, the others the incremental parser. Every
+   mode must deliver the same frames, which is checked with a hash of
+   the fields handed to the receive functions. Not installed, run from
+   the build directory, e.g.
+
+     arim-parsebench
+     arim-parsebench 50000                                           */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <pthread.h>
+#include "main.h"
+#include "ini.h"
+#include "arim.h"
+#include "util.h"
+
+#define PBENCH_DEF_CNT      20000
+#define PBENCH_MAX_CNT      1000000
+#define PBENCH_RUNS         3
+#define PBENCH_PACK_SIZE    MAX_DATA_SIZE
+#define PBENCH_MIN_PIECE    16
+#define PBENCH_MAX_PIECE    256
+#define PBENCH_MAX_TEXT     3000
+#define PBENCH_MAX_FRAME    (MAX_ARIM_HDR_SIZE+PBENCH_MAX_TEXT)
+
+#define FEED_WHOLE          0
+#define FEED_PACKED         1
+#define FEED_SPLIT          2
+#define FEED_PACKED_SPLIT   3
+
+/* globals normally provided by the rest of arim */
+UI_SET g_ui_settings;
+pthread_mutex_t mutex_time = PTHREAD_MUTEX_INITIALIZER;
+
+static unsigned int rx_hash;
+static size_t rx_cnt;
+
+static void hash_str(const char *s)
+{
+    /* FNV-1a, with the terminating null so fields can't run together */
+    do {
+        rx_hash = (rx_hash ^ (unsigned char)*s) * 16777619;
+    } while (*s++);
+}
+
+static void hash_frame(int type, const char *fm_call, const char *to_call,
+                       unsigned int check, const char *msg)
+{
+    char buf[16];
+
+    snprintf(buf, sizeof(buf), "%c%04X", type, check);
+    hash_str(buf);
+    hash_str(fm_call);
+    hash_str(to_call);
+    hash_str(msg);
+    ++rx_cnt;
+}
+
+/* receive functions normally provided by the rest of arim */
+int arim_recv_msg(const char *fm_call, const char *to_call,
+                  unsigned int check, const char *msg)
+{
+    hash_frame('M', fm_call, to_call, check, msg);
+    return 1;
+}
+
+int arim_recv_query(const char *fm_call, const char *to_call,
+                    unsigned int check, const char *query)
+{
+    hash_frame('Q', fm_call, to_call, check, query);
+    return 1;
+}
+
+int arim_recv_response(const char *fm_call, const char *to_call,
+                       unsigned int check, const char *msg)
+{
+    hash_frame('R', fm_call, to_call, check, msg);
+    return 1;
+}
+
+void arim_beacon_recv(const char *fm_call, const char *gridsq, const char *msg)
+{
+    hash_frame('B', fm_call, gridsq, 0, msg);
+}
+
+void arim_recv_ack(const char *fm_call, const char *to_call)
+{
+    hash_frame('A', fm_call, to_call, 0, "");
+}
+
+void arim_recv_nak(const char *fm_call, const char *to_call)
+{
+    hash_frame('N', fm_call, to_call, 0, "");
+}
+
+int arim_test_mycall(const char *call)
+{
+    return !strcmp(call, "NW8L");
+}
+
+int arim_test_netcall(const char *call)
+{
+    return 0;
+}
+
+int ini_check_ac_calls(const char *call)
+{
+    return 1;
+}
+
+void ui_truncate_line(char *line, size_t size)
+{
+    line[size - 1] = '\0';
+}
+
+void ui_status_xfer_start(int min, int max, int dir)
+{
+}
+
+void ui_status_xfer_update(int val)
+{
+}
+
+void ui_status_xfer_end()
+{
+}
+
+void bufq_queue_data_in(const char *text)
+{
+}
+
+void bufq_queue_traffic_log(const char *text)
+{
+}
+
+void bufq_queue_debug_log(const char *text)
+{
+}
+
+static unsigned char *corpus;
+static size_t *frame_end, corpus_size;
+static int frame_cnt;
+static unsigned int corpus_hash;
+
+static void usage()
+{
+    fprintf(stderr,
+        "usage: arim-parsebench [frames]\n"
+        "  feeds frames (default %d) through the ARIM frame parser whole,\n"
+        "  packed, split and packed then split\n", PBENCH_DEF_CNT);
+    exit(1);
+}
+
+static double now_ms()
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000.0 + ts.tv_nsec / 1000000.0;
+}
+
+static void gen_text(char *text, size_t len)
+{
+    static const char *words[] = {
+        "de", "NW8L", "QSL", "73", "net", "tonight", "on", "the", "band",
+        "signal", "report", "ARIM", "message", "check", "in", "please",
+        "weather", "here", "is", "fine", "antenna", "rig", "thanks", "for",
+        "the", "contact", "see", "you", "at", "the", "hamfest", "QTH",
+    };
+    const char *word;
+    size_t n = 0, w;
+
+    /* plain text like the traffic arim carries, a line break now and then */
+    while (n < len) {
+        word = words[rand() % (sizeof(words) / sizeof(words[0]))];
+        w = strlen(word);
+        if (n + w + 1 > len)
+            break;
+        memcpy(text + n, word, w);
+        n += w;
+        text[n++] = rand() % 12 ? ' ' : '\n';
+    }
+    while (n < len)
+        text[n++] = '.';
+    text[n] = '\0';
+}
+
+static size_t gen_frame(char *frame, size_t size, int i)
+{
+    static const char *calls[] = { "NW8L", "KB8OJH", "W1AW", "VE3XYZ-7", "QST" };
+    char text[MAX_MSG_SIZE], hdr[MAX_ARIM_HDR_SIZE];
+    const char *fm, *to;
+    unsigned int check;
+    size_t len;
+    int kind;
+
+    /* mostly messages, some queries and responses, a few beacons and
+       ACK/NAKs, roughly the mix on a busy net frequency */
+    fm = calls[rand() % 4];
+    to = calls[1 + rand() % 4];
+    kind = i % 20;
+    if (kind < 2) {
+        len = snprintf(frame, size, "|%c%02d|%s|%s|", kind ? 'N' : 'A',
+                       ARIM_PROTO_VERSION, fm, to);
+        hash_frame(kind ? 'N' : 'A', fm, to, 0, "");
+        return len;
+    }
+    if (kind < 4) {
+        gen_text(text, 8 + rand() % 24);
+        len = snprintf(hdr, sizeof(hdr), "|B%02d|%s|%04X|EN81|", ARIM_PROTO_VERSION, fm, 0);
+        len = snprintf(frame, size, "|B%02d|%s|%04zX|EN81|%s",
+                       ARIM_PROTO_VERSION, fm, len + strlen(text), text);
+        hash_frame('B', fm, "EN81", 0, text);
+        return len;
+    }
+    if (kind < 7)
+        gen_text(text, 4 + rand() % 12);         /* query, e.g. "version" */
+    else if (kind < 10)
+        gen_text(text, 200 + rand() % (PBENCH_MAX_TEXT - 200)); /* response */
+    else
+        gen_text(text, 20 + rand() % 1500);      /* message */
+    check = ccitt_crc16((unsigned char *)text, strlen(text));
+    kind = kind < 7 ? 'Q' : kind < 10 ? 'R' : 'M';
+    len = snprintf(hdr, sizeof(hdr), "|%c%02d|%s|%s|%04X|%04X|",
+                   kind, ARIM_PROTO_VERSION, fm, to, 0, check);
+    len = snprintf(frame, size, "|%c%02d|%s|%s|%04zX|%04X|%s",
+                   kind, ARIM_PROTO_VERSION, fm, to, len + strlen(text), check, text);
+    hash_frame(kind, fm, to, check, text);
+    return len;
+}
+
+static int gen_corpus(int cnt)
+{
+    size_t size = 0;
+    int i;
+
+    /* room for the null the fast path puts past the payload */
+    corpus = malloc((size_t)cnt * PBENCH_MAX_FRAME + 1);
+    frame_end = malloc(cnt * sizeof(size_t));
+    if (!corpus || !frame_end)
+        return 0;
+    srand(1);
+    rx_hash = 2166136261u;
+    rx_cnt = 0;
+    for (i = 0; i < cnt; i++) {
+        size += gen_frame((char *)corpus + size, PBENCH_MAX_FRAME + 1, i);
+        frame_end[i] = size;
+    }
+    corpus[size] = '\0';
+    corpus_size = size;
+    frame_cnt = cnt;
+    corpus_hash = rx_hash;
+    return 1;
+}
+
+static void feed(int how)
+{
+    size_t pos = 0, start, n, end;
+    int i = 0, waiting = 0;
+
+    srand(2);
+    rx_hash = 2166136261u;
+    rx_cnt = 0;
+    while (pos < corpus_size) {
+        switch (how) {
+        case FEED_WHOLE:
+            n = frame_end[i++] - pos;
+            break;
+        case FEED_PACKED:
+            /* as many whole frames as fit one payload */
+            start = pos;
+            do {
+                ++i;
+            } while (i < frame_cnt && frame_end[i] - start <= PBENCH_PACK_SIZE);
+            n = frame_end[i - 1] - start;
+            break;
+        case FEED_SPLIT:
+            /* pieces of the current frame, as it comes off the air */
+            end = frame_end[i];
+            n = PBENCH_MIN_PIECE + rand() % (PBENCH_MAX_PIECE - PBENCH_MIN_PIECE + 1);
+            if (n >= end - pos) {
+                n = end - pos;
+                ++i;
+            }
+            break;
+        default:
+            n = PBENCH_MIN_PIECE + rand() % (PBENCH_MAX_PIECE - PBENCH_MIN_PIECE + 1);
+            if (n > corpus_size - pos)
+                n = corpus_size - pos;
+            break;
+        }
+        /* as ardop_data_dispatch() does, other payloads aren't ARIM frames */
+        if (waiting || arim_test_frame((char *)corpus + pos, n))
+            waiting = arim_on_data((char *)corpus + pos, n);
+        pos += n;
+    }
+}
+
+int main(int argc, char *argv[])
+{
+    static const char *names[] = { "whole", "packed", "split", "packed, split" };
+    double t0, ms, best;
+    int how, run, cnt = PBENCH_DEF_CNT, fails = 0;
+
+    if (argc > 2)
+        usage();
+    if (argc == 2) {
+        cnt = atoi(argv[1]);
+        if (cnt <= 0 || cnt > PBENCH_MAX_CNT)
+            usage();
+    }
+    if (!gen_corpus(cnt)) {
+        fprintf(stderr, "arim-parsebench: cannot allocate corpus\n");
+        return 1;
+    }
+    printf("%d frames, %zu bytes, best of %d runs\n\n", frame_cnt, corpus_size, PBENCH_RUNS);
+    printf("%-14s %10s %10s %12s %8s %10s\n", "feed", "ms", "MB/s", "frames/s",
+           "frames", "hash");
+    for (how = FEED_WHOLE; how <= FEED_PACKED_SPLIT; how++) {
+        best = 0;
+        for (run = 0; run < PBENCH_RUNS; run++) {
+            arim_on_data(NULL, 0); /* start clean */
+            t0 = now_ms();
+            feed(how);
+            ms = now_ms() - t0;
+            if (!run || ms < best)
+                best = ms;
+        }
+        printf("%-14s %10.1f %10.1f %12.0f %8zu %10X%s\n", names[how], best,
+               corpus_size / best / 1000.0, frame_cnt / best * 1000.0, rx_cnt, rx_hash,
+               rx_cnt != (size_t)frame_cnt || rx_hash != corpus_hash ? "  MISMATCH" : "");
+        if (rx_cnt != (size_t)frame_cnt || rx_hash != corpus_hash)
+            fails++;
+    }
+    free(corpus);
+    free(frame_end);
+    return fails ? 1 : 0;
+}
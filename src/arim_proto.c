@@ -25,6 +25,7 @@
 #include <stdlib.h>
 #include <unistd.h>
 #include <string.h>
+#include <stdint.h>
 #include "main.h"
 #include "ini.h"
 #include "mbox.h"
@@ -50,6 +51,8 @@
 #include "mbox.h"
 #include "tnc_attach.h"
 #include "datathread.h"
+#include "tnc_state.h"
+#include "timer.h"
 
 pthread_mutex_t mutex_arim_state = PTHREAD_MUTEX_INITIALIZER;
 pthread_mutex_t mutex_send_repeats = PTHREAD_MUTEX_INITIALIZER;
@@ -58,12 +61,16 @@ char msg_acknak_buffer[MAX_ACKNAK_SIZE];
 char msg_buffer[MAX_UNCOMP_DATA_SIZE];
 
 size_t msg_len;
-time_t prev_time;
 char prev_fecmode[TNC_FECMODE_SIZE];
 char prev_to_call[TNC_MYCALL_SIZE];
 char prev_msg[MAX_UNCOMP_DATA_SIZE];
 int rcv_nak_cnt = 0, ack_timeout = 30, send_repeats = 0, fecmode_downshift = 0;
 static int arim_state = 0;
+/* protocol timers, serviced by the data, reactor or serial thread */
+TIMER_SVC proto_timers = TIMER_SVC_INITIALIZER;
+/* deadline of the current state, guarded by mutex_arim_state */
+static unsigned int state_timer, state_timer_seq;
+static int state_timer_secs;
 
 const char *downshift_v1[] = {
     /* 4FSK family */
@@ -216,6 +223,7 @@ const char *events[] = {
     "EV_ARQ_FLIST_RCV_DONE",            /* 60 */
     "EV_ARQ_FLIST_SEND",                /* 61 */
     "EV_ARQ_FLIST_SEND_CMD",            /* 62 */
+    "EV_TIMEOUT",                       /* 63 */
 };
 
 void arim_on_cancel()
@@ -277,9 +285,7 @@ int arim_copy_netcall(char *call, size_t size, int which)
 
 void arim_copy_remote_call(char *call, size_t size)
 {
-    pthread_mutex_lock(&mutex_tnc_set);
-    snprintf(call, size, "%s", g_tnc_settings[g_cur_tnc].arq_remote_call);
-    pthread_mutex_unlock(&mutex_tnc_set);
+    tnc_state_copy_remote(call, size, NULL, 0);
 }
 
 void arim_copy_target_call(char *call, size_t size)
@@ -305,9 +311,7 @@ void arim_copy_arq_bw(char *val, size_t size)
 
 void arim_copy_arq_bw_hz(char *val, size_t size)
 {
-    pthread_mutex_lock(&mutex_tnc_set);
-    snprintf(val, size, "%s", g_tnc_settings[g_cur_tnc].arq_bandwidth_hz);
-    pthread_mutex_unlock(&mutex_tnc_set);
+    tnc_state_copy_remote(NULL, 0, val, size);
 }
 
 void arim_copy_listen(char *val, size_t size)
@@ -444,6 +448,57 @@ void arim_set_state(int newstate)
     }
     pthread_mutex_lock(&mutex_arim_state);
     arim_state = newstate;
+    /* leaving the previous state, so its deadline no longer applies.
+       A state with a timeout arms its own by arim_start_timer() */
+    timer_cancel(&proto_timers, state_timer);
+    state_timer = 0;
+    state_timer_secs = 0;
+    ++state_timer_seq;
+    pthread_mutex_unlock(&mutex_arim_state);
+    if (newstate != ST_IDLE)
+        datathread_wake_tick(); /* start protocol timers */
+}
+
+static void arim_on_state_timer(void *arg)
+{
+    unsigned int seq = (unsigned int)(uintptr_t)arg;
+    int current;
+
+    /* a deadline may expire while another thread is changing the state,
+       so ignore it if it was cancelled or replaced in the meantime */
+    pthread_mutex_lock(&mutex_arim_state);
+    current = (seq == state_timer_seq);
+    if (current)
+        state_timer = 0;
+    pthread_mutex_unlock(&mutex_arim_state);
+    if (current)
+        arim_on_event(EV_TIMEOUT, 0);
+}
+
+static void arim_arm_state_timer(int secs)
+{
+    /* call with mutex_arim_state held */
+    timer_cancel(&proto_timers, state_timer);
+    state_timer_secs = secs;
+    state_timer = timer_start(&proto_timers, secs * 1000, 0,
+                                  arim_on_state_timer, (void *)(uintptr_t)(++state_timer_seq));
+}
+
+void arim_start_timer(int secs)
+{
+    /* (re)arm the deadline for the current state, EV_TIMEOUT
+       is sent to the state when it expires */
+    pthread_mutex_lock(&mutex_arim_state);
+    arim_arm_state_timer(secs);
+    pthread_mutex_unlock(&mutex_arim_state);
+}
+
+void arim_reload_timer()
+{
+    /* restart the current state's deadline with its full timeout */
+    pthread_mutex_lock(&mutex_arim_state);
+    if (state_timer_secs)
+        arim_arm_state_timer(state_timer_secs);
     pthread_mutex_unlock(&mutex_arim_state);
 }
 
@@ -462,32 +517,18 @@ int arim_is_idle()
 
 int arim_is_channel_busy()
 {
-    int ret;
-
-    pthread_mutex_lock(&mutex_tnc_set);
-    ret = strncmp(g_tnc_settings[g_cur_tnc].busy, "TRUE", 4);
-    pthread_mutex_unlock(&mutex_tnc_set);
-    return ret ? 0 : 1;
+    return tnc_state_is_busy();
 }
 
 void arim_set_channel_not_busy()
 {
-    pthread_mutex_lock(&mutex_tnc_set);
-    snprintf(g_tnc_settings[g_cur_tnc].busy,
-        sizeof(g_tnc_settings[g_cur_tnc].busy), "%s", "FALSE");
-    pthread_mutex_unlock(&mutex_tnc_set);
+    tnc_state_set_busy(0);
     bufq_queue_debug_log("ARIM: TNC is not BUSY");
 }
 
 int arim_tnc_is_idle()
 {
-    int tnc_disc, tnc_ch_not_busy;
-
-    pthread_mutex_lock(&mutex_tnc_set);
-    tnc_disc = strncmp(g_tnc_settings[g_cur_tnc].state, "DISC", 4) ? 0 : 1;
-    tnc_ch_not_busy = strncmp(g_tnc_settings[g_cur_tnc].busy, "TRUE", 4);
-    pthread_mutex_unlock(&mutex_tnc_set);
-    return (tnc_disc && tnc_ch_not_busy);
+    return (tnc_state_get_state() == TNC_STATE_DISC && !tnc_state_is_busy());
 }
 
 int arim_get_send_repeats()
@@ -509,32 +550,17 @@ void arim_set_send_repeats(int val)
 
 int arim_get_fec_repeats()
 {
-    int ret;
-
-    pthread_mutex_lock(&mutex_tnc_set);
-    ret = atoi(g_tnc_settings[g_cur_tnc].fecrepeats);
-    pthread_mutex_unlock(&mutex_tnc_set);
-    return ret;
+    return tnc_state_get_fec_repeats();
 }
 
 int arim_get_buffer_cnt()
 {
-    int ret;
-
-    pthread_mutex_lock(&mutex_tnc_set);
-    ret = atoi(g_tnc_settings[g_cur_tnc].buffer);
-    pthread_mutex_unlock(&mutex_tnc_set);
-    return ret;
+    return tnc_state_get_buffer();
 }
 
 int arim_is_receiving()
 {
-    int ret;
-
-    pthread_mutex_lock(&mutex_tnc_set);
-    ret = strncasecmp(g_tnc_settings[g_cur_tnc].state, "FECRCV", 6);
-    pthread_mutex_unlock(&mutex_tnc_set);
-    return ret ? 0 : 1;
+    return (tnc_state_get_state() == TNC_STATE_FECRCV);
 }
 
 void arim_copy_fecmode(char *mode, size_t size)
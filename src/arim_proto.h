@@ -26,6 +26,7 @@
 
 #include "main.h"
 #include "ini.h"
+#include "timer.h"
 
 #define ST_IDLE                         0
 #define ST_SEND_MSG_BUF_WAIT            1
@@ -133,6 +134,7 @@
 #define EV_ARQ_FLIST_RCV_DONE           60
 #define EV_ARQ_FLIST_SEND               61
 #define EV_ARQ_FLIST_SEND_CMD           62
+#define EV_TIMEOUT                      63
 
 #define MAX_ACKNAK_SIZE                 50
 
@@ -173,9 +175,10 @@ extern int arim_tnc_is_idle(void);
 extern int arim_is_channel_busy(void);
 extern void arim_set_channel_not_busy(void);
 extern void arim_on_cancel(void);
+extern void arim_start_timer(int secs);
+extern void arim_reload_timer(void);
 
 extern size_t msg_len;
-extern time_t prev_time;
 extern int rcv_nak_cnt;
 extern int ack_timeout;
 extern int send_repeats;
@@ -185,6 +188,7 @@ extern char prev_to_call[TNC_MYCALL_SIZE];
 extern char prev_msg[MAX_UNCOMP_DATA_SIZE];
 extern char msg_buffer[MAX_UNCOMP_DATA_SIZE];
 extern char msg_acknak_buffer[MAX_ACKNAK_SIZE];
+extern TIMER_SVC proto_timers;
 
 #endif
 
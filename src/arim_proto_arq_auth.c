@@ -35,7 +35,6 @@
 
 void arim_proto_arq_auth_send_a1_wait(int event, int param)
 {
-    time_t t;
     char buffer[MAX_LOG_LINE_SIZE];
 
     switch (event) {
@@ -49,14 +48,12 @@ void arim_proto_arq_auth_send_a1_wait(int event, int param)
         /* a PTT async response was received from the TNC */
         if (param) {
             /* still sending, reload timer */
-            prev_time = time(NULL);
+            arim_reload_timer();
         }
         break;
     case EV_ARQ_CANCEL_WAIT:
         /* wait canceled, return to connected state */
         arim_set_state(ST_ARQ_CONNECTED);
-        ack_timeout = ARDOP_CONN_TIMEOUT;
-        prev_time = time(NULL);
         break;
     case EV_ARQ_DISCONNECTED:
         /* a DISCONNECTED async response was received from the TNC */
@@ -73,28 +70,21 @@ void arim_proto_arq_auth_send_a1_wait(int event, int param)
             ui_set_status_dirty(STATUS_ARQ_DISCONNECTED);
         } else {
             /* reload timer */
-            ack_timeout = ARDOP_CONN_TIMEOUT;
-            prev_time = time(NULL);
+            arim_start_timer(ARDOP_CONN_TIMEOUT);
             ui_set_status_dirty(STATUS_REFRESH);
         }
         break;
     case EV_PERIODIC:
+    case EV_TIMEOUT:
         if (!arim_get_buffer_cnt()) {
             /* done sending a1 command, will wait for a2 response next */
             arim_set_state(ST_ARQ_AUTH_RCV_A2_WAIT);
-            ack_timeout = ARDOP_CONN_SEND_TIMEOUT;
-            prev_time = time(NULL);
+            arim_start_timer(ARDOP_CONN_SEND_TIMEOUT);
             ui_set_status_dirty(STATUS_ARQ_AUTH_BUSY);
-        } else {
-            t = time(NULL);
-            /* see if we timed out */
-            if (t > prev_time + ack_timeout) {
-                /* timeout, return to connected state */
-                ack_timeout = ARDOP_CONN_TIMEOUT;
-                prev_time = time(NULL);
-                arim_set_state(ST_ARQ_CONNECTED);
-                ui_set_status_dirty(STATUS_REFRESH);
-            }
+        } else if (event == EV_TIMEOUT) {
+            /* timeout, return to connected state */
+            arim_set_state(ST_ARQ_CONNECTED);
+            ui_set_status_dirty(STATUS_REFRESH);
         }
         break;
     }
@@ -102,7 +92,6 @@ void arim_proto_arq_auth_send_a1_wait(int event, int param)
 
 void arim_proto_arq_auth_send_a2_wait(int event, int param)
 {
-    time_t t;
     char buffer[MAX_LOG_LINE_SIZE];
 
     switch (event) {
@@ -116,14 +105,12 @@ void arim_proto_arq_auth_send_a2_wait(int event, int param)
         /* a PTT async response was received from the TNC */
         if (param) {
             /* still sending, reload timer */
-            prev_time = time(NULL);
+            arim_reload_timer();
         }
         break;
     case EV_ARQ_CANCEL_WAIT:
         /* wait canceled, return to connected state */
         arim_set_state(ST_ARQ_CONNECTED);
-        ack_timeout = ARDOP_CONN_TIMEOUT;
-        prev_time = time(NULL);
         break;
     case EV_ARQ_DISCONNECTED:
         /* a DISCONNECTED async response was received from the TNC */
@@ -140,28 +127,21 @@ void arim_proto_arq_auth_send_a2_wait(int event, int param)
             ui_set_status_dirty(STATUS_ARQ_DISCONNECTED);
         } else {
             /* reload timer */
-            ack_timeout = ARDOP_CONN_TIMEOUT;
-            prev_time = time(NULL);
+            arim_start_timer(ARDOP_CONN_TIMEOUT);
             ui_set_status_dirty(STATUS_REFRESH);
         }
         break;
     case EV_PERIODIC:
+    case EV_TIMEOUT:
         if (!arim_get_buffer_cnt()) {
             /* done sending a2 command, will wait for a3 response next */
             arim_set_state(ST_ARQ_AUTH_RCV_A3_WAIT);
-            ack_timeout = ARDOP_CONN_SEND_TIMEOUT;
-            prev_time = time(NULL);
+            arim_start_timer(ARDOP_CONN_SEND_TIMEOUT);
             ui_set_status_dirty(STATUS_ARQ_AUTH_BUSY);
-        } else {
-            t = time(NULL);
-            /* see if we timed out */
-            if (t > prev_time + ack_timeout) {
-                /* timeout, return to connected state */
-                ack_timeout = ARDOP_CONN_TIMEOUT;
-                prev_time = time(NULL);
-                arim_set_state(ST_ARQ_CONNECTED);
-                ui_set_status_dirty(STATUS_REFRESH);
-            }
+        } else if (event == EV_TIMEOUT) {
+            /* timeout, return to connected state */
+            arim_set_state(ST_ARQ_CONNECTED);
+            ui_set_status_dirty(STATUS_REFRESH);
         }
         break;
     }
@@ -169,7 +149,6 @@ void arim_proto_arq_auth_send_a2_wait(int event, int param)
 
 void arim_proto_arq_auth_send_a3_wait(int event, int param)
 {
-    time_t t;
     char buffer[MAX_LOG_LINE_SIZE];
 
     switch (event) {
@@ -183,14 +162,12 @@ void arim_proto_arq_auth_send_a3_wait(int event, int param)
         /* a PTT async response was received from the TNC */
         if (param) {
             /* still sending, reload timer */
-            prev_time = time(NULL);
+            arim_reload_timer();
         }
         break;
     case EV_ARQ_CANCEL_WAIT:
         /* wait canceled, return to connected state */
         arim_set_state(ST_ARQ_CONNECTED);
-        ack_timeout = ARDOP_CONN_TIMEOUT;
-        prev_time = time(NULL);
         break;
     case EV_ARQ_DISCONNECTED:
         /* a DISCONNECTED async response was received from the TNC */
@@ -207,28 +184,21 @@ void arim_proto_arq_auth_send_a3_wait(int event, int param)
             ui_set_status_dirty(STATUS_ARQ_DISCONNECTED);
         } else {
             /* reload timer */
-            ack_timeout = ARDOP_CONN_TIMEOUT;
-            prev_time = time(NULL);
+            arim_start_timer(ARDOP_CONN_TIMEOUT);
             ui_set_status_dirty(STATUS_REFRESH);
         }
         break;
     case EV_PERIODIC:
+    case EV_TIMEOUT:
         if (!arim_get_buffer_cnt()) {
             /* done sending a3 command, wait for a4 response */
             arim_set_state(ST_ARQ_AUTH_RCV_A4_WAIT);
-            ack_timeout = ARDOP_CONN_SEND_TIMEOUT;
-            prev_time = time(NULL);
+            arim_start_timer(ARDOP_CONN_SEND_TIMEOUT);
             ui_set_status_dirty(STATUS_ARQ_AUTH_BUSY);
-        } else {
-            t = time(NULL);
-            /* see if we timed out */
-            if (t > prev_time + ack_timeout) {
-                /* timeout, return to connected state */
-                ack_timeout = ARDOP_CONN_TIMEOUT;
-                prev_time = time(NULL);
-                arim_set_state(ST_ARQ_CONNECTED);
-                ui_set_status_dirty(STATUS_REFRESH);
-            }
+        } else if (event == EV_TIMEOUT) {
+            /* timeout, return to connected state */
+            arim_set_state(ST_ARQ_CONNECTED);
+            ui_set_status_dirty(STATUS_REFRESH);
         }
         break;
     }
@@ -236,7 +206,6 @@ void arim_proto_arq_auth_send_a3_wait(int event, int param)
 
 void arim_proto_arq_auth_rcv_a2_wait(int event, int param)
 {
-    time_t t;
     char buffer[MAX_LOG_LINE_SIZE];
 
     switch (event) {
@@ -250,29 +219,24 @@ void arim_proto_arq_auth_rcv_a2_wait(int event, int param)
         /* a PTT async response was received from the TNC */
         if (param) {
             /* still sending, reload timer */
-            prev_time = time(NULL);
+            arim_reload_timer();
         }
         break;
     case EV_ARQ_CANCEL_WAIT:
         /* wait canceled, return to connected state */
         arim_set_state(ST_ARQ_CONNECTED);
-        ack_timeout = ARDOP_CONN_TIMEOUT;
-        prev_time = time(NULL);
         break;
     case EV_ARQ_AUTH_SEND_CMD:
         /* received good /A2 from remote stn in response to our /A1 */
         arim_arq_auth_on_send_a3();
         arim_set_state(ST_ARQ_AUTH_SEND_A3);
-        ack_timeout = ARDOP_CONN_TIMEOUT;
-        prev_time = time(NULL);
+        arim_start_timer(ARDOP_CONN_TIMEOUT);
         ui_set_status_dirty(STATUS_ARQ_AUTH_BUSY);
         break;
     case EV_ARQ_AUTH_ERROR:
         /* something went wrong */
         arim_arq_auth_on_error();
         arim_set_state(ST_ARQ_CONNECTED);
-        ack_timeout = ARDOP_CONN_TIMEOUT;
-        prev_time = time(NULL);
         ui_set_status_dirty(STATUS_ARQ_AUTH_ERROR);
         break;
     case EV_ARQ_DISCONNECTED:
@@ -290,28 +254,20 @@ void arim_proto_arq_auth_rcv_a2_wait(int event, int param)
             ui_set_status_dirty(STATUS_ARQ_DISCONNECTED);
         } else {
             /* reload timer */
-            ack_timeout = ARDOP_CONN_TIMEOUT;
-            prev_time = time(NULL);
+            arim_start_timer(ARDOP_CONN_TIMEOUT);
             ui_set_status_dirty(STATUS_REFRESH);
         }
         break;
-    case EV_PERIODIC:
-        t = time(NULL);
-        /* see if we timed out */
-        if (t > prev_time + ack_timeout) {
-            /* timeout, return to connected state */
-            ack_timeout = ARDOP_CONN_TIMEOUT;
-            prev_time = time(NULL);
-            arim_set_state(ST_ARQ_CONNECTED);
-            ui_set_status_dirty(STATUS_REFRESH);
-        }
+    case EV_TIMEOUT:
+        /* timeout, return to connected state */
+        arim_set_state(ST_ARQ_CONNECTED);
+        ui_set_status_dirty(STATUS_REFRESH);
         break;
     }
 }
 
 void arim_proto_arq_auth_rcv_a3_wait(int event, int param)
 {
-    time_t t;
     char buffer[MAX_LOG_LINE_SIZE];
 
     switch (event) {
@@ -325,29 +281,23 @@ void arim_proto_arq_auth_rcv_a3_wait(int event, int param)
         /* a PTT async response was received from the TNC */
         if (param) {
             /* still sending, reload timer */
-            prev_time = time(NULL);
+            arim_reload_timer();
         }
         break;
     case EV_ARQ_CANCEL_WAIT:
         /* wait canceled, return to connected state */
         arim_set_state(ST_ARQ_CONNECTED);
-        ack_timeout = ARDOP_CONN_TIMEOUT;
-        prev_time = time(NULL);
         break;
     case EV_ARQ_AUTH_OK:
         /* /A3 from remote stn is accepted, mutual auth is complete */
         arim_arq_auth_on_ok();
         arim_set_state(ST_ARQ_CONNECTED);
-        ack_timeout = ARDOP_CONN_TIMEOUT;
-        prev_time = time(NULL);
         ui_set_status_dirty(STATUS_ARQ_AUTH_OK);
         break;
     case EV_ARQ_AUTH_ERROR:
         /* remote station can't be authenticated */
         arim_arq_auth_on_error();
         arim_set_state(ST_ARQ_CONNECTED);
-        ack_timeout = ARDOP_CONN_TIMEOUT;
-        prev_time = time(NULL);
         ui_set_status_dirty(STATUS_ARQ_EAUTH_REMOTE);
         break;
     case EV_ARQ_DISCONNECTED:
@@ -365,28 +315,20 @@ void arim_proto_arq_auth_rcv_a3_wait(int event, int param)
             ui_set_status_dirty(STATUS_ARQ_DISCONNECTED);
         } else {
             /* reload timer */
-            ack_timeout = ARDOP_CONN_TIMEOUT;
-            prev_time = time(NULL);
+            arim_start_timer(ARDOP_CONN_TIMEOUT);
             ui_set_status_dirty(STATUS_REFRESH);
         }
         break;
-    case EV_PERIODIC:
-        t = time(NULL);
-        /* see if we timed out */
-        if (t > prev_time + ack_timeout) {
-            /* timeout, return to connected state */
-            ack_timeout = ARDOP_CONN_TIMEOUT;
-            prev_time = time(NULL);
-            arim_set_state(ST_ARQ_CONNECTED);
-            ui_set_status_dirty(STATUS_REFRESH);
-        }
+    case EV_TIMEOUT:
+        /* timeout, return to connected state */
+        arim_set_state(ST_ARQ_CONNECTED);
+        ui_set_status_dirty(STATUS_REFRESH);
         break;
     }
 }
 
 void arim_proto_arq_auth_rcv_a4_wait(int event, int param)
 {
-    time_t t;
     char buffer[MAX_LOG_LINE_SIZE];
 
     switch (event) {
@@ -400,29 +342,23 @@ void arim_proto_arq_auth_rcv_a4_wait(int event, int param)
         /* a PTT async response was received from the TNC */
         if (param) {
             /* still sending, reload timer */
-            prev_time = time(NULL);
+            arim_reload_timer();
         }
         break;
     case EV_ARQ_CANCEL_WAIT:
         /* wait canceled, return to connected state */
         arim_set_state(ST_ARQ_CONNECTED);
-        ack_timeout = ARDOP_CONN_TIMEOUT;
-        prev_time = time(NULL);
         break;
     case EV_ARQ_AUTH_OK:
         /* remote stn accepted our /A3, mutual auth is complete */
         arim_arq_auth_on_ok();
         arim_set_state(ST_ARQ_CONNECTED);
-        ack_timeout = ARDOP_CONN_TIMEOUT;
-        prev_time = time(NULL);
         ui_set_status_dirty(STATUS_ARQ_AUTH_OK);
         break;
     case EV_ARQ_AUTH_ERROR:
         /* something went wrong */
         arim_arq_auth_on_error();
         arim_set_state(ST_ARQ_CONNECTED);
-        ack_timeout = ARDOP_CONN_TIMEOUT;
-        prev_time = time(NULL);
         ui_set_status_dirty(STATUS_ARQ_AUTH_ERROR);
         break;
     case EV_ARQ_DISCONNECTED:
@@ -440,21 +376,14 @@ void arim_proto_arq_auth_rcv_a4_wait(int event, int param)
             ui_set_status_dirty(STATUS_ARQ_DISCONNECTED);
         } else {
             /* reload timer */
-            ack_timeout = ARDOP_CONN_TIMEOUT;
-            prev_time = time(NULL);
+            arim_start_timer(ARDOP_CONN_TIMEOUT);
             ui_set_status_dirty(STATUS_REFRESH);
         }
         break;
-    case EV_PERIODIC:
-        t = time(NULL);
-        /* see if we timed out */
-        if (t > prev_time + ack_timeout) {
-            /* timeout, return to connected state */
-            ack_timeout = ARDOP_CONN_TIMEOUT;
-            prev_time = time(NULL);
-            arim_set_state(ST_ARQ_CONNECTED);
-            ui_set_status_dirty(STATUS_REFRESH);
-        }
+    case EV_TIMEOUT:
+        /* timeout, return to connected state */
+        arim_set_state(ST_ARQ_CONNECTED);
+        ui_set_status_dirty(STATUS_REFRESH);
         break;
     }
 }
@@ -39,13 +39,12 @@
 
 void arim_proto_arq_conn_pend_wait(int event, int param)
 {
-    time_t t;
-
     switch(event) {
     case EV_RCV_PING:
         /* a PING asynch response was received from the TNC */
         if (arim_proc_ping()) {
             arim_set_state(ST_SEND_PING_ACK_PEND);
+            arim_start_timer(ARDOP_CONNREQ_TIMEOUT);
             ui_set_status_dirty(STATUS_PING_RCVD);
         } else {
             arim_set_state(ST_IDLE);
@@ -55,7 +54,7 @@ void arim_proto_arq_conn_pend_wait(int event, int param)
         /* a PTT async response was received from the TNC */
         if (param) {
             /* reload timer */
-            prev_time = time(NULL);
+            arim_reload_timer();
         }
         break;
     case EV_ARQ_CAN_PENDING:
@@ -65,9 +64,8 @@ void arim_proto_arq_conn_pend_wait(int event, int param)
     case EV_ARQ_TARGET:
         /* a TARGET asynch response was received from the TNC */
         if (arim_arq_on_target()) {
-            ack_timeout = ARDOP_CONNREQ_TIMEOUT;
-            t = time(NULL);
             arim_set_state(ST_ARQ_IN_CONNECT_WAIT);
+            arim_start_timer(ARDOP_CONNREQ_TIMEOUT);
         } else {
             arim_set_state(ST_IDLE);
         }
@@ -84,20 +82,15 @@ void arim_proto_arq_conn_pend_wait(int event, int param)
         arim_arq_on_conn_rej_bw();
         ui_set_status_dirty(STATUS_ARQ_CONN_REQ_FAIL);
         break;
-    case EV_PERIODIC:
-        t = time(NULL);
-        /* see if we timed out waiting */
-        if (t > prev_time + ack_timeout) {
-            /* timeout, all done */
-            arim_set_state(ST_IDLE);
-        }
+    case EV_TIMEOUT:
+        /* timeout, all done */
+        arim_set_state(ST_IDLE);
         break;
     }
 }
 
 void arim_proto_arq_conn_out_wait(int event, int param)
 {
-    time_t t;
     char buffer[MAX_LOG_LINE_SIZE];
 
     /* handle every case encountered in testing to date,
@@ -113,14 +106,12 @@ void arim_proto_arq_conn_out_wait(int event, int param)
         /* a PTT async response was received from the TNC */
         if (param) {
             /* reload timer */
-            prev_time = time(NULL);
+            arim_reload_timer();
         }
         break;
     case EV_ARQ_CONNECTED:
         /* a CONNECTED async response was received from the TNC */
         arim_set_state(ST_ARQ_CONNECTED);
-        ack_timeout = ARDOP_CONN_TIMEOUT;
-        prev_time = time(NULL);
         arim_arq_on_connected();
         ui_set_status_dirty(STATUS_ARQ_CONNECTED);
         break;
@@ -139,8 +130,7 @@ void arim_proto_arq_conn_out_wait(int event, int param)
             ui_set_status_dirty(STATUS_ARQ_CONN_REQ_FAIL);
         } else {
             /* reload timer */
-            ack_timeout = ARDOP_CONN_TIMEOUT;
-            prev_time = time(NULL);
+            arim_start_timer(ARDOP_CONN_TIMEOUT);
             ui_set_status_dirty(STATUS_REFRESH);
         }
         break;
@@ -155,30 +145,23 @@ void arim_proto_arq_conn_out_wait(int event, int param)
         if (arim_arq_on_conn_rej_bw()) {
             arim_set_state(ST_ARQ_OUT_CONNECT_WAIT_RPT);
             /* trying again, so reload timer */
-            ack_timeout = ARDOP_OUT_CONN_RPT_TIMEOUT;
-            prev_time = time(NULL);
+            arim_start_timer(ARDOP_OUT_CONN_RPT_TIMEOUT);
         } else {
             arim_set_state(ST_IDLE);
             ui_set_status_dirty(STATUS_ARQ_CONN_REQ_FAIL);
         }
         break;
-    case EV_PERIODIC:
-        t = time(NULL);
-        /* see if we timed out waiting for connection ack */
-        if (t > prev_time + ack_timeout) {
-            /* timeout, all done */
-            arim_set_state(ST_IDLE);
-            arim_arq_on_conn_fail();
-            ui_set_status_dirty(STATUS_ARQ_CONN_REQ_FAIL);
-        }
+    case EV_TIMEOUT:
+        /* timeout, all done */
+        arim_set_state(ST_IDLE);
+        arim_arq_on_conn_fail();
+        ui_set_status_dirty(STATUS_ARQ_CONN_REQ_FAIL);
         break;
     }
 }
 
 void arim_proto_arq_conn_out_wait_rpt(int event, int param)
 {
-    time_t t;
-
     /* delay for ARDOP_OUT_CONN_RPT_TIMEOUT seconds before
        repeating a connection request with a new ARQBW */
     switch (event) {
@@ -188,21 +171,16 @@ void arim_proto_arq_conn_out_wait_rpt(int event, int param)
         arim_arq_on_conn_cancel();
         ui_set_status_dirty(STATUS_ARQ_CONN_CAN);
         break;
-    case EV_PERIODIC:
-        t = time(NULL);
-        /* see if it's time to repeat connection request */
-        if (t > prev_time + ack_timeout) {
-            arim_set_state(ST_IDLE);
-            ui_set_status_dirty(STATUS_ARQ_CONN_REQ_REPEAT);
-        }
+    case EV_TIMEOUT:
+        /* time to repeat connection request */
+        arim_set_state(ST_IDLE);
+        ui_set_status_dirty(STATUS_ARQ_CONN_REQ_REPEAT);
         break;
     }
 }
 
 void arim_proto_arq_conn_pp_wait(int event, int param)
 {
-    time_t t;
-
     switch (event) {
     case EV_CANCEL:
         bufq_queue_cmd_out("ABORT");
@@ -228,21 +206,16 @@ void arim_proto_arq_conn_pp_wait(int event, int param)
             ui_set_status_dirty(STATUS_ARQ_CONN_PP_SEND);
         }
         break;
-    case EV_PERIODIC:
-        t = time(NULL);
-        /* see if we timed out waiting for ping ack */
-        if (t > prev_time + ack_timeout) {
-            /* timeout, all done */
-            arim_set_state(ST_IDLE);
-            ui_set_status_dirty(STATUS_ARQ_CONN_PP_ACK_TO);
-        }
+    case EV_TIMEOUT:
+        /* timeout, all done */
+        arim_set_state(ST_IDLE);
+        ui_set_status_dirty(STATUS_ARQ_CONN_PP_ACK_TO);
         break;
     }
 }
 
 void arim_proto_arq_conn_in_wait(int event, int param)
 {
-    time_t t;
     char buffer[MAX_LOG_LINE_SIZE];
 
     /* handle every case encountered in testing to date,
@@ -258,14 +231,12 @@ void arim_proto_arq_conn_in_wait(int event, int param)
         /* a PTT async response was received from the TNC */
         if (param) {
             /* reload timer */
-            prev_time = time(NULL);
+            arim_reload_timer();
         }
         break;
     case EV_ARQ_CONNECTED:
         /* a CONNECTED async response was received from the TNC */
         arim_set_state(ST_ARQ_CONNECTED);
-        ack_timeout = ARDOP_CONN_TIMEOUT;
-        prev_time = time(NULL);
         arim_arq_on_connected();
         ui_set_status_dirty(STATUS_ARQ_CONNECTED);
         break;
@@ -284,8 +255,7 @@ void arim_proto_arq_conn_in_wait(int event, int param)
             ui_set_status_dirty(STATUS_ARQ_DISCONNECTED);
         } else {
             /* reload timer */
-            ack_timeout = ARDOP_CONN_TIMEOUT;
-            prev_time = time(NULL);
+            arim_start_timer(ARDOP_CONN_TIMEOUT);
             ui_set_status_dirty(STATUS_REFRESH);
         }
         break;
@@ -301,15 +271,11 @@ void arim_proto_arq_conn_in_wait(int event, int param)
         arim_arq_on_conn_rej_bw();
         ui_set_status_dirty(STATUS_ARQ_CONN_REQ_FAIL);
         break;
-    case EV_PERIODIC:
-        t = time(NULL);
-        /* see if we timed out waiting */
-        if (t > prev_time + ack_timeout) {
-            /* timeout, all done */
-            arim_set_state(ST_IDLE);
-            arim_arq_on_conn_timeout();
-            ui_set_status_dirty(STATUS_ARQ_CONN_TIMEOUT);
-        }
+    case EV_TIMEOUT:
+        /* timeout, all done */
+        arim_set_state(ST_IDLE);
+        arim_arq_on_conn_timeout();
+        ui_set_status_dirty(STATUS_ARQ_CONN_TIMEOUT);
         break;
     }
 }
@@ -329,64 +295,55 @@ void arim_proto_arq_conn_connected(int event, int param)
     case EV_ARQ_FLIST_RCV_WAIT:
         /* after outgoing /FLGET, wait for incoming /FLPUT */
         arim_set_state(ST_ARQ_FLIST_RCV_WAIT);
-        ack_timeout = ARDOP_CONN_TIMEOUT;
-        prev_time = time(NULL);
+        arim_start_timer(ARDOP_CONN_TIMEOUT);
         ui_set_status_dirty(STATUS_ARQ_FLIST_RCV_WAIT);
         break;
     case EV_ARQ_FLIST_SEND_CMD:
         /* start sending file listing */
         arim_set_state(ST_ARQ_FLIST_SEND_WAIT);
-        ack_timeout = ARDOP_CONN_SEND_TIMEOUT;
-        prev_time = time(NULL);
+        arim_start_timer(ARDOP_CONN_SEND_TIMEOUT);
         ui_set_status_dirty(STATUS_ARQ_FLIST_SEND);
         break;
     case EV_ARQ_FILE_SEND_CMD:
         /* start sending file */
         arim_set_state(ST_ARQ_FILE_SEND_WAIT);
-        ack_timeout = ARDOP_CONN_SEND_TIMEOUT;
-        prev_time = time(NULL);
+        arim_start_timer(ARDOP_CONN_SEND_TIMEOUT);
         ui_set_status_dirty(STATUS_ARQ_FILE_SEND);
         break;
     case EV_ARQ_FILE_SEND_CMD_CLIENT:
         /* wait for response from remote station */
         arim_set_state(ST_ARQ_FILE_SEND_WAIT_OK);
-        ack_timeout = ARDOP_CONN_SEND_TIMEOUT;
-        prev_time = time(NULL);
+        arim_start_timer(ARDOP_CONN_SEND_TIMEOUT);
         ui_set_status_dirty(STATUS_ARQ_FILE_SEND);
         break;
     case EV_ARQ_FILE_RCV_WAIT:
         /* after outgoing /FGET, wait for incoming /FPUT command */
         arim_set_state(ST_ARQ_FILE_RCV_WAIT);
-        ack_timeout = ARDOP_CONN_TIMEOUT;
-        prev_time = time(NULL);
+        arim_start_timer(ARDOP_CONN_TIMEOUT);
         ui_set_status_dirty(STATUS_ARQ_FILE_RCV_WAIT);
         break;
     case EV_ARQ_FILE_RCV_WAIT_OK:
         /* after incoming /FPUT, wait for outgoing /OK response */
         arim_set_state(ST_ARQ_FILE_RCV_WAIT_OK);
-        ack_timeout = ARDOP_CONN_TIMEOUT;
-        prev_time = time(NULL);
+        arim_start_timer(ARDOP_CONN_TIMEOUT);
         ui_set_status_dirty(STATUS_ARQ_FILE_RCV);
         break;
     case EV_ARQ_FILE_RCV:
         /* start receiving file */
         arim_set_state(ST_ARQ_FILE_RCV);
-        ack_timeout = ARDOP_CONN_TIMEOUT;
-        prev_time = time(NULL);
+        arim_start_timer(ARDOP_CONN_TIMEOUT);
         ui_set_status_dirty(STATUS_ARQ_FILE_RCV);
         break;
     case EV_ARQ_MSG_SEND_CMD:
         /* start sending message */
         arim_set_state(ST_ARQ_MSG_SEND_WAIT);
-        ack_timeout = ARDOP_CONN_SEND_TIMEOUT;
-        prev_time = time(NULL);
+        arim_start_timer(ARDOP_CONN_SEND_TIMEOUT);
         ui_set_status_dirty(STATUS_ARQ_MSG_SEND);
         break;
     case EV_ARQ_MSG_RCV:
         /* start receiving message */
         arim_set_state(ST_ARQ_MSG_RCV);
-        ack_timeout = ARDOP_CONN_TIMEOUT;
-        prev_time = time(NULL);
+        arim_start_timer(ARDOP_CONN_TIMEOUT);
         ui_set_status_dirty(STATUS_ARQ_MSG_RCV);
         break;
     case EV_ARQ_AUTH_SEND_CMD:
@@ -398,16 +355,13 @@ void arim_proto_arq_conn_connected(int event, int param)
             arim_arq_auth_on_send_a2();
             arim_set_state(ST_ARQ_AUTH_SEND_A2);
         }
-        ack_timeout = ARDOP_CONN_SEND_TIMEOUT;
-        prev_time = time(NULL);
+        arim_start_timer(ARDOP_CONN_SEND_TIMEOUT);
         ui_set_status_dirty(STATUS_ARQ_AUTH_BUSY);
         break;
     case EV_ARQ_AUTH_ERROR:
         /* remote station can't authenticate this station */
         arim_arq_auth_on_error();
         arim_set_state(ST_ARQ_CONNECTED);
-        ack_timeout = ARDOP_CONN_TIMEOUT;
-        prev_time = time(NULL);
         ui_set_status_dirty(STATUS_ARQ_EAUTH_LOCAL);
         break;
     case EV_ARQ_DISCONNECTED:
@@ -424,9 +378,6 @@ void arim_proto_arq_conn_connected(int event, int param)
             arim_arq_on_disconnected();
             ui_set_status_dirty(STATUS_ARQ_DISCONNECTED);
         } else {
-            /* reload timer */
-            ack_timeout = ARDOP_CONN_TIMEOUT;
-            prev_time = time(NULL);
             ui_set_status_dirty(STATUS_REFRESH);
         }
         break;
@@ -40,7 +40,6 @@
 
 void arim_proto_arq_file_send_wait_ok(int event, int param)
 {
-    time_t t;
     char buffer[MAX_LOG_LINE_SIZE];
 
     switch (event) {
@@ -56,14 +55,13 @@ void arim_proto_arq_file_send_wait_ok(int event, int param)
         /* a PTT async response was received from the TNC */
         if (param) {
             /* still sending, reload timer */
-            prev_time = time(NULL);
+            arim_reload_timer();
         }
         break;
     case EV_ARQ_FILE_OK:
         /* remote station is ready to receive file */
-        ack_timeout = ARDOP_CONNREQ_TIMEOUT;
-        prev_time = time(NULL);
         arim_set_state(ST_ARQ_FILE_SEND);
+        arim_start_timer(ARDOP_CONNREQ_TIMEOUT);
         arim_arq_files_on_send_cmd();
         ui_set_status_dirty(STATUS_ARQ_FILE_SEND);
         break;
@@ -71,16 +69,13 @@ void arim_proto_arq_file_send_wait_ok(int event, int param)
         /* auth challenge received, send a2 response */
         arim_arq_auth_on_send_a2();
         arim_set_state(ST_ARQ_AUTH_SEND_A2);
-        ack_timeout = ARDOP_CONN_SEND_TIMEOUT;
-        prev_time = time(NULL);
+        arim_start_timer(ARDOP_CONN_SEND_TIMEOUT);
         ui_set_status_dirty(STATUS_ARQ_AUTH_BUSY);
         break;
     case EV_ARQ_AUTH_ERROR:
         /* remote station can't authenticate this station */
         arim_arq_auth_on_error();
         arim_set_state(ST_ARQ_CONNECTED);
-        ack_timeout = ARDOP_CONN_TIMEOUT;
-        prev_time = time(NULL);
         ui_set_status_dirty(STATUS_ARQ_EAUTH_LOCAL);
         /* cancel file history view entry */
         bufq_queue_ftable("X");
@@ -88,8 +83,6 @@ void arim_proto_arq_file_send_wait_ok(int event, int param)
     case EV_ARQ_FILE_ERROR:
         /* something went wrong */
         arim_set_state(ST_ARQ_CONNECTED);
-        ack_timeout = ARDOP_CONN_TIMEOUT;
-        prev_time = time(NULL);
         ui_set_status_dirty(STATUS_ARQ_FILE_SEND_ERROR);
         /* cancel file history view entry */
         bufq_queue_ftable("X");
@@ -98,8 +91,6 @@ void arim_proto_arq_file_send_wait_ok(int event, int param)
         /* wait canceled, return to connected state */
         arim_set_state(ST_ARQ_CONNECTED);
         ui_set_status_dirty(STATUS_ARQ_CONN_CAN);
-        ack_timeout = ARDOP_CONN_TIMEOUT;
-        prev_time = time(NULL);
         /* cancel file history view entry */
         bufq_queue_ftable("X");
         break;
@@ -122,30 +113,22 @@ void arim_proto_arq_file_send_wait_ok(int event, int param)
             bufq_queue_ftable("X");
         } else {
             /* reload timer */
-            ack_timeout = ARDOP_CONN_TIMEOUT;
-            prev_time = time(NULL);
+            arim_start_timer(ARDOP_CONN_TIMEOUT);
             ui_set_status_dirty(STATUS_REFRESH);
         }
         break;
-    case EV_PERIODIC:
-        t = time(NULL);
-        /* see if we timed out */
-        if (t > prev_time + ack_timeout) {
-            /* timeout, return to connected state */
-            ack_timeout = ARDOP_CONN_TIMEOUT;
-            prev_time = time(NULL);
-            arim_set_state(ST_ARQ_CONNECTED);
-            ui_set_status_dirty(STATUS_ARQ_FILE_SEND_TIMEOUT);
-            /* cancel file history view entry */
-            bufq_queue_ftable("X");
-        }
+    case EV_TIMEOUT:
+        /* timeout, return to connected state */
+        arim_set_state(ST_ARQ_CONNECTED);
+        ui_set_status_dirty(STATUS_ARQ_FILE_SEND_TIMEOUT);
+        /* cancel file history view entry */
+        bufq_queue_ftable("X");
         break;
     }
 }
 
 void arim_proto_arq_file_send_wait(int event, int param)
 {
-    time_t t;
     char buffer[MAX_LOG_LINE_SIZE];
 
     switch (event) {
@@ -161,15 +144,13 @@ void arim_proto_arq_file_send_wait(int event, int param)
         /* a PTT async response was received from the TNC */
         if (param) {
             /* still sending, reload timer */
-            prev_time = time(NULL);
+            arim_reload_timer();
         }
         break;
     case EV_ARQ_CANCEL_WAIT:
         /* wait canceled, return to connected state */
         arim_set_state(ST_ARQ_CONNECTED);
         ui_set_status_dirty(STATUS_ARQ_CONN_CAN);
-        ack_timeout = ARDOP_CONN_TIMEOUT;
-        prev_time = time(NULL);
         /* cancel file history view entry */
         bufq_queue_ftable("X");
         break;
@@ -192,31 +173,24 @@ void arim_proto_arq_file_send_wait(int event, int param)
             bufq_queue_ftable("X");
         } else {
             /* reload timer */
-            ack_timeout = ARDOP_CONN_TIMEOUT;
-            prev_time = time(NULL);
+            arim_start_timer(ARDOP_CONN_TIMEOUT);
             ui_set_status_dirty(STATUS_REFRESH);
         }
         break;
     case EV_PERIODIC:
+    case EV_TIMEOUT:
         if (arim_get_buffer_cnt()) {
             /* data is buffered, change state to sending */
-            ack_timeout = ARDOP_CONN_SEND_TIMEOUT;
-            prev_time = time(NULL);
             arim_set_state(ST_ARQ_FILE_SEND);
+            arim_start_timer(ARDOP_CONN_SEND_TIMEOUT);
             arim_arq_files_on_send_cmd();
             ui_set_status_dirty(STATUS_ARQ_FILE_SEND);
-        } else {
-            t = time(NULL);
-            /* see if we timed out */
-            if (t > prev_time + ack_timeout) {
-                /* timeout, return to connected state */
-                ack_timeout = ARDOP_CONN_TIMEOUT;
-                prev_time = time(NULL);
-                arim_set_state(ST_ARQ_CONNECTED);
-                ui_set_status_dirty(STATUS_ARQ_FILE_SEND_TIMEOUT);
-                /* cancel file history view entry */
-                bufq_queue_ftable("X");
-            }
+        } else if (event == EV_TIMEOUT) {
+            /* timeout, return to connected state */
+            arim_set_state(ST_ARQ_CONNECTED);
+            ui_set_status_dirty(STATUS_ARQ_FILE_SEND_TIMEOUT);
+            /* cancel file history view entry */
+            bufq_queue_ftable("X");
         }
         break;
     }
@@ -224,7 +198,6 @@ void arim_proto_arq_file_send_wait(int event, int param)
 
 void arim_proto_arq_file_send(int event, int param)
 {
-    time_t t;
     char buffer[MAX_LOG_LINE_SIZE];
 
     switch (event) {
@@ -240,23 +213,25 @@ void arim_proto_arq_file_send(int event, int param)
         /* a PTT async response was received from the TNC */
         if (param) {
             /* still sending, reload timer */
-            prev_time = time(NULL);
+            arim_reload_timer();
         }
         break;
     case EV_ARQ_FILE_OK:
         /* success */
         arim_set_state(ST_ARQ_CONNECTED);
-        ack_timeout = ARDOP_CONN_TIMEOUT;
-        prev_time = time(NULL);
         ui_set_status_dirty(STATUS_ARQ_FILE_SEND_ACK);
         /* add to file history view */
         bufq_queue_ftable("D");
         break;
+    case EV_ARQ_FILE_RCV_WAIT:
+        /* remote station has our /FSYNC block sums, wait for the delta */
+        arim_set_state(ST_ARQ_FILE_RCV_WAIT);
+        arim_start_timer(ARDOP_CONN_TIMEOUT);
+        ui_set_status_dirty(STATUS_ARQ_FILE_RCV_WAIT);
+        break;
     case EV_ARQ_FILE_ERROR:
         /* something went wrong */
         arim_set_state(ST_ARQ_CONNECTED);
-        ack_timeout = ARDOP_CONN_TIMEOUT;
-        prev_time = time(NULL);
         ui_set_status_dirty(STATUS_ARQ_FILE_SEND_ERROR);
         /* cancel file history view entry */
         bufq_queue_ftable("X");
@@ -280,27 +255,21 @@ void arim_proto_arq_file_send(int event, int param)
             bufq_queue_ftable("X");
         } else {
             /* reload timer */
-            ack_timeout = ARDOP_CONN_TIMEOUT;
-            prev_time = time(NULL);
+            arim_start_timer(ARDOP_CONN_TIMEOUT);
             ui_set_status_dirty(STATUS_REFRESH);
         }
         break;
     case EV_PERIODIC:
+    case EV_TIMEOUT:
         if (!arim_arq_files_on_send_buffer(arim_get_buffer_cnt())) {
             /* done sending file, will wait for ack */
             ui_set_status_dirty(STATUS_ARQ_FILE_SEND_DONE);
-        } else {
-            t = time(NULL);
-            /* see if we timed out */
-            if (t > prev_time + ack_timeout) {
-                /* timeout, return to connected state */
-                ack_timeout = ARDOP_CONN_TIMEOUT;
-                prev_time = time(NULL);
-                arim_set_state(ST_ARQ_CONNECTED);
-                ui_set_status_dirty(STATUS_ARQ_FILE_SEND_TIMEOUT);
-                /* cancel file history view entry */
-                bufq_queue_ftable("X");
-            }
+        } else if (event == EV_TIMEOUT) {
+            /* timeout, return to connected state */
+            arim_set_state(ST_ARQ_CONNECTED);
+            ui_set_status_dirty(STATUS_ARQ_FILE_SEND_TIMEOUT);
+            /* cancel file history view entry */
+            bufq_queue_ftable("X");
         }
         break;
     }
@@ -308,7 +277,6 @@ void arim_proto_arq_file_send(int event, int param)
 
 void arim_proto_arq_file_rcv_wait_ok(int event, int param)
 {
-    time_t t;
     char buffer[MAX_LOG_LINE_SIZE];
 
     switch (event) {
@@ -322,15 +290,13 @@ void arim_proto_arq_file_rcv_wait_ok(int event, int param)
         /* a PTT async response was received from the TNC */
         if (param) {
             /* still sending, reload timer */
-            prev_time = time(NULL);
+            arim_reload_timer();
         }
         break;
     case EV_ARQ_CANCEL_WAIT:
         /* wait canceled, return to connected state */
         arim_set_state(ST_ARQ_CONNECTED);
         ui_set_status_dirty(STATUS_ARQ_CONN_CAN);
-        ack_timeout = ARDOP_CONN_TIMEOUT;
-        prev_time = time(NULL);
         break;
     case EV_ARQ_DISCONNECTED:
         /* a DISCONNECTED async response was received from the TNC */
@@ -347,28 +313,21 @@ void arim_proto_arq_file_rcv_wait_ok(int event, int param)
             ui_set_status_dirty(STATUS_ARQ_DISCONNECTED);
         } else {
             /* reload timer */
-            ack_timeout = ARDOP_CONN_TIMEOUT;
-            prev_time = time(NULL);
+            arim_start_timer(ARDOP_CONN_TIMEOUT);
             ui_set_status_dirty(STATUS_REFRESH);
         }
         break;
     case EV_PERIODIC:
+    case EV_TIMEOUT:
         if (!arim_get_buffer_cnt()) {
             /* done sending /OK response, will receive file next */
-            ack_timeout = ARDOP_CONN_SEND_TIMEOUT;
-            prev_time = time(NULL);
             arim_set_state(ST_ARQ_FILE_RCV);
+            arim_start_timer(ARDOP_CONN_SEND_TIMEOUT);
             ui_set_status_dirty(STATUS_ARQ_FILE_RCV);
-        } else {
-            t = time(NULL);
-            /* see if we timed out */
-            if (t > prev_time + ack_timeout) {
-                /* timeout, return to connected state */
-                ack_timeout = ARDOP_CONN_TIMEOUT;
-                prev_time = time(NULL);
-                arim_set_state(ST_ARQ_CONNECTED);
-                ui_set_status_dirty(STATUS_ARQ_FILE_RCV_TIMEOUT);
-            }
+        } else if (event == EV_TIMEOUT) {
+            /* timeout, return to connected state */
+            arim_set_state(ST_ARQ_CONNECTED);
+            ui_set_status_dirty(STATUS_ARQ_FILE_RCV_TIMEOUT);
         }
         break;
     }
@@ -376,7 +335,6 @@ void arim_proto_arq_file_rcv_wait_ok(int event, int param)
 
 void arim_proto_arq_file_rcv_wait(int event, int param)
 {
-    time_t t;
     char buffer[MAX_LOG_LINE_SIZE];
 
     switch (event) {
@@ -390,44 +348,41 @@ void arim_proto_arq_file_rcv_wait(int event, int param)
         /* a PTT async response was received from the TNC */
         if (param) {
             /* still sending, reload timer */
-            prev_time = time(NULL);
+            arim_reload_timer();
         }
         break;
     case EV_ARQ_AUTH_SEND_CMD:
         /* auth challenge received, send a2 response */
         arim_arq_auth_on_send_a2();
         arim_set_state(ST_ARQ_AUTH_SEND_A2);
-        ack_timeout = ARDOP_CONN_SEND_TIMEOUT;
-        prev_time = time(NULL);
+        arim_start_timer(ARDOP_CONN_SEND_TIMEOUT);
         ui_set_status_dirty(STATUS_ARQ_AUTH_BUSY);
         break;
     case EV_ARQ_AUTH_ERROR:
         /* remote station can't authenticate this station */
         arim_arq_auth_on_error();
         arim_set_state(ST_ARQ_CONNECTED);
-        ack_timeout = ARDOP_CONN_TIMEOUT;
-        prev_time = time(NULL);
         ui_set_status_dirty(STATUS_ARQ_EAUTH_LOCAL);
         break;
     case EV_ARQ_CANCEL_WAIT:
         /* wait canceled, return to connected state */
         arim_set_state(ST_ARQ_CONNECTED);
         ui_set_status_dirty(STATUS_ARQ_CONN_CAN);
-        ack_timeout = ARDOP_CONN_TIMEOUT;
-        prev_time = time(NULL);
         break;
     case EV_ARQ_FILE_RCV:
         /* start receiving file */
         arim_set_state(ST_ARQ_FILE_RCV);
-        ack_timeout = ARDOP_CONN_TIMEOUT;
-        prev_time = time(NULL);
+        arim_start_timer(ARDOP_CONN_TIMEOUT);
         ui_set_status_dirty(STATUS_ARQ_FILE_RCV);
         break;
+    case EV_ARQ_FILE_OK:
+        /* remote station says our copy is unchanged */
+        arim_set_state(ST_ARQ_CONNECTED);
+        ui_set_status_dirty(STATUS_ARQ_FILE_RCV_SAME);
+        break;
     case EV_ARQ_FILE_ERROR:
         /* something went wrong */
         arim_set_state(ST_ARQ_CONNECTED);
-        ack_timeout = ARDOP_CONN_TIMEOUT;
-        prev_time = time(NULL);
         ui_set_status_dirty(STATUS_ARQ_FILE_RCV_ERROR);
         break;
     case EV_ARQ_DISCONNECTED:
@@ -445,28 +400,20 @@ void arim_proto_arq_file_rcv_wait(int event, int param)
             ui_set_status_dirty(STATUS_ARQ_DISCONNECTED);
         } else {
             /* reload timer */
-            ack_timeout = ARDOP_CONN_TIMEOUT;
-            prev_time = time(NULL);
+            arim_start_timer(ARDOP_CONN_TIMEOUT);
             ui_set_status_dirty(STATUS_REFRESH);
         }
         break;
-    case EV_PERIODIC:
-        t = time(NULL);
-        /* see if we timed out */
-        if (t > prev_time + ack_timeout) {
-            /* timeout, return to connected state */
-            ack_timeout = ARDOP_CONN_TIMEOUT;
-            prev_time = time(NULL);
-            arim_set_state(ST_ARQ_CONNECTED);
-            ui_set_status_dirty(STATUS_ARQ_FILE_RCV_TIMEOUT);
-        }
+    case EV_TIMEOUT:
+        /* timeout, return to connected state */
+        arim_set_state(ST_ARQ_CONNECTED);
+        ui_set_status_dirty(STATUS_ARQ_FILE_RCV_TIMEOUT);
         break;
     }
 }
 
 void arim_proto_arq_file_rcv(int event, int param)
 {
-    time_t t;
     char buffer[MAX_LOG_LINE_SIZE];
 
     switch (event) {
@@ -480,27 +427,28 @@ void arim_proto_arq_file_rcv(int event, int param)
         /* a PTT async response was received from the TNC */
         if (param) {
             /* still sending, reload timer */
-            prev_time = time(NULL);
+            arim_reload_timer();
         }
         break;
     case EV_ARQ_FILE_RCV_FRAME:
         /* still receiving, reload timer */
-        ack_timeout = ARDOP_CONN_TIMEOUT;
-        prev_time = time(NULL);
+        arim_start_timer(ARDOP_CONN_TIMEOUT);
         ui_set_status_dirty(STATUS_ARQ_FILE_RCV);
         break;
     case EV_ARQ_FILE_RCV_DONE:
         /* done */
         arim_set_state(ST_ARQ_CONNECTED);
-        ack_timeout = ARDOP_CONN_TIMEOUT;
-        prev_time = time(NULL);
         ui_set_status_dirty(STATUS_ARQ_FILE_RCV_DONE);
         break;
+    case EV_ARQ_FILE_SEND_CMD:
+        /* got /FSYNC block sums, start sending the delta */
+        arim_set_state(ST_ARQ_FILE_SEND_WAIT);
+        arim_start_timer(ARDOP_CONN_SEND_TIMEOUT);
+        ui_set_status_dirty(STATUS_ARQ_FILE_SEND);
+        break;
     case EV_ARQ_FILE_ERROR:
         /* done */
         arim_set_state(ST_ARQ_CONNECTED);
-        ack_timeout = ARDOP_CONN_TIMEOUT;
-        prev_time = time(NULL);
         ui_set_status_dirty(STATUS_ARQ_FILE_RCV_ERROR);
         break;
     case EV_ARQ_DISCONNECTED:
@@ -518,28 +466,20 @@ void arim_proto_arq_file_rcv(int event, int param)
             ui_set_status_dirty(STATUS_ARQ_DISCONNECTED);
         } else {
             /* reload timer */
-            ack_timeout = ARDOP_CONN_TIMEOUT;
-            prev_time = time(NULL);
+            arim_start_timer(ARDOP_CONN_TIMEOUT);
             ui_set_status_dirty(STATUS_REFRESH);
         }
         break;
-    case EV_PERIODIC:
-        t = time(NULL);
-        /* see if we timed out */
-        if (t > prev_time + ack_timeout) {
-            /* timeout, return to connected state */
-            ack_timeout = ARDOP_CONN_TIMEOUT;
-            prev_time = time(NULL);
-            arim_set_state(ST_ARQ_CONNECTED);
-            ui_set_status_dirty(STATUS_ARQ_FILE_RCV_TIMEOUT);
-        }
+    case EV_TIMEOUT:
+        /* timeout, return to connected state */
+        arim_set_state(ST_ARQ_CONNECTED);
+        ui_set_status_dirty(STATUS_ARQ_FILE_RCV_TIMEOUT);
         break;
     }
 }
 
 void arim_proto_arq_file_flist_rcv_wait(int event, int param)
 {
-    time_t t;
     char buffer[MAX_LOG_LINE_SIZE];
 
     switch (event) {
@@ -553,44 +493,36 @@ void arim_proto_arq_file_flist_rcv_wait(int event, int param)
         /* a PTT async response was received from the TNC */
         if (param) {
             /* still sending, reload timer */
-            prev_time = time(NULL);
+            arim_reload_timer();
         }
         break;
     case EV_ARQ_AUTH_SEND_CMD:
         /* auth challenge received, send a2 response */
         arim_arq_auth_on_send_a2();
         arim_set_state(ST_ARQ_AUTH_SEND_A2);
-        ack_timeout = ARDOP_CONN_SEND_TIMEOUT;
-        prev_time = time(NULL);
+        arim_start_timer(ARDOP_CONN_SEND_TIMEOUT);
         ui_set_status_dirty(STATUS_ARQ_AUTH_BUSY);
         break;
     case EV_ARQ_AUTH_ERROR:
         /* remote station can't authenticate this station */
         arim_arq_auth_on_error();
         arim_set_state(ST_ARQ_CONNECTED);
-        ack_timeout = ARDOP_CONN_TIMEOUT;
-        prev_time = time(NULL);
         ui_set_status_dirty(STATUS_ARQ_EAUTH_LOCAL);
         break;
     case EV_ARQ_CANCEL_WAIT:
         /* wait canceled, return to connected state */
         arim_set_state(ST_ARQ_CONNECTED);
         ui_set_status_dirty(STATUS_ARQ_CONN_CAN);
-        ack_timeout = ARDOP_CONN_TIMEOUT;
-        prev_time = time(NULL);
         break;
     case EV_ARQ_FLIST_RCV:
         /* start receiving file listing */
         arim_set_state(ST_ARQ_FLIST_RCV);
-        ack_timeout = ARDOP_CONN_TIMEOUT;
-        prev_time = time(NULL);
+        arim_start_timer(ARDOP_CONN_TIMEOUT);
         ui_set_status_dirty(STATUS_ARQ_FLIST_RCV);
         break;
     case EV_ARQ_FILE_ERROR:
         /* something went wrong */
         arim_set_state(ST_ARQ_CONNECTED);
-        ack_timeout = ARDOP_CONN_TIMEOUT;
-        prev_time = time(NULL);
         ui_set_status_dirty(STATUS_ARQ_FLIST_RCV_ERROR);
         break;
     case EV_ARQ_DISCONNECTED:
@@ -608,28 +540,20 @@ void arim_proto_arq_file_flist_rcv_wait(int event, int param)
             ui_set_status_dirty(STATUS_ARQ_DISCONNECTED);
         } else {
             /* reload timer */
-            ack_timeout = ARDOP_CONN_TIMEOUT;
-            prev_time = time(NULL);
+            arim_start_timer(ARDOP_CONN_TIMEOUT);
             ui_set_status_dirty(STATUS_REFRESH);
         }
         break;
-    case EV_PERIODIC:
-        t = time(NULL);
-        /* see if we timed out */
-        if (t > prev_time + ack_timeout) {
-            /* timeout, return to connected state */
-            ack_timeout = ARDOP_CONN_TIMEOUT;
-            prev_time = time(NULL);
-            arim_set_state(ST_ARQ_CONNECTED);
-            ui_set_status_dirty(STATUS_ARQ_FLIST_RCV_TIMEOUT);
-        }
+    case EV_TIMEOUT:
+        /* timeout, return to connected state */
+        arim_set_state(ST_ARQ_CONNECTED);
+        ui_set_status_dirty(STATUS_ARQ_FLIST_RCV_TIMEOUT);
         break;
     }
 }
 
 void arim_proto_arq_file_flist_rcv(int event, int param)
 {
-    time_t t;
     char buffer[MAX_LOG_LINE_SIZE];
 
     switch (event) {
@@ -643,27 +567,22 @@ void arim_proto_arq_file_flist_rcv(int event, int param)
         /* a PTT async response was received from the TNC */
         if (param) {
             /* still sending, reload timer */
-            prev_time = time(NULL);
+            arim_reload_timer();
         }
         break;
     case EV_ARQ_FLIST_RCV_FRAME:
         /* still receiving, reload timer */
-        ack_timeout = ARDOP_CONN_TIMEOUT;
-        prev_time = time(NULL);
+        arim_start_timer(ARDOP_CONN_TIMEOUT);
         ui_set_status_dirty(STATUS_ARQ_FLIST_RCV);
         break;
     case EV_ARQ_FLIST_RCV_DONE:
         /* done */
         arim_set_state(ST_ARQ_CONNECTED);
-        ack_timeout = ARDOP_CONN_TIMEOUT;
-        prev_time = time(NULL);
         ui_set_status_dirty(STATUS_ARQ_FLIST_RCV_DONE);
         break;
     case EV_ARQ_FILE_ERROR:
         /* done */
         arim_set_state(ST_ARQ_CONNECTED);
-        ack_timeout = ARDOP_CONN_TIMEOUT;
-        prev_time = time(NULL);
         ui_set_status_dirty(STATUS_ARQ_FLIST_RCV_ERROR);
         break;
     case EV_ARQ_DISCONNECTED:
@@ -681,28 +600,20 @@ void arim_proto_arq_file_flist_rcv(int event, int param)
             ui_set_status_dirty(STATUS_ARQ_DISCONNECTED);
         } else {
             /* reload timer */
-            ack_timeout = ARDOP_CONN_TIMEOUT;
-            prev_time = time(NULL);
+            arim_start_timer(ARDOP_CONN_TIMEOUT);
             ui_set_status_dirty(STATUS_REFRESH);
         }
         break;
-    case EV_PERIODIC:
-        t = time(NULL);
-        /* see if we timed out */
-        if (t > prev_time + ack_timeout) {
-            /* timeout, return to connected state */
-            ack_timeout = ARDOP_CONN_TIMEOUT;
-            prev_time = time(NULL);
-            arim_set_state(ST_ARQ_CONNECTED);
-            ui_set_status_dirty(STATUS_ARQ_FLIST_RCV_TIMEOUT);
-        }
+    case EV_TIMEOUT:
+        /* timeout, return to connected state */
+        arim_set_state(ST_ARQ_CONNECTED);
+        ui_set_status_dirty(STATUS_ARQ_FLIST_RCV_TIMEOUT);
         break;
     }
 }
 
 void arim_proto_arq_file_flist_send_wait(int event, int param)
 {
-    time_t t;
     char buffer[MAX_LOG_LINE_SIZE];
 
     switch (event) {
@@ -716,15 +627,13 @@ void arim_proto_arq_file_flist_send_wait(int event, int param)
         /* a PTT async response was received from the TNC */
         if (param) {
             /* still sending, reload timer */
-            prev_time = time(NULL);
+            arim_reload_timer();
         }
         break;
     case EV_ARQ_CANCEL_WAIT:
         /* wait canceled, return to connected state */
         arim_set_state(ST_ARQ_CONNECTED);
         ui_set_status_dirty(STATUS_ARQ_CONN_CAN);
-        ack_timeout = ARDOP_CONN_TIMEOUT;
-        prev_time = time(NULL);
         break;
     case EV_ARQ_DISCONNECTED:
         /* a DISCONNECTED async response was received from the TNC */
@@ -741,29 +650,22 @@ void arim_proto_arq_file_flist_send_wait(int event, int param)
             ui_set_status_dirty(STATUS_ARQ_DISCONNECTED);
         } else {
             /* reload timer */
-            ack_timeout = ARDOP_CONN_TIMEOUT;
-            prev_time = time(NULL);
+            arim_start_timer(ARDOP_CONN_TIMEOUT);
             ui_set_status_dirty(STATUS_REFRESH);
         }
         break;
     case EV_PERIODIC:
+    case EV_TIMEOUT:
         if (arim_get_buffer_cnt()) {
             /* data is buffered, change state to sending */
-            ack_timeout = ARDOP_CONN_SEND_TIMEOUT;
-            prev_time = time(NULL);
             arim_set_state(ST_ARQ_FLIST_SEND);
+            arim_start_timer(ARDOP_CONN_SEND_TIMEOUT);
             arim_arq_files_flist_on_send_cmd();
             ui_set_status_dirty(STATUS_ARQ_FLIST_SEND);
-        } else {
-            t = time(NULL);
-            /* see if we timed out */
-            if (t > prev_time + ack_timeout) {
-                /* timeout, return to connected state */
-                ack_timeout = ARDOP_CONN_TIMEOUT;
-                prev_time = time(NULL);
-                arim_set_state(ST_ARQ_CONNECTED);
-                ui_set_status_dirty(STATUS_ARQ_FLIST_SEND_TIMEOUT);
-            }
+        } else if (event == EV_TIMEOUT) {
+            /* timeout, return to connected state */
+            arim_set_state(ST_ARQ_CONNECTED);
+            ui_set_status_dirty(STATUS_ARQ_FLIST_SEND_TIMEOUT);
         }
         break;
     }
@@ -771,7 +673,6 @@ void arim_proto_arq_file_flist_send_wait(int event, int param)
 
 void arim_proto_arq_file_flist_send(int event, int param)
 {
-    time_t t;
     char buffer[MAX_LOG_LINE_SIZE];
 
     switch (event) {
@@ -785,21 +686,17 @@ void arim_proto_arq_file_flist_send(int event, int param)
         /* a PTT async response was received from the TNC */
         if (param) {
             /* still sending, reload timer */
-            prev_time = time(NULL);
+            arim_reload_timer();
         }
         break;
     case EV_ARQ_FILE_OK:
         /* success */
         arim_set_state(ST_ARQ_CONNECTED);
-        ack_timeout = ARDOP_CONN_TIMEOUT;
-        prev_time = time(NULL);
         ui_set_status_dirty(STATUS_ARQ_FLIST_SEND_ACK);
         break;
     case EV_ARQ_FILE_ERROR:
         /* something went wrong */
         arim_set_state(ST_ARQ_CONNECTED);
-        ack_timeout = ARDOP_CONN_TIMEOUT;
-        prev_time = time(NULL);
         ui_set_status_dirty(STATUS_ARQ_FLIST_SEND_ERROR);
         break;
     case EV_ARQ_DISCONNECTED:
@@ -817,25 +714,19 @@ void arim_proto_arq_file_flist_send(int event, int param)
             ui_set_status_dirty(STATUS_ARQ_DISCONNECTED);
         } else {
             /* reload timer */
-            ack_timeout = ARDOP_CONN_TIMEOUT;
-            prev_time = time(NULL);
+            arim_start_timer(ARDOP_CONN_TIMEOUT);
             ui_set_status_dirty(STATUS_REFRESH);
         }
         break;
     case EV_PERIODIC:
+    case EV_TIMEOUT:
         if (!arim_arq_files_flist_on_send_buffer(arim_get_buffer_cnt())) {
             /* done sending file listing, will wait for ack */
             ui_set_status_dirty(STATUS_ARQ_FLIST_SEND_DONE);
-        } else {
-            t = time(NULL);
-            /* see if we timed out */
-            if (t > prev_time + ack_timeout) {
-                /* timeout, return to connected state */
-                ack_timeout = ARDOP_CONN_TIMEOUT;
-                prev_time = time(NULL);
-                arim_set_state(ST_ARQ_CONNECTED);
-                ui_set_status_dirty(STATUS_ARQ_FLIST_SEND_TIMEOUT);
-            }
+        } else if (event == EV_TIMEOUT) {
+            /* timeout, return to connected state */
+            arim_set_state(ST_ARQ_CONNECTED);
+            ui_set_status_dirty(STATUS_ARQ_FLIST_SEND_TIMEOUT);
         }
         break;
     }
@@ -41,7 +41,6 @@
 
 void arim_proto_arq_msg_send_wait(int event, int param)
 {
-    time_t t;
     char buffer[MAX_LOG_LINE_SIZE];
 
     switch (event) {
@@ -55,15 +54,13 @@ void arim_proto_arq_msg_send_wait(int event, int param)
         /* a PTT async response was received from the TNC */
         if (param) {
             /* still sending, reload timer */
-            prev_time = time(NULL);
+            arim_reload_timer();
         }
         break;
     case EV_ARQ_CANCEL_WAIT:
         /* wait canceled, return to connected state */
         arim_set_state(ST_ARQ_CONNECTED);
         ui_set_status_dirty(STATUS_ARQ_CONN_CAN);
-        ack_timeout = ARDOP_CONN_TIMEOUT;
-        prev_time = time(NULL);
         break;
     case EV_ARQ_DISCONNECTED:
         /* a DISCONNECTED async response was received from the TNC */
@@ -80,29 +77,22 @@ void arim_proto_arq_msg_send_wait(int event, int param)
             ui_set_status_dirty(STATUS_ARQ_DISCONNECTED);
         } else {
             /* reload timer */
-            ack_timeout = ARDOP_CONN_TIMEOUT;
-            prev_time = time(NULL);
+            arim_start_timer(ARDOP_CONN_TIMEOUT);
             ui_set_status_dirty(STATUS_REFRESH);
         }
         break;
     case EV_PERIODIC:
+    case EV_TIMEOUT:
         if (arim_get_buffer_cnt()) {
             /* data is buffered, change state to sending */
-            ack_timeout = ARDOP_CONN_SEND_TIMEOUT;
-            prev_time = time(NULL);
             arim_set_state(ST_ARQ_MSG_SEND);
+            arim_start_timer(ARDOP_CONN_SEND_TIMEOUT);
             arim_arq_msg_on_send_msg();
             ui_set_status_dirty(STATUS_ARQ_MSG_SEND);
-        } else {
-            t = time(NULL);
-            /* see if we timed out */
-            if (t > prev_time + ack_timeout) {
-                /* timeout, return to connected state */
-                ack_timeout = ARDOP_CONN_TIMEOUT;
-                prev_time = time(NULL);
-                arim_set_state(ST_ARQ_CONNECTED);
-                ui_set_status_dirty(STATUS_ARQ_MSG_SEND_TIMEOUT);
-            }
+        } else if (event == EV_TIMEOUT) {
+            /* timeout, return to connected state */
+            arim_set_state(ST_ARQ_CONNECTED);
+            ui_set_status_dirty(STATUS_ARQ_MSG_SEND_TIMEOUT);
         }
         break;
     }
@@ -110,7 +100,6 @@ void arim_proto_arq_msg_send_wait(int event, int param)
 
 void arim_proto_arq_msg_send(int event, int param)
 {
-    time_t t;
     char buffer[MAX_LOG_LINE_SIZE];
 
     switch (event) {
@@ -124,21 +113,17 @@ void arim_proto_arq_msg_send(int event, int param)
         /* a PTT async response was received from the TNC */
         if (param) {
             /* still sending, reload timer */
-            prev_time = time(NULL);
+            arim_reload_timer();
         }
         break;
     case EV_ARQ_MSG_OK:
         /* success, return to connected state */
         arim_set_state(ST_ARQ_CONNECTED);
-        ack_timeout = ARDOP_CONN_TIMEOUT;
-        prev_time = time(NULL);
         ui_set_status_dirty(STATUS_ARQ_MSG_SEND_ACK);
         break;
     case EV_ARQ_MSG_ERROR:
         /* something went wrong */
         arim_set_state(ST_ARQ_CONNECTED);
-        ack_timeout = ARDOP_CONN_TIMEOUT;
-        prev_time = time(NULL);
         ui_set_status_dirty(STATUS_ARQ_MSG_SEND_ERROR);
         break;
     case EV_ARQ_DISCONNECTED:
@@ -156,25 +141,19 @@ void arim_proto_arq_msg_send(int event, int param)
             ui_set_status_dirty(STATUS_ARQ_DISCONNECTED);
         } else {
             /* reload timer */
-            ack_timeout = ARDOP_CONN_TIMEOUT;
-            prev_time = time(NULL);
+            arim_start_timer(ARDOP_CONN_TIMEOUT);
             ui_set_status_dirty(STATUS_REFRESH);
         }
         break;
     case EV_PERIODIC:
+    case EV_TIMEOUT:
         if (!arim_arq_msg_on_send_buffer(arim_get_buffer_cnt())) {
             /* done sending message, will wait for ack */
             ui_set_status_dirty(STATUS_ARQ_MSG_SEND_DONE);
-        } else {
-            t = time(NULL);
-            /* see if we timed out */
-            if (t > prev_time + ack_timeout) {
-                /* timeout, return to connected state */
-                ack_timeout = ARDOP_CONN_TIMEOUT;
-                prev_time = time(NULL);
-                arim_set_state(ST_ARQ_CONNECTED);
-                ui_set_status_dirty(STATUS_ARQ_MSG_SEND_TIMEOUT);
-            }
+        } else if (event == EV_TIMEOUT) {
+            /* timeout, return to connected state */
+            arim_set_state(ST_ARQ_CONNECTED);
+            ui_set_status_dirty(STATUS_ARQ_MSG_SEND_TIMEOUT);
         }
         break;
     }
@@ -182,7 +161,6 @@ void arim_proto_arq_msg_send(int event, int param)
 
 void arim_proto_arq_msg_rcv(int event, int param)
 {
-    time_t t;
     char buffer[MAX_LOG_LINE_SIZE];
 
     switch (event) {
@@ -196,27 +174,22 @@ void arim_proto_arq_msg_rcv(int event, int param)
         /* a PTT async response was received from the TNC */
         if (param) {
             /* still sending, reload timer */
-            prev_time = time(NULL);
+            arim_reload_timer();
         }
         break;
     case EV_ARQ_MSG_RCV_FRAME:
         /* still receiving, reload timer */
-        ack_timeout = ARDOP_CONN_TIMEOUT;
-        prev_time = time(NULL);
+        arim_start_timer(ARDOP_CONN_TIMEOUT);
         ui_set_status_dirty(STATUS_ARQ_MSG_RCV);
         break;
     case EV_ARQ_MSG_RCV_DONE:
         /* done */
         arim_set_state(ST_ARQ_CONNECTED);
-        ack_timeout = ARDOP_CONN_TIMEOUT;
-        prev_time = time(NULL);
         ui_set_status_dirty(STATUS_ARQ_MSG_RCV_DONE);
         break;
     case EV_ARQ_MSG_ERROR:
         /* done */
         arim_set_state(ST_ARQ_CONNECTED);
-        ack_timeout = ARDOP_CONN_TIMEOUT;
-        prev_time = time(NULL);
         ui_set_status_dirty(STATUS_ARQ_MSG_RCV_ERROR);
         break;
     case EV_ARQ_DISCONNECTED:
@@ -234,21 +207,14 @@ void arim_proto_arq_msg_rcv(int event, int param)
             ui_set_status_dirty(STATUS_ARQ_DISCONNECTED);
         } else {
             /* reload timer */
-            ack_timeout = ARDOP_CONN_TIMEOUT;
-            prev_time = time(NULL);
+            arim_start_timer(ARDOP_CONN_TIMEOUT);
             ui_set_status_dirty(STATUS_REFRESH);
         }
         break;
-    case EV_PERIODIC:
-        t = time(NULL);
-        /* see if we timed out */
-        if (t > prev_time + ack_timeout) {
-            /* timeout, return to connected state */
-            ack_timeout = ARDOP_CONN_TIMEOUT;
-            prev_time = time(NULL);
-            arim_set_state(ST_ARQ_CONNECTED);
-            ui_set_status_dirty(STATUS_ARQ_MSG_RCV_TIMEOUT);
-        }
+    case EV_TIMEOUT:
+        /* timeout, return to connected state */
+        arim_set_state(ST_ARQ_CONNECTED);
+        ui_set_status_dirty(STATUS_ARQ_MSG_RCV_TIMEOUT);
         break;
     }
 }
@@ -38,8 +38,6 @@
 
 void arim_proto_beacon_buf_wait(int event, int param)
 {
-    time_t t;
-
     switch (event) {
     case EV_CANCEL:
         arim_cancel_trans();
@@ -48,19 +46,16 @@ void arim_proto_beacon_buf_wait(int event, int param)
         ui_set_status_dirty(STATUS_BCN_SEND_CAN);
         break;
     case EV_PERIODIC:
+    case EV_TIMEOUT:
         /* wait until tx buffer is empty before announcing idle state */
         if (!arim_get_buffer_cnt()) {
             arim_set_state(ST_IDLE);
             ui_set_status_dirty(STATUS_BEACON_SENT);
-        } else {
-            t = time(NULL);
-            /* see if we timed out waiting for buffer to empty */
-            if (t > prev_time + ack_timeout) {
-                /* timeout, abandon attempt to send beacon */
-                arim_cancel_trans();
-                arim_set_state(ST_IDLE);
-                arim_beacon_timeout();
-            }
+        } else if (event == EV_TIMEOUT) {
+            /* timed out waiting for buffer to empty, abandon attempt to send beacon */
+            arim_cancel_trans();
+            arim_set_state(ST_IDLE);
+            arim_beacon_timeout();
         }
         break;
     }
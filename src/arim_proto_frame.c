@@ -37,8 +37,6 @@
 
 void arim_proto_frame_rcv_wait(int event, int param)
 {
-    time_t t;
-
     switch (event) {
     case EV_FRAME_TO:
         arim_set_state(ST_IDLE);
@@ -65,13 +63,13 @@ void arim_proto_frame_rcv_wait(int event, int param)
         arim_set_state(ST_IDLE);
         break;
     case EV_RCV_MSG:
-        prev_time = time(NULL);
         arim_set_state(ST_SEND_ACKNAK_PEND);
+        arim_start_timer(ARIM_ACKNAK_DELAY);
         ui_set_status_dirty(STATUS_MSG_RCVD);
         break;
     case EV_RCV_QRY:
-        prev_time = time(NULL);
         arim_set_state(ST_SEND_RESP_PEND);
+        arim_start_timer(ARIM_RESP_DELAY);
         ui_set_status_dirty(STATUS_QUERY_RCVD);
         break;
     case EV_RCV_NET_MSG:
@@ -85,19 +83,16 @@ void arim_proto_frame_rcv_wait(int event, int param)
         break;
     case EV_TNC_NEWSTATE:
         /* reload timer */
-        prev_time = time(NULL);
+        arim_reload_timer();
         break;
-    case EV_PERIODIC:
-        t = time(NULL);
-        /* see if we timed out while receiving ARIM frame not addressed to this TNC. If
-           TNC is receiving reload the timer. The purpose of this state is to block attempts
-           to transmit while receiving an incoming ARIM frame. */
-        if (arim_is_receiving()) {
-            prev_time = t;
-        } else if (t > prev_time + ack_timeout) {
-            /* timeout, all done */
+    case EV_TIMEOUT:
+        /* timed out while receiving ARIM frame not addressed to this TNC. If
+           TNC is receiving reload the timer. The purpose of this state is to block
+           attempts to transmit while receiving an incoming ARIM frame. */
+        if (arim_is_receiving())
+            arim_reload_timer();
+        else
             arim_set_state(ST_IDLE);
-        }
         break;
     }
 }
@@ -42,9 +42,8 @@ void arim_proto_idle(int event, int param)
 
     switch (event) {
     case EV_FRAME_START:
-        ack_timeout = atoi(g_arim_settings.frame_timeout);
-        prev_time = time(NULL);
         arim_set_state(ST_RCV_FRAME_WAIT);
+        arim_start_timer(atoi(g_arim_settings.frame_timeout));
         bufq_queue_cmd_out("LISTEN FALSE");
         switch (param) {
         case 'M':
@@ -65,9 +64,8 @@ void arim_proto_idle(int event, int param)
         }
         break;
     case EV_SEND_BCN:
-        ack_timeout = ARDOP_BCN_SEND_TIMEOUT;
-        prev_time = time(NULL);
         arim_set_state(ST_SEND_BCN_BUF_WAIT);
+        arim_start_timer(ARDOP_BCN_SEND_TIMEOUT);
         bufq_queue_cmd_out("LISTEN FALSE");
         break;
     case EV_SEND_MSG:
@@ -75,10 +73,9 @@ void arim_proto_idle(int event, int param)
         bufq_queue_cmd_out("LISTEN FALSE");
         break;
     case EV_SEND_MSG_PP:
-        ack_timeout = param * ARDOP_PINGACK_TIMEOUT;
-        prev_time = time(NULL);
         if (arim_send_ping(g_arim_settings.pilot_ping, prev_to_call, 0)) {
             arim_set_state(ST_RCV_MSG_PING_ACK_WAIT);
+            arim_start_timer(param * ARDOP_PINGACK_TIMEOUT);
             bufq_queue_cmd_out("LISTEN FALSE");
         } else {
             ui_set_status_dirty(STATUS_PING_TNC_BUSY);
@@ -98,10 +95,9 @@ void arim_proto_idle(int event, int param)
         bufq_queue_cmd_out("LISTEN FALSE");
         break;
     case EV_SEND_QRY_PP:
-        ack_timeout = param * ARDOP_PINGACK_TIMEOUT;
-        prev_time = time(NULL);
         if (arim_send_ping(g_arim_settings.pilot_ping, prev_to_call, 0)) {
             arim_set_state(ST_RCV_QRY_PING_ACK_WAIT);
+            arim_start_timer(param * ARDOP_PINGACK_TIMEOUT);
             bufq_queue_cmd_out("LISTEN FALSE");
         } else {
             ui_set_status_dirty(STATUS_PING_TNC_BUSY);
@@ -109,9 +105,8 @@ void arim_proto_idle(int event, int param)
         break;
     case EV_SEND_PING:
         /* a PING command was sent to the TNC */
-        ack_timeout = ARDOP_PINGACK_TIMEOUT * param;
-        prev_time = time(NULL);
         arim_set_state(ST_RCV_PING_ACK_WAIT);
+        arim_start_timer(ARDOP_PINGACK_TIMEOUT * param);
         bufq_queue_cmd_out("LISTEN FALSE");
         break;
     case EV_ARQ_PENDING:
@@ -121,27 +116,25 @@ void arim_proto_idle(int event, int param)
         if (!strncasecmp(buffer, "TRUE", 4)) {
             /* respond only if ARQ listen is TRUE */
             bufq_queue_cmd_out("PROTOCOLMODE ARQ");
-            ack_timeout = ARDOP_CONNREQ_TIMEOUT;
-            prev_time = time(NULL);
             arim_set_state(ST_ARQ_PEND_WAIT);
+            arim_start_timer(ARDOP_CONNREQ_TIMEOUT);
         }
         break;
     case EV_ARQ_CONNECT:
         /* an ARQ connection attempt is underway */
-        ack_timeout = ARDOP_CONNREQ_TIMEOUT;
-        prev_time = time(NULL);
         arim_set_state(ST_ARQ_OUT_CONNECT_WAIT);
+        arim_start_timer(ARDOP_CONNREQ_TIMEOUT);
         bufq_queue_cmd_out("LISTEN FALSE");
         bufq_queue_cmd_out("PROTOCOLMODE ARQ");
         break;
     case EV_ARQ_CONNECT_PP:
         /* an ARQ connection attempt is underway */
-        ack_timeout = param * ARDOP_PINGACK_TIMEOUT;
-        prev_time = time(NULL);
-        if (arim_send_ping(g_arim_settings.pilot_ping, prev_to_call, 0))
+        if (arim_send_ping(g_arim_settings.pilot_ping, prev_to_call, 0)) {
             arim_set_state(ST_RCV_ARQ_CONN_PING_ACK_WAIT);
-        else
+            arim_start_timer(param * ARDOP_PINGACK_TIMEOUT);
+        } else {
             ui_set_status_dirty(STATUS_PING_TNC_BUSY);
+        }
         break;
     }
 }
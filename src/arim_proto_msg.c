@@ -51,8 +51,8 @@ void arim_proto_msg_buf_wait(int event, int param)
     case EV_PERIODIC:
         /* wait until tx buffer is empty before starting ack timer */
         if (!arim_msg_on_send_buffer(arim_get_buffer_cnt())) {
-            prev_time = time(NULL);
             arim_set_state(ST_RCV_ACKNAK_WAIT);
+            arim_start_timer(ack_timeout);
             ui_set_status_dirty(STATUS_MSG_WAIT_ACK);
         }
         break;
@@ -99,21 +99,20 @@ extern void arim_proto_msg_acknak_buf_wait(int event, int param)
 
 extern void arim_proto_msg_acknak_pend(int event, int param)
 {
-    time_t t;
-
     switch (event) {
     case EV_CANCEL:
         arim_set_state(ST_IDLE);
         arim_cancel_msg();
         ui_set_status_dirty(STATUS_MSG_SEND_CAN);
         break;
-    case EV_PERIODIC:
-        /* 1 to 2 second delay for sending ack/nak */
-        t = time(NULL);
-        if (t > prev_time + 2) {
-            bufq_queue_data_out(msg_acknak_buffer);
+    case EV_TIMEOUT:
+        /* delay for sending ack/nak has elapsed */
+        if (bufq_queue_data_out(msg_acknak_buffer)) {
             arim_set_state(ST_SEND_ACKNAK_BUF_WAIT);
             ui_set_status_dirty(STATUS_ACKNAK_SEND);
+        } else {
+            /* outbound queue full, try again shortly */
+            arim_start_timer(ARIM_QUEUE_RETRY_TIMEOUT);
         }
         break;
     }
@@ -121,8 +120,6 @@ extern void arim_proto_msg_acknak_pend(int event, int param)
 
 extern void arim_proto_msg_acknak_wait(int event, int param)
 {
-    time_t t;
-
     switch (event) {
     case EV_RCV_ACK:
         arim_reset_msg_rpt_state();
@@ -136,7 +133,7 @@ extern void arim_proto_msg_acknak_wait(int event, int param)
             arim_set_state(ST_IDLE);
             ui_set_status_dirty(STATUS_MSG_NAK_RCVD);
         } else {
-            prev_time = time(NULL);
+            arim_start_timer(ack_timeout);
         }
         break;
     case EV_CANCEL:
@@ -145,25 +142,24 @@ extern void arim_proto_msg_acknak_wait(int event, int param)
         arim_cancel_msg();
         ui_set_status_dirty(STATUS_MSG_SEND_CAN);
         break;
-    case EV_PERIODIC:
-        t = time(NULL);
-        /* see if we timed out waiting for ack */
-        if (t > prev_time + ack_timeout) {
-            if (++rcv_nak_cnt > arim_get_send_repeats()) {
-                /* timeout, all done */
-                arim_reset_msg_rpt_state();
-                arim_set_state(ST_IDLE);
-                ui_set_status_dirty(STATUS_MSG_ACK_TIMEOUT);
-            } else {
-                if (fecmode_downshift)
-                    arim_fecmode_downshift();
-                bufq_queue_data_out(msg_buffer);
-                prev_time = t;
-                arim_set_state(ST_SEND_MSG_BUF_WAIT);
-                /* start progress meter */
-                ui_status_xfer_start(0, msg_len, STATUS_XFER_DIR_UP);
-                ui_set_status_dirty(STATUS_MSG_REPEAT);
-            }
+    case EV_TIMEOUT:
+        /* timed out waiting for ack */
+        if (++rcv_nak_cnt > arim_get_send_repeats()) {
+            /* timeout, all done */
+            arim_reset_msg_rpt_state();
+            arim_set_state(ST_IDLE);
+            ui_set_status_dirty(STATUS_MSG_ACK_TIMEOUT);
+        } else if (!bufq_queue_data_out(msg_buffer)) {
+            /* outbound queue full, try again shortly */
+            --rcv_nak_cnt;
+            arim_start_timer(ARIM_QUEUE_RETRY_TIMEOUT);
+        } else {
+            if (fecmode_downshift)
+                arim_fecmode_downshift();
+            arim_set_state(ST_SEND_MSG_BUF_WAIT);
+            /* start progress meter */
+            ui_status_xfer_start(0, msg_len, STATUS_XFER_DIR_UP);
+            ui_set_status_dirty(STATUS_MSG_REPEAT);
         }
         break;
     }
@@ -171,8 +167,6 @@ extern void arim_proto_msg_acknak_wait(int event, int param)
 
 void arim_proto_msg_pingack_wait(int event, int param)
 {
-    time_t t;
-
     switch (event) {
     case EV_CANCEL:
         bufq_queue_cmd_out("ABORT"); /* unconditionally abort */
@@ -198,14 +192,10 @@ void arim_proto_msg_pingack_wait(int event, int param)
             ui_set_status_dirty(STATUS_PING_MSG_SEND);
         }
         break;
-    case EV_PERIODIC:
-        t = time(NULL);
-        /* see if we timed out waiting for ack */
-        if (t > prev_time + ack_timeout) {
-            /* timeout, all done */
-            arim_set_state(ST_IDLE);
-            ui_set_status_dirty(STATUS_PING_MSG_ACK_TO);
-        }
+    case EV_TIMEOUT:
+        /* timed out waiting for ack, all done */
+        arim_set_state(ST_IDLE);
+        ui_set_status_dirty(STATUS_PING_MSG_ACK_TO);
         break;
     }
 }
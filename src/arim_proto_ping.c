@@ -38,8 +38,6 @@
 
 void arim_proto_ping_ack_pend(int event, int param)
 {
-    time_t t;
-
     switch(event) {
     case EV_SEND_PING_ACK:
         /* a PINGREPLY asynch response was received from the TNC */
@@ -54,21 +52,15 @@ void arim_proto_ping_ack_pend(int event, int param)
            CANCELPENDING so it must be handled here */
         arim_set_state(ST_IDLE);
         break;
-    case EV_PERIODIC:
-        t = time(NULL);
-        /* see if we timed out waiting for ack send */
-        if (t > prev_time + ack_timeout) {
-            /* timeout, all done */
-            arim_set_state(ST_IDLE);
-        }
+    case EV_TIMEOUT:
+        /* timed out waiting for ack send, all done */
+        arim_set_state(ST_IDLE);
         break;
     }
 }
 
 void arim_proto_ping_ack_wait(int event, int param)
 {
-    time_t t;
-
     switch (event) {
     case EV_CANCEL:
         bufq_queue_cmd_out("ABORT");
@@ -87,14 +79,10 @@ void arim_proto_ping_ack_wait(int event, int param)
         arim_set_state(ST_IDLE);
         ui_set_status_dirty(STATUS_PING_ACK_RCVD);
         break;
-    case EV_PERIODIC:
-        t = time(NULL);
-        /* see if we timed out waiting for ack */
-        if (t > prev_time + ack_timeout) {
-            /* timeout, all done */
-            arim_set_state(ST_IDLE);
-            ui_set_status_dirty(STATUS_PING_ACK_TIMEOUT);
-        }
+    case EV_TIMEOUT:
+        /* timed out waiting for ack, all done */
+        arim_set_state(ST_IDLE);
+        ui_set_status_dirty(STATUS_PING_ACK_TIMEOUT);
         break;
     }
 }
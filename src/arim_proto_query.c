@@ -51,8 +51,8 @@ void arim_proto_query_buf_wait(int event, int param)
     case EV_PERIODIC:
         if (arim_get_buffer_cnt()) {
             /* query is buffered, change to response waiting state */
-            prev_time = time(NULL);
             arim_set_state(ST_RCV_RESP_WAIT);
+            arim_start_timer(ack_timeout);
             ui_set_status_dirty(STATUS_WAIT_RESP);
         }
         break;
@@ -80,21 +80,20 @@ void arim_proto_query_resp_buf_wait(int event, int param)
 
 void arim_proto_query_resp_pend(int event, int param)
 {
-    time_t t;
-
     switch (event) {
     case EV_CANCEL:
         arim_set_state(ST_IDLE);
         arim_cancel_query();
         ui_set_status_dirty(STATUS_RESP_SEND_CAN);
         break;
-    case EV_PERIODIC:
-        /* 1 second delay for sending response to query */
-        t = time(NULL);
-        if (t > prev_time) {
-            bufq_queue_data_out(msg_buffer);
+    case EV_TIMEOUT:
+        /* delay for sending response to query has elapsed */
+        if (bufq_queue_data_out(msg_buffer)) {
             arim_set_state(ST_SEND_RESP_BUF_WAIT);
             ui_set_status_dirty(STATUS_RESP_SEND);
+        } else {
+            /* outbound queue full, try again shortly */
+            arim_start_timer(ARIM_QUEUE_RETRY_TIMEOUT);
         }
         break;
     }
@@ -102,8 +101,6 @@ void arim_proto_query_resp_pend(int event, int param)
 
 void arim_proto_query_pingack_wait(int event, int param)
 {
-    time_t t;
-
     switch (event) {
     case EV_CANCEL:
         bufq_queue_cmd_out("ABORT"); /* unconditionally abort */
@@ -129,22 +126,16 @@ void arim_proto_query_pingack_wait(int event, int param)
             ui_set_status_dirty(STATUS_PING_QRY_SEND);
         }
         break;
-    case EV_PERIODIC:
-        t = time(NULL);
-        /* see if we timed out waiting for ack */
-        if (t > prev_time + ack_timeout) {
-            /* timeout, all done */
-            arim_set_state(ST_IDLE);
-            ui_set_status_dirty(STATUS_PING_QRY_ACK_TO);
-        }
+    case EV_TIMEOUT:
+        /* timed out waiting for ack, all done */
+        arim_set_state(ST_IDLE);
+        ui_set_status_dirty(STATUS_PING_QRY_ACK_TO);
         break;
     }
 }
 
 void arim_proto_query_resp_wait(int event, int param)
 {
-    time_t t;
-
     switch (event) {
     case EV_FRAME_START:
         if (param == 'R')
@@ -161,17 +152,15 @@ void arim_proto_query_resp_wait(int event, int param)
         break;
     case EV_TNC_NEWSTATE:
         /* reload timer */
-        prev_time = time(NULL);
+        arim_reload_timer();
         break;
-    case EV_PERIODIC:
-        t = time(NULL);
-        /* see if we timed out waiting for response frame. If TNC is receiving reload
-           the timer. The purpose of this state is to block attempts to transmit while
-           receiving an incoming response frame. */
+    case EV_TIMEOUT:
+        /* timed out waiting for response frame. If TNC is receiving reload
+           the timer. The purpose of this state is to block attempts to transmit
+           while receiving an incoming response frame. */
         if (arim_is_receiving()) {
-            prev_time = t;
-        } else if (t > prev_time + ack_timeout) {
-            /* timeout, all done */
+            arim_reload_timer();
+        } else {
             arim_set_state(ST_IDLE);
             ui_set_status_dirty(STATUS_RESP_TIMEOUT);
         }
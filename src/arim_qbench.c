@@ -0,0 +1,299 @@
+/***********************************************************************
+
+    ARIM Amateur Radio Instant Messaging program for the ARDOP TNC.
+
+    Copyright (C) 2016-2021 Robert Cunnings NW8L
+
+    This file is part of the ARIM messaging program.
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+*************************************************************************/
+
+
+
+/* arim-qbench: compare the variable length record rings behind
+   dataq_push/dataq_pop and cmdq_push/cmdq_pop with the fixed slot,
+   mutex guarded queues they replaced. Reports memory footprint,
+   single thread push/pop throughput, producer/consumer throughput
+   and queue latency across two threads, and checks that a full
+   outbound queue refuses new records. Not installed, run from the
+   build directory, e.g.
+
+     arim-qbench
+     arim-qbench 2000000                                             */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <sched.h>
+#include <pthread.h>
+#include "main.h"
+#include "bufq.h"
+
+#define QBENCH_DEF_CNT      1000000
+#define QBENCH_MAX_CNT      100000000
+#define QBENCH_BURST        16
+#define OLD_DATAQUEUE_LEN   128
+
+/* globals normally provided by the rest of arim */
+pthread_mutex_t mutex_cmd_in = PTHREAD_MUTEX_INITIALIZER;
+pthread_mutex_t mutex_cmd_out = PTHREAD_MUTEX_INITIALIZER;
+pthread_mutex_t mutex_data_in = PTHREAD_MUTEX_INITIALIZER;
+pthread_mutex_t mutex_data_out = PTHREAD_MUTEX_INITIALIZER;
+pthread_mutex_t mutex_heard = PTHREAD_MUTEX_INITIALIZER;
+pthread_mutex_t mutex_debug_log = PTHREAD_MUTEX_INITIALIZER;
+pthread_mutex_t mutex_tncpi9k6_log = PTHREAD_MUTEX_INITIALIZER;
+pthread_mutex_t mutex_traffic_log = PTHREAD_MUTEX_INITIALIZER;
+pthread_mutex_t mutex_recents = PTHREAD_MUTEX_INITIALIZER;
+pthread_mutex_t mutex_ptable = PTHREAD_MUTEX_INITIALIZER;
+pthread_mutex_t mutex_ctable = PTHREAD_MUTEX_INITIALIZER;
+pthread_mutex_t mutex_ftable = PTHREAD_MUTEX_INITIALIZER;
+pthread_mutex_t mutex_file_out = PTHREAD_MUTEX_INITIALIZER;
+pthread_mutex_t mutex_msg_out = PTHREAD_MUTEX_INITIALIZER;
+int g_debug_log_enable;
+int g_tncpi9k6_log_enable;
+int g_traffic_log_enable;
+int mon_timestamp;
+
+char *util_timestamp(char *buffer, size_t maxsize)
+{
+    snprintf(buffer, maxsize, "00:00:00");
+    return buffer;
+}
+
+char *util_timestamp_usec(char *buffer, size_t maxsize)
+{
+    snprintf(buffer, maxsize, "00:00:00.000000");
+    return buffer;
+}
+
+/* the queue as it was before the record rings: 128 fixed slots of
+   MIN_DATA_BUF_SIZE, every access under the queue's mutex */
+typedef struct old_q {
+    int head, tail;
+    int size;
+    char data[OLD_DATAQUEUE_LEN][MIN_DATA_BUF_SIZE];
+} OLDQUEUE;
+
+static OLDQUEUE old_q;
+static pthread_mutex_t mutex_old_q = PTHREAD_MUTEX_INITIALIZER;
+static DATAQUEUE new_q;
+static char oldbuf[MIN_DATA_BUF_SIZE];
+
+static int old_push(OLDQUEUE *q, const char *data)
+{
+    int size;
+
+    pthread_mutex_lock(&mutex_old_q);
+    if (q->size == OLD_DATAQUEUE_LEN) {
+        pthread_mutex_unlock(&mutex_old_q);
+        return -1;
+    }
+    snprintf(q->data[q->head], sizeof(q->data[q->head]), "%s", data);
+    if (++q->head == OLD_DATAQUEUE_LEN)
+        q->head = 0;
+    size = ++q->size;
+    pthread_mutex_unlock(&mutex_old_q);
+    return size;
+}
+
+static char *old_pop(OLDQUEUE *q)
+{
+    int p;
+
+    /* callers copied the record out before dropping the lock */
+    pthread_mutex_lock(&mutex_old_q);
+    if (!q->size) {
+        pthread_mutex_unlock(&mutex_old_q);
+        return NULL;
+    }
+    p = q->tail;
+    if (++q->tail == OLD_DATAQUEUE_LEN)
+        q->tail = 0;
+    --q->size;
+    snprintf(oldbuf, sizeof(oldbuf), "%s", q->data[p]);
+    pthread_mutex_unlock(&mutex_old_q);
+    return oldbuf;
+}
+
+static int new_push(DATAQUEUE *q, const char *data)
+{
+    return dataq_push(q, data);
+}
+
+static char *new_pop(DATAQUEUE *q)
+{
+    return dataq_pop(q);
+}
+
+typedef struct bench_arg {
+    int old;
+    int cnt;
+    const char *rec;
+    double lat_sum, lat_max;
+} BENCHARG;
+
+static double now_us()
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000000.0 + ts.tv_nsec / 1000.0;
+}
+
+static void usage()
+{
+    fprintf(stderr,
+        "usage: arim-qbench [count]\n"
+        "  pushes and pops count records (default %d) of 40, 256 and\n"
+        "  4096 bytes through the old and the new data queue\n", QBENCH_DEF_CNT);
+    exit(1);
+}
+
+static double run_single(int old, const char *rec, int cnt)
+{
+    double t0;
+    int i;
+
+    /* push then pop in bursts, as the ui and I/O threads do; a burst
+       of the largest records still fits the default queue size */
+    t0 = now_us();
+    for (i = 0; i < cnt; i += QBENCH_BURST) {
+        int j, n = cnt - i < QBENCH_BURST ? cnt - i : QBENCH_BURST;
+        for (j = 0; j < n; j++) {
+            if ((old ? old_push(&old_q, rec) : new_push(&new_q, rec)) < 0)
+                return -1;
+        }
+        for (j = 0; j < n; j++) {
+            if (!(old ? old_pop(&old_q) : new_pop(&new_q)))
+                return -1;
+        }
+    }
+    return cnt / ((now_us() - t0) / 1000000.0);
+}
+
+static void *producer(void *arg)
+{
+    BENCHARG *b = arg;
+    char rec[MIN_DATA_BUF_SIZE];
+    int i;
+
+    /* records carry their enqueue time so the consumer can measure
+       latency through the queue */
+    snprintf(rec, sizeof(rec), "%s", b->rec);
+    for (i = 0; i < b->cnt; i++) {
+        snprintf(rec, sizeof(rec), "%.0f", now_us());
+        rec[strlen(rec)] = ' ';
+        while ((b->old ? old_push(&old_q, rec) : new_push(&new_q, rec)) < 0)
+            sched_yield();
+    }
+    return NULL;
+}
+
+static double run_pair(BENCHARG *b)
+{
+    pthread_t tid;
+    char *p;
+    double t0, lat;
+    int i;
+
+    b->lat_sum = b->lat_max = 0;
+    t0 = now_us();
+    if (pthread_create(&tid, NULL, producer, b))
+        return -1;
+    for (i = 0; i < b->cnt; i++) {
+        while (!(p = b->old ? old_pop(&old_q) : new_pop(&new_q)))
+            sched_yield();
+        lat = now_us() - atof(p);
+        b->lat_sum += lat;
+        if (lat > b->lat_max)
+            b->lat_max = lat;
+    }
+    pthread_join(tid, NULL);
+    return b->cnt / ((now_us() - t0) / 1000000.0);
+}
+
+static int check_full()
+{
+    char rec[MAX_CMD_SIZE];
+    int i;
+
+    /* a full outbound queue must refuse the record and say so,
+       rather than drop it silently */
+    memset(rec, 'x', sizeof(rec) - 1);
+    rec[sizeof(rec) - 1] = '\0';
+    for (i = 0; i < MIN_DATAQUEUE_SIZE; i++) {
+        if (!bufq_queue_data_out(rec))
+            break;
+    }
+    if (i == MIN_DATAQUEUE_SIZE || dataq_get_size(&g_data_out_q) != i) {
+        printf("full data_out queue: FAILED, %d records accepted\n", i);
+        return 0;
+    }
+    printf("full data_out queue: refused record %d of %d bytes, ok\n",
+           i + 1, (int)sizeof(rec));
+    return 1;
+}
+
+int main(int argc, char *argv[])
+{
+    static const int sizes[] = { 40, 256, 4096 };
+    char rec[MIN_DATA_BUF_SIZE];
+    BENCHARG b;
+    double old_rate, new_rate;
+    int i, cnt = QBENCH_DEF_CNT;
+
+    if (argc > 2)
+        usage();
+    if (argc == 2) {
+        cnt = atoi(argv[1]);
+        if (cnt <= 0 || cnt > QBENCH_MAX_CNT)
+            usage();
+    }
+    if (!bufq_init(MIN_DATAQUEUE_SIZE) ||
+        !dataq_init(&new_q, DEFAULT_DATAQUEUE_SIZE)) {
+        fprintf(stderr, "arim-qbench: cannot allocate queues\n");
+        return 1;
+    }
+    printf("footprint per data queue: old %zu bytes, new %zu bytes "
+           "(default size, %d to %d configurable)\n",
+           sizeof(OLDQUEUE), sizeof(DATAQUEUE) + (size_t)new_q.cap,
+           MIN_DATAQUEUE_SIZE, MAX_DATAQUEUE_SIZE);
+    printf("footprint per cmd queue:  old %zu bytes, new %zu bytes\n",
+           (size_t)OLD_DATAQUEUE_LEN * MAX_CMD_SIZE + 3 * sizeof(int),
+           sizeof(CMDQUEUE) + (size_t)g_cmd_in_q.cap);
+    printf("%d records per run\n\n", cnt);
+    printf("%6s  %-6s %14s %14s %12s %12s\n", "bytes", "queue",
+           "1 thread/s", "2 threads/s", "avg lat us", "max lat us");
+    for (i = 0; i < (int)(sizeof(sizes) / sizeof(sizes[0])); i++) {
+        memset(rec, 'x', sizes[i]);
+        rec[sizes[i]] = '\0';
+        b.cnt = cnt;
+        b.rec = rec;
+        b.old = 1;
+        old_rate = run_single(1, rec, cnt);
+        new_rate = run_pair(&b);
+        printf("%6d  %-6s %14.0f %14.0f %12.1f %12.1f\n", sizes[i], "old",
+               old_rate, new_rate, b.lat_sum / cnt, b.lat_max);
+        b.old = 0;
+        old_rate = run_single(0, rec, cnt);
+        new_rate = run_pair(&b);
+        printf("%6d  %-6s %14.0f %14.0f %12.1f %12.1f\n", sizes[i], "new",
+               old_rate, new_rate, b.lat_sum / cnt, b.lat_max);
+    }
+    printf("\n");
+    return check_full() ? 0 : 1;
+}
@@ -69,7 +69,8 @@ int arim_send_query(const char *query, const char *to_call)
                     len,
                     check,
                     query);
-    bufq_queue_data_out(msg_buffer);
+    if (!bufq_queue_data_out(msg_buffer))
+        return 0;
     ack_timeout = atoi(g_arim_settings.ack_timeout);
     arim_on_event(EV_SEND_QRY, 0);
     return 1;
@@ -98,7 +99,8 @@ int arim_send_query_pp()
                      len,
                      check,
                      prev_msg);
-    bufq_queue_data_out(msg_buffer);
+    if (!bufq_queue_data_out(msg_buffer))
+        return 0;
     ack_timeout = atoi(g_arim_settings.ack_timeout);
     arim_on_event(EV_SEND_QRY, 0);
     (void)numch; /* suppress 'assigned but not used' warning for dummy var */
@@ -120,9 +122,7 @@ int arim_recv_response(const char *fm_call, const char *to_call,
             /* good checksum, store message into mbox, add to recents */
             hdr = mbox_add_msg(MBOX_INBOX_FNAME, fm_call, to_call, check, msg, 1);
             if (hdr != NULL) {
-                pthread_mutex_lock(&mutex_recents);
-                cmdq_push(&g_recents_q, hdr);
-                pthread_mutex_unlock(&mutex_recents);
+                bufq_queue_recents(hdr);
             }
             snprintf(buffer, sizeof(buffer), "3[R] %-10s ", fm_call);
         } else {
@@ -0,0 +1,293 @@
+/***********************************************************************
+
+    ARIM Amateur Radio Instant Messaging program for the ARDOP TNC.
+
+    Copyright (C) 2016-2021 Robert Cunnings NW8L
+
+    This file is part of the ARIM messaging program.
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+*************************************************************************/
+
+
+
+/* arim-replay: replay an ARDOP data port byte stream through the frame
+   decoder in ardop_data.c and time it, both reading into a local buffer
+   and handing that to ardop_data_handle_data(), as the data thread did,
+   and reading straight into the decoder's buffer with ardop_data_rx_space()
+   and ardop_data_on_read(). Reads are 1460 bytes (a TCP segment), 16 kB
+   or a random 1 to 4096 bytes, so frames are split at every boundary.
+   A further untimed run of each checks that every mode delivers the
+   same payload. The stream is a
+   capture of the data port if one is given, otherwise 32 MB of ARQ data
+   frames with some FEC and IDF frames mixed in. Not installed, run from
+   the build directory, e.g.
+
+     arim-replay
+     arim-replay dataport.cap                                        */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <time.h>
+#include <pthread.h>
+#include "main.h"
+#include "arim_proto.h"
+#include "ardop_data.h"
+
+#define REPLAY_GEN_SIZE     (32*1024*1024)
+#define REPLAY_MAX_SIZE     (1024*1024*1024)
+#define REPLAY_RUNS         3
+
+#define READ_RANDOM         0
+
+/* globals normally provided by the rest of arim */
+pthread_mutex_t mutex_num_bytes = PTHREAD_MUTEX_INITIALIZER;
+
+static size_t arq_bytes, fec_cnt, idf_cnt;
+static unsigned int arq_hash;
+static int verify;
+
+int arim_arq_on_data(char *data, size_t size)
+{
+    size_t i;
+
+    /* FNV-1a over the payload to compare the modes, untimed runs only */
+    if (verify) {
+        for (i = 0; i < size; i++)
+            arq_hash = (arq_hash ^ (unsigned char)data[i]) * 16777619;
+    }
+    arq_bytes += size;
+    return 1;
+}
+
+int arim_arq_files_on_rcv_frame(const char *data, size_t size)
+{
+    return 1;
+}
+
+int arim_arq_files_flist_on_rcv_frame(const char *data, size_t size)
+{
+    return 1;
+}
+
+int arim_arq_msg_on_rcv_frame(const char *data, size_t size)
+{
+    return 1;
+}
+
+int arim_on_data(char *data, size_t size)
+{
+    return 0;
+}
+
+int arim_test_frame(char *data, size_t size)
+{
+    return 0;
+}
+
+void arim_on_event(int event, int param)
+{
+}
+
+int arim_get_state()
+{
+    return ST_ARQ_CONNECTED;
+}
+
+void arim_copy_remote_call(char *call, size_t size)
+{
+    snprintf(call, size, "NW8L");
+}
+
+void bufq_queue_data_in(const char *text)
+{
+    if (text[4] == 'U')
+        ++fec_cnt;
+    else if (text[4] == 'I')
+        ++idf_cnt;
+}
+
+void bufq_queue_traffic_log(const char *text)
+{
+}
+
+void bufq_queue_debug_log(const char *text)
+{
+}
+
+void bufq_queue_heard(const char *text)
+{
+}
+
+static void usage()
+{
+    fprintf(stderr,
+        "usage: arim-replay [capture]\n"
+        "  replays a capture of the ARDOP data port, or a generated stream,\n"
+        "  through the frame decoder\n");
+    exit(1);
+}
+
+static double now_ms()
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000.0 + ts.tv_nsec / 1000000.0;
+}
+
+static size_t put_frame(unsigned char *p, const char *type, const char *text, size_t len)
+{
+    size_t i, datasize = len + 3;
+
+    p[0] = (datasize >> 8) & 0xFF;
+    p[1] = datasize & 0xFF;
+    memcpy(p + 2, type, 3);
+    if (text) {
+        memcpy(p + 5, text, len);
+    } else {
+        for (i = 0; i < len; i++)
+            p[5 + i] = 'A' + (rand() % 58);
+    }
+    return datasize + 2;
+}
+
+static size_t gen_stream(FILE *fp)
+{
+    static unsigned char frame[MIN_DATA_BUF_SIZE];
+    static const char idf[] = "ID:NW8L [EN81]:";
+    char fec[64];
+    size_t n, total = 0;
+    int i = 0;
+
+    /* mostly ARQ data frames up to the size the TNC sends in one go */
+    srand(1);
+    while (total < REPLAY_GEN_SIZE) {
+        if (i % 50 == 0) {
+            n = put_frame(frame, "IDF", idf, sizeof(idf) - 1);
+        } else if (i % 10 == 0) {
+            snprintf(fec, sizeof(fec), "CQ CQ de NW8L net %d", i);
+            n = put_frame(frame, "FEC", fec, strlen(fec));
+        } else {
+            n = put_frame(frame, "ARQ", NULL, 16 + rand() % 2048);
+        }
+        if (fwrite(frame, 1, n, fp) != n)
+            return 0;
+        total += n;
+        i++;
+    }
+    return total;
+}
+
+static int replay(int fd, size_t total, int direct, int chunk, double *ms)
+{
+    static unsigned char buffer[MIN_DATA_BUF_SIZE];
+    unsigned char *p;
+    size_t left = total, want, space;
+    ssize_t n;
+    double t0;
+
+    if (lseek(fd, 0, SEEK_SET) == -1)
+        return 0;
+    srand(2);
+    arq_bytes = fec_cnt = idf_cnt = 0;
+    arq_hash = 2166136261u;
+    t0 = now_ms();
+    while (left) {
+        want = chunk == READ_RANDOM ? 1 + rand() % 4096 : (size_t)chunk;
+        if (direct) {
+            p = ardop_data_rx_space(&space);
+            n = read(fd, p, want < space ? want : space);
+            if (n <= 0)
+                return 0;
+            ardop_data_on_read(n);
+        } else {
+            n = read(fd, buffer, want < sizeof(buffer) ? want : sizeof(buffer));
+            if (n <= 0)
+                return 0;
+            ardop_data_handle_data(buffer, n);
+        }
+        left -= n;
+    }
+    *ms = now_ms() - t0;
+    return 1;
+}
+
+int main(int argc, char *argv[])
+{
+    static const int chunks[] = { 1460, 16384, READ_RANDOM };
+    FILE *fp;
+    size_t total;
+    unsigned int hash = 0;
+    double ms, best;
+    int c, direct, run, fails = 0;
+    long size;
+
+    if (argc > 2 || (argc == 2 && argv[1][0] == '-'))
+        usage();
+    if (argc == 2) {
+        fp = fopen(argv[1], "rb");
+        if (!fp || fseek(fp, 0, SEEK_END) || (size = ftell(fp)) <= 0 ||
+            size > REPLAY_MAX_SIZE) {
+            fprintf(stderr, "arim-replay: cannot read %s\n", argv[1]);
+            return 1;
+        }
+        total = size;
+    } else {
+        fp = tmpfile();
+        if (!fp || !(total = gen_stream(fp)) || fflush(fp)) {
+            fprintf(stderr, "arim-replay: cannot write stream to temporary file\n");
+            return 1;
+        }
+    }
+    printf("%zu bytes, best of %d runs, page cache warm\n\n", total, REPLAY_RUNS);
+    printf("%-8s %-7s %10s %10s %12s %8s %6s %10s\n", "read", "mode", "ms",
+           "MB/s", "ARQ bytes", "FEC", "IDF", "hash");
+    for (c = 0; c < (int)(sizeof(chunks) / sizeof(chunks[0])); c++) {
+        for (direct = 0; direct < 2; direct++) {
+            best = 0;
+            verify = 0;
+            for (run = 0; run < REPLAY_RUNS; run++) {
+                if (!replay(fileno(fp), total, direct, chunks[c], &ms)) {
+                    fprintf(stderr, "arim-replay: read failed\n");
+                    return 1;
+                }
+                if (!run || ms < best)
+                    best = ms;
+            }
+            verify = 1;
+            if (!replay(fileno(fp), total, direct, chunks[c], &ms)) {
+                fprintf(stderr, "arim-replay: read failed\n");
+                return 1;
+            }
+            if (!c && !direct)
+                hash = arq_hash;
+            else if (arq_hash != hash)
+                fails++;
+            if (chunks[c] == READ_RANDOM)
+                printf("%-8s ", "random");
+            else
+                printf("%-8d ", chunks[c]);
+            printf("%-7s %10.1f %10.1f %12zu %8zu %6zu %10X%s\n",
+                   direct ? "direct" : "copy", best, total / best / 1000.0,
+                   arq_bytes, fec_cnt, idf_cnt, arq_hash,
+                   arq_hash != hash ? "  MISMATCH" : "");
+        }
+    }
+    fclose(fp);
+    return fails ? 1 : 0;
+}
@@ -0,0 +1,828 @@
+/***********************************************************************
+
+    ARIM Amateur Radio Instant Messaging program for the ARDOP TNC.
+
+    Copyright (C) 2016-2021 Robert Cunnings NW8L
+
+    This file is part of the ARIM messaging program.
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+*************************************************************************/
+
+
+
+/* arim-serialbench: run the serial port thread against a fake TNC-Pi
+   on a pseudo terminal and measure how often the thread wakes, how
+   regularly its 50 msec tick and 200 msec EV_PERIODIC event run, and
+   how long a queued command takes to reach the TNC, idle, under a
+   steady stream of queued commands and under steady serial traffic.
+   With -t, answer general polls with crafted frames instead to check
+   the host mode receive state machine: CRC, byte stuffing, split and
+   run together frames, resync, repeat requests and bad frames, then
+   make a real protocol state change and check that the state's tick
+   and deadline run once, on the serial thread, and that canceling a
+   streamed file stops it reaching the TNC. Not installed, run from
+   the build directory, e.g.
+
+     arim-serialbench
+     arim-serialbench 10
+     arim-serialbench -t                                             */
+
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <time.h>
+#include <termios.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <sys/syscall.h>
+#include "main.h"
+#include "ini.h"
+#include "bufq.h"
+#include "arim_proto.h"
+#include "ardop_flow.h"
+#include "datathread.h"
+#include "serialthread.h"
+#include "tnc_attach.h"
+#include "mbox.h"
+
+#define SBENCH_DEF_SECS     5
+#define SBENCH_MAX_SECS     600
+#define SBENCH_CMD_USEC     2000
+#define SBENCH_NOISE_MSEC   2
+
+#define SBENCH_PHASE_IDLE   0
+#define SBENCH_PHASE_CMDS   1
+#define SBENCH_PHASE_NOISE  2
+#define SBENCH_PHASE_TEST   3
+
+#define SBENCH_REPEAT_MSEC  25
+#define SBENCH_STATE_SECS   1
+#define SBENCH_FILE_SIZE    (64*1024)
+#define SBENCH_DATA_MSEC    20
+
+/* globals normally provided by the rest of arim */
+ARIM_SET g_arim_settings;
+UI_SET g_ui_settings;
+TNC_SET g_tnc_settings[TNC_MAX_COUNT];
+int g_cur_tnc;
+int g_tnc_attached;
+int g_serialthread_stop;
+int g_serialthread_ready;
+int g_datathread_stop;
+int g_datathread_ready;
+int g_debug_log_enable;
+int g_tncpi9k6_log_enable;
+int g_traffic_log_enable;
+int mon_timestamp;
+int arim_data_waiting;
+time_t arim_start_time;
+TNC_VERSION g_tnc_version;
+pthread_mutex_t mutex_time = PTHREAD_MUTEX_INITIALIZER;
+pthread_mutex_t mutex_cmd_in = PTHREAD_MUTEX_INITIALIZER;
+pthread_mutex_t mutex_cmd_out = PTHREAD_MUTEX_INITIALIZER;
+pthread_mutex_t mutex_data_in = PTHREAD_MUTEX_INITIALIZER;
+pthread_mutex_t mutex_data_out = PTHREAD_MUTEX_INITIALIZER;
+pthread_mutex_t mutex_heard = PTHREAD_MUTEX_INITIALIZER;
+pthread_mutex_t mutex_debug_log = PTHREAD_MUTEX_INITIALIZER;
+pthread_mutex_t mutex_tncpi9k6_log = PTHREAD_MUTEX_INITIALIZER;
+pthread_mutex_t mutex_traffic_log = PTHREAD_MUTEX_INITIALIZER;
+pthread_mutex_t mutex_recents = PTHREAD_MUTEX_INITIALIZER;
+pthread_mutex_t mutex_ptable = PTHREAD_MUTEX_INITIALIZER;
+pthread_mutex_t mutex_ctable = PTHREAD_MUTEX_INITIALIZER;
+pthread_mutex_t mutex_ftable = PTHREAD_MUTEX_INITIALIZER;
+pthread_mutex_t mutex_file_out = PTHREAD_MUTEX_INITIALIZER;
+pthread_mutex_t mutex_msg_out = PTHREAD_MUTEX_INITIALIZER;
+pthread_mutex_t mutex_tnc_set = PTHREAD_MUTEX_INITIALIZER;
+
+static atomic_int serial_tid, periodic_cnt, timeout_cnt, poll_cnt, cmd_cnt;
+static atomic_int wrong_tid, data_out_cnt, data_slow;
+static atomic_int phase, tnc_host, tnc_stop;
+static double lat_sum, lat_max;
+static pthread_mutex_t mutex_lat = PTHREAD_MUTEX_INITIALIZER;
+
+/* data delivered by the serial thread on the data channel, -t only */
+static unsigned char rx_data[MAX_CMD_SIZE*4];
+static int rx_data_size;
+static pthread_mutex_t mutex_rx_data = PTHREAD_MUTEX_INITIALIZER;
+
+typedef struct test_case {
+    const char *name;
+    int split;        /* write a byte at a time */
+    int repeat;       /* expect the last host frame again, promptly */
+    int size;
+    unsigned char bytes[MAX_CMD_SIZE*4];
+    int expect_size;
+    unsigned char expect[MAX_CMD_SIZE*2];
+} TEST_CASE;
+
+static TEST_CASE test;
+static int test_idx = -1, test_fails;
+static atomic_int test_done;
+static unsigned char last_poll[16];
+static double test_sent;
+
+void *arim_reset()
+{
+    /* first called on the serial thread, note its id for /proc */
+    if (!atomic_load(&serial_tid))
+        atomic_store(&serial_tid, (int)syscall(SYS_gettid));
+    return NULL;
+}
+
+static void state_on_event(int event)
+{
+    /* arim_on_event() from arim_proto.c dispatches here for every state,
+       the tick and deadline events must come from the serial thread */
+    if (event != EV_PERIODIC && event != EV_TIMEOUT)
+        return;
+    if ((int)syscall(SYS_gettid) != atomic_load(&serial_tid))
+        atomic_fetch_add(&wrong_tid, 1);
+    if (event == EV_PERIODIC)
+        atomic_fetch_add(&periodic_cnt, 1);
+    else
+        atomic_fetch_add(&timeout_cnt, 1);
+}
+
+#define SBENCH_STATE(name) \
+    void name(int event, int param) { state_on_event(event); }
+
+SBENCH_STATE(arim_proto_idle)
+SBENCH_STATE(arim_proto_msg_buf_wait)
+SBENCH_STATE(arim_proto_msg_net_buf_wait)
+SBENCH_STATE(arim_proto_query_buf_wait)
+SBENCH_STATE(arim_proto_query_resp_buf_wait)
+SBENCH_STATE(arim_proto_msg_acknak_buf_wait)
+SBENCH_STATE(arim_proto_beacon_buf_wait)
+SBENCH_STATE(arim_proto_unproto_buf_wait)
+SBENCH_STATE(arim_proto_query_resp_pend)
+SBENCH_STATE(arim_proto_msg_acknak_pend)
+SBENCH_STATE(arim_proto_msg_acknak_wait)
+SBENCH_STATE(arim_proto_arq_conn_pend_wait)
+SBENCH_STATE(arim_proto_ping_ack_pend)
+SBENCH_STATE(arim_proto_ping_ack_wait)
+SBENCH_STATE(arim_proto_arq_conn_out_wait)
+SBENCH_STATE(arim_proto_arq_conn_out_wait_rpt)
+SBENCH_STATE(arim_proto_arq_conn_pp_wait)
+SBENCH_STATE(arim_proto_arq_conn_in_wait)
+SBENCH_STATE(arim_proto_arq_conn_connected)
+SBENCH_STATE(arim_proto_arq_file_flist_rcv_wait)
+SBENCH_STATE(arim_proto_arq_file_flist_rcv)
+SBENCH_STATE(arim_proto_arq_file_flist_send_wait)
+SBENCH_STATE(arim_proto_arq_file_flist_send)
+SBENCH_STATE(arim_proto_arq_file_send_wait)
+SBENCH_STATE(arim_proto_arq_file_send_wait_ok)
+SBENCH_STATE(arim_proto_arq_file_send)
+SBENCH_STATE(arim_proto_arq_file_rcv_wait_ok)
+SBENCH_STATE(arim_proto_arq_file_rcv_wait)
+SBENCH_STATE(arim_proto_arq_file_rcv)
+SBENCH_STATE(arim_proto_arq_msg_send_wait)
+SBENCH_STATE(arim_proto_arq_msg_send)
+SBENCH_STATE(arim_proto_arq_msg_rcv)
+SBENCH_STATE(arim_proto_msg_pingack_wait)
+SBENCH_STATE(arim_proto_query_pingack_wait)
+SBENCH_STATE(arim_proto_query_resp_wait)
+SBENCH_STATE(arim_proto_arq_auth_send_a1_wait)
+SBENCH_STATE(arim_proto_arq_auth_send_a2_wait)
+SBENCH_STATE(arim_proto_arq_auth_send_a3_wait)
+SBENCH_STATE(arim_proto_arq_auth_rcv_a2_wait)
+SBENCH_STATE(arim_proto_arq_auth_rcv_a3_wait)
+SBENCH_STATE(arim_proto_arq_auth_rcv_a4_wait)
+SBENCH_STATE(arim_proto_frame_rcv_wait)
+
+int arim_test_frame(char *data, size_t size)
+{
+    return 0;
+}
+
+size_t arim_arq_on_cmd(const char *cmd, size_t size)
+{
+    return 0;
+}
+
+size_t arim_arq_on_resp(const char *resp, size_t size)
+{
+    return 0;
+}
+
+size_t ardop_cmds_proc_resp(char *response, size_t size)
+{
+    return size;
+}
+
+void ardop_cmds_init()
+{
+}
+
+size_t ardop_data_handle_data(unsigned char *data, size_t size)
+{
+    pthread_mutex_lock(&mutex_rx_data);
+    if (rx_data_size + size <= sizeof(rx_data)) {
+        memcpy(rx_data + rx_data_size, data, size);
+        rx_data_size += size;
+    }
+    pthread_mutex_unlock(&mutex_rx_data);
+    return size;
+}
+
+void ardop_data_inc_num_bytes_out(size_t num)
+{
+}
+
+unsigned char *ardop_data_rx_space(size_t *size)
+{
+    static unsigned char buf[MIN_DATA_BUF_SIZE];
+
+    *size = sizeof(buf);
+    return buf;
+}
+
+size_t ardop_data_on_read(size_t size)
+{
+    return 0;
+}
+
+int ardop_flow_is_enabled()
+{
+    return 0;
+}
+
+void ardop_flow_reset()
+{
+}
+
+void ardop_flow_start(size_t size)
+{
+}
+
+void ardop_flow_end()
+{
+}
+
+void ardop_flow_on_write(size_t size)
+{
+}
+
+size_t ardop_flow_block_size(size_t nleft)
+{
+    return nleft < FLOW_MAX_BLOCK ? nleft : FLOW_MAX_BLOCK;
+}
+
+char *mbox_add_msg(const char *fn, const char *fm_call, const char *to_call,
+                       int check, const char *msg, int trace)
+{
+    return NULL;
+}
+
+void tnc_detach()
+{
+}
+
+void ui_truncate_line(char *line, size_t size)
+{
+    line[size - 1] = '\0';
+}
+
+extern unsigned int calc_crc16(const unsigned char *data, size_t size);
+
+static double now_us()
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000000.0 + ts.tv_nsec / 1000.0;
+}
+
+static void usage()
+{
+    fprintf(stderr,
+        "usage: arim-serialbench [seconds]\n"
+        "       arim-serialbench -t\n"
+        "  runs each phase for seconds (default %d) against a fake TNC\n"
+        "  on a pseudo terminal, or with -t checks the host mode receive\n"
+        "  state machine\n", SBENCH_DEF_SECS);
+    exit(1);
+}
+
+static int tnc_frame(unsigned char *frame, const unsigned char *data, int size)
+{
+    unsigned char buf[MAX_CMD_SIZE*4];
+    unsigned int crc16;
+    int i, n = 2;
+
+    /* sync bytes, then data and CRC with every 0xAA stuffed */
+    memcpy(buf, data, size);
+    crc16 = calc_crc16(buf, size) ^ 0xFFFF;
+    buf[size++] = crc16 & 0xFF;
+    buf[size++] = (crc16 >> 8) & 0xFF;
+    frame[0] = frame[1] = 0xAA;
+    for (i = 0; i < size; i++) {
+        frame[n++] = buf[i];
+        if (buf[i] == 0xAA)
+            frame[n++] = 0x00;
+    }
+    return n;
+}
+
+static void tnc_send(int fd, const unsigned char *data, int size)
+{
+    unsigned char frame[MAX_CMD_SIZE*4];
+    int n;
+
+    n = tnc_frame(frame, data, size);
+    if (write(fd, frame, n) != n)
+        fprintf(stderr, "arim-serialbench: fake TNC write failed\n");
+}
+
+static int data_frame(unsigned char *frame, int seq, const unsigned char *data, int size)
+{
+    unsigned char buf[MAX_CMD_SIZE*2];
+
+    buf[0] = 0x21;         /* data channel */
+    buf[1] = 0x07 | seq;   /* data, counted */
+    buf[2] = size - 1;
+    memcpy(&buf[3], data, size);
+    return tnc_frame(frame, buf, size + 3);
+}
+
+static void test_expect(const void *data, int size)
+{
+    memcpy(test.expect + test.expect_size, data, size);
+    test.expect_size += size;
+}
+
+static int test_build(int idx, int seq)
+{
+    static const unsigned char stuffed[] = "\xAA\xAA de NW8L \xAA\x00\xAA";
+    unsigned char data[MAX_CMD_SIZE*2], *b = test.bytes;
+    unsigned int crc16;
+    int i, n;
+
+    memset(&test, 0, sizeof(test));
+    switch (idx) {
+    case 0:
+        test.name = "plain frame";
+        n = snprintf((char *)data, sizeof(data), "QST de NW8L");
+        test.size = data_frame(b, seq, data, n);
+        test_expect(data, n);
+        break;
+    case 1:
+        test.name = "stuffed 0xAA data bytes";
+        test.size = data_frame(b, seq, stuffed, sizeof(stuffed) - 1);
+        test_expect(stuffed, sizeof(stuffed) - 1);
+        break;
+    case 2:
+        test.name = "frame split into 1 byte reads";
+        test.split = 1;
+        test.size = data_frame(b, seq, stuffed, sizeof(stuffed) - 1);
+        test_expect(stuffed, sizeof(stuffed) - 1);
+        break;
+    case 3:
+        test.name = "stuffed 0xAA in CRC";
+        /* vary the text until a CRC byte is 0xAA */
+        for (i = 0; i < 65536; i++) {
+            data[0] = 0x21;
+            data[1] = 0x07 | seq;
+            n = snprintf((char *)&data[3], sizeof(data) - 3, "crc %d", i);
+            data[2] = n - 1;
+            crc16 = calc_crc16(data, n + 3) ^ 0xFFFF;
+            if ((crc16 & 0xFF) == 0xAA || (crc16 >> 8) == 0xAA)
+                break;
+        }
+        test.size = tnc_frame(b, data, n + 3);
+        test_expect(&data[3], n);
+        break;
+    case 4:
+        test.name = "noise before sync";
+        n = snprintf((char *)data, sizeof(data), "73");
+        memcpy(b, "\r\n\x55\xAA\x01", 5);
+        test.size = 5 + data_frame(b + 5, seq, data, n);
+        test_expect(data, n);
+        break;
+    case 5:
+        test.name = "two frames run together";
+        n = snprintf((char *)data, sizeof(data), "first");
+        test.size = data_frame(b, seq, data, n);
+        test_expect(data, n);
+        n = snprintf((char *)data, sizeof(data), "second");
+        test.size += data_frame(b + test.size, seq ^ 0x80, data, n);
+        test_expect(data, n);
+        break;
+    case 6:
+        test.name = "frame cut short by sync";
+        n = snprintf((char *)data, sizeof(data), "resync");
+        b[0] = b[1] = 0xAA;
+        b[2] = 0x21;
+        /* the new frame's sync ends the partial one */
+        test.size = 3 + data_frame(b + 3, seq, data, n);
+        test_expect(data, n);
+        break;
+    case 7:
+        test.name = "bad CRC dropped";
+        n = snprintf((char *)data, sizeof(data), "bad crc");
+        test.size = data_frame(b, seq, data, n);
+        b[test.size - 1] ^= 0x01;
+        break;
+    case 8:
+        test.name = "stuffing error dropped";
+        n = snprintf((char *)data, sizeof(data), "bad stuffing");
+        test.size = data_frame(b, seq, data, n);
+        b[test.size - 3] = 0xAA;
+        b[test.size - 2] = 0x12;
+        break;
+    case 9:
+        test.name = "bad sequence bit dropped";
+        n = snprintf((char *)data, sizeof(data), "bad seq");
+        test.size = data_frame(b, seq ^ 0x80, data, n);
+        break;
+    case 10:
+        test.name = "oversize frame dropped";
+        data[0] = 0x21;
+        data[1] = 0x01 | seq; /* null terminated, but no null */
+        memset(&data[2], 'x', MAX_CMD_SIZE*2 - 2);
+        test.size = tnc_frame(b, data, MAX_CMD_SIZE*2);
+        break;
+    case 11:
+        test.name = "repeat request";
+        test.repeat = 1;
+        b[0] = b[1] = b[2] = 0xAA;
+        b[3] = 0x55;
+        test.size = 4;
+        break;
+    default:
+        return 0;
+    }
+    return 1;
+}
+
+static int test_step(int fd, const unsigned char *f, int size)
+{
+    int i, ok;
+
+    /* each poll shows the host has finished with the previous case */
+    if (test_idx >= 0) {
+        if (test.repeat) {
+            ok = size <= (int)sizeof(last_poll) && !memcmp(f, last_poll, size) &&
+                 now_us() - test_sent < SBENCH_REPEAT_MSEC * 1000.0;
+        } else {
+            pthread_mutex_lock(&mutex_rx_data);
+            ok = rx_data_size == test.expect_size &&
+                 !memcmp(rx_data, test.expect, rx_data_size);
+            pthread_mutex_unlock(&mutex_rx_data);
+        }
+        printf("%-32s %s\n", test.name, ok ? "ok" : "FAILED");
+        if (!ok)
+            test_fails++;
+    }
+    if (!test_build(++test_idx, f[1] & 0x80)) {
+        atomic_store(&test_done, 1);
+        return 0;
+    }
+    if (size <= (int)sizeof(last_poll))
+        memcpy(last_poll, f, size);
+    pthread_mutex_lock(&mutex_rx_data);
+    rx_data_size = 0;
+    pthread_mutex_unlock(&mutex_rx_data);
+    test_sent = now_us();
+    if (test.split) {
+        for (i = 0; i < test.size; i++) {
+            if (write(fd, &test.bytes[i], 1) != 1)
+                break;
+            usleep(500);
+        }
+    } else if (write(fd, test.bytes, test.size) != test.size) {
+        fprintf(stderr, "arim-serialbench: fake TNC write failed\n");
+    }
+    return 1;
+}
+
+static void tnc_on_frame(int fd, const unsigned char *f, int size)
+{
+    unsigned char resp[8];
+    char text[MAX_CMD_SIZE];
+    double lat;
+    int seq = f[1] & 0x80;
+
+    /* answer every host frame with the sequence bit it carried */
+    resp[0] = f[0];
+    if (f[0] == 0xFF) {
+        atomic_fetch_add(&poll_cnt, 1);
+        if (atomic_load(&phase) == SBENCH_PHASE_TEST &&
+            !atomic_load(&test_done) && test_step(fd, f, size))
+            return;
+        resp[1] = 0x01 | seq; /* success, no channels with data */
+        resp[2] = 0x00;
+        tnc_send(fd, resp, 3);
+        return;
+    }
+    if (f[0] == 0x21) {
+        atomic_fetch_add(&data_out_cnt, size - 3);
+        if (atomic_load(&data_slow))
+            usleep(SBENCH_DATA_MSEC * 1000); /* pace like a radio link */
+    }
+    if (f[0] == 0x20 && size > 4) {
+        snprintf(text, sizeof(text), "%.*s", size - 3, (const char *)&f[3]);
+        if (!strncmp(text, "BENCH ", 6)) {
+            lat = now_us() - atof(text + 6);
+            pthread_mutex_lock(&mutex_lat);
+            lat_sum += lat;
+            if (lat > lat_max)
+                lat_max = lat;
+            pthread_mutex_unlock(&mutex_lat);
+            atomic_fetch_add(&cmd_cnt, 1);
+        }
+    }
+    resp[1] = 0x00 | seq; /* success, no message */
+    tnc_send(fd, resp, 2);
+}
+
+static void *tnc_func(void *arg)
+{
+    int fd = *(int *)arg;
+    unsigned char in[256], frame[MAX_CMD_SIZE*2];
+    char text[64];
+    struct pollfd pfd;
+    int i, n, sync = 0, stuff = 0, fsize = 0, tsize = 0;
+    unsigned char b;
+
+    pfd.fd = fd;
+    pfd.events = POLLIN;
+    while (!atomic_load(&tnc_stop)) {
+        n = poll(&pfd, 1, SBENCH_NOISE_MSEC);
+        if (n == 0 || !(pfd.revents & POLLIN)) {
+            /* idle line; in the noise phase send bytes the host must
+               ignore between frames */
+            if (atomic_load(&phase) == SBENCH_PHASE_NOISE && !fsize)
+                n = write(fd, "\r", 1);
+            continue;
+        }
+        n = read(fd, in, sizeof(in));
+        if (n <= 0)
+            continue;
+        if (!atomic_load(&tnc_host)) {
+            /* command mode: answer the probe, ARDOP and JHOST4 */
+            for (i = 0; i < n && tsize < (int)sizeof(text) - 1; i++)
+                text[tsize++] = in[i];
+            text[tsize] = '\0';
+            if (strstr(text, "JHOST4\r")) {
+                atomic_store(&tnc_host, 1);
+                tsize = 0;
+            } else if (strstr(text, "ARDOP\r")) {
+                n = write(fd, "\r\nARDOP\r\n", 9);
+                tsize = 0;
+            } else if (strchr(text, '\r')) {
+                n = write(fd, "\r\ncmd: ", 7);
+                tsize = 0;
+            }
+            continue;
+        }
+        for (i = 0; i < n; i++) {
+            b = in[i];
+            if (!fsize && !stuff) {
+                /* hunt for the two sync bytes */
+                sync = b == 0xAA ? sync + 1 : 0;
+                if (sync == 2) {
+                    sync = 0;
+                    fsize = 1; /* frame open, nothing stored yet */
+                }
+                continue;
+            }
+            if (stuff) {
+                stuff = 0;
+                if (b != 0x00)
+                    continue; /* not a stuffed 0xAA, drop */
+            } else if (b == 0xAA) {
+                stuff = 1;
+                continue;
+            }
+            frame[fsize++ - 1] = b;
+            /* chan, code, count-1, count bytes, 2 byte CRC */
+            if (fsize - 1 >= 3 && fsize - 1 == 3 + frame[2] + 1 + 2) {
+                tnc_on_frame(fd, frame, fsize - 1 - 2);
+                fsize = 0;
+            } else if (fsize >= (int)sizeof(frame)) {
+                fsize = 0;
+            }
+        }
+    }
+    return NULL;
+}
+
+static void *cmd_func(void *arg)
+{
+    char cmd[MAX_CMD_SIZE];
+
+    while (atomic_load(&phase) == SBENCH_PHASE_CMDS) {
+        snprintf(cmd, sizeof(cmd), "BENCH %.0f", now_us());
+        bufq_queue_cmd_out(cmd);
+        usleep(SBENCH_CMD_USEC);
+    }
+    return NULL;
+}
+
+static int state_check()
+{
+    double t0, t, rate;
+    int p0, ok, fails = 0;
+
+    /* leave idle for a state with a deadline, as arim_proto_idle() does
+       for EV_SEND_PING. The serial thread ticks the state five times a
+       second and services its deadline, nothing else may */
+    atomic_store(&wrong_tid, 0);
+    atomic_store(&timeout_cnt, 0);
+    p0 = atomic_load(&periodic_cnt);
+    t0 = now_us();
+    arim_set_state(ST_RCV_PING_ACK_WAIT);
+    arim_start_timer(SBENCH_STATE_SECS);
+    while (!atomic_load(&timeout_cnt) && now_us() - t0 < SBENCH_STATE_SECS * 3000000.0)
+        usleep(10000);
+    t = (now_us() - t0) / 1000000.0;
+    /* give a stray second tick time to show up */
+    usleep(500000);
+    rate = (atomic_load(&periodic_cnt) - p0) / ((now_us() - t0) / 1000000.0);
+    arim_set_state(ST_IDLE);
+    ok = rate < 7.5 && !atomic_load(&wrong_tid);
+    printf("%-32s %s (%.1f/s)\n", "state tick, serial thread only", ok ? "ok" : "FAILED", rate);
+    if (!ok)
+        fails++;
+    ok = atomic_load(&timeout_cnt) == 1 &&
+         t >= SBENCH_STATE_SECS && t < SBENCH_STATE_SECS + 0.25;
+    printf("%-32s %s (%.0f ms)\n", "state deadline", ok ? "ok" : "FAILED", t * 1000.0);
+    if (!ok)
+        fails++;
+    return fails;
+}
+
+static int file_cancel_check()
+{
+    static unsigned char buf[SBENCH_FILE_SIZE];
+    FILEQUEUEITEM file;
+    int i, sent, ok, fd;
+
+    /* stream a file far too big to finish during the check, cancel it
+       part way through and make sure nothing more reaches the TNC */
+    memset(&file, 0, sizeof(file));
+    file.size = sizeof(buf);
+    file.fp = tmpfile();
+    memset(buf, 'x', sizeof(buf));
+    if (!file.fp || fwrite(buf, 1, sizeof(buf), file.fp) != sizeof(buf)) {
+        printf("%-32s FAILED (no temporary file)\n", "streamed file canceled");
+        return 1;
+    }
+    rewind(file.fp);
+    fd = fileno(file.fp);
+    atomic_store(&data_out_cnt, 0);
+    atomic_store(&data_slow, 1);
+    bufq_queue_file_out(&file);
+    for (i = 0; i < 100 && atomic_load(&data_out_cnt) < 1024; i++)
+        usleep(10000);
+    datathread_cancel_send_data_out();
+    /* a block already handed to the TNC may still be acknowledged */
+    usleep(250000);
+    sent = atomic_load(&data_out_cnt);
+    usleep(1000000);
+    atomic_store(&data_slow, 0);
+    ok = sent >= 1024 && sent < (int)sizeof(buf) &&
+         atomic_load(&data_out_cnt) == sent && fcntl(fd, F_GETFD) == -1;
+    printf("%-32s %s (%d of %d bytes)\n", "streamed file canceled",
+           ok ? "ok" : "FAILED", atomic_load(&data_out_cnt), (int)sizeof(buf));
+    return ok ? 0 : 1;
+}
+
+static long ctx_switches(int tid)
+{
+    FILE *fp;
+    char path[64], line[128];
+    long n, total = 0;
+
+    snprintf(path, sizeof(path), "/proc/self/task/%d/status", tid);
+    fp = fopen(path, "r");
+    if (!fp)
+        return -1;
+    while (fgets(line, sizeof(line), fp)) {
+        if (sscanf(line, "voluntary_ctxt_switches: %ld", &n) == 1 ||
+            sscanf(line, "nonvoluntary_ctxt_switches: %ld", &n) == 1)
+            total += n;
+    }
+    fclose(fp);
+    return total;
+}
+
+static void run_phase(const char *name, int which, int secs)
+{
+    pthread_t tid;
+    double t0, t;
+    long sw0, sw;
+    int ev0, poll0, cmds;
+
+    atomic_store(&phase, which);
+    if (which == SBENCH_PHASE_CMDS)
+        pthread_create(&tid, NULL, cmd_func, NULL);
+    pthread_mutex_lock(&mutex_lat);
+    lat_sum = lat_max = 0;
+    pthread_mutex_unlock(&mutex_lat);
+    atomic_store(&cmd_cnt, 0);
+    ev0 = atomic_load(&periodic_cnt);
+    poll0 = atomic_load(&poll_cnt);
+    sw0 = ctx_switches(atomic_load(&serial_tid));
+    t0 = now_us();
+    sleep(secs);
+    t = (now_us() - t0) / 1000000.0;
+    sw = ctx_switches(atomic_load(&serial_tid)) - sw0;
+    atomic_store(&phase, SBENCH_PHASE_IDLE);
+    if (which == SBENCH_PHASE_CMDS)
+        pthread_join(tid, NULL);
+    cmds = atomic_load(&cmd_cnt);
+    pthread_mutex_lock(&mutex_lat);
+    printf("%-13s %11.1f %10.1f %10.1f %9.1f %10.2f %10.2f\n", name, sw / t,
+           (atomic_load(&poll_cnt) - poll0) / t,
+           (atomic_load(&periodic_cnt) - ev0) / t, cmds / t,
+           cmds ? lat_sum / cmds / 1000.0 : 0.0, lat_max / 1000.0);
+    pthread_mutex_unlock(&mutex_lat);
+}
+
+int main(int argc, char *argv[])
+{
+    pthread_t serial_tid_h, tnc_tid;
+    struct termios io_set;
+    int i, mfd, secs = SBENCH_DEF_SECS, test_mode = 0;
+
+    if (argc > 2)
+        usage();
+    if (argc == 2 && !strcmp(argv[1], "-t")) {
+        test_mode = 1;
+    } else if (argc == 2) {
+        secs = atoi(argv[1]);
+        if (secs <= 0 || secs > SBENCH_MAX_SECS)
+            usage();
+    }
+    mfd = posix_openpt(O_RDWR | O_NOCTTY);
+    if (mfd == -1 || grantpt(mfd) || unlockpt(mfd)) {
+        fprintf(stderr, "arim-serialbench: cannot open pseudo terminal\n");
+        return 1;
+    }
+    tcgetattr(mfd, &io_set);
+    cfmakeraw(&io_set);
+    tcsetattr(mfd, TCSANOW, &io_set);
+    snprintf(g_tnc_settings[0].serial_port, sizeof(g_tnc_settings[0].serial_port),
+             "%s", ptsname(mfd));
+    snprintf(g_tnc_settings[0].serial_baudrate,
+             sizeof(g_tnc_settings[0].serial_baudrate), "115200");
+    snprintf(g_arim_settings.frame_timeout, sizeof(g_arim_settings.frame_timeout), "30");
+    if (!bufq_init(MIN_DATAQUEUE_SIZE)) {
+        fprintf(stderr, "arim-serialbench: cannot allocate queues\n");
+        return 1;
+    }
+    pthread_create(&tnc_tid, NULL, tnc_func, &mfd);
+    pthread_create(&serial_tid_h, NULL, serialthread_func, NULL);
+    /* wait for the host mode handshake and the first general poll */
+    for (i = 0; i < 100 && !atomic_load(&poll_cnt); i++)
+        usleep(100000);
+    if (!atomic_load(&poll_cnt) || g_serialthread_stop) {
+        fprintf(stderr, "arim-serialbench: serial thread did not reach host mode\n");
+        return 1;
+    }
+    if (test_mode) {
+        /* cases run one per general poll, a few per second */
+        atomic_store(&phase, SBENCH_PHASE_TEST);
+        for (i = 0; i < 100 && !atomic_load(&test_done); i++)
+            usleep(100000);
+        if (!atomic_load(&test_done)) {
+            printf("timed out after case %d\n", test_idx);
+            test_fails++;
+        }
+        atomic_store(&phase, SBENCH_PHASE_IDLE);
+        test_fails += state_check();
+        test_fails += file_cancel_check();
+        atomic_store(&tnc_stop, 1);
+        pthread_join(tnc_tid, NULL);
+        printf("%d failed\n", test_fails);
+        return test_fails ? 1 : 0;
+    }
+    printf("serial thread in host mode, %d s per phase\n"
+           "(ideal: 20 polls/s, 5 EV_PERIODIC/s)\n\n", secs);
+    printf("%-13s %11s %10s %10s %9s %10s %10s\n", "phase", "wakeups/s",
+           "polls/s", "periodic/s", "cmds/s", "avg ms", "max ms");
+    run_phase("idle", SBENCH_PHASE_IDLE, secs);
+    run_phase("queued cmds", SBENCH_PHASE_CMDS, secs);
+    run_phase("serial noise", SBENCH_PHASE_NOISE, secs);
+    atomic_store(&tnc_stop, 1);
+    pthread_join(tnc_tid, NULL);
+    return 0;
+}
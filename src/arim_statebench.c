@@ -0,0 +1,260 @@
+/***********************************************************************
+
+    ARIM Amateur Radio Instant Messaging program for the ARDOP TNC.
+
+    Copyright (C) 2016-2021 Robert Cunnings NW8L
+
+    This file is part of the ARIM messaging program.
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+*************************************************************************/
+
+
+
+/* arim-statebench: measure TNC run time state reads under contention,
+   through the lock free tnc_state snapshot and through the getters it
+   replaced, which locked mutex_tnc_set and parsed the string fields in
+   g_tnc_settings. Reader threads make the calls the data thread pacing
+   code and the ui redraw make while a writer thread applies BUFFER,
+   BUSY, NEWSTATE and remote call updates as fast as it can. Readers
+   also check that the remote call and ARQ bandwidth they read are a
+   pair the writer published together. Not installed, run from the
+   build directory, e.g.
+
+     arim-statebench
+     arim-statebench 3                                               */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <time.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include "main.h"
+#include "ini.h"
+#include "tnc_state.h"
+
+#define STATEBENCH_DEF_SECS 1
+#define STATEBENCH_MAX_SECS 60
+#define STATEBENCH_READERS  4
+
+/* globals normally provided by the rest of arim */
+TNC_SET g_tnc_settings[TNC_MAX_COUNT];
+int g_cur_tnc;
+pthread_mutex_t mutex_tnc_set = PTHREAD_MUTEX_INITIALIZER;
+
+/* remote call and bandwidth pairs, a reader must never mix them */
+static const char *calls[] = { "NW8L", "K7ABCDEF-12" };
+static const char *bws[] = { "500", "2000" };
+
+static atomic_int stop;
+static int use_old;
+
+/* the getters as they were before tnc_state */
+static int old_get_buffer_cnt()
+{
+    int ret;
+
+    pthread_mutex_lock(&mutex_tnc_set);
+    ret = atoi(g_tnc_settings[g_cur_tnc].buffer);
+    pthread_mutex_unlock(&mutex_tnc_set);
+    return ret;
+}
+
+static int old_is_channel_busy()
+{
+    int ret;
+
+    pthread_mutex_lock(&mutex_tnc_set);
+    ret = strncmp(g_tnc_settings[g_cur_tnc].busy, "TRUE", 4);
+    pthread_mutex_unlock(&mutex_tnc_set);
+    return ret ? 0 : 1;
+}
+
+static int old_tnc_is_idle()
+{
+    int tnc_disc, tnc_ch_not_busy;
+
+    pthread_mutex_lock(&mutex_tnc_set);
+    tnc_disc = strncmp(g_tnc_settings[g_cur_tnc].state, "DISC", 4) ? 0 : 1;
+    tnc_ch_not_busy = strncmp(g_tnc_settings[g_cur_tnc].busy, "TRUE", 4);
+    pthread_mutex_unlock(&mutex_tnc_set);
+    return (tnc_disc && tnc_ch_not_busy);
+}
+
+static int old_get_fec_repeats()
+{
+    int ret;
+
+    pthread_mutex_lock(&mutex_tnc_set);
+    ret = atoi(g_tnc_settings[g_cur_tnc].fecrepeats);
+    pthread_mutex_unlock(&mutex_tnc_set);
+    return ret;
+}
+
+static void old_copy_remote(char *call, size_t call_size, char *bw_hz, size_t bw_hz_size)
+{
+    /* the two fields were read under one lock by callers that wanted both */
+    pthread_mutex_lock(&mutex_tnc_set);
+    snprintf(call, call_size, "%s", g_tnc_settings[g_cur_tnc].arq_remote_call);
+    snprintf(bw_hz, bw_hz_size, "%s", g_tnc_settings[g_cur_tnc].arq_bandwidth_hz);
+    pthread_mutex_unlock(&mutex_tnc_set);
+}
+
+static void old_set(char *field, size_t size, const char *val)
+{
+    pthread_mutex_lock(&mutex_tnc_set);
+    snprintf(field, size, "%s", val);
+    pthread_mutex_unlock(&mutex_tnc_set);
+}
+
+static void old_set_remote(const char *call, const char *bw_hz)
+{
+    pthread_mutex_lock(&mutex_tnc_set);
+    snprintf(g_tnc_settings[g_cur_tnc].arq_remote_call,
+        sizeof(g_tnc_settings[g_cur_tnc].arq_remote_call), "%s", call);
+    snprintf(g_tnc_settings[g_cur_tnc].arq_bandwidth_hz,
+        sizeof(g_tnc_settings[g_cur_tnc].arq_bandwidth_hz), "%s", bw_hz);
+    pthread_mutex_unlock(&mutex_tnc_set);
+}
+
+static void usage()
+{
+    fprintf(stderr,
+        "usage: arim-statebench [seconds]\n"
+        "  runs 1, 2 and 4 readers against one writer for seconds (default %d)\n",
+        STATEBENCH_DEF_SECS);
+    exit(1);
+}
+
+typedef struct reader_arg {
+    long reads;
+    long torn;
+    long sum;
+} READERARG;
+
+static void *reader(void *arg)
+{
+    READERARG *r = arg;
+    char call[TNC_MYCALL_SIZE], bw[TNC_ARQ_BW_SIZE];
+    long sum = 0;
+    int i;
+
+    while (!atomic_load_explicit(&stop, memory_order_relaxed)) {
+        /* one pacing check and one status line redraw */
+        if (use_old) {
+            sum += old_get_buffer_cnt() + old_is_channel_busy() +
+                   old_tnc_is_idle() + old_get_fec_repeats();
+            old_copy_remote(call, sizeof(call), bw, sizeof(bw));
+        } else {
+            sum += tnc_state_get_buffer() + tnc_state_is_busy() +
+                   (tnc_state_get_state() == TNC_STATE_DISC && !tnc_state_is_busy()) +
+                   tnc_state_get_fec_repeats();
+            tnc_state_copy_remote(call, sizeof(call), bw, sizeof(bw));
+        }
+        for (i = 0; i < 2; i++) {
+            if (!strcmp(call, calls[i]))
+                break;
+        }
+        if (i == 2 || strcmp(bw, bws[i]))
+            r->torn++;
+        r->reads += 5;
+    }
+    r->sum = sum;
+    return NULL;
+}
+
+static void *writer(void *arg)
+{
+    long *writes = arg;
+    char val[sizeof(g_tnc_settings[0].buffer)];
+    int i = 0;
+
+    while (!atomic_load_explicit(&stop, memory_order_relaxed)) {
+        snprintf(val, sizeof(val), "%d", i & 0xFFF);
+        if (use_old) {
+            old_set(g_tnc_settings[0].buffer, sizeof(g_tnc_settings[0].buffer), val);
+            old_set(g_tnc_settings[0].busy, sizeof(g_tnc_settings[0].busy),
+                    i & 1 ? "TRUE" : "FALSE");
+            old_set(g_tnc_settings[0].state, sizeof(g_tnc_settings[0].state),
+                    i & 2 ? "DISC" : "IRS");
+            old_set_remote(calls[i & 1], bws[i & 1]);
+        } else {
+            tnc_state_set_buffer(i & 0xFFF);
+            tnc_state_set_busy(i & 1);
+            tnc_state_set_state(i & 2 ? "DISC" : "IRS");
+            tnc_state_set_remote(calls[i & 1], bws[i & 1]);
+        }
+        *writes += 4;
+        i++;
+    }
+    return NULL;
+}
+
+static int run(int old, int nreaders, int secs)
+{
+    pthread_t rtid[STATEBENCH_READERS], wtid;
+    READERARG r[STATEBENCH_READERS];
+    long reads = 0, torn = 0, writes = 0;
+    int i;
+
+    use_old = old;
+    memset(r, 0, sizeof(r));
+    atomic_store(&stop, 0);
+    pthread_create(&wtid, NULL, writer, &writes);
+    for (i = 0; i < nreaders; i++)
+        pthread_create(&rtid[i], NULL, reader, &r[i]);
+    sleep(secs);
+    atomic_store(&stop, 1);
+    for (i = 0; i < nreaders; i++) {
+        pthread_join(rtid[i], NULL);
+        reads += r[i].reads;
+        torn += r[i].torn;
+    }
+    pthread_join(wtid, NULL);
+    printf("%7d  %-8s %14.0f %14.0f %8ld\n", nreaders, old ? "mutex" : "snapshot",
+           (double)reads / secs, (double)writes / secs, torn);
+    return torn == 0;
+}
+
+int main(int argc, char *argv[])
+{
+    int n, secs = STATEBENCH_DEF_SECS, fails = 0;
+
+    if (argc > 2)
+        usage();
+    if (argc == 2) {
+        secs = atoi(argv[1]);
+        if (secs <= 0 || secs > STATEBENCH_MAX_SECS)
+            usage();
+    }
+    snprintf(g_tnc_settings[0].buffer, sizeof(g_tnc_settings[0].buffer), "0");
+    snprintf(g_tnc_settings[0].busy, sizeof(g_tnc_settings[0].busy), "FALSE");
+    snprintf(g_tnc_settings[0].state, sizeof(g_tnc_settings[0].state), "DISC");
+    snprintf(g_tnc_settings[0].fecrepeats, sizeof(g_tnc_settings[0].fecrepeats), "1");
+    snprintf(g_tnc_settings[0].arq_remote_call,
+             sizeof(g_tnc_settings[0].arq_remote_call), "%s", calls[0]);
+    snprintf(g_tnc_settings[0].arq_bandwidth_hz,
+             sizeof(g_tnc_settings[0].arq_bandwidth_hz), "%s", bws[0]);
+    tnc_state_init();
+    printf("%ld cpus online, %d s per run\n\n", sysconf(_SC_NPROCESSORS_ONLN), secs);
+    printf("%7s  %-8s %14s %14s %8s\n", "readers", "state", "reads/s", "writes/s", "torn");
+    for (n = 1; n <= STATEBENCH_READERS; n *= 2) {
+        fails += !run(1, n, secs);
+        fails += !run(0, n, secs);
+    }
+    return fails ? 1 : 0;
+}
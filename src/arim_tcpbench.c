@@ -0,0 +1,521 @@
+/***********************************************************************
+
+    ARIM Amateur Radio Instant Messaging program for the ARDOP TNC.
+
+    Copyright (C) 2016-2021 Robert Cunnings NW8L
+
+    This file is part of the ARIM messaging program.
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+*************************************************************************/
+
+
+
+/* arim-tcpbench: run the TNC command and data threads, or with -r the
+   reactor thread, against a fake ARDOP TNC on the loopback interface
+   and measure how often each thread wakes and how long a queued
+   command or data frame takes to reach the TNC's command or data port,
+   idle, with commands queued and with data queued. Items are queued
+   100 to 400 msec apart at random, sparse traffic like a session's
+   that the old 200 msec select() timeout could also keep up with, so
+   the latency is the thread's own and not a backlog. Not installed,
+   run from the build directory, e.g.
+
+     arim-tcpbench
+     arim-tcpbench -r 10                                             */
+
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <poll.h>
+#include <time.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <sys/socket.h>
+#include <sys/syscall.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#include "main.h"
+#include "ini.h"
+#include "bufq.h"
+#include "arim_proto.h"
+#include "ardop_flow.h"
+#include "cmdthread.h"
+#include "datathread.h"
+#include "reactorthread.h"
+#include "serialthread.h"
+#include "tnc_attach.h"
+#include "mbox.h"
+
+#define TBENCH_DEF_SECS     10
+#define TBENCH_MAX_SECS     600
+#define TBENCH_MIN_GAP_MSEC 100
+#define TBENCH_MAX_GAP_MSEC 400
+#define TBENCH_BASE_PORT    18515
+#define TBENCH_MAX_PORT     18615
+
+#define TBENCH_PHASE_IDLE   0
+#define TBENCH_PHASE_CMDS   1
+#define TBENCH_PHASE_DATA   2
+
+/* globals normally provided by the rest of arim */
+ARIM_SET g_arim_settings;
+UI_SET g_ui_settings;
+TNC_SET g_tnc_settings[TNC_MAX_COUNT];
+int g_cur_tnc;
+int g_tnc_attached;
+int g_cmdthread_stop;
+int g_cmdthread_ready;
+int g_datathread_stop;
+int g_datathread_ready;
+int g_reactorthread_stop;
+int g_reactorthread_ready;
+int g_debug_log_enable;
+int g_tncpi9k6_log_enable;
+int g_traffic_log_enable;
+int mon_timestamp;
+int arim_data_waiting;
+time_t arim_start_time;
+TNC_VERSION g_tnc_version;
+pthread_mutex_t mutex_time = PTHREAD_MUTEX_INITIALIZER;
+pthread_mutex_t mutex_cmd_in = PTHREAD_MUTEX_INITIALIZER;
+pthread_mutex_t mutex_cmd_out = PTHREAD_MUTEX_INITIALIZER;
+pthread_mutex_t mutex_data_in = PTHREAD_MUTEX_INITIALIZER;
+pthread_mutex_t mutex_data_out = PTHREAD_MUTEX_INITIALIZER;
+pthread_mutex_t mutex_heard = PTHREAD_MUTEX_INITIALIZER;
+pthread_mutex_t mutex_debug_log = PTHREAD_MUTEX_INITIALIZER;
+pthread_mutex_t mutex_tncpi9k6_log = PTHREAD_MUTEX_INITIALIZER;
+pthread_mutex_t mutex_traffic_log = PTHREAD_MUTEX_INITIALIZER;
+pthread_mutex_t mutex_recents = PTHREAD_MUTEX_INITIALIZER;
+pthread_mutex_t mutex_ptable = PTHREAD_MUTEX_INITIALIZER;
+pthread_mutex_t mutex_ctable = PTHREAD_MUTEX_INITIALIZER;
+pthread_mutex_t mutex_ftable = PTHREAD_MUTEX_INITIALIZER;
+pthread_mutex_t mutex_file_out = PTHREAD_MUTEX_INITIALIZER;
+pthread_mutex_t mutex_msg_out = PTHREAD_MUTEX_INITIALIZER;
+pthread_mutex_t mutex_tnc_set = PTHREAD_MUTEX_INITIALIZER;
+
+static atomic_int cmd_tid, data_tid, periodic_cnt, item_cnt;
+static atomic_int phase, tnc_stop;
+static double lat_sum, lat_max;
+static pthread_mutex_t mutex_lat = PTHREAD_MUTEX_INITIALIZER;
+
+void *arim_reset()
+{
+    /* first called on the data (or reactor) thread, note its id for /proc */
+    if (!atomic_load(&data_tid))
+        atomic_store(&data_tid, (int)syscall(SYS_gettid));
+    return NULL;
+}
+
+static void state_on_event(int event)
+{
+    /* arim_on_event() from arim_proto.c dispatches here for every state */
+    if (event == EV_PERIODIC)
+        atomic_fetch_add(&periodic_cnt, 1);
+}
+
+#define TBENCH_STATE(name) \
+    void name(int event, int param) { state_on_event(event); }
+
+TBENCH_STATE(arim_proto_idle)
+TBENCH_STATE(arim_proto_msg_buf_wait)
+TBENCH_STATE(arim_proto_msg_net_buf_wait)
+TBENCH_STATE(arim_proto_query_buf_wait)
+TBENCH_STATE(arim_proto_query_resp_buf_wait)
+TBENCH_STATE(arim_proto_msg_acknak_buf_wait)
+TBENCH_STATE(arim_proto_beacon_buf_wait)
+TBENCH_STATE(arim_proto_unproto_buf_wait)
+TBENCH_STATE(arim_proto_query_resp_pend)
+TBENCH_STATE(arim_proto_msg_acknak_pend)
+TBENCH_STATE(arim_proto_msg_acknak_wait)
+TBENCH_STATE(arim_proto_arq_conn_pend_wait)
+TBENCH_STATE(arim_proto_ping_ack_pend)
+TBENCH_STATE(arim_proto_ping_ack_wait)
+TBENCH_STATE(arim_proto_arq_conn_out_wait)
+TBENCH_STATE(arim_proto_arq_conn_out_wait_rpt)
+TBENCH_STATE(arim_proto_arq_conn_pp_wait)
+TBENCH_STATE(arim_proto_arq_conn_in_wait)
+TBENCH_STATE(arim_proto_arq_conn_connected)
+TBENCH_STATE(arim_proto_arq_file_flist_rcv_wait)
+TBENCH_STATE(arim_proto_arq_file_flist_rcv)
+TBENCH_STATE(arim_proto_arq_file_flist_send_wait)
+TBENCH_STATE(arim_proto_arq_file_flist_send)
+TBENCH_STATE(arim_proto_arq_file_send_wait)
+TBENCH_STATE(arim_proto_arq_file_send_wait_ok)
+TBENCH_STATE(arim_proto_arq_file_send)
+TBENCH_STATE(arim_proto_arq_file_rcv_wait_ok)
+TBENCH_STATE(arim_proto_arq_file_rcv_wait)
+TBENCH_STATE(arim_proto_arq_file_rcv)
+TBENCH_STATE(arim_proto_arq_msg_send_wait)
+TBENCH_STATE(arim_proto_arq_msg_send)
+TBENCH_STATE(arim_proto_arq_msg_rcv)
+TBENCH_STATE(arim_proto_msg_pingack_wait)
+TBENCH_STATE(arim_proto_query_pingack_wait)
+TBENCH_STATE(arim_proto_query_resp_wait)
+TBENCH_STATE(arim_proto_arq_auth_send_a1_wait)
+TBENCH_STATE(arim_proto_arq_auth_send_a2_wait)
+TBENCH_STATE(arim_proto_arq_auth_send_a3_wait)
+TBENCH_STATE(arim_proto_arq_auth_rcv_a2_wait)
+TBENCH_STATE(arim_proto_arq_auth_rcv_a3_wait)
+TBENCH_STATE(arim_proto_arq_auth_rcv_a4_wait)
+TBENCH_STATE(arim_proto_frame_rcv_wait)
+
+int arim_test_frame(char *data, size_t size)
+{
+    return 0;
+}
+
+size_t arim_arq_on_cmd(const char *cmd, size_t size)
+{
+    return 0;
+}
+
+size_t arim_arq_on_resp(const char *resp, size_t size)
+{
+    return 0;
+}
+
+size_t ardop_cmds_proc_resp(char *response, size_t size)
+{
+    return size;
+}
+
+void ardop_cmds_init()
+{
+    /* called on the cmd (or reactor) thread, note its id for /proc */
+    if (!atomic_load(&cmd_tid))
+        atomic_store(&cmd_tid, (int)syscall(SYS_gettid));
+}
+
+void ardop_data_inc_num_bytes_out(size_t num)
+{
+}
+
+unsigned char *ardop_data_rx_space(size_t *size)
+{
+    static unsigned char buf[MIN_DATA_BUF_SIZE];
+
+    *size = sizeof(buf);
+    return buf;
+}
+
+size_t ardop_data_on_read(size_t size)
+{
+    return 0;
+}
+
+int ardop_flow_is_enabled()
+{
+    return 0;
+}
+
+void ardop_flow_reset()
+{
+}
+
+void ardop_flow_start(size_t size)
+{
+}
+
+void ardop_flow_end()
+{
+}
+
+void ardop_flow_on_write(size_t size)
+{
+}
+
+size_t ardop_flow_block_size(size_t nleft)
+{
+    return nleft < FLOW_MAX_BLOCK ? nleft : FLOW_MAX_BLOCK;
+}
+
+void serialthread_cancel_send_file_out()
+{
+}
+
+char *mbox_add_msg(const char *fn, const char *fm_call, const char *to_call,
+                       int check, const char *msg, int trace)
+{
+    return NULL;
+}
+
+void tnc_detach()
+{
+}
+
+void ui_truncate_line(char *line, size_t size)
+{
+    line[size - 1] = '\0';
+}
+
+static double now_us()
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000000.0 + ts.tv_nsec / 1000.0;
+}
+
+static void usage()
+{
+    fprintf(stderr,
+        "usage: arim-tcpbench [-r] [seconds]\n"
+        "  runs each phase for seconds (default %d) against a fake TNC\n"
+        "  on the loopback interface, with the cmd and data threads or\n"
+        "  with -r the reactor thread\n", TBENCH_DEF_SECS);
+    exit(1);
+}
+
+static void on_bench_item(const char *text, size_t size)
+{
+    char buf[64];
+    double lat;
+
+    /* a command or data frame queued by the bench, stamped when queued */
+    if (size < 6 || size >= sizeof(buf) || strncmp(text, "BENCH ", 6))
+        return;
+    memcpy(buf, text, size);
+    buf[size] = '\0';
+    lat = now_us() - atof(buf + 6);
+    pthread_mutex_lock(&mutex_lat);
+    lat_sum += lat;
+    if (lat > lat_max)
+        lat_max = lat;
+    pthread_mutex_unlock(&mutex_lat);
+    atomic_fetch_add(&item_cnt, 1);
+}
+
+static int tnc_listen(int port)
+{
+    struct sockaddr_in addr;
+    int fd, on = 1;
+
+    fd = socket(AF_INET, SOCK_STREAM, 0);
+    if (fd == -1)
+        return -1;
+    setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &on, sizeof(on));
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons(port);
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    if (bind(fd, (struct sockaddr *)&addr, sizeof(addr)) || listen(fd, 1)) {
+        close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+static void *tnc_cmd_func(void *arg)
+{
+    int fd, lfd = *(int *)arg;
+    char in[MAX_CMD_SIZE], line[MAX_CMD_SIZE];
+    struct pollfd pfd;
+    int i, n, len = 0;
+
+    /* command port: lines end in CR, nothing needs an answer here */
+    fd = accept(lfd, NULL, NULL);
+    pfd.fd = fd;
+    pfd.events = POLLIN;
+    while (!atomic_load(&tnc_stop)) {
+        if (poll(&pfd, 1, 100) <= 0)
+            continue;
+        n = read(fd, in, sizeof(in));
+        if (n <= 0)
+            break;
+        for (i = 0; i < n; i++) {
+            if (in[i] == '\r') {
+                on_bench_item(line, len);
+                len = 0;
+            } else if (len < (int)sizeof(line) - 1) {
+                line[len++] = in[i];
+            }
+        }
+    }
+    close(fd);
+    return NULL;
+}
+
+static void *tnc_data_func(void *arg)
+{
+    int fd, lfd = *(int *)arg;
+    unsigned char in[MAX_CMD_SIZE*4];
+    struct pollfd pfd;
+    int n, size, len = 0;
+
+    /* data port: each block is a 2 byte big endian count, then data */
+    fd = accept(lfd, NULL, NULL);
+    pfd.fd = fd;
+    pfd.events = POLLIN;
+    while (!atomic_load(&tnc_stop)) {
+        if (poll(&pfd, 1, 100) <= 0)
+            continue;
+        n = read(fd, in + len, sizeof(in) - len);
+        if (n <= 0)
+            break;
+        len += n;
+        while (len >= 2 && len >= 2 + (size = (in[0] << 8) | in[1])) {
+            on_bench_item((char *)in + 2, size);
+            len -= 2 + size;
+            memmove(in, in + 2 + size, len);
+        }
+        if (len == sizeof(in))
+            len = 0; /* lost sync, can't happen with a sane writer */
+    }
+    close(fd);
+    return NULL;
+}
+
+static void *queue_func(void *arg)
+{
+    char text[MAX_CMD_SIZE];
+    unsigned int seed = 1;
+    int gap, which = atomic_load(&phase);
+
+    while (atomic_load(&phase) == which) {
+        snprintf(text, sizeof(text), "BENCH %.0f", now_us());
+        if (which == TBENCH_PHASE_CMDS)
+            bufq_queue_cmd_out(text);
+        else
+            bufq_queue_data_out(text);
+        gap = TBENCH_MIN_GAP_MSEC +
+              rand_r(&seed) % (TBENCH_MAX_GAP_MSEC - TBENCH_MIN_GAP_MSEC + 1);
+        usleep(gap * 1000);
+    }
+    return NULL;
+}
+
+static long ctx_switches(int tid)
+{
+    FILE *fp;
+    char path[64], line[128];
+    long n, total = 0;
+
+    snprintf(path, sizeof(path), "/proc/self/task/%d/status", tid);
+    fp = fopen(path, "r");
+    if (!fp)
+        return -1;
+    while (fgets(line, sizeof(line), fp)) {
+        if (sscanf(line, "voluntary_ctxt_switches: %ld", &n) == 1 ||
+            sscanf(line, "nonvoluntary_ctxt_switches: %ld", &n) == 1)
+            total += n;
+    }
+    fclose(fp);
+    return total;
+}
+
+static void run_phase(const char *name, int which, int secs)
+{
+    pthread_t tid;
+    double t0, t;
+    long csw0, csw, dsw0, dsw;
+    int ev0, items, one = atomic_load(&cmd_tid) == atomic_load(&data_tid);
+
+    atomic_store(&phase, which);
+    if (which != TBENCH_PHASE_IDLE)
+        pthread_create(&tid, NULL, queue_func, NULL);
+    pthread_mutex_lock(&mutex_lat);
+    lat_sum = lat_max = 0;
+    pthread_mutex_unlock(&mutex_lat);
+    atomic_store(&item_cnt, 0);
+    ev0 = atomic_load(&periodic_cnt);
+    csw0 = ctx_switches(atomic_load(&cmd_tid));
+    dsw0 = ctx_switches(atomic_load(&data_tid));
+    t0 = now_us();
+    sleep(secs);
+    t = (now_us() - t0) / 1000000.0;
+    csw = ctx_switches(atomic_load(&cmd_tid)) - csw0;
+    dsw = ctx_switches(atomic_load(&data_tid)) - dsw0;
+    atomic_store(&phase, TBENCH_PHASE_IDLE);
+    if (which != TBENCH_PHASE_IDLE)
+        pthread_join(tid, NULL);
+    /* let the last items arrive before they're counted */
+    usleep(500000);
+    items = atomic_load(&item_cnt);
+    pthread_mutex_lock(&mutex_lat);
+    if (one)
+        printf("%-13s %10.1f %10s", name, csw / t, "-");
+    else
+        printf("%-13s %10.1f %10.1f", name, csw / t, dsw / t);
+    printf(" %10.1f %9.1f %10.2f %10.2f\n",
+           (atomic_load(&periodic_cnt) - ev0) / t, items / t,
+           items ? lat_sum / items / 1000.0 : 0.0, lat_max / 1000.0);
+    pthread_mutex_unlock(&mutex_lat);
+}
+
+int main(int argc, char *argv[])
+{
+    pthread_t cmd_tid_h, data_tid_h, tnc_cmd_tid, tnc_data_tid;
+    int i, port, cmd_lfd = -1, data_lfd = -1, secs = TBENCH_DEF_SECS, reactor = 0;
+
+    for (i = 1; i < argc; i++) {
+        if (!strcmp(argv[i], "-r")) {
+            reactor = 1;
+        } else {
+            secs = atoi(argv[i]);
+            if (secs <= 0 || secs > TBENCH_MAX_SECS)
+                usage();
+        }
+    }
+    /* the data port is always the command port + 1 */
+    for (port = TBENCH_BASE_PORT; port < TBENCH_MAX_PORT; port += 2) {
+        cmd_lfd = tnc_listen(port);
+        data_lfd = cmd_lfd == -1 ? -1 : tnc_listen(port + 1);
+        if (data_lfd != -1)
+            break;
+        if (cmd_lfd != -1)
+            close(cmd_lfd);
+    }
+    if (data_lfd == -1) {
+        fprintf(stderr, "arim-tcpbench: no free pair of loopback ports\n");
+        return 1;
+    }
+    snprintf(g_tnc_settings[0].ipaddr, sizeof(g_tnc_settings[0].ipaddr), "127.0.0.1");
+    snprintf(g_tnc_settings[0].port, sizeof(g_tnc_settings[0].port), "%d", port);
+    snprintf(g_arim_settings.frame_timeout, sizeof(g_arim_settings.frame_timeout), "30");
+    if (!bufq_init(MIN_DATAQUEUE_SIZE)) {
+        fprintf(stderr, "arim-tcpbench: cannot allocate queues\n");
+        return 1;
+    }
+    pthread_create(&tnc_cmd_tid, NULL, tnc_cmd_func, &cmd_lfd);
+    pthread_create(&tnc_data_tid, NULL, tnc_data_func, &data_lfd);
+    if (reactor) {
+        pthread_create(&cmd_tid_h, NULL, reactorthread_func, NULL);
+    } else {
+        pthread_create(&cmd_tid_h, NULL, cmdthread_func, NULL);
+        pthread_create(&data_tid_h, NULL, datathread_func, NULL);
+    }
+    for (i = 0; i < 100 && (!atomic_load(&cmd_tid) || !atomic_load(&data_tid)); i++)
+        usleep(100000);
+    if (!atomic_load(&cmd_tid) || !atomic_load(&data_tid)) {
+        fprintf(stderr, "arim-tcpbench: TNC threads did not connect\n");
+        return 1;
+    }
+    /* give the threads time to settle after connecting */
+    sleep(1);
+    printf("%s connected, %d s per phase\n\n", reactor ?
+           "reactor thread" : "cmd and data threads", secs);
+    printf("%-13s %10s %10s %10s %9s %10s %10s\n", "phase", "cmd wk/s",
+           reactor ? "" : "data wk/s", "periodic/s", "items/s", "avg ms", "max ms");
+    run_phase("idle", TBENCH_PHASE_IDLE, secs);
+    run_phase("queued cmds", TBENCH_PHASE_CMDS, secs);
+    run_phase("queued data", TBENCH_PHASE_DATA, secs);
+    atomic_store(&tnc_stop, 1);
+    pthread_join(tnc_cmd_tid, NULL);
+    pthread_join(tnc_data_tid, NULL);
+    return 0;
+}
@@ -0,0 +1,562 @@
+/***********************************************************************
+
+    ARIM Amateur Radio Instant Messaging program for the ARDOP TNC.
+
+    Copyright (C) 2016-2021 Robert Cunnings NW8L
+
+    This file is part of the ARIM messaging program.
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+*************************************************************************/
+
+
+
+/* arim-txcheck: drive the data thread's transmit scheduler over a unix
+   socketpair standing in for the TNC data port, with the smallest send
+   buffer the kernel allows and a reader that drains it a few bytes at a
+   time, so blocks are cut short and must be resumed when the socket is
+   writable again. Checks that the reassembled stream is the queued data,
+   intact and in order:
+
+     kernel  short writes as the socket fills
+     short   writev() also clipped to a few bytes or refused, so writes
+             resume at every offset, including inside the length header
+     cancel  the ui thread cancelling transfers while blocks are in
+             flight, the stream must stay framed and no file is leaked
+
+   Not installed, run from the build directory, e.g.
+
+     arim-txcheck                                                    */
+
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <dirent.h>
+#include <time.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <sys/socket.h>
+#include <sys/syscall.h>
+#include <sys/uio.h>
+#include "main.h"
+#include "ini.h"
+#include "bufq.h"
+#include "arim_proto.h"
+#include "ardop_flow.h"
+#include "datathread.h"
+
+#define TXCHECK_DATA_CNT    40
+#define TXCHECK_STREAM_SIZE 300000
+#define TXCHECK_CANCEL_SECS 2
+#define TXCHECK_RX_SIZE     (4*1024*1024)
+
+/* globals normally provided by the rest of arim */
+ARIM_SET g_arim_settings;
+UI_SET g_ui_settings;
+TNC_SET g_tnc_settings[TNC_MAX_COUNT];
+int g_cur_tnc;
+int g_datathread_stop;
+int g_datathread_ready;
+int g_debug_log_enable;
+int g_tncpi9k6_log_enable;
+int g_traffic_log_enable;
+int mon_timestamp;
+int arim_data_waiting;
+time_t arim_start_time;
+TIMER_SVC proto_timers = TIMER_SVC_INITIALIZER;
+pthread_mutex_t mutex_time = PTHREAD_MUTEX_INITIALIZER;
+pthread_mutex_t mutex_cmd_in = PTHREAD_MUTEX_INITIALIZER;
+pthread_mutex_t mutex_cmd_out = PTHREAD_MUTEX_INITIALIZER;
+pthread_mutex_t mutex_data_in = PTHREAD_MUTEX_INITIALIZER;
+pthread_mutex_t mutex_data_out = PTHREAD_MUTEX_INITIALIZER;
+pthread_mutex_t mutex_heard = PTHREAD_MUTEX_INITIALIZER;
+pthread_mutex_t mutex_debug_log = PTHREAD_MUTEX_INITIALIZER;
+pthread_mutex_t mutex_tncpi9k6_log = PTHREAD_MUTEX_INITIALIZER;
+pthread_mutex_t mutex_traffic_log = PTHREAD_MUTEX_INITIALIZER;
+pthread_mutex_t mutex_recents = PTHREAD_MUTEX_INITIALIZER;
+pthread_mutex_t mutex_ptable = PTHREAD_MUTEX_INITIALIZER;
+pthread_mutex_t mutex_ctable = PTHREAD_MUTEX_INITIALIZER;
+pthread_mutex_t mutex_ftable = PTHREAD_MUTEX_INITIALIZER;
+pthread_mutex_t mutex_file_out = PTHREAD_MUTEX_INITIALIZER;
+pthread_mutex_t mutex_msg_out = PTHREAD_MUTEX_INITIALIZER;
+
+static unsigned int seed = 1;
+static atomic_int clip_writes;
+static atomic_long wv_calls, wv_short, wv_again, wv_hdr_resume, wv_data_resume;
+
+static unsigned int rnd(unsigned int n)
+{
+    /* reproducible runs, so a failure can be replayed */
+    seed = seed * 1103515245 + 12345;
+    return (seed >> 16) % n;
+}
+
+ssize_t writev(int fd, const struct iovec *iov, int cnt)
+{
+    struct iovec clip[2];
+    size_t total = 0, limit;
+    ssize_t n;
+    int i;
+
+    /* stands in for the libc writev() called by datathread_flush_block(),
+       a resumed block starts with a 1 byte header piece or no header */
+    atomic_fetch_add(&wv_calls, 1);
+    if (cnt == 2 && iov[0].iov_len == 1)
+        atomic_fetch_add(&wv_hdr_resume, 1);
+    else if (cnt == 1)
+        atomic_fetch_add(&wv_data_resume, 1);
+    for (i = 0; i < cnt && i < 2; i++) {
+        clip[i] = iov[i];
+        total += iov[i].iov_len;
+    }
+    if (atomic_load(&clip_writes)) {
+        if (!rnd(4)) {
+            atomic_fetch_add(&wv_again, 1);
+            errno = EAGAIN;
+            return -1;
+        }
+        /* split fresh length headers often, they are the rare case */
+        limit = cnt == 2 && iov[0].iov_len == 2 && !rnd(4) ? 1 : 1 + rnd(16);
+        for (i = 0; i < cnt; i++) {
+            if (clip[i].iov_len > limit)
+                clip[i].iov_len = limit;
+            limit -= clip[i].iov_len;
+        }
+    }
+    n = syscall(SYS_writev, fd, clip, cnt);
+    if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK))
+        atomic_fetch_add(&wv_again, 1);
+    else if (n >= 0 && (size_t)n < total)
+        atomic_fetch_add(&wv_short, 1);
+    return n;
+}
+
+void *arim_reset()
+{
+    return NULL;
+}
+
+void arim_on_event(int event, int param)
+{
+}
+
+int arim_test_frame(char *data, size_t size)
+{
+    return 0;
+}
+
+int arim_is_arq_state()
+{
+    return 1;
+}
+
+int arim_get_state()
+{
+    return ST_IDLE;
+}
+
+int arim_get_buffer_cnt()
+{
+    return 0;
+}
+
+size_t arim_arq_on_cmd(const char *cmd, size_t size)
+{
+    return 0;
+}
+
+size_t arim_arq_on_resp(const char *resp, size_t size)
+{
+    return 0;
+}
+
+unsigned char *ardop_data_rx_space(size_t *size)
+{
+    static unsigned char buf[MIN_DATA_BUF_SIZE];
+
+    *size = sizeof(buf);
+    return buf;
+}
+
+size_t ardop_data_on_read(size_t size)
+{
+    return 0;
+}
+
+void ardop_data_inc_num_bytes_out(size_t num)
+{
+}
+
+int ardop_flow_is_enabled()
+{
+    return 1;
+}
+
+void ardop_flow_reset()
+{
+}
+
+void ardop_flow_start(size_t size)
+{
+}
+
+void ardop_flow_end()
+{
+}
+
+void ardop_flow_on_write(size_t size)
+{
+}
+
+size_t ardop_flow_block_size(size_t nleft)
+{
+    static unsigned int n = 1;
+    size_t len;
+
+    /* vary block size like the flow controller, lock free */
+    n = n * 1103515245 + 12345;
+    len = FLOW_MIN_BLOCK + (n >> 16) % (FLOW_MAX_BLOCK - FLOW_MIN_BLOCK + 1);
+    return nleft < len ? nleft : len;
+}
+
+void tnc_detach()
+{
+}
+
+void serialthread_cancel_send_file_out()
+{
+}
+
+static unsigned char rxbuf[TXCHECK_RX_SIZE], expect[TXCHECK_RX_SIZE];
+static size_t rx_size, expect_size;
+
+static void fill(unsigned char *p, size_t size, unsigned int tag)
+{
+    size_t i;
+
+    /* payload is lower case letters, so a misframed block shows up
+       as an impossible length */
+    for (i = 0; i < size; i++)
+        p[i] = 'a' + (tag + i * 7 + i / 26) % 26;
+}
+
+static FILE *stream_file(size_t size, unsigned int tag, int keep)
+{
+    static unsigned char buf[TXCHECK_STREAM_SIZE];
+    FILE *fp;
+
+    fp = tmpfile();
+    if (!fp)
+        return NULL;
+    fill(buf, size, tag);
+    if (fwrite(buf, 1, size, fp) != size) {
+        fclose(fp);
+        return NULL;
+    }
+    rewind(fp);
+    if (keep) {
+        memcpy(expect + expect_size, buf, size);
+        expect_size += size;
+    }
+    return fp;
+}
+
+static int queue_data(unsigned int tag, int keep)
+{
+    char line[MAX_CMD_SIZE];
+    size_t len;
+
+    len = 10 + rnd(sizeof(line) - 11);
+    fill((unsigned char *)line, len, tag);
+    line[len] = '\0';
+    if (!bufq_queue_data_out(line))
+        return 0;
+    if (keep) {
+        memcpy(expect + expect_size, line, len);
+        expect_size += len;
+    }
+    return 1;
+}
+
+static int queue_all()
+{
+    static MSGQUEUEITEM msg;
+    static FILEQUEUEITEM file;
+    int i;
+
+    /* all queued before the first pass, so the scheduler sends them
+       in class order: data lines, messages, then files */
+    expect_size = 0;
+    for (i = 0; i < TXCHECK_DATA_CNT; i++) {
+        if (!queue_data(i, 1))
+            return 0;
+    }
+    for (i = 0; i < 2; i++) {
+        memset(&msg, 0, sizeof(msg));
+        msg.size = i ? MAX_MSG_SIZE : 5000;
+        fill((unsigned char *)msg.data, msg.size, 100 + i);
+        if (!bufq_queue_msg_out(&msg))
+            return 0;
+        memcpy(expect + expect_size, msg.data, msg.size);
+        expect_size += msg.size;
+    }
+    memset(&file, 0, sizeof(file));
+    file.size = MAX_FILE_SIZE;
+    fill(file.data, file.size, 200);
+    if (!bufq_queue_file_out(&file))
+        return 0;
+    memcpy(expect + expect_size, file.data, file.size);
+    expect_size += file.size;
+    memset(&file, 0, sizeof(file));
+    file.size = TXCHECK_STREAM_SIZE;
+    file.fp = stream_file(file.size, 300, 1);
+    if (!file.fp || !bufq_queue_file_out(&file))
+        return 0;
+    return 1;
+}
+
+static int queues_empty()
+{
+    return !dataq_get_size(&g_data_out_q) && !msgq_get_size(&g_msg_out_q) &&
+           !fileq_get_size(&g_file_out_q);
+}
+
+static void read_peer(int peer, int small)
+{
+    ssize_t n;
+    size_t want;
+
+    /* a slow TNC takes a few bytes at a time */
+    want = small ? 1 + rnd(64) : sizeof(rxbuf) - rx_size;
+    if (want > sizeof(rxbuf) - rx_size)
+        want = sizeof(rxbuf) - rx_size;
+    n = read(peer, rxbuf + rx_size, want);
+    if (n > 0)
+        rx_size += n;
+}
+
+static long parse_blocks(size_t *payload)
+{
+    size_t i = 0, out = 0, len;
+    long blocks = 0;
+
+    /* strip the 2 byte length headers in place, -1 if misframed */
+    while (i < rx_size) {
+        if (rx_size - i < 2)
+            return -1;
+        len = (rxbuf[i] << 8) | rxbuf[i + 1];
+        if (!len || len > FLOW_MAX_BLOCK || rx_size - i - 2 < len)
+            return -1;
+        memmove(rxbuf + out, rxbuf + i + 2, len);
+        out += len;
+        i += len + 2;
+        blocks++;
+    }
+    *payload = out;
+    return blocks;
+}
+
+static int open_pair(int *sock, int *peer)
+{
+    int sv[2], size = 1;
+
+    if (socketpair(AF_UNIX, SOCK_STREAM, 0, sv) == -1)
+        return 0;
+    /* the kernel rounds these up to its minimum */
+    setsockopt(sv[0], SOL_SOCKET, SO_SNDBUF, &size, sizeof(size));
+    setsockopt(sv[1], SOL_SOCKET, SO_RCVBUF, &size, sizeof(size));
+    fcntl(sv[0], F_SETFL, fcntl(sv[0], F_GETFL) | O_NONBLOCK);
+    fcntl(sv[1], F_SETFL, fcntl(sv[1], F_GETFL) | O_NONBLOCK);
+    *sock = sv[0];
+    *peer = sv[1];
+    return 1;
+}
+
+static void pump(int sock, int peer)
+{
+    struct pollfd pfd[2];
+
+    /* one pass of the data thread's loop: the tick and writable
+       handlers both come down to datathread_on_writable() */
+    pfd[0].fd = sock;
+    pfd[0].events = datathread_is_writing() ? POLLOUT : 0;
+    pfd[1].fd = peer;
+    pfd[1].events = POLLIN;
+    poll(pfd, 2, 1);
+    if (pfd[1].revents & POLLIN)
+        read_peer(peer, 1);
+    datathread_on_writable(sock);
+}
+
+static void print_stats(const char *name, long blocks, int ok)
+{
+    printf("%-7s %8ld %8ld %8ld %8ld %8ld %8ld  %s\n", name, blocks,
+           atomic_load(&wv_calls), atomic_load(&wv_short), atomic_load(&wv_again),
+           atomic_load(&wv_hdr_resume), atomic_load(&wv_data_resume),
+           ok ? "ok" : "FAILED");
+}
+
+static void reset_stats()
+{
+    atomic_store(&wv_calls, 0);
+    atomic_store(&wv_short, 0);
+    atomic_store(&wv_again, 0);
+    atomic_store(&wv_hdr_resume, 0);
+    atomic_store(&wv_data_resume, 0);
+}
+
+static int run_exact(const char *name, int clip)
+{
+    size_t payload;
+    long blocks;
+    int sock, peer, ok;
+
+    if (!open_pair(&sock, &peer))
+        return 0;
+    reset_stats();
+    atomic_store(&clip_writes, clip);
+    rx_size = 0;
+    if (!queue_all()) {
+        printf("%-7s cannot queue test data\n", name);
+        return 0;
+    }
+    while (datathread_is_sending() || datathread_is_writing() || !queues_empty())
+        pump(sock, peer);
+    atomic_store(&clip_writes, 0);
+    read_peer(peer, 0);
+    blocks = parse_blocks(&payload);
+    ok = blocks > 0 && payload == expect_size && !memcmp(rxbuf, expect, payload);
+    print_stats(name, blocks, ok);
+    close(sock);
+    close(peer);
+    return ok;
+}
+
+static atomic_int cancel_stop;
+static atomic_long cancel_cnt;
+
+static void *cancel_func(void *arg)
+{
+    /* the ui thread, cancelling transfers at random moments */
+    while (!atomic_load(&cancel_stop)) {
+        usleep(200 + (rand() % 2000));
+        datathread_cancel_send_data_out();
+        atomic_fetch_add(&cancel_cnt, 1);
+    }
+    return NULL;
+}
+
+static int count_fds()
+{
+    DIR *dir;
+    int cnt = 0;
+
+    dir = opendir("/proc/self/fd");
+    if (!dir)
+        return -1;
+    while (readdir(dir))
+        cnt++;
+    closedir(dir);
+    return cnt;
+}
+
+static int run_cancel()
+{
+    static FILEQUEUEITEM file;
+    FILEQUEUEITEM *item;
+    pthread_t tid;
+    size_t payload;
+    long blocks;
+    double t0;
+    int sock, peer, ok, fds, tag = 0;
+    struct timespec ts;
+
+    if (!open_pair(&sock, &peer))
+        return 0;
+    reset_stats();
+    atomic_store(&clip_writes, 1);
+    rx_size = 0;
+    fds = count_fds();
+    pthread_create(&tid, NULL, cancel_func, NULL);
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    t0 = ts.tv_sec;
+    while (1) {
+        clock_gettime(CLOCK_MONOTONIC, &ts);
+        if (ts.tv_sec - t0 >= TXCHECK_CANCEL_SECS ||
+            rx_size > sizeof(rxbuf) - 65536)
+            break;
+        /* keep the queues topped up with lines and streamed files */
+        if (dataq_get_size(&g_data_out_q) < 4)
+            queue_data(tag++, 0);
+        if (!fileq_get_size(&g_file_out_q)) {
+            memset(&file, 0, sizeof(file));
+            file.size = 20000 + rnd(40000);
+            file.fp = stream_file(file.size, tag++, 0);
+            if (file.fp)
+                bufq_queue_file_out(&file);
+        }
+        pump(sock, peer);
+    }
+    atomic_store(&cancel_stop, 1);
+    pthread_join(tid, NULL);
+    /* let the block in hand finish, then drop whatever is queued */
+    datathread_cancel_send_data_out();
+    while (datathread_is_writing())
+        pump(sock, peer);
+    while (dataq_pop(&g_data_out_q))
+        ;
+    pthread_mutex_lock(&mutex_file_out);
+    while ((item = fileq_pop(&g_file_out_q))) {
+        if (item->fp)
+            fclose(item->fp);
+    }
+    pthread_mutex_unlock(&mutex_file_out);
+    atomic_store(&clip_writes, 0);
+    read_peer(peer, 0);
+    blocks = parse_blocks(&payload);
+    ok = blocks > 0 && count_fds() == fds;
+    print_stats("cancel", blocks, ok);
+    printf("        %ld cancels, %zu payload bytes, open files %s\n",
+           atomic_load(&cancel_cnt), payload, count_fds() == fds ? "ok" : "leaked");
+    close(sock);
+    close(peer);
+    return ok;
+}
+
+int main(int argc, char *argv[])
+{
+    int fails = 0;
+
+    if (argc > 1) {
+        fprintf(stderr, "usage: arim-txcheck\n");
+        return 1;
+    }
+    if (!bufq_init(MAX_DATAQUEUE_SIZE)) {
+        fprintf(stderr, "arim-txcheck: cannot allocate queues\n");
+        return 1;
+    }
+    printf("%-7s %8s %8s %8s %8s %8s %8s\n", "mode", "blocks", "writev",
+           "short", "EAGAIN", "hdr res", "data res");
+    fails += !run_exact("kernel", 0);
+    fails += !run_exact("short", 1);
+    fails += !run_cancel();
+    printf("%d failed\n", fails);
+    return fails ? 1 : 0;
+}
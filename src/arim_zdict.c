@@ -0,0 +1,565 @@
+/***********************************************************************
+
+    ARIM Amateur Radio Instant Messaging program for the ARDOP TNC.
+
+    Copyright (C) 2016-2021 Robert Cunnings NW8L
+
+    This file is part of the ARIM messaging program.
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+*************************************************************************/
+
+
+/* arim-zdict: train a preset dictionary for -zN payloads from a
+   mailbox, and measure the size and CPU time of each codec built
+   into arim over the messages in a mailbox. Not installed, run from
+   the build directory, e.g.
+
+     arim-zdict train -s 4096 sent.mbox > zdict.c.txt
+     arim-zdict bench -d zdict.raw sample.mbox                       */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+#include <unistd.h>
+#include <time.h>
+#include "zlib.h"
+#include "arim_arq_zdict.h"
+#include "arim_arq_lz.h"
+#include "arim_arq_text.h"
+
+#define ZDICT_DEFAULT_SIZE  4096
+#define ZDICT_MAX_SIZE      32768
+#define ZDICT_MIN_PHRASE    3
+#define ZDICT_MAX_PHRASE    64
+#define ZDICT_MAX_WORDS     3
+#define ZDICT_MAX_MSG_SIZE  (16384*5)
+
+typedef struct phrase {
+    char *s;
+    size_t len;
+    int df;         /* number of messages containing phrase */
+    int last_msg;   /* last message counted */
+} PHRASE;
+
+static PHRASE *table;
+static size_t table_size, table_cnt;
+
+static char **msgs;
+static size_t *msg_lens;
+static int num_msgs;
+
+static void usage()
+{
+    fprintf(stderr,
+        "usage: arim-zdict train [-s size] [-r] mbox\n"
+        "       arim-zdict bench [-d dictfile] mbox\n"
+        "  train   print dictionary trained from messages in mbox as a C\n"
+        "          string (raw bytes if -r), at most size bytes (default %d)\n"
+        "  bench   compare size and CPU time per pass of each codec over\n"
+        "          messages in mbox, and zlib with dictfile if given. auto\n"
+        "          picks the smallest result per message, with zlib at\n"
+        "          level 9 where arim picks the level to suit the link\n",
+        ZDICT_DEFAULT_SIZE);
+    exit(1);
+}
+
+static int load_mbox(const char *fn)
+{
+    FILE *fp;
+    char line[1024];
+    size_t len, cap = 0;
+
+    /* split mailbox into message bodies, dropping the separator lines */
+    fp = fopen(fn, "r");
+    if (!fp)
+        return 0;
+    while (fgets(line, sizeof(line), fp)) {
+        if (!strncmp(line, "From ", 5)) {
+            if (num_msgs == cap) {
+                cap = cap ? cap * 2 : 64;
+                msgs = realloc(msgs, cap * sizeof(char *));
+                msg_lens = realloc(msg_lens, cap * sizeof(size_t));
+                if (!msgs || !msg_lens)
+                    return 0;
+            }
+            msgs[num_msgs] = calloc(1, ZDICT_MAX_MSG_SIZE + 1);
+            if (!msgs[num_msgs])
+                return 0;
+            msg_lens[num_msgs++] = 0;
+            continue;
+        }
+        if (!num_msgs)
+            continue;
+        len = strlen(line);
+        if (msg_lens[num_msgs - 1] + len > ZDICT_MAX_MSG_SIZE)
+            continue;
+        memcpy(msgs[num_msgs - 1] + msg_lens[num_msgs - 1], line, len);
+        msg_lens[num_msgs - 1] += len;
+    }
+    fclose(fp);
+    return 1;
+}
+
+static unsigned long hash(const char *s, size_t len)
+{
+    unsigned long h = 5381;
+
+    while (len--)
+        h = h * 33 + (unsigned char)*s++;
+    return h;
+}
+
+static void count_phrase(const char *s, size_t len, int msg)
+{
+    PHRASE *old;
+    size_t i, n;
+
+    if (len < ZDICT_MIN_PHRASE || len > ZDICT_MAX_PHRASE)
+        return;
+    if (table_cnt * 2 >= table_size) {
+        /* grow the table and rehash */
+        old = table;
+        n = table_size;
+        table_size = table_size ? table_size * 2 : 4096;
+        table = calloc(table_size, sizeof(PHRASE));
+        if (!table) {
+            fprintf(stderr, "arim-zdict: out of memory\n");
+            exit(1);
+        }
+        for (i = 0; i < n; i++) {
+            if (old[i].s) {
+                size_t j = hash(old[i].s, old[i].len) & (table_size - 1);
+                while (table[j].s)
+                    j = (j + 1) & (table_size - 1);
+                table[j] = old[i];
+            }
+        }
+        free(old);
+    }
+    i = hash(s, len) & (table_size - 1);
+    while (table[i].s) {
+        if (table[i].len == len && !memcmp(table[i].s, s, len)) {
+            if (table[i].last_msg != msg) {
+                table[i].last_msg = msg;
+                ++table[i].df;
+            }
+            return;
+        }
+        i = (i + 1) & (table_size - 1);
+    }
+    table[i].s = malloc(len + 1);
+    if (!table[i].s) {
+        fprintf(stderr, "arim-zdict: out of memory\n");
+        exit(1);
+    }
+    memcpy(table[i].s, s, len);
+    table[i].s[len] = '\0';
+    table[i].len = len;
+    table[i].df = 1;
+    table[i].last_msg = msg;
+    ++table_cnt;
+}
+
+static void count_msg(const char *m, size_t size, int msg)
+{
+    const char *line, *end, *p, *words[ZDICT_MAX_WORDS];
+    int i, nw;
+
+    /* candidates are whole lines, header field names and runs of up
+       to ZDICT_MAX_WORDS words, each with the separator that follows */
+    for (line = m; line < m + size; line = end) {
+        end = memchr(line, '\n', (m + size) - line);
+        end = end ? end + 1 : m + size;
+        count_phrase(line, end - line, msg);
+        for (p = line; p < end && (isalnum((int)*p) || *p == '-'); p++)
+            ;
+        if (p > line && p + 1 < end && p[0] == ':' && p[1] == ' ')
+            count_phrase(line, p + 2 - line, msg);
+        nw = 0;
+        for (p = line; p < end; ) {
+            while (p < end && isspace((int)*p))
+                ++p;
+            if (p == end)
+                break;
+            if (nw == ZDICT_MAX_WORDS) {
+                memmove(words, words + 1, (ZDICT_MAX_WORDS - 1) * sizeof(char *));
+                --nw;
+            }
+            words[nw++] = p;
+            while (p < end && !isspace((int)*p))
+                ++p;
+            /* every run of words ending with this one */
+            for (i = 0; i < nw; i++)
+                count_phrase(words[i], p - words[i] + (p < end ? 1 : 0), msg);
+        }
+    }
+}
+
+static int cmp_score(const void *a, const void *b)
+{
+    const PHRASE *pa = a, *pb = b;
+    long sa, sb;
+
+    sa = (long)(pa->df - 1) * pa->len;
+    sb = (long)(pb->df - 1) * pb->len;
+    if (sa != sb)
+        return sa < sb ? 1 : -1;
+    return strcmp(pa->s, pb->s);
+}
+
+static size_t train(char *dict, size_t size)
+{
+    PHRASE *cand;
+    size_t i, n = 0, total = 0, *picked, num_picked = 0;
+    char *tmp;
+    int m;
+
+    for (m = 0; m < num_msgs; m++)
+        count_msg(msgs[m], msg_lens[m], m);
+    cand = malloc((table_cnt + 1) * sizeof(PHRASE));
+    picked = malloc((table_cnt + 1) * sizeof(size_t));
+    tmp = calloc(1, size + 1);
+    if (!cand || !picked || !tmp) {
+        fprintf(stderr, "arim-zdict: out of memory\n");
+        exit(1);
+    }
+    for (i = 0; i < table_size; i++) {
+        if (table[i].s && table[i].df > 1)
+            cand[n++] = table[i];
+    }
+    /* take the phrases saving the most bytes across messages first,
+       skipping any already contained in those taken */
+    qsort(cand, n, sizeof(PHRASE), cmp_score);
+    for (i = 0; i < n && total < size; i++) {
+        if (total + cand[i].len > size || strstr(tmp, cand[i].s))
+            continue;
+        memcpy(tmp + total, cand[i].s, cand[i].len);
+        total += cand[i].len;
+        tmp[total] = '\0';
+        picked[num_picked++] = i;
+    }
+    /* zlib matches nearer the end of the dictionary more cheaply,
+       so lay the phrases out with the best last */
+    total = 0;
+    while (num_picked--) {
+        i = picked[num_picked];
+        memcpy(dict + total, cand[i].s, cand[i].len);
+        total += cand[i].len;
+    }
+    free(tmp);
+    free(picked);
+    free(cand);
+    return total;
+}
+
+static void print_c(const char *dict, size_t size)
+{
+    size_t i, col = 0;
+    unsigned char c;
+
+    printf("/* trained by arim-zdict from %d messages, %zu bytes */\n", num_msgs, size);
+    printf("static const char zdict_vN[] =\n    \"");
+    for (i = 0; i < size; i++) {
+        c = (unsigned char)dict[i];
+        if (c == '\n')
+            col += printf("\\n");
+        else if (c == '"' || c == '\\')
+            col += printf("\\%c", c);
+        else if (isprint(c))
+            col += printf("%c", c);
+        else
+            col += printf("\\%03o", c);
+        if ((c == '\n' || col >= 64) && i + 1 < size) {
+            printf("\"\n    \"");
+            col = 0;
+        }
+    }
+    printf("\";\n");
+}
+
+#define BENCH_ZLIB      0
+#define BENCH_LZ        1
+#define BENCH_TEXT      2
+#define BENCH_AUTO      3
+/* passes over the mailbox, so that short messages take measurable CPU time */
+#define BENCH_PASSES    20
+
+typedef struct bench_codec {
+    const char *label;
+    int kind;
+    int level;
+    const unsigned char *dict;
+    size_t dsize;
+} BENCH_CODEC;
+
+static unsigned char bench_out[ZDICT_MAX_MSG_SIZE*2 + 1024];
+static unsigned char bench_trial[ZDICT_MAX_MSG_SIZE*2 + 1024];
+static unsigned char bench_back[ZDICT_MAX_MSG_SIZE + 1];
+/* codecs auto chooses from, as arim does for messages */
+static BENCH_CODEC auto_codecs[3 + ARQ_ZDICT_VERSION];
+static int num_auto_codecs;
+static const BENCH_CODEC *auto_pick;
+
+static double cpu_secs()
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_PROCESS_CPUTIME_ID, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static size_t bench_encode_one(const BENCH_CODEC *c, const char *data, size_t size,
+                               unsigned char *out, size_t outsize)
+{
+    z_stream zs;
+    size_t n;
+
+    /* returns size of encoded data, 0 on error */
+    switch (c->kind) {
+    case BENCH_LZ:
+        return arim_arq_lz_compress(data, size, out, outsize, &n) == 1 ? n : 0;
+    case BENCH_TEXT:
+        return arim_arq_text_compress(data, size, out, outsize, &n) == 1 ? n : 0;
+    default:
+        zs.zalloc = Z_NULL;
+        zs.zfree = Z_NULL;
+        zs.opaque = Z_NULL;
+        if (deflateInit(&zs, c->level) != Z_OK)
+            return 0;
+        if (c->dict)
+            deflateSetDictionary(&zs, c->dict, c->dsize);
+        zs.avail_in = size;
+        zs.next_in = (Bytef *)data;
+        zs.avail_out = outsize;
+        zs.next_out = out;
+        n = (deflate(&zs, Z_FINISH) == Z_STREAM_END) ? zs.total_out : 0;
+        deflateEnd(&zs);
+        return n;
+    }
+}
+
+static size_t bench_encode(const BENCH_CODEC *c, const char *data, size_t size)
+{
+    size_t n, best = 0;
+    int i;
+
+    if (c->kind != BENCH_AUTO)
+        return bench_encode_one(c, data, size, bench_out, sizeof(bench_out));
+    /* try each codec, keeping the smallest result */
+    for (i = 0; i < num_auto_codecs; i++) {
+        n = bench_encode_one(&auto_codecs[i], data, size, bench_trial, sizeof(bench_trial));
+        if (n && (!best || n < best)) {
+            memcpy(bench_out, bench_trial, n);
+            best = n;
+            auto_pick = &auto_codecs[i];
+        }
+    }
+    return best;
+}
+
+static size_t bench_decode(const BENCH_CODEC *c, size_t len)
+{
+    z_stream zs;
+    size_t n;
+
+    /* returns size of decoded data, 0 on error */
+    if (c->kind == BENCH_AUTO)
+        c = auto_pick;
+    switch (c->kind) {
+    case BENCH_LZ:
+        return arim_arq_lz_decompress(bench_out, len, bench_back, sizeof(bench_back), &n) == 1 ? n : 0;
+    case BENCH_TEXT:
+        return arim_arq_text_decompress(bench_out, len, bench_back, sizeof(bench_back), &n) == 1 ? n : 0;
+    default:
+        zs.zalloc = Z_NULL;
+        zs.zfree = Z_NULL;
+        zs.opaque = Z_NULL;
+        zs.avail_in = len;
+        zs.next_in = bench_out;
+        zs.avail_out = sizeof(bench_back);
+        zs.next_out = bench_back;
+        if (inflateInit(&zs) != Z_OK)
+            return 0;
+        n = inflate(&zs, Z_FINISH);
+        if (n == Z_NEED_DICT && c->dict) {
+            inflateSetDictionary(&zs, c->dict, c->dsize);
+            n = inflate(&zs, Z_FINISH);
+        }
+        n = (n == Z_STREAM_END) ? zs.total_out : 0;
+        inflateEnd(&zs);
+        return n;
+    }
+}
+
+static void bench_line(const BENCH_CODEC *c, size_t raw)
+{
+    size_t total = 0, n, len, smaller = 0, bad = 0;
+    double t, enc = 0, dec = 0;
+    int m, pass;
+
+    for (m = 0; m < num_msgs; m++) {
+        t = cpu_secs();
+        for (pass = 0; pass < BENCH_PASSES; pass++)
+            n = bench_encode(c, msgs[m], msg_lens[m]);
+        enc += cpu_secs() - t;
+        t = cpu_secs();
+        for (pass = 0; pass < BENCH_PASSES; pass++)
+            len = bench_decode(c, n);
+        dec += cpu_secs() - t;
+        if (!n || len != msg_lens[m] || memcmp(bench_back, msgs[m], len))
+            ++bad;
+        /* arim sends a message as is if it doesn't compress */
+        if (n && n < msg_lens[m])
+            ++smaller;
+        total += (n && n < msg_lens[m]) ? n : msg_lens[m];
+    }
+    enc /= BENCH_PASSES;
+    dec /= BENCH_PASSES;
+    printf("%-12s %10zu %7.1f%% %8zu %9.2f %9.2f %9.1f",
+           c->label, total, raw ? 100.0 * total / raw : 0.0, smaller,
+           enc * 1000, dec * 1000, enc > 0 ? raw / enc / 1e6 : 0.0);
+    if (bad)
+        printf("  %zu FAILED ROUND TRIP", bad);
+    printf("\n");
+}
+
+static void bench(const char *dfn)
+{
+    static char labels[ARQ_ZDICT_VERSION][16];
+    BENCH_CODEC c;
+    unsigned char *fdict;
+    size_t raw = 0, dsize;
+    FILE *fp;
+    int m, v;
+
+    for (m = 0; m < num_msgs; m++)
+        raw += msg_lens[m];
+    printf("%d messages, average %zu bytes\n\n", num_msgs, num_msgs ? raw / num_msgs : 0);
+    printf("%-12s %10s %8s %8s %9s %9s %9s\n", "encoding", "bytes", "ratio",
+           "smaller", "enc ms", "dec ms", "enc MB/s");
+    printf("%-12s %10zu %7.1f%% %8s %9s %9s %9s\n", "none", raw, 100.0, "-", "-", "-", "-");
+    memset(&c, 0, sizeof(c));
+    c.kind = BENCH_ZLIB;
+    c.label = "-z L1";
+    c.level = Z_BEST_SPEED;
+    bench_line(&c, raw);
+    c.label = "-z L6";
+    c.level = Z_DEFAULT_COMPRESSION;
+    bench_line(&c, raw);
+    c.label = "-z L9";
+    c.level = Z_BEST_COMPRESSION;
+    bench_line(&c, raw);
+    auto_codecs[num_auto_codecs++] = c;
+    for (v = 1; v <= ARQ_ZDICT_VERSION; v++) {
+        c.dict = arim_arq_zdict_get(v, &c.dsize);
+        snprintf(labels[v - 1], sizeof(labels[v - 1]), "-z%d L9", v);
+        c.label = labels[v - 1];
+        bench_line(&c, raw);
+        /* auto uses the newest version */
+        if (v == ARQ_ZDICT_VERSION)
+            auto_codecs[num_auto_codecs++] = c;
+    }
+    memset(&c, 0, sizeof(c));
+    c.kind = BENCH_LZ;
+    c.label = "-zlz";
+    bench_line(&c, raw);
+    auto_codecs[num_auto_codecs++] = c;
+    c.kind = BENCH_TEXT;
+    c.label = "-ztx";
+    bench_line(&c, raw);
+    auto_codecs[num_auto_codecs++] = c;
+    c.kind = BENCH_AUTO;
+    c.label = "auto";
+    bench_line(&c, raw);
+    if (dfn) {
+        fdict = malloc(ZDICT_MAX_SIZE);
+        fp = fopen(dfn, "rb");
+        if (!fdict || !fp) {
+            fprintf(stderr, "arim-zdict: cannot read %s\n", dfn);
+            exit(1);
+        }
+        dsize = fread(fdict, 1, ZDICT_MAX_SIZE, fp);
+        fclose(fp);
+        memset(&c, 0, sizeof(c));
+        c.kind = BENCH_ZLIB;
+        c.label = dfn;
+        c.level = Z_BEST_COMPRESSION;
+        c.dict = fdict;
+        c.dsize = dsize;
+        bench_line(&c, raw);
+        free(fdict);
+    }
+}
+
+int main(int argc, char **argv)
+{
+    char *dict, *dfn = NULL;
+    size_t size = ZDICT_DEFAULT_SIZE, n;
+    int opt, raw = 0, is_train;
+
+    if (argc < 2)
+        usage();
+    if (!strcmp(argv[1], "train"))
+        is_train = 1;
+    else if (!strcmp(argv[1], "bench"))
+        is_train = 0;
+    else
+        usage();
+    optind = 2;
+    while ((opt = getopt(argc, argv, "s:rd:")) != -1) {
+        switch (opt) {
+        case 's':
+            size = atoi(optarg);
+            if (size < 1 || size > ZDICT_MAX_SIZE) {
+                fprintf(stderr, "arim-zdict: size must be 1 to %d\n", ZDICT_MAX_SIZE);
+                return 1;
+            }
+            break;
+        case 'r':
+            raw = 1;
+            break;
+        case 'd':
+            dfn = optarg;
+            break;
+        default:
+            usage();
+        }
+    }
+    if (optind != argc - 1)
+        usage();
+    if (!load_mbox(argv[optind])) {
+        fprintf(stderr, "arim-zdict: cannot read %s\n", argv[optind]);
+        return 1;
+    }
+    if (is_train) {
+        dict = malloc(size);
+        if (!dict) {
+            fprintf(stderr, "arim-zdict: out of memory\n");
+            return 1;
+        }
+        n = train(dict, size);
+        if (raw)
+            fwrite(dict, 1, n, stdout);
+        else
+            print_c(dict, n);
+        free(dict);
+    } else {
+        bench(dfn);
+    }
+    return 0;
+}
+
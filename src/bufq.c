@@ -25,6 +25,9 @@
 #include <stdlib.h>
 #include <unistd.h>
 #include <string.h>
+#include <stdint.h>
+#include <fcntl.h>
+#include <errno.h>
 #include "main.h"
 #include "bufq.h"
 #include "util.h"
@@ -46,84 +49,130 @@ CMDQUEUE g_tncpi9k6_log_q;
 FILEQUEUE g_file_out_q;
 MSGQUEUE g_msg_out_q;
 
-void cmdq_init(CMDQUEUE *q)
+/* self-pipes used to wake the TNC I/O threads when work is queued */
+static int ev_pipe[BUFQ_EV_CNT][2] = { { -1, -1 }, { -1, -1 } };
+
+#define RECQ_HDR_SIZE   sizeof(uint32_t)
+#define RECQ_WRAP       0xFFFFFFFF
+#define RECQ_ALIGN(n)   (((n) + 3) & ~((size_t)3))
+
+int recq_init(RECQUEUE *q, size_t cap, size_t max_rec)
+{
+    size_t size = 1;
+
+    /* round capacity up to a power of 2 so offsets can be masked */
+    while (size < cap)
+        size <<= 1;
+    q->buf = malloc(size);
+    if (!q->buf)
+        return 0;
+    atomic_init(&q->head, 0);
+    atomic_init(&q->tail, 0);
+    atomic_init(&q->size, 0);
+    q->next = 0;
+    q->cap = size;
+    q->max_rec = max_rec;
+    return 1;
+}
+
+int recq_push(RECQUEUE *q, const char *data)
 {
-    memset(q, 0, sizeof(CMDQUEUE));
+    size_t head, tail, len, need, pos, room;
+    uint32_t hdr;
+
+    if (!q->buf)
+        return -1;
+    len = strlen(data);
+    if (len > q->max_rec - 1)
+        len = q->max_rec - 1;
+    need = RECQ_ALIGN(RECQ_HDR_SIZE + len + 1);
+    head = atomic_load_explicit(&q->head, memory_order_relaxed);
+    tail = atomic_load_explicit(&q->tail, memory_order_acquire);
+    pos = head & (q->cap - 1);
+    room = q->cap - pos;
+    if (need > room) {
+        /* not enough room before end of buffer, wrap to start */
+        if (q->cap - (head - tail) < room + need)
+            return -1; /* full */
+        hdr = RECQ_WRAP;
+        memcpy(q->buf + pos, &hdr, sizeof(hdr));
+        head += room;
+        pos = 0;
+    } else if (q->cap - (head - tail) < need) {
+        return -1; /* full */
+    }
+    hdr = (uint32_t)len;
+    memcpy(q->buf + pos, &hdr, sizeof(hdr));
+    memcpy(q->buf + pos + RECQ_HDR_SIZE, data, len);
+    q->buf[pos + RECQ_HDR_SIZE + len] = '\0';
+    /* publish record to consumer */
+    atomic_store_explicit(&q->head, head + need, memory_order_release);
+    return atomic_fetch_add(&q->size, 1) + 1;
+}
+
+char *recq_pop(RECQUEUE *q)
+{
+    size_t head, tail, pos;
+    uint32_t hdr;
+
+    if (!q->buf)
+        return NULL;
+    /* release record returned by the previous call back to producer */
+    tail = q->next;
+    atomic_store_explicit(&q->tail, tail, memory_order_release);
+    head = atomic_load_explicit(&q->head, memory_order_acquire);
+    if (tail == head)
+        return NULL;
+    pos = tail & (q->cap - 1);
+    memcpy(&hdr, q->buf + pos, sizeof(hdr));
+    if (hdr == RECQ_WRAP) {
+        tail += q->cap - pos;
+        pos = 0;
+        memcpy(&hdr, q->buf, sizeof(hdr));
+    }
+    q->next = tail + RECQ_ALIGN(RECQ_HDR_SIZE + hdr + 1);
+    atomic_fetch_sub(&q->size, 1);
+    return q->buf + pos + RECQ_HDR_SIZE;
+}
+
+int cmdq_init(CMDQUEUE *q)
+{
+    return recq_init(q, CMDQUEUE_SIZE, MAX_CMD_SIZE);
 }
 
 int cmdq_get_size(CMDQUEUE *q)
 {
-    return q->size;
+    return atomic_load(&q->size);
 }
 
 int cmdq_push(CMDQUEUE *q, const char *data)
 {
-    snprintf(q->data[q->head], sizeof(q->data[q->head]), "%s", data);
-    if (++q->head == MAX_CMDQUEUE_LEN)
-        q->head = 0;
-    /* calculate size */
-    q->size = q->head - q->tail;
-    /* when head catches up to tail buffer holds MAX_CMDQUEUE_LEN elements */
-    if (q->size <= 0)
-        q->size += MAX_CMDQUEUE_LEN;
-    return q->size;
+    return recq_push(q, data);
 }
 
 char *cmdq_pop(CMDQUEUE *q)
 {
-    int p;
-
-    if (!q->size)
-        return NULL;
-    p = q->tail;
-    if (++q->tail >= MAX_CMDQUEUE_LEN)
-        q->tail = 0;
-    /* calculate size */
-    q->size = q->head - q->tail;
-    /* when tail catches up to head buffer holds 0 elements */
-    if (q->size < 0)
-        q->size += MAX_CMDQUEUE_LEN;
-    return q->data[p];
+    return recq_pop(q);
 }
 
-void dataq_init(DATAQUEUE *q)
+int dataq_init(DATAQUEUE *q, size_t size)
 {
-    memset(q, 0, sizeof(DATAQUEUE));
+    return recq_init(q, size, MIN_DATA_BUF_SIZE);
 }
 
 int dataq_get_size(DATAQUEUE *q)
 {
-    return q->size;
+    return atomic_load(&q->size);
 }
 
 int dataq_push(DATAQUEUE *q, const char *data)
 {
-    snprintf(q->data[q->head], sizeof(q->data[q->head]), "%s", data);
-    if (++q->head == MAX_DATAQUEUE_LEN)
-        q->head = 0;
-    /* calculate size */
-    q->size = q->head - q->tail;
-    /* when head catches up to tail buffer holds MAX_DATAQUEUE_LEN elements */
-    if (q->size <= 0)
-        q->size += MAX_DATAQUEUE_LEN;
-    return q->size;
+    return recq_push(q, data);
 }
 
 char *dataq_pop(DATAQUEUE *q)
 {
-    int p;
-
-    if (!q->size)
-        return NULL;
-    p = q->tail;
-    if (++q->tail >= MAX_DATAQUEUE_LEN)
-        q->tail = 0;
-    /* calculate size */
-    q->size = q->head - q->tail;
-    /* when tail catches up to head buffer holds 0 elements */
-    if (q->size < 0)
-        q->size = MAX_DATAQUEUE_LEN;
-    return q->data[p];
+    return recq_pop(q);
 }
 
 void fileq_init(FILEQUEUE *q)
@@ -138,6 +187,8 @@ int fileq_get_size(FILEQUEUE *q)
 
 int fileq_push(FILEQUEUE *q, const FILEQUEUEITEM *data)
 {
+    if (q->size == MAX_FILEQUEUE_LEN)
+        return -1; /* full */
     memcpy(&q->data[q->head], data, sizeof(q->data[q->head]));
     if (++q->head == MAX_FILEQUEUE_LEN)
         q->head = 0;
@@ -178,6 +229,8 @@ int msgq_get_size(MSGQUEUE *q)
 
 int msgq_push(MSGQUEUE *q, const MSGQUEUEITEM *data)
 {
+    if (q->size == MAX_MSGQUEUE_LEN)
+        return -1; /* full */
     memcpy(&q->data[q->head], data, sizeof(q->data[q->head]));
     if (++q->head == MAX_MSGQUEUE_LEN)
         q->head = 0;
@@ -206,15 +259,124 @@ MSGQUEUEITEM *msgq_pop(MSGQUEUE *q)
     return &q->data[p];
 }
 
+int bufq_init(size_t data_q_size)
+{
+    int i;
+
+    if (data_q_size < MIN_DATAQUEUE_SIZE)
+        data_q_size = MIN_DATAQUEUE_SIZE;
+    if (!dataq_init(&g_data_in_q, data_q_size) ||
+        !dataq_init(&g_data_out_q, data_q_size) ||
+        !dataq_init(&g_traffic_log_q, data_q_size))
+        return 0;
+    if (!cmdq_init(&g_cmd_in_q) || !cmdq_init(&g_cmd_out_q) ||
+        !cmdq_init(&g_heard_q) || !cmdq_init(&g_recents_q) ||
+        !cmdq_init(&g_ptable_q) || !cmdq_init(&g_ctable_q) ||
+        !cmdq_init(&g_ftable_q) || !cmdq_init(&g_debug_log_q) ||
+        !cmdq_init(&g_tncpi9k6_log_q))
+        return 0;
+    for (i = 0; i < BUFQ_EV_CNT; i++) {
+        if (pipe(ev_pipe[i]) == -1)
+            return 0;
+        fcntl(ev_pipe[i][0], F_SETFL, fcntl(ev_pipe[i][0], F_GETFL) | O_NONBLOCK);
+        fcntl(ev_pipe[i][1], F_SETFL, fcntl(ev_pipe[i][1], F_GETFL) | O_NONBLOCK);
+    }
+    return 1;
+}
+
+int bufq_event_fd(int which)
+{
+    return ev_pipe[which][0];
+}
+
+void bufq_signal(int which)
+{
+    char c = 1;
+    ssize_t n;
+
+    if (ev_pipe[which][1] == -1)
+        return;
+    /* a full pipe means a wakeup is already pending, so EAGAIN is ignored */
+    n = write(ev_pipe[which][1], &c, 1);
+    (void)n;
+}
+
+void bufq_clear(int which)
+{
+    char buffer[64];
+
+    if (ev_pipe[which][0] == -1)
+        return;
+    while (read(ev_pipe[which][0], buffer, sizeof(buffer)) > 0)
+        ;
+}
+
+/*
+    A record is never dropped silently when its queue is full. Outbound
+    queues fail the send, so the caller can give up or try again later,
+    and say so in the monitor view. Text queues make room for a note of
+    how many lines were lost ahead of the next one that fits, and the
+    other queues, whose records are parsed by the ui, log the loss.
+*/
+
+static int bufq_push_text(RECQUEUE *q, int *dropped, const char *text)
+{
+    char note[MAX_LOG_LINE_SIZE];
+
+    /* mutex for queue held */
+    if (*dropped) {
+        snprintf(note, sizeof(note), "(%d lines dropped, queue full)", *dropped);
+        if (recq_push(q, note) < 0) {
+            ++*dropped;
+            return 0;
+        }
+        *dropped = 0;
+    }
+    if (recq_push(q, text) < 0) {
+        ++*dropped;
+        return 0;
+    }
+    return 1;
+}
+
+static void bufq_on_full(const char *queue, int outbound)
+{
+    char buffer[MAX_LOG_LINE_SIZE];
+
+    snprintf(buffer, sizeof(buffer), "BUFQ: %s queue full, %s dropped",
+             queue, outbound ? "outbound item" : "record");
+    bufq_queue_debug_log(buffer);
+    if (outbound) {
+        snprintf(buffer, sizeof(buffer), ">> [X] (%s queue full, not sent)", queue);
+        bufq_queue_data_in(buffer);
+    }
+}
+
 void bufq_queue_heard(const char *text)
 {
+    int result;
+
     pthread_mutex_lock(&mutex_heard);
-    cmdq_push(&g_heard_q, text);
+    result = cmdq_push(&g_heard_q, text);
     pthread_mutex_unlock(&mutex_heard);
+    if (result < 0)
+        bufq_on_full("Heard list", 0);
+}
+
+void bufq_queue_recents(const char *text)
+{
+    int result;
+
+    pthread_mutex_lock(&mutex_recents);
+    result = cmdq_push(&g_recents_q, text);
+    pthread_mutex_unlock(&mutex_recents);
+    if (result < 0)
+        bufq_on_full("Recent messages", 0);
 }
 
 void bufq_queue_traffic_log(const char *text)
 {
+    static int dropped;
     char buffer[MIN_MSG_BUF_SIZE];
     char timestamp[MAX_TIMESTAMP_SIZE];
 
@@ -222,13 +384,14 @@ void bufq_queue_traffic_log(const char *text)
         snprintf(buffer, sizeof(buffer), "[%s] %s",
                 util_timestamp(timestamp, sizeof(timestamp)), text);
         pthread_mutex_lock(&mutex_traffic_log);
-        dataq_push(&g_traffic_log_q, buffer);
+        bufq_push_text(&g_traffic_log_q, &dropped, buffer);
         pthread_mutex_unlock(&mutex_traffic_log);
     }
 }
 
 void bufq_queue_debug_log(const char *text)
 {
+    static int dropped;
     char buffer[MAX_CMD_SIZE];
     char timestamp[MAX_TIMESTAMP_SIZE];
 
@@ -236,13 +399,14 @@ void bufq_queue_debug_log(const char *text)
         snprintf(buffer, sizeof(buffer), "[%s] %s",
                 util_timestamp_usec(timestamp, sizeof(timestamp)), text);
         pthread_mutex_lock(&mutex_debug_log);
-        cmdq_push(&g_debug_log_q, buffer);
+        bufq_push_text(&g_debug_log_q, &dropped, buffer);
         pthread_mutex_unlock(&mutex_debug_log);
     }
 }
 
 void bufq_queue_tncpi9k6_log(const char *text)
 {
+    static int dropped;
     char buffer[MAX_CMD_SIZE];
     char timestamp[MAX_TIMESTAMP_SIZE];
 
@@ -250,30 +414,40 @@ void bufq_queue_tncpi9k6_log(const char *text)
         snprintf(buffer, sizeof(buffer), "[%s] %s",
                 util_timestamp_usec(timestamp, sizeof(timestamp)), text);
         pthread_mutex_lock(&mutex_tncpi9k6_log);
-        cmdq_push(&g_tncpi9k6_log_q, buffer);
+        bufq_push_text(&g_tncpi9k6_log_q, &dropped, buffer);
         pthread_mutex_unlock(&mutex_tncpi9k6_log);
     }
 }
 
 void bufq_queue_cmd_in(const char *text)
 {
+    int result;
+
     pthread_mutex_lock(&mutex_cmd_in);
-    cmdq_push(&g_cmd_in_q, text);
+    result = cmdq_push(&g_cmd_in_q, text);
     pthread_mutex_unlock(&mutex_cmd_in);
+    if (result < 0)
+        bufq_on_full("TNC response", 0);
 }
 
-void bufq_queue_cmd_out(const char *text)
+int bufq_queue_cmd_out(const char *text)
 {
-    char inbuffer[MAX_CMD_SIZE];
+    int result;
 
-    snprintf(inbuffer, sizeof(inbuffer), "%s\r", text);
     pthread_mutex_lock(&mutex_cmd_out);
-    cmdq_push(&g_cmd_out_q, text);
+    result = cmdq_push(&g_cmd_out_q, text);
     pthread_mutex_unlock(&mutex_cmd_out);
+    if (result < 0) {
+        bufq_on_full("TNC command", 1);
+        return 0;
+    }
+    bufq_signal(BUFQ_EV_CMD_OUT);
+    return 1;
 }
 
 void bufq_queue_data_in(const char *text)
 {
+    static int dropped;
     char buffer[MIN_MSG_BUF_SIZE+MAX_TIMESTAMP_SIZE];
     char timestamp[MAX_TIMESTAMP_SIZE];
 
@@ -281,38 +455,92 @@ void bufq_queue_data_in(const char *text)
     if (mon_timestamp) {
         snprintf(buffer, sizeof(buffer), "[%s] %s",
                 util_timestamp(timestamp, sizeof(timestamp)), text);
-        dataq_push(&g_data_in_q, buffer);
+        bufq_push_text(&g_data_in_q, &dropped, buffer);
     } else {
-        dataq_push(&g_data_in_q, text);
+        bufq_push_text(&g_data_in_q, &dropped, text);
     }
     pthread_mutex_unlock(&mutex_data_in);
 }
 
-void bufq_queue_data_out(const char *text)
+int bufq_queue_data_out(const char *text)
 {
+    int result;
+
     pthread_mutex_lock(&mutex_data_out);
-    dataq_push(&g_data_out_q, text);
+    result = dataq_push(&g_data_out_q, text);
     pthread_mutex_unlock(&mutex_data_out);
+    if (result < 0) {
+        bufq_on_full("TNC data", 1);
+        return 0;
+    }
+    bufq_signal(BUFQ_EV_DATA_OUT);
+    return 1;
+}
+
+int bufq_queue_file_out(const FILEQUEUEITEM *item)
+{
+    int result;
+
+    /* the queue owns item->fp from here on, it's closed if the item
+       can't be queued */
+    pthread_mutex_lock(&mutex_file_out);
+    result = fileq_push(&g_file_out_q, item);
+    pthread_mutex_unlock(&mutex_file_out);
+    if (result < 0) {
+        if (item->fp)
+            fclose(item->fp);
+        bufq_on_full("ARQ file", 1);
+        return 0;
+    }
+    bufq_signal(BUFQ_EV_DATA_OUT);
+    return 1;
+}
+
+int bufq_queue_msg_out(const MSGQUEUEITEM *item)
+{
+    int result;
+
+    pthread_mutex_lock(&mutex_msg_out);
+    result = msgq_push(&g_msg_out_q, item);
+    pthread_mutex_unlock(&mutex_msg_out);
+    if (result < 0) {
+        bufq_on_full("ARQ message", 1);
+        return 0;
+    }
+    bufq_signal(BUFQ_EV_DATA_OUT);
+    return 1;
 }
 
 void bufq_queue_ptable(const char *text)
 {
+    int result;
+
     pthread_mutex_lock(&mutex_ptable);
-    cmdq_push(&g_ptable_q, text);
+    result = cmdq_push(&g_ptable_q, text);
     pthread_mutex_unlock(&mutex_ptable);
+    if (result < 0)
+        bufq_on_full("Ping history", 0);
 }
 
 void bufq_queue_ctable(const char *text)
 {
+    int result;
+
     pthread_mutex_lock(&mutex_ctable);
-    cmdq_push(&g_ctable_q, text);
+    result = cmdq_push(&g_ctable_q, text);
     pthread_mutex_unlock(&mutex_ctable);
+    if (result < 0)
+        bufq_on_full("Connection history", 0);
 }
 
 void bufq_queue_ftable(const char *text)
 {
+    int result;
+
     pthread_mutex_lock(&mutex_ftable);
-    cmdq_push(&g_ftable_q, text);
+    result = cmdq_push(&g_ftable_q, text);
     pthread_mutex_unlock(&mutex_ftable);
+    if (result < 0)
+        bufq_on_full("File history", 0);
 }
 
@@ -24,24 +24,44 @@
 #ifndef _BUFQ_H_INCLUDED_
 #define _BUFQ_H_INCLUDED_
 
-#define MAX_DATAQUEUE_LEN     128
-#define MAX_CMDQUEUE_LEN      128
 #define MAX_FILEQUEUE_LEN     4
 #define MAX_MSGQUEUE_LEN      4
 
-#include "main.h"
+#define DEFAULT_DATAQUEUE_SIZE  131072
+#define MIN_DATAQUEUE_SIZE      65536
+#define MAX_DATAQUEUE_SIZE      8388608
+#define CMDQUEUE_SIZE           16384
 
-typedef struct data_q {
-    int head, tail;
-    int size;
-    char data[MAX_DATAQUEUE_LEN][MIN_DATA_BUF_SIZE];
-} DATAQUEUE;
+#define BUFQ_EV_CMD_OUT         0
+#define BUFQ_EV_DATA_OUT        1
+#define BUFQ_EV_CNT             2
 
-typedef struct cmd_q {
-    int head, tail;
-    int size;
-    char data[MAX_CMDQUEUE_LEN][MAX_CMD_SIZE];
-} CMDQUEUE;
+#include <stdio.h>
+#include <stdatomic.h>
+#include "main.h"
+
+/*
+    Variable length record ring, single producer/single consumer.
+    Records are stored contiguously as a 32-bit length word followed
+    by the NUL terminated text, padded to a 4 byte boundary. A record
+    that won't fit before the end of the buffer is preceded by a wrap
+    marker and stored at the start instead, so the consumer always
+    gets a contiguous string. The pointer returned by a pop remains
+    valid until the next pop on the same queue, because the space is
+    not released back to the producer until then.
+*/
+typedef struct rec_q {
+    atomic_size_t head;   /* producer write offset, free running */
+    atomic_size_t tail;   /* consumer release offset, free running */
+    atomic_int size;      /* number of records in queue */
+    size_t next;          /* consumer offset of record after last one popped */
+    size_t cap;           /* buffer size in bytes, power of 2 */
+    size_t max_rec;       /* max record text size incl. NUL terminator */
+    char *buf;
+} RECQUEUE;
+
+typedef RECQUEUE DATAQUEUE;
+typedef RECQUEUE CMDQUEUE;
 
 typedef struct fileq_item {
     size_t size;
@@ -49,6 +69,7 @@ typedef struct fileq_item {
     char name[MAX_DIR_PATH_SIZE];
     char path[MAX_DIR_PATH_SIZE];
     unsigned char data[MAX_FILE_SIZE];
+    FILE *fp; /* if set, payload is streamed from here, not data */
 } FILEQUEUEITEM;
 
 typedef struct file_q {
@@ -85,12 +106,16 @@ extern CMDQUEUE g_tncpi9k6_log_q;
 extern FILEQUEUE g_file_out_q;
 extern MSGQUEUE g_msg_out_q;
 
-extern void cmdq_init(CMDQUEUE *q);
+extern int recq_init(RECQUEUE *q, size_t cap, size_t max_rec);
+extern int recq_push(RECQUEUE *q, const char *data);
+extern char *recq_pop(RECQUEUE *q);
+
+extern int cmdq_init(CMDQUEUE *q);
 extern int cmdq_get_size(CMDQUEUE *q);
 extern int cmdq_push(CMDQUEUE *q, const char *data);
 extern char *cmdq_pop(CMDQUEUE *q);
 
-extern void dataq_init(DATAQUEUE *q);
+extern int dataq_init(DATAQUEUE *q, size_t size);
 extern int dataq_get_size(DATAQUEUE *q);
 extern int dataq_push(DATAQUEUE *q, const char *data);
 extern char *dataq_pop(DATAQUEUE *q);
@@ -105,14 +130,21 @@ extern int fileq_get_size(FILEQUEUE *q);
 extern int fileq_push(FILEQUEUE *q, const FILEQUEUEITEM *data);
 extern FILEQUEUEITEM *fileq_pop(FILEQUEUE *q);
 
+extern int bufq_init(size_t data_q_size);
+extern int bufq_event_fd(int which);
+extern void bufq_signal(int which);
+extern void bufq_clear(int which);
 extern void bufq_queue_heard(const char *text);
+extern void bufq_queue_recents(const char *text);
 extern void bufq_queue_traffic_log(const char *text);
 extern void bufq_queue_debug_log(const char *text);
 extern void bufq_queue_tncpi9k6_log(const char *text);
 extern void bufq_queue_cmd_in(const char *text);
-extern void bufq_queue_cmd_out(const char *text);
+extern int bufq_queue_cmd_out(const char *text);
 extern void bufq_queue_data_in(const char *text);
-extern void bufq_queue_data_out(const char *text);
+extern int bufq_queue_data_out(const char *text);
+extern int bufq_queue_file_out(const FILEQUEUEITEM *item);
+extern int bufq_queue_msg_out(const MSGQUEUEITEM *item);
 extern void bufq_queue_ptable(const char *text);
 extern void bufq_queue_ctable(const char *text);
 extern void bufq_queue_ftable(const char *text);
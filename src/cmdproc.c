@@ -52,10 +52,13 @@
 #include "ui_heard_list.h"
 #include "ui_tnc_data_win.h"
 #include "util.h"
+#include "mbox.h"
+#include "mbox_search.h"
 #include "auth.h"
 #include "bufq.h"
 #include "cmdproc.h"
 #include "tnc_attach.h"
+#include "tnc_state.h"
 
 #define MSG_SEND_FAIL_PROMPT_SAVE   1
 
@@ -146,6 +149,30 @@ int cmdproc_cmd(const char *cmd)
                     destdir = NULL;
                 arim_arq_files_on_client_fget(cmd, fn, destdir, zoption);
                 return 1;
+            } else if (!strncasecmp(cmd, "/FSYNC", 6)) {
+                arim_arq_cache_cmd(cmd);
+                /* check for -z option */
+                snprintf(msgbuffer, sizeof(msgbuffer), "%s", cmd + 6);
+                fn = msgbuffer;
+                while (*fn && *fn == ' ')
+                    ++fn;
+                if (*fn && (fn == strstr(fn, "-z"))) {
+                    zoption = 1;
+                    fn += 2;
+                } else {
+                    /* -z option not found, back up to start */
+                    fn = msgbuffer;
+                }
+                /* check for destination dir path */
+                destdir = fn;
+                while (*destdir && *destdir != '>')
+                    ++destdir;
+                if (*destdir == '>')
+                    *destdir++ = '\0';
+                else
+                    destdir = NULL;
+                arim_arq_files_on_client_fsync(fn, destdir, zoption);
+                return 1;
             } else if (!strncasecmp(cmd, "/FPUT", 5)) {
                 arim_arq_cache_cmd(cmd);
                 /* check for -z option */
@@ -251,7 +278,8 @@ int cmdproc_cmd(const char *cmd)
                 snprintf(buffer, sizeof(buffer), "%s\r\n", cmd);
             else
                 snprintf(buffer, sizeof(buffer), "%s\n", cmd);
-            bufq_queue_data_out(buffer);
+            if (!bufq_queue_data_out(buffer))
+                ui_print_status("ARQ: cannot send, outbound queue full", 1);
         }
         return 1;
     default:
@@ -274,13 +302,13 @@ int cmdproc_cmd(const char *cmd)
         result1 = arim_get_state();
         /* allow sending of text when TNC already busy with previous unproto send */
         if (g_tnc_attached && (result1 == ST_IDLE || result1 == ST_SEND_UN_BUF_WAIT)) {
-            bufq_queue_data_out(&buffer[1]);
+            if (!bufq_queue_data_out(&buffer[1])) {
+                ui_print_status("Unproto: cannot send, outbound queue full", 1);
+                break;
+            }
             if (!arim_get_buffer_cnt()) {
                 /* prime buffer count because update from TNC not immediate */
-                pthread_mutex_lock(&mutex_tnc_set);
-                snprintf(g_tnc_settings[g_cur_tnc].buffer,
-                    sizeof(g_tnc_settings[g_cur_tnc].buffer), "%zu", strlen(&buffer[1]));
-                pthread_mutex_unlock(&mutex_tnc_set);
+                tnc_state_set_buffer(strlen(&buffer[1]));
             }
             arim_on_event(EV_SEND_UNPROTO, 0);
         } else {
@@ -1069,7 +1097,7 @@ int cmdproc_query(const char *cmd, char *respbuf, size_t respbufsize)
 {
     /* called from data thread, not UI thread */
     char *p, *t, buffer[MAX_CMD_SIZE], remote_call[TNC_MYCALL_SIZE];
-    char dpath[MAX_PATH_SIZE];
+    char dpath[MAX_PATH_SIZE], hdrs[MBOX_SEARCH_MAX_REMOTE][MAX_MBOX_HDR_SIZE];
     size_t i, len, cnt;
     int result;
 
@@ -1255,6 +1283,28 @@ int cmdproc_query(const char *cmd, char *respbuf, size_t respbufsize)
         pthread_mutex_unlock(&mutex_tnc_set);
         if (len + 1 < respbufsize)
             strncat(respbuf, "\n", respbufsize - len - 1);
+    } else if (!strncasecmp(t, "msearch", 4)) {
+        /* search inbox, offering only messages sent to net calls */
+        t = strtok(NULL, "\0");
+        result = t ? mbox_search(hdrs, MBOX_SEARCH_MAX_REMOTE, MBOX_INBOX_FNAME,
+                                     t, arim_test_netcall) : -1;
+        if (result == -1) {
+            snprintf(respbuf, respbufsize, "Error: invalid search query.\n");
+            return CMDPROC_FAIL;
+        }
+        snprintf(respbuf, respbufsize, "MSEARCH: %d messages\n", result);
+        len = strlen(respbuf);
+        for (i = 0; i < result; i++) {
+            /* drop 'From ' prefix and flags field */
+            snprintf(buffer, sizeof(buffer), "%3d %.*s\n", (int)i + 1,
+                     (int)(strlen(hdrs[i]) > 10 ? strlen(hdrs[i]) - 10 : 0), hdrs[i] + 5);
+            if (len + strlen(buffer) < respbufsize) {
+                strncat(respbuf, buffer, respbufsize - len - 1);
+                len = strlen(respbuf);
+            }
+        }
+        if (len + 1 < respbufsize)
+            strncat(respbuf, "\n", respbufsize - len - 1);
     } else {
         snprintf(respbuf, respbufsize, "Error: unknown query.\n");
         return CMDPROC_FAIL;
@@ -37,16 +37,16 @@
 #include "ini.h"
 #include "ardop_cmds.h"
 #include "tnc_attach.h"
+#include "tnc_state.h"
 
 void cmdthread_next_cmd_out(int sock)
 {
     char *cmd, inbuffer[MAX_CMD_SIZE];
     int sent;
 
-    pthread_mutex_lock(&mutex_cmd_out);
+    /* drain the queue, commands are sent as soon as they are queued */
     cmd = cmdq_pop(&g_cmd_out_q);
-    pthread_mutex_unlock(&mutex_cmd_out);
-    if (cmd) {
+    while (cmd) {
         snprintf(inbuffer, sizeof(inbuffer), "%s\r", cmd);
         sent = write(sock, inbuffer, strlen(inbuffer));
         if (sent < 0) {
@@ -56,6 +56,7 @@ void cmdthread_next_cmd_out(int sock)
             bufq_queue_cmd_in(inbuffer);
             bufq_queue_debug_log(inbuffer);
         }
+        cmd = cmdq_pop(&g_cmd_out_q);
     }
 }
 
@@ -65,9 +66,8 @@ void *cmdthread_func(void *data)
     char buffer[MAX_CMD_SIZE];
     struct addrinfo hints, *res = NULL;
     fd_set cmdreadfds, cmderrorfds;
-    struct timeval timeout;
     ssize_t rsize;
-    int result;
+    int result, evfd, maxfd;
 
     bufq_queue_debug_log("Cmd thread: initializing");
     memset(&hints, 0, sizeof hints);
@@ -88,25 +88,31 @@ void *cmdthread_func(void *data)
     }
     freeaddrinfo(res);
     g_cmdthread_ready = 1;
-    snprintf(g_tnc_settings[g_cur_tnc].busy,
-        sizeof(g_tnc_settings[g_cur_tnc].busy), "%s", "FALSE");
+    tnc_state_set_busy(0);
     ardop_cmds_init();
+    evfd = bufq_event_fd(BUFQ_EV_CMD_OUT);
+    maxfd = cmdsock > evfd ? cmdsock : evfd;
+    /* send anything queued before the thread started */
+    cmdthread_next_cmd_out(cmdsock);
     while (1) {
         FD_ZERO(&cmdreadfds);
         FD_ZERO(&cmderrorfds);
         FD_SET(cmdsock, &cmdreadfds);
+        FD_SET(evfd, &cmdreadfds);
         FD_SET(cmdsock, &cmderrorfds);
-        timeout.tv_sec = 0;
-        timeout.tv_usec = 200000;
-        result = select(cmdsock + 1, &cmdreadfds, (fd_set *)0, &cmderrorfds, &timeout);
+        /* no timeout, sleep until the TNC responds or a command is queued */
+        result = select(maxfd + 1, &cmdreadfds, (fd_set *)0, &cmderrorfds, NULL);
         switch (result) {
         case 0:
-            cmdthread_next_cmd_out(cmdsock);
             break;
         case -1:
             bufq_queue_debug_log("Cmd thread: Socket select error (-1)");
             break;
         default:
+            if (FD_ISSET(evfd, &cmdreadfds)) {
+                bufq_clear(BUFQ_EV_CMD_OUT);
+                cmdthread_next_cmd_out(cmdsock);
+            }
             if (FD_ISSET(cmdsock, &cmdreadfds)) {
                 rsize = read(cmdsock, buffer, sizeof(buffer) - 1);
                 if (rsize == 0) {
@@ -127,8 +133,7 @@ void *cmdthread_func(void *data)
             break;
         }
     }
-    snprintf(g_tnc_settings[g_cur_tnc].busy,
-        sizeof(g_tnc_settings[g_cur_tnc].busy), "%s", "FALSE");
+    tnc_state_set_busy(0);
     bufq_queue_debug_log("Cmd thread: terminating");
     sleep(2);
     close(cmdsock);
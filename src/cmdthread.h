@@ -25,6 +25,7 @@
 #define _CMDTHREAD_H_INCLUDED_
 
 extern void *cmdthread_func(void *data);
+extern void cmdthread_next_cmd_out(int sock);
 
 #endif
 
@@ -23,6 +23,7 @@
 
 #include <sys/types.h>
 #include <sys/socket.h>
+#include <sys/uio.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <netinet/in.h>
@@ -35,269 +36,439 @@
 #include <sys/ioctl.h>
 #include <fcntl.h>
 #include <ctype.h>
+#include <errno.h>
 #include "main.h"
 #include "datathread.h"
+#include "serialthread.h"
 #include "arim.h"
 #include "arim_proto.h"
 #include "arim_arq.h"
 #include "bufq.h"
 #include "ardop_data.h"
+#include "ardop_flow.h"
 #include "tnc_attach.h"
+#include "timer.h"
+#include "util.h"
 
 /* 10 second wait before next check of TNC's BUFFER count */
 #define TNC_BUFFER_UPDATE_WAIT  50
 #define TNC_DATA_BLOCK_SIZE     2048
 
-static size_t data_send_nrem, file_send_nrem, msg_send_nrem, send_bytes_buffered;
-static int data_send_nblk, data_send_timer;
-static int file_send_nblk, file_send_timer;
-static int msg_send_nblk, msg_send_timer;
+/* transmit scheduler item classes, in order of priority */
+#define TX_CLASS_CTRL           0   /* control lines and FEC frames, incl. ACK/NAK */
+#define TX_CLASS_MSG            1   /* ARQ message */
+#define TX_CLASS_FILE           2   /* ARQ file or file listing */
+#define TX_NUM_CLASSES          3
+
+typedef struct tx_item {
+    const unsigned char *data;
+    FILE *fp; /* if set, payload is read from here block by block */
+    size_t nrem;
+    int timer;
+} TXITEM;
+
+/* the scheduler state below is guarded by mutex_tx. The data (or
+   reactor) thread holds it for each pass of datathread_send_out(), so
+   a cancel from the ui thread waits for the block in hand to be written
+   instead of pulling the item and its file out from under the writer */
+static pthread_mutex_t mutex_tx = PTHREAD_MUTEX_INITIALIZER;
+static TXITEM tx_items[TX_NUM_CLASSES];
+/* holds the block read from a streamed file item */
+static unsigned char tx_stream_buf[FLOW_MAX_BLOCK];
+/* block being written to the TNC data port, kept across short writes */
+static struct {
+    unsigned char hdr[2];
+    const unsigned char *data;
+    size_t len, nleft;
+    int fecsend;
+} tx_block;
+static int tx_cur = -1; /* class of item in progress, -1 if none */
+static size_t send_bytes_buffered;
+/* periodic tick, run from the protocol timers (see arim_proto.c) */
+static unsigned int tick_timer;
+static int tick_sock, tick_arim_timeout, tick_open;
+static pthread_mutex_t mutex_tick = PTHREAD_MUTEX_INITIALIZER;
 
 size_t datathread_get_num_bytes_buffered()
 {
     return send_bytes_buffered;
 }
 
-void datathread_cancel_send_data_out()
+int datathread_is_sending()
 {
-    /* reset TNC transmit data buffering state */
-    data_send_nrem = file_send_nrem = msg_send_nrem = send_bytes_buffered = 0;
-    data_send_nblk = file_send_nblk = msg_send_nblk = 0;
-    data_send_timer = file_send_timer = msg_send_timer = 0;
+    return (tx_cur != -1);
 }
 
-void datathread_send_file_out(int sock)
+static void datathread_reset_send()
 {
-    static FILEQUEUEITEM *item;
-    static char *p, buffer[MAX_FILE_SIZE+4];
-    static unsigned char *s;
-    size_t sent;
+    int i;
 
-    if (msg_send_nblk || msg_send_nrem || data_send_nblk || data_send_nrem)
-        return;
-    if (!file_send_nblk && !file_send_nrem) {
-        pthread_mutex_lock(&mutex_file_out);
-        item = fileq_pop(&g_file_out_q);
-        pthread_mutex_unlock(&mutex_file_out);
-        if (!item)
-            return;
-        bufq_queue_debug_log("Data thread: sending file to TNC");
-        p = buffer;
-        s = item->data;
-        file_send_nblk = item->size / TNC_DATA_BLOCK_SIZE;
-        file_send_nrem = item->size % TNC_DATA_BLOCK_SIZE;
-        send_bytes_buffered = 0;
-        file_send_timer = 0;
+    /* reset TNC transmit data buffering state, mutex_tx held. A block
+       partly written to the socket is left to finish, the TNC can't
+       resync on a short one */
+    for (i = 0; i < TX_NUM_CLASSES; i++) {
+        if (tx_items[i].fp)
+            fclose(tx_items[i].fp);
     }
+    memset(tx_items, 0, sizeof(tx_items));
+    tx_cur = -1;
+    send_bytes_buffered = 0;
+    ardop_flow_reset();
+}
+
+void datathread_cancel_send_data_out()
+{
+    pthread_mutex_lock(&mutex_tx);
+    datathread_reset_send();
+    pthread_mutex_unlock(&mutex_tx);
+    /* in TNC-Pi9k6 serial mode files are streamed by the serial thread */
+    serialthread_cancel_send_file_out();
+}
+
+static size_t datathread_block_size(size_t nleft, int *timer)
+{
+    size_t len;
+
+    if (ardop_flow_is_enabled())
+        return ardop_flow_block_size(nleft);
     /*  BUFFER notifications from TNC are several seconds apart when transmitting.
         Don't proceed until timer has expired to save the overhead of checking
         the BUFFER value every time function is called (multiple times per sec). */
-    if (file_send_timer && --file_send_timer > 0)
-        return;
-    if (file_send_nblk) {
-        if (arim_get_buffer_cnt() >= TNC_DATA_BLOCK_SIZE) {
-            file_send_timer = TNC_BUFFER_UPDATE_WAIT; /* wait for next BUFFER notification */
-            return;
-        }
-        bufq_queue_debug_log("Data thread: writing block of data to socket");
-        *p++ = (TNC_DATA_BLOCK_SIZE >> 8) & 0xFF;
-        *p++ = TNC_DATA_BLOCK_SIZE & 0xFF;
-        memcpy(p, s, TNC_DATA_BLOCK_SIZE);
-        sent = write(sock, buffer, TNC_DATA_BLOCK_SIZE + 2);
-        if (sent < 0) {
-            bufq_queue_debug_log("Data thread: write to socket failed");
-            datathread_cancel_send_data_out();
-            return;
-        }
-        s += TNC_DATA_BLOCK_SIZE;
-        p = buffer;
-        ardop_data_inc_num_bytes_out(TNC_DATA_BLOCK_SIZE);
-        send_bytes_buffered += TNC_DATA_BLOCK_SIZE;
-        --file_send_nblk;
-        file_send_timer = TNC_BUFFER_UPDATE_WAIT; /* wait for next BUFFER notification */
-        return;
+    if (*timer && --*timer > 0)
+        return 0;
+    if (arim_get_buffer_cnt() >= TNC_DATA_BLOCK_SIZE) {
+        *timer = TNC_BUFFER_UPDATE_WAIT; /* wait for next BUFFER notification */
+        return 0;
     }
-    if (!file_send_nblk && file_send_nrem) {
-        if (arim_get_buffer_cnt() >= TNC_DATA_BLOCK_SIZE) {
-            file_send_timer = TNC_BUFFER_UPDATE_WAIT; /* wait for next BUFFER notification */
-            return;
+    len = nleft < TNC_DATA_BLOCK_SIZE ? nleft : TNC_DATA_BLOCK_SIZE;
+    if (len == TNC_DATA_BLOCK_SIZE)
+        *timer = TNC_BUFFER_UPDATE_WAIT; /* wait for next BUFFER notification */
+    return len;
+}
+
+static int datathread_flush_block(int sock)
+{
+    struct iovec iov[2];
+    ssize_t sent;
+    size_t off;
+    int cnt;
+
+    while (tx_block.nleft) {
+        /* resume where the last short write left off */
+        off = tx_block.len + 2 - tx_block.nleft;
+        cnt = 0;
+        if (off < 2) {
+            iov[cnt].iov_base = tx_block.hdr + off;
+            iov[cnt++].iov_len = 2 - off;
+            off = 2;
         }
-        bufq_queue_debug_log("Data thread: writing remainder of data to socket");
-        *p++ = (file_send_nrem >> 8) & 0xFF;
-        *p++ = file_send_nrem & 0xFF;
-        memcpy(p, s, file_send_nrem);
-        sent = write(sock, buffer, file_send_nrem + 2);
+        iov[cnt].iov_base = (void *)(tx_block.data + off - 2);
+        iov[cnt++].iov_len = tx_block.len + 2 - off;
+        sent = writev(sock, iov, cnt);
         if (sent < 0) {
+            if (errno == EINTR)
+                continue;
+            if (errno == EAGAIN || errno == EWOULDBLOCK)
+                return 0; /* socket full, resume when writable */
             bufq_queue_debug_log("Data thread: write to socket failed");
-            datathread_cancel_send_data_out();
-            return;
+            tx_block.nleft = 0;
+            datathread_reset_send();
+            return -1;
         }
-        ardop_data_inc_num_bytes_out(file_send_nrem + 2);
-        send_bytes_buffered += file_send_nrem;
-        file_send_nrem = 0;
+        tx_block.nleft -= sent;
     }
+    if (tx_block.fecsend) {
+        /* TNC has the whole block, ok to send it */
+        tx_block.fecsend = 0;
+        bufq_queue_cmd_out("FECSEND TRUE");
+    }
+    return 1;
 }
 
-void datathread_send_msg_out(int sock)
+static int datathread_write_block(int sock, const unsigned char *data, size_t len, int fecsend)
 {
-    static MSGQUEUEITEM *item;
-    static char *p, *s, buffer[MIN_MSG_BUF_SIZE];
-    size_t sent;
+    bufq_queue_debug_log("Data thread: writing block of data to socket");
+    /* payload is written straight from the queue item, which stays
+       put until the scheduler moves on to the next item */
+    tx_block.hdr[0] = (len >> 8) & 0xFF;
+    tx_block.hdr[1] = len & 0xFF;
+    tx_block.data = data;
+    tx_block.len = len;
+    tx_block.nleft = len + 2;
+    tx_block.fecsend = fecsend;
+    ardop_data_inc_num_bytes_out(len);
+    ardop_flow_on_write(len);
+    send_bytes_buffered += len;
+    return datathread_flush_block(sock);
+}
 
-    if (file_send_nblk || file_send_nrem || data_send_nblk || data_send_nrem)
-        return;
-    if (!msg_send_nblk && !msg_send_nrem) {
-        pthread_mutex_lock(&mutex_msg_out);
-        item = msgq_pop(&g_msg_out_q);
-        pthread_mutex_unlock(&mutex_msg_out);
-        if (!item)
-            return;
-        bufq_queue_debug_log("Data thread: sending message to TNC");
-        p = buffer;
-        s = item->data;
-        msg_send_nblk = item->size / TNC_DATA_BLOCK_SIZE;
-        msg_send_nrem = item->size % TNC_DATA_BLOCK_SIZE;
-        send_bytes_buffered = 0;
-        msg_send_timer = 0;
-    }
-    /*  BUFFER notifications from TNC are several seconds apart when transmitting.
-        Don't proceed until timer has expired to save the overhead of checking
-        the BUFFER value every time function is called (multiple times per sec). */
-    if (msg_send_timer && --msg_send_timer > 0)
-        return;
-    if (msg_send_nblk) {
-        if (arim_get_buffer_cnt() >= TNC_DATA_BLOCK_SIZE) {
-            msg_send_timer = TNC_BUFFER_UPDATE_WAIT; /* wait for next BUFFER notification */
-            return;
-        }
-        bufq_queue_debug_log("Data thread: writing block of data to socket");
-        *p++ = (TNC_DATA_BLOCK_SIZE >> 8) & 0xFF;
-        *p++ = TNC_DATA_BLOCK_SIZE & 0xFF;
-        memcpy(p, s, TNC_DATA_BLOCK_SIZE);
-        sent = write(sock, buffer, TNC_DATA_BLOCK_SIZE + 2);
-        if (sent < 0) {
-            bufq_queue_debug_log("Data thread: write to socket failed");
-            datathread_cancel_send_data_out();
-            return;
+int datathread_is_writing()
+{
+    return (tx_block.nleft != 0);
+}
+
+static const unsigned char *datathread_pop_data_out(size_t *size)
+{
+    static char buffer[MIN_DATA_BUF_SIZE];
+    char *data;
+
+    data = dataq_pop(&g_data_out_q);
+    if (!data)
+        return NULL;
+    bufq_queue_debug_log("Data thread: sending data to TNC");
+    *size = strlen(data);
+    if (arim_test_frame(data, *size))
+        snprintf(buffer, sizeof(buffer), "<< [%c] %s", data[1], data);
+    else if (arim_is_arq_state())
+        snprintf(buffer, sizeof(buffer), "<< [@] %s", data);
+    else
+        snprintf(buffer, sizeof(buffer), "<< [U] %s", data);
+    bufq_queue_data_in(buffer);
+    bufq_queue_traffic_log(buffer);
+    return (unsigned char *)data;
+}
+
+static const unsigned char *datathread_pop_msg_out(size_t *size)
+{
+    MSGQUEUEITEM *item;
+
+    pthread_mutex_lock(&mutex_msg_out);
+    item = msgq_pop(&g_msg_out_q);
+    pthread_mutex_unlock(&mutex_msg_out);
+    if (!item)
+        return NULL;
+    bufq_queue_debug_log("Data thread: sending message to TNC");
+    *size = item->size;
+    return (unsigned char *)item->data;
+}
+
+static const unsigned char *datathread_pop_file_out(size_t *size, FILE **fp)
+{
+    FILEQUEUEITEM *item;
+
+    pthread_mutex_lock(&mutex_file_out);
+    item = fileq_pop(&g_file_out_q);
+    pthread_mutex_unlock(&mutex_file_out);
+    if (!item)
+        return NULL;
+    bufq_queue_debug_log("Data thread: sending file to TNC");
+    *size = item->size;
+    *fp = item->fp;
+    return item->data;
+}
+
+static int datathread_next_item()
+{
+    const unsigned char *data;
+    FILE *fp;
+    size_t size;
+    int class;
+
+    /*  pick the highest priority item waiting in the outbound queues.
+        An item in progress is never interrupted: ARQ file and message
+        payloads are delimited only by byte count on the receiving end,
+        so anything written between their blocks would corrupt them. */
+    for (class = 0; class < TX_NUM_CLASSES; class++) {
+        do {
+            size = 0;
+            fp = NULL;
+            switch (class) {
+            case TX_CLASS_CTRL:
+                data = datathread_pop_data_out(&size);
+                break;
+            case TX_CLASS_MSG:
+                data = datathread_pop_msg_out(&size);
+                break;
+            default:
+                data = datathread_pop_file_out(&size, &fp);
+                break;
+            }
+            if (data && !size && fp)
+                fclose(fp);
+        } while (data && !size); /* skip empty items */
+        if (data) {
+            tx_items[class].data = data;
+            tx_items[class].fp = fp;
+            tx_items[class].nrem = size;
+            tx_items[class].timer = 0;
+            send_bytes_buffered = 0;
+            ardop_flow_start(size);
+            return class;
         }
-        s += TNC_DATA_BLOCK_SIZE;
-        p = buffer;
-        ardop_data_inc_num_bytes_out(TNC_DATA_BLOCK_SIZE);
-        send_bytes_buffered += TNC_DATA_BLOCK_SIZE;
-        --msg_send_nblk;
-        msg_send_timer = TNC_BUFFER_UPDATE_WAIT; /* wait for next BUFFER notification */
-        return;
     }
-    if (!msg_send_nblk && msg_send_nrem) {
-        if (arim_get_buffer_cnt() >= TNC_DATA_BLOCK_SIZE) {
-            msg_send_timer = TNC_BUFFER_UPDATE_WAIT; /* wait for next BUFFER notification */
-            return;
-        }
-        bufq_queue_debug_log("Data thread: writing remainder of data to socket");
-        *p++ = (msg_send_nrem >> 8) & 0xFF;
-        *p++ = msg_send_nrem & 0xFF;
-        memcpy(p, s, msg_send_nrem);
-        sent = write(sock, buffer, msg_send_nrem + 2);
-        if (sent < 0) {
-            bufq_queue_debug_log("Data thread: write to socket failed");
-            datathread_cancel_send_data_out();
-            return;
-        }
-        ardop_data_inc_num_bytes_out(msg_send_nrem + 2);
-        send_bytes_buffered += msg_send_nrem;
-        msg_send_nrem = 0;
+    return -1;
+}
+
+static int datathread_read_stream(TXITEM *item, size_t len)
+{
+    return (fread(tx_stream_buf, 1, len, item->fp) == len);
+}
+
+static void datathread_close_stream(TXITEM *item)
+{
+    if (item->fp) {
+        fclose(item->fp);
+        item->fp = NULL;
     }
 }
 
-void datathread_send_data_out(int sock)
+static void datathread_send_items(int sock)
 {
-    static char *p, *s, *data, buffer[MIN_DATA_BUF_SIZE];
-    size_t len, sent;
+    TXITEM *item;
+    const unsigned char *data;
+    size_t len;
+    int result;
 
-    if (file_send_nblk || file_send_nrem || msg_send_nblk || msg_send_nrem)
+    /* mutex_tx held */
+    if (datathread_flush_block(sock) < 1)
         return;
-    if (!data_send_nblk && !data_send_nrem) {
-        pthread_mutex_lock(&mutex_data_out);
-        data = dataq_pop(&g_data_out_q);
-        pthread_mutex_unlock(&mutex_data_out);
-        if (!data)
+    while (1) {
+        if (tx_cur == -1 && (tx_cur = datathread_next_item()) == -1)
             return;
-        bufq_queue_debug_log("Data thread: sending data to TNC");
-        len = strlen(data);
-        if (arim_test_frame(data, len))
-            snprintf(buffer, sizeof(buffer), "<< [%c] %s", data[1], data);
-        else if (arim_is_arq_state())
-            snprintf(buffer, sizeof(buffer), "<< [@] %s", data);
-        else
-            snprintf(buffer, sizeof(buffer), "<< [U] %s", data);
-        bufq_queue_data_in(buffer);
-        bufq_queue_traffic_log(buffer);
-        p = buffer;
-        s = data;
-        data_send_nblk = len / TNC_DATA_BLOCK_SIZE;
-        data_send_nrem = len % TNC_DATA_BLOCK_SIZE;
-        send_bytes_buffered = 0;
-        data_send_timer = 0;
-    }
-    if (data_send_timer && --data_send_timer > 0)
-        return;
-    if (data_send_nblk) {
-        if (arim_get_buffer_cnt() >= TNC_DATA_BLOCK_SIZE) {
-            data_send_timer = TNC_BUFFER_UPDATE_WAIT; /* wait for next BUFFER notification */
+        item = &tx_items[tx_cur];
+        len = datathread_block_size(item->nrem, &item->timer);
+        if (!len)
             return;
+        if (item->fp) {
+            /* streamed file, read the next block as the TNC drains */
+            if (len > sizeof(tx_stream_buf))
+                len = sizeof(tx_stream_buf);
+            if (!datathread_read_stream(item, len)) {
+                bufq_queue_debug_log("Data thread: read from file failed");
+                datathread_reset_send();
+                return;
+            }
+            data = tx_stream_buf;
+        } else {
+            data = item->data;
         }
-        bufq_queue_debug_log("Data thread: writing block of data to socket");
-        *p++ = (TNC_DATA_BLOCK_SIZE >> 8) & 0xFF;
-        *p++ = TNC_DATA_BLOCK_SIZE & 0xFF;
-        memcpy(p, s, TNC_DATA_BLOCK_SIZE);
-        sent = write(sock, buffer, TNC_DATA_BLOCK_SIZE + 2);
-        if (sent < 0) {
-            bufq_queue_debug_log("Data thread: write to socket failed");
-            datathread_cancel_send_data_out();
+        result = datathread_write_block(sock, data, len,
+                        tx_cur == TX_CLASS_CTRL && !arim_is_arq_state());
+        if (result == -1)
             return;
+        if (!item->fp)
+            item->data += len;
+        item->nrem -= len;
+        if (!item->nrem) {
+            datathread_close_stream(item);
+            ardop_flow_end();
+            tx_cur = -1;
         }
-        s += TNC_DATA_BLOCK_SIZE;
-        p = buffer;
-        ardop_data_inc_num_bytes_out(TNC_DATA_BLOCK_SIZE);
-        send_bytes_buffered += TNC_DATA_BLOCK_SIZE;
-        --data_send_nblk;
-        if (!arim_is_arq_state())
-            bufq_queue_cmd_out("FECSEND TRUE");
-        data_send_timer = TNC_BUFFER_UPDATE_WAIT; /* wait for next BUFFER notification */
-        return;
+        if (!result || item->nrem)
+            return; /* wait for socket or TNC to take more data */
     }
-    if (!data_send_nblk && data_send_nrem) {
-        if (arim_get_buffer_cnt() >= TNC_DATA_BLOCK_SIZE) {
-            data_send_timer = TNC_BUFFER_UPDATE_WAIT; /* wait for next BUFFER notification */
-            return;
-        }
-        bufq_queue_debug_log("Data thread: writing remainder of data to socket");
-        *p++ = (data_send_nrem >> 8) & 0xFF;
-        *p++ = data_send_nrem & 0xFF;
-        memcpy(p, s, data_send_nrem);
-        sent = write(sock, buffer, data_send_nrem + 2);
-        if (sent < 0) {
-            bufq_queue_debug_log("Data thread: write to socket failed");
-            datathread_cancel_send_data_out();
-            return;
+}
+
+static void datathread_send_out(int sock)
+{
+    pthread_mutex_lock(&mutex_tx);
+    datathread_send_items(sock);
+    pthread_mutex_unlock(&mutex_tx);
+}
+
+void datathread_on_writable(int sock)
+{
+    /* finish a block left over from a short write, then carry on */
+    datathread_send_out(sock);
+}
+
+void datathread_on_queued(int sock)
+{
+    bufq_clear(BUFQ_EV_DATA_OUT);
+    /* start sending newly queued data right away, but leave
+       a transfer already in progress to the periodic tick
+       so its TNC buffer wait timer isn't shortened */
+    if (!datathread_is_sending())
+        datathread_send_out(sock);
+}
+
+static void datathread_on_tick(int sock, int arim_timeout)
+{
+    time_t cur_time;
+
+    /* periodic tick, drives protocol timers and transmit pacing */
+    arim_on_event(EV_PERIODIC, 0);
+    datathread_send_out(sock);
+    if (arim_data_waiting) {
+        cur_time = time(NULL);
+        if (cur_time - arim_start_time > arim_timeout) {
+            /* timeout, reset arim state */
+            arim_reset();
+            arim_data_waiting = arim_start_time = 0;
+            bufq_queue_debug_log("Data thread: ARIM frame time out");
+            arim_on_event(EV_FRAME_TO, 0);
         }
-        ardop_data_inc_num_bytes_out(data_send_nrem + 2);
-        send_bytes_buffered += data_send_nrem;
-        data_send_nrem = 0;
-        if (!arim_is_arq_state())
-            bufq_queue_cmd_out("FECSEND TRUE");
     }
+    /* pump outbound and inbound arq line queues */
+    arim_arq_on_cmd(NULL, 0);
+    arim_arq_on_resp(NULL, 0);
+}
+
+static void datathread_on_tick_timer(void *arg)
+{
+    datathread_on_tick(tick_sock, tick_arim_timeout);
+    datathread_sched_tick();
+}
+
+void datathread_sched_tick()
+{
+    /* the periodic tick only runs while there's protocol work under way:
+       a state other than idle, a transfer to the TNC or a partly received
+       frame. Otherwise the thread sleeps until I/O or datathread_wake_tick() */
+    if (arim_get_state() != ST_IDLE || datathread_is_sending() ||
+        datathread_is_writing() || arim_data_waiting) {
+        timer_arm(&proto_timers, &tick_timer, DATATHREAD_TICK_MSEC, 0,
+                      datathread_on_tick_timer, NULL);
+    }
+}
+
+void datathread_wake_tick()
+{
+    /* may be called from any thread, e.g. on leaving the idle state.
+       In TNC-Pi9k6 serial mode the serial thread services the protocol
+       timers and runs its own tick, so there's nothing to start */
+    pthread_mutex_lock(&mutex_tick);
+    if (tick_open)
+        timer_arm(&proto_timers, &tick_timer, DATATHREAD_TICK_MSEC, 0,
+                      datathread_on_tick_timer, NULL);
+    pthread_mutex_unlock(&mutex_tick);
+}
+
+int datathread_timer_open(int sock, int arim_timeout)
+{
+    int fd;
+
+    pthread_mutex_lock(&mutex_tick);
+    tick_sock = sock;
+    tick_arim_timeout = arim_timeout;
+    tick_timer = 0;
+    fd = timer_svc_open(&proto_timers);
+    tick_open = (fd != -1);
+    pthread_mutex_unlock(&mutex_tick);
+    return fd;
+}
+
+void datathread_timer_close()
+{
+    pthread_mutex_lock(&mutex_tick);
+    tick_open = 0;
+    timer_svc_close(&proto_timers);
+    pthread_mutex_unlock(&mutex_tick);
+}
+
+void datathread_on_timer()
+{
+    timer_on_expired(&proto_timers);
 }
 
 void *datathread_func(void *data)
 {
-    unsigned char buffer[MIN_DATA_BUF_SIZE];
+    unsigned char buffer[MAX_CMD_SIZE], *rxbuf;
     struct addrinfo hints, *res = NULL;
-    fd_set datareadfds, dataerrorfds;
-    struct timeval timeout;
+    fd_set datareadfds, datawritefds, dataerrorfds;
     ssize_t rsize;
-    int result, portnum, datasock, arim_timeout;
-    time_t cur_time;
+    size_t rxlen;
+    int result, portnum, datasock, arim_timeout, evfd, timerfd, maxfd;
 
     memset(&hints, 0, sizeof hints);
     bufq_queue_debug_log("Data thread: initializing");
@@ -319,65 +490,71 @@ void *datathread_func(void *data)
         pthread_exit(data);
     }
     freeaddrinfo(res);
+    /* non-blocking so a slow TNC can't stall the thread mid-block */
+    fcntl(datasock, F_SETFL, fcntl(datasock, F_GETFL) | O_NONBLOCK);
     g_datathread_ready = 1;
     /* timeout specified in secs */
     arim_timeout = atoi(g_arim_settings.frame_timeout);
     arim_reset();
+    timerfd = datathread_timer_open(datasock, arim_timeout);
+    if (timerfd == -1) {
+        bufq_queue_debug_log("Data thread: failed to create protocol timer");
+        close(datasock);
+        g_datathread_stop = 1;
+        pthread_exit(data);
+    }
+    evfd = bufq_event_fd(BUFQ_EV_DATA_OUT);
+    maxfd = datasock > evfd ? datasock : evfd;
+    if (timerfd > maxfd)
+        maxfd = timerfd;
+    datathread_sched_tick();
     while (1) {
         FD_ZERO(&datareadfds);
+        FD_ZERO(&datawritefds);
         FD_ZERO(&dataerrorfds);
         FD_SET(datasock, &datareadfds);
+        if (datathread_is_writing())
+            FD_SET(datasock, &datawritefds);
+        FD_SET(evfd, &datareadfds);
+        FD_SET(timerfd, &datareadfds);
         FD_SET(datasock, &dataerrorfds);
-        timeout.tv_sec = 0;
-        timeout.tv_usec = 200000;
-        result = select(datasock + 1, &datareadfds, (fd_set *)0, &dataerrorfds, &timeout);
-        switch (result) {
-        case 0:
-            /* select timeout */
-            arim_on_event(EV_PERIODIC, 0);
-            datathread_send_data_out(datasock);
-            datathread_send_file_out(datasock);
-            datathread_send_msg_out(datasock);
-            if (arim_data_waiting) {
-                cur_time = time(NULL);
-                if (cur_time - arim_start_time > arim_timeout) {
-                    /* timeout, reset arim state */
-                    arim_reset();
-                    arim_data_waiting = arim_start_time = 0;
-                    bufq_queue_debug_log("Data thread: ARIM frame time out");
-                    arim_on_event(EV_FRAME_TO, 0);
-                }
-            }
-            /* pump outbound and inbound arq line queues */
-            arim_arq_on_cmd(NULL, 0);
-            arim_arq_on_resp(NULL, 0);
-            break;
-        case -1:
-            bufq_queue_debug_log("Data thread: Socket select error (-1)");
-            break;
-        default:
+        /* sleep until I/O, queued outbound data or a protocol timer expires */
+        result = select(maxfd + 1, &datareadfds, &datawritefds, &dataerrorfds, NULL);
+        if (result == -1) {
+            if (errno != EINTR)
+                bufq_queue_debug_log("Data thread: Socket select error (-1)");
+        } else if (result > 0) {
+            if (FD_ISSET(timerfd, &datareadfds))
+                datathread_on_timer();
+            if (FD_ISSET(datasock, &datawritefds))
+                datathread_on_writable(datasock);
+            if (FD_ISSET(evfd, &datareadfds))
+                datathread_on_queued(datasock);
             if (FD_ISSET(datasock, &datareadfds)) {
-                rsize = read(datasock, buffer, sizeof(buffer) - 1);
+                /* read straight into the frame decoder's buffer */
+                rxbuf = ardop_data_rx_space(&rxlen);
+                rsize = read(datasock, rxbuf, rxlen);
                 if (rsize == 0) {
                     bufq_queue_debug_log("Data thread: Socket closed by TNC");
                     tnc_detach(); /* close TCP connection to TNC */
                 } else if (rsize == -1) {
-                    bufq_queue_debug_log("Data thread: Socket read error (-1)");
+                    if (errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR)
+                        bufq_queue_debug_log("Data thread: Socket read error (-1)");
                 } else {
-                    ardop_data_handle_data(buffer, rsize);
+                    ardop_data_on_read(rsize);
                 }
             }
-            if (FD_ISSET(datasock, &dataerrorfds)) {
+            if (FD_ISSET(datasock, &dataerrorfds))
                 bufq_queue_debug_log("Data thread: Socket select error (FD_ISSET)");
-                break;
-            }
         }
+        datathread_sched_tick();
         if (g_datathread_stop) {
             break;
         }
     }
     bufq_queue_debug_log("Data thread: terminating");
     sleep(2);
+    datathread_timer_close();
     close(datasock);
     return data;
 }
@@ -24,12 +24,23 @@
 #ifndef _DATATHREAD_H_INCLUDED_
 #define _DATATHREAD_H_INCLUDED_
 
+#define DATATHREAD_TICK_MSEC    200
+
 extern void *datathread_func(void *data);
 extern size_t datathread_get_num_bytes_in(void);
 extern size_t datathread_get_num_bytes_out(void);
 extern void datathread_reset_num_bytes(void);
 extern void datathread_cancel_send_data_out(void);
 extern size_t datathread_get_num_bytes_buffered(void);
+extern int datathread_is_sending(void);
+extern int datathread_is_writing(void);
+extern void datathread_on_queued(int sock);
+extern void datathread_on_writable(int sock);
+extern int datathread_timer_open(int sock, int arim_timeout);
+extern void datathread_timer_close(void);
+extern void datathread_on_timer(void);
+extern void datathread_sched_tick(void);
+extern void datathread_wake_tick(void);
 
 #endif
 
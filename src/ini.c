@@ -32,9 +32,20 @@
 #include "main.h"
 #include "ini.h"
 #include "tnc_attach.h"
+#include "bufq.h"
 
 #define MAX_INI_LINE_SIZE 256
 
+/* values of arq-codec setting, auto picks per payload */
+const char *arq_codecs[] = {
+    "auto",
+    "zlib",
+    "dict",
+    "lz",
+    "text",
+    0,
+};
+
 const char *fecmodes_v1[] = {
     "4FSK.200.50S",
     "4FSK.500.100S",
@@ -319,6 +330,17 @@ int ini_validate_arq_bw(const char *val)
     return 0;
 }
 
+int ini_validate_arq_codec(const char *val)
+{
+    int i;
+
+    for (i = 0; arq_codecs[i]; i++) {
+        if (!strcasecmp(arq_codecs[i], val))
+            return 1;
+    }
+    return 0;
+}
+
 int ini_validate_bool(const char *val)
 {
     if (!strncasecmp(val, "TRUE", 4))
@@ -492,6 +514,8 @@ void ini_read_tnc_set(FILE *inifp, int which)
     snprintf(g_tnc_settings[which].interface, sizeof(g_tnc_settings[which].interface), DEFAULT_TNC_INTERFACE);
     snprintf(g_tnc_settings[which].serial_port, sizeof(g_tnc_settings[which].serial_port), DEFAULT_TNC_SERIAL_PORT);
     snprintf(g_tnc_settings[which].serial_baudrate, sizeof(g_tnc_settings[which].serial_baudrate), DEFAULT_TNC_SERIAL_BAUD);
+    snprintf(g_tnc_settings[which].tcp_reactor, sizeof(g_tnc_settings[which].tcp_reactor), DEFAULT_TNC_TCP_REACTOR);
+    snprintf(g_tnc_settings[which].adaptive_flow, sizeof(g_tnc_settings[which].adaptive_flow), DEFAULT_TNC_ADAPTIVE_FLOW);
     snprintf(g_tnc_settings[which].debug_en, sizeof(g_tnc_settings[which].debug_en), DEFAULT_TNC_DEBUG_EN);
     snprintf(g_tnc_settings[which].traffic_en, sizeof(g_tnc_settings[which].traffic_en),  DEFAULT_TNC_TRAFFIC_EN);
     snprintf(g_tnc_settings[which].tncpi9k6_en, sizeof(g_tnc_settings[which].tncpi9k6_en),  DEFAULT_TNC_TNCPI9K6_EN);
@@ -706,6 +730,24 @@ void ini_read_tnc_set(FILE *inifp, int which)
                 if (g_print_config)
                     fprintf(printconf_fp ? printconf_fp : stdout, "%s=%s\n", "interface", g_tnc_settings[which].interface);
             }
+            else if ((v = ini_get_value("adaptive-flow", p))) {
+                if (ini_validate_bool(v))
+                    snprintf(g_tnc_settings[which].adaptive_flow, sizeof(g_tnc_settings[which].adaptive_flow), "TRUE");
+                else
+                    snprintf(g_tnc_settings[which].adaptive_flow, sizeof(g_tnc_settings[which].adaptive_flow), "FALSE");
+                /* if program invoked with --print-conf switch, print key/value pair */
+                if (g_print_config)
+                    fprintf(printconf_fp ? printconf_fp : stdout, "%s=%s\n", "adaptive-flow", g_tnc_settings[which].adaptive_flow);
+            }
+            else if ((v = ini_get_value("tcp-reactor", p))) {
+                if (ini_validate_bool(v))
+                    snprintf(g_tnc_settings[which].tcp_reactor, sizeof(g_tnc_settings[which].tcp_reactor), "TRUE");
+                else
+                    snprintf(g_tnc_settings[which].tcp_reactor, sizeof(g_tnc_settings[which].tcp_reactor), "FALSE");
+                /* if program invoked with --print-conf switch, print key/value pair */
+                if (g_print_config)
+                    fprintf(printconf_fp ? printconf_fp : stdout, "%s=%s\n", "tcp-reactor", g_tnc_settings[which].tcp_reactor);
+            }
             else if ((v = ini_get_value("serial-baudrate", p))) {
                 if (ini_validate_baudrate(v))
                     snprintf(g_tnc_settings[which].serial_baudrate, sizeof(g_tnc_settings[which].serial_baudrate), "%s", v);
@@ -1128,6 +1170,29 @@ void ini_read_arim_set(FILE *inifp)
                 if (g_print_config)
                     fprintf(printconf_fp ? printconf_fp : stdout, "%s=%s\n", "max-file-size", g_arim_settings.max_file_size);
             }
+            else if ((v = ini_get_value("max-arq-file-size", p))) {
+                test = atoi(v);
+                if (test >= 0 && test <= MAX_ARQ_FILE_SIZE)
+                    snprintf(g_arim_settings.max_arq_file_size, sizeof(g_arim_settings.max_arq_file_size), "%d", test);
+                /* if program invoked with --print-conf switch, print key/value pair */
+                if (g_print_config)
+                    fprintf(printconf_fp ? printconf_fp : stdout, "%s=%s\n", "max-arq-file-size", g_arim_settings.max_arq_file_size);
+            }
+            else if ((v = ini_get_value("resume-max-days", p))) {
+                test = atoi(v);
+                if (test >= MIN_ARIM_RESUME_MAX_DAYS && test <= MAX_ARIM_RESUME_MAX_DAYS)
+                    snprintf(g_arim_settings.resume_max_days, sizeof(g_arim_settings.resume_max_days), "%d", test);
+                /* if program invoked with --print-conf switch, print key/value pair */
+                if (g_print_config)
+                    fprintf(printconf_fp ? printconf_fp : stdout, "%s=%s\n", "resume-max-days", g_arim_settings.resume_max_days);
+            }
+            else if ((v = ini_get_value("arq-codec", p))) {
+                if (ini_validate_arq_codec(v))
+                    snprintf(g_arim_settings.arq_codec, sizeof(g_arim_settings.arq_codec), "%s", v);
+                /* if program invoked with --print-conf switch, print key/value pair */
+                if (g_print_config)
+                    fprintf(printconf_fp ? printconf_fp : stdout, "%s=%s\n", "arq-codec", g_arim_settings.arq_codec);
+            }
             else if ((v = ini_get_value("msg-trace-en", p))) {
                 if (ini_validate_bool(v))
                     snprintf(g_arim_settings.msg_trace_en, sizeof(g_arim_settings.msg_trace_en), "TRUE");
@@ -1137,6 +1202,22 @@ void ini_read_arim_set(FILE *inifp)
                 if (g_print_config)
                     fprintf(printconf_fp ? printconf_fp : stdout, "%s=%s\n", "msg-trace-en", g_arim_settings.msg_trace_en);
             }
+            else if ((v = ini_get_value("data-queue-size", p))) {
+                test = atoi(v);
+                if (test >= MIN_DATAQUEUE_SIZE && test <= MAX_DATAQUEUE_SIZE)
+                    snprintf(g_arim_settings.data_queue_size, sizeof(g_arim_settings.data_queue_size), "%d", test);
+                /* if program invoked with --print-conf switch, print key/value pair */
+                if (g_print_config)
+                    fprintf(printconf_fp ? printconf_fp : stdout, "%s=%s\n", "data-queue-size", g_arim_settings.data_queue_size);
+            }
+            else if ((v = ini_get_value("mbox-compact-pct", p))) {
+                test = atoi(v);
+                if (test >= MIN_ARIM_MBOX_COMPACT_PCT && test <= MAX_ARIM_MBOX_COMPACT_PCT)
+                    snprintf(g_arim_settings.mbox_compact_pct, sizeof(g_arim_settings.mbox_compact_pct), "%d", test);
+                /* if program invoked with --print-conf switch, print key/value pair */
+                if (g_print_config)
+                    fprintf(printconf_fp ? printconf_fp : stdout, "%s=%s\n", "mbox-compact-pct", g_arim_settings.mbox_compact_pct);
+            }
             else if ((v = ini_get_value("dynamic-file", p))) {
                 if (g_arim_settings.dyn_files_cnt < ARIM_DYN_FILES_MAX_CNT)
                     snprintf(g_arim_settings.dyn_files[g_arim_settings.dyn_files_cnt],
@@ -1191,9 +1272,14 @@ int ini_get_arim_set(const char *fn)
     snprintf(g_arim_settings.frame_timeout, sizeof(g_arim_settings.frame_timeout), DEFAULT_ARIM_FRAME_TIMEOUT);
     numch = snprintf(g_arim_settings.files_dir, sizeof(g_arim_settings.files_dir), "%s/%s", g_arim_path, DEFAULT_ARIM_FILES_DIR);
     snprintf(g_arim_settings.max_file_size, sizeof(g_arim_settings.max_file_size), DEFAULT_ARIM_FILES_MAX_SIZE);
+    snprintf(g_arim_settings.max_arq_file_size, sizeof(g_arim_settings.max_arq_file_size), DEFAULT_ARIM_ARQ_FILES_MAX_SIZE);
+    snprintf(g_arim_settings.resume_max_days, sizeof(g_arim_settings.resume_max_days), DEFAULT_ARIM_RESUME_MAX_DAYS);
+    snprintf(g_arim_settings.arq_codec, sizeof(g_arim_settings.arq_codec), DEFAULT_ARIM_ARQ_CODEC);
     snprintf(g_arim_settings.max_msg_days, sizeof(g_arim_settings.max_msg_days), DEFAULT_ARIM_MSG_MAX_DAYS);
     snprintf(g_arim_settings.fecmode_downshift, sizeof(g_arim_settings.fecmode_downshift), DEFAULT_ARIM_FECMODE_DOWN);
     snprintf(g_arim_settings.msg_trace_en, sizeof(g_arim_settings.msg_trace_en), DEFAULT_ARIM_MSG_TRACE_EN);
+    snprintf(g_arim_settings.data_queue_size, sizeof(g_arim_settings.data_queue_size), DEFAULT_ARIM_DATA_QUEUE_SIZE);
+    snprintf(g_arim_settings.mbox_compact_pct, sizeof(g_arim_settings.mbox_compact_pct), DEFAULT_ARIM_MBOX_COMPACT_PCT);
 
     inifp = fopen(fn, "r");
     if (inifp == NULL)
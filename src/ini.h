@@ -62,6 +62,8 @@
 #define TNC_DEBUG_EN_SIZE        8
 #define TNC_TRAFFIC_EN_SIZE      8
 #define TNC_TNCPI9K6_EN_SIZE     8
+#define TNC_TCP_REACTOR_SIZE     8
+#define TNC_ADAPTIVE_FLOW_SIZE   8
 
 #define TNC_MAX_COUNT            10
 #define TNC_NETCALL_MAX_CNT      8
@@ -94,6 +96,8 @@
 #define DEFAULT_TNC_DEBUG_EN     "FALSE"
 #define DEFAULT_TNC_TRAFFIC_EN   "FALSE"
 #define DEFAULT_TNC_TNCPI9K6_EN  "FALSE"
+#define DEFAULT_TNC_TCP_REACTOR  "FALSE"
+#define DEFAULT_TNC_ADAPTIVE_FLOW "FALSE"
 
 #define MAX_TNC_GRIDSQ_STRLEN    8
 #define MAX_TNC_NETCALL_STRLEN   10
@@ -146,6 +150,8 @@ typedef struct tnc_set {
     char interface[TNC_INTERFACE_SIZE];
     char serial_port[TNC_SERIAL_PORT_SIZE];
     char serial_baudrate[TNC_SERIAL_BAUD_SIZE];
+    char tcp_reactor[TNC_TCP_REACTOR_SIZE];
+    char adaptive_flow[TNC_ADAPTIVE_FLOW_SIZE];
     char log_dir[MAX_DIR_PATH_SIZE];
     char debug_en[TNC_DEBUG_EN_SIZE];
     char traffic_en[TNC_TRAFFIC_EN_SIZE];
@@ -175,6 +181,10 @@ extern int g_num_tnc;
 #define ARIM_FECMODE_DOWN_SIZE       8
 #define ARIM_MAX_MSG_DAYS_SIZE       8
 #define ARIM_MSG_TRACE_EN_SIZE       8
+#define ARIM_DATA_QUEUE_SIZE         12
+#define ARIM_MBOX_COMPACT_PCT_SIZE   4
+#define ARIM_RESUME_MAX_DAYS_SIZE    8
+#define ARIM_ARQ_CODEC_SIZE          8
 #define ARIM_AC_LIST_MAX_CNT         512
 #define DEFAULT_ARIM_MYCALL          "NOCALL"
 #define DEFAULT_ARIM_SEND_REPEATS    "0"
@@ -184,9 +194,14 @@ extern int g_num_tnc;
 #define DEFAULT_ARIM_FRAME_TIMEOUT   "30"
 #define DEFAULT_ARIM_FILES_DIR       "files/"
 #define DEFAULT_ARIM_FILES_MAX_SIZE  "4096"
+#define DEFAULT_ARIM_ARQ_FILES_MAX_SIZE "1048576"
 #define DEFAULT_ARIM_FECMODE_DOWN    "FALSE"
 #define DEFAULT_ARIM_MSG_MAX_DAYS    "0"
 #define DEFAULT_ARIM_MSG_TRACE_EN    "FALSE"
+#define DEFAULT_ARIM_DATA_QUEUE_SIZE "131072"
+#define DEFAULT_ARIM_MBOX_COMPACT_PCT "25"
+#define DEFAULT_ARIM_RESUME_MAX_DAYS "7"
+#define DEFAULT_ARIM_ARQ_CODEC       "auto"
 
 #define MAX_ARIM_SEND_REPEATS        5
 #define MIN_ARIM_PILOT_PING          2
@@ -199,6 +214,10 @@ extern int g_num_tnc;
 #define MAX_ARIM_FRAME_TIMEOUT       999
 #define MIN_ARIM_MSG_DAYS            0
 #define MAX_ARIM_MSG_DAYS            9999
+#define MIN_ARIM_MBOX_COMPACT_PCT    0
+#define MAX_ARIM_MBOX_COMPACT_PCT    100
+#define MIN_ARIM_RESUME_MAX_DAYS     0
+#define MAX_ARIM_RESUME_MAX_DAYS     365
 
 // default to using rigctld
 #define	DEFAULT_HAMLIB_MODEL		2
@@ -215,8 +234,13 @@ typedef struct arim_set {
     char frame_timeout[ARIM_FRAME_TIMEOUT_SIZE];
     char files_dir[MAX_DIR_PATH_SIZE];
     char max_file_size[ARIM_FILES_MAX_SIZE];
+    char max_arq_file_size[ARIM_FILES_MAX_SIZE];
+    char resume_max_days[ARIM_RESUME_MAX_DAYS_SIZE];
+    char arq_codec[ARIM_ARQ_CODEC_SIZE];
     char max_msg_days[ARIM_MAX_MSG_DAYS_SIZE];
     char msg_trace_en[ARIM_MSG_TRACE_EN_SIZE];
+    char data_queue_size[ARIM_DATA_QUEUE_SIZE];
+    char mbox_compact_pct[ARIM_MBOX_COMPACT_PCT_SIZE];
     char dyn_files[ARIM_DYN_FILES_MAX_CNT][ARIM_DYN_FILES_SIZE];
     int dyn_files_cnt;
     char add_files_dir[ARIM_ADD_FILES_DIR_MAX_CNT][MAX_DIR_PATH_SIZE];
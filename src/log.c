@@ -58,13 +58,11 @@ void log_write_debug_log()
 
     debug_fp = fopen(debug_fn, "a");
     if (debug_fp != NULL) {
-        pthread_mutex_lock(&mutex_debug_log);
         p = cmdq_pop(&g_debug_log_q);
         while (p) {
             fprintf(debug_fp, "%s\n",  p);
             p = cmdq_pop(&g_debug_log_q);
         }
-        pthread_mutex_unlock(&mutex_debug_log);
         fclose(debug_fp);
     }
 }
@@ -76,13 +74,11 @@ void log_write_tncpi9k6_log()
 
     tncpi9k6_fp = fopen(tncpi9k6_fn, "a");
     if (tncpi9k6_fp != NULL) {
-        pthread_mutex_lock(&mutex_tncpi9k6_log);
         p = cmdq_pop(&g_tncpi9k6_log_q);
         while (p) {
             fprintf(tncpi9k6_fp, "%s\n",  p);
             p = cmdq_pop(&g_tncpi9k6_log_q);
         }
-        pthread_mutex_unlock(&mutex_tncpi9k6_log);
         fclose(tncpi9k6_fp);
     }
 }
@@ -95,7 +91,6 @@ void log_write_traffic_log()
 
     traffic_fp = fopen(traffic_fn, "a");
     if (traffic_fp != NULL) {
-        pthread_mutex_lock(&mutex_traffic_log);
         p = dataq_pop(&g_traffic_log_q);
         while (p) {
             len = strlen(p);
@@ -106,7 +101,6 @@ void log_write_traffic_log()
             fprintf(traffic_fp, "%s\n", p);
             p = dataq_pop(&g_traffic_log_q);
         }
-        pthread_mutex_unlock(&mutex_traffic_log);
         fclose(traffic_fp);
     }
 }
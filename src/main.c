@@ -29,6 +29,7 @@
 #include <signal.h>
 #include <time.h>
 #include <getopt.h>
+#include <poll.h>
 #include "main.h"
 #include "cmdthread.h"
 #include "datathread.h"
@@ -38,6 +39,10 @@
 #include "arim_beacon.h"
 #include "mbox.h"
 #include "auth.h"
+#include "bufq.h"
+#include "tnc_state.h"
+#include "timer.h"
+#include "mboxthread.h"
 
 int g_cmdthread_stop;
 int g_cmdthread_ready;
@@ -45,16 +50,19 @@ int g_datathread_stop;
 int g_datathread_ready;
 int g_serialthread_stop;
 int g_serialthread_ready;
+int g_reactorthread_stop;
+int g_reactorthread_ready;
 pthread_t g_cmdthread;
 pthread_t g_datathread;
 pthread_t g_serialthread;
+pthread_t g_reactorthread;
 
 int g_tnc_attached;
 int g_win_changed;
 int g_new_install;
 int g_print_config;
 
-static time_t prev_time;
+static TIMER_SVC alarm_timers = TIMER_SVC_INITIALIZER;
 static int timerthread_stop;
 
 pthread_mutex_t mutex_title = PTHREAD_MUTEX_INITIALIZER;
@@ -78,6 +86,8 @@ pthread_mutex_t mutex_file_out = PTHREAD_MUTEX_INITIALIZER;
 pthread_mutex_t mutex_msg_out = PTHREAD_MUTEX_INITIALIZER;
 pthread_mutex_t mutex_tnc_busy = PTHREAD_MUTEX_INITIALIZER;
 pthread_mutex_t mutex_num_bytes = PTHREAD_MUTEX_INITIALIZER;
+pthread_mutex_t mutex_tnc_flow = PTHREAD_MUTEX_INITIALIZER;
+pthread_mutex_t mutex_mbox = PTHREAD_MUTEX_INITIALIZER;
 
 void sighandler(int sig, siginfo_t *siginfo, void *context)
 {
@@ -88,20 +98,26 @@ void sighandler(int sig, siginfo_t *siginfo, void *context)
     }
 }
 
+static void timerthread_on_alarm(void *arg)
+{
+    if (g_tnc_attached) {
+        arim_beacon_on_alarm();
+    }
+    log_on_alarm();
+    mboxthread_request(0);
+}
+
 void *timerthread_func(void *data)
 {
-    time_t cur_time;
+    struct pollfd pfd;
 
+    pfd.fd = alarm_timers.fd;
+    pfd.events = POLLIN;
     do {
-        cur_time = time((time_t *)0);
-        if (cur_time - prev_time >= ALARM_INTERVAL_SEC) {
-            prev_time = cur_time;
-            if (g_tnc_attached) {
-                arim_beacon_on_alarm();
-            }
-            log_on_alarm();
-        }
-        usleep(100000);
+        /* sleep until the next alarm; fall back to polling the
+           deadlines if the timerfd couldn't be created */
+        poll(&pfd, 1, pfd.fd == -1 ? 100 : -1);
+        timer_on_expired(&alarm_timers);
     } while (!timerthread_stop);
     return data;
 }
@@ -160,11 +176,23 @@ int main(int argc, char *argv[])
         printf("Error: cannot open .ini file\n");
         return 2;
     }
+    /* allocate the inter-thread buffer queues */
+    if (!bufq_init(atoi(g_arim_settings.data_queue_size))) {
+        printf("Error: cannot allocate buffer queues\n");
+        return 5;
+    }
+    tnc_state_init();
     /* initialize mailbox files */
     if (!mbox_init()) {
         printf("Error: cannot initialize mailbox files\n");
         return 3;
     }
+    /* start the mailbox maintenance threads, purge old messages */
+    if (!mboxthread_start()) {
+        perror("pthread_create");
+        return 6;
+    }
+    mboxthread_request(1);
     /* initialize password file */
     if (!auth_init()) {
         printf("Error: cannot initialize password file\n");
@@ -172,7 +200,9 @@ int main(int argc, char *argv[])
     }
     /* initialize log directory */
     snprintf(g_log_dir_path, MAX_DIR_PATH_SIZE, "%s/%s", g_arim_path, "log");
-    /* create the timer thread */
+    /* create the timer thread, first alarm is due right away */
+    timer_svc_open(&alarm_timers);
+    timer_start(&alarm_timers, 0, ALARM_INTERVAL_SEC * 1000, timerthread_on_alarm, NULL);
     result = pthread_create(&timerthread, NULL, timerthread_func, NULL);
     if (result) {
         perror("pthread_create");
@@ -185,19 +215,30 @@ int main(int argc, char *argv[])
     ui_run();
     if (g_cmdthread) {
         g_cmdthread_stop = 1;
+        bufq_signal(BUFQ_EV_CMD_OUT); /* wake thread so it sees stop flag */
         pthread_join(g_cmdthread, NULL);
     }
     if (g_datathread) {
         g_datathread_stop = 1;
+        bufq_signal(BUFQ_EV_DATA_OUT); /* wake thread so it sees stop flag */
         pthread_join(g_datathread, NULL);
     }
+    if (g_reactorthread) {
+        g_reactorthread_stop = 1;
+        bufq_signal(BUFQ_EV_CMD_OUT); /* wake thread so it sees stop flag */
+        pthread_join(g_reactorthread, NULL);
+    }
     /* end the ui */
     ui_end();
+    /* stop the mailbox maintenance threads */
+    mboxthread_end();
     /* flush queued events to logs */
     log_close();
     /* kill the timer thread */
     timerthread_stop = 1;
+    timer_start(&alarm_timers, 0, 0, NULL, NULL); /* wake thread so it sees stop flag */
     pthread_join(timerthread, NULL);
+    timer_svc_close(&alarm_timers);
 
     exit(0);
 }
@@ -39,6 +39,7 @@
 #define MIN_MSG_BUF_SIZE       (MAX_ARIM_HDR_SIZE+MAX_MSG_SIZE+1)
 #define MAX_MSG_LINE_SIZE      1024
 #define MAX_FILE_SIZE          MAX_DATA_SIZE
+#define MAX_ARQ_FILE_SIZE      16777216
 #define MAX_BEACON_SIZE        128
 #define MIN_BEACON_BUF_SIZE    (MAX_ARIM_HDR_SIZE+MAX_BEACON_SIZE+1)
 #define MAX_HEARD_SIZE         32
@@ -74,6 +75,9 @@
 #define ARDOP_CONN_TIMEOUT         180
 #define ARDOP_CONN_SEND_TIMEOUT    120
 #define ARDOP_OUT_CONN_RPT_TIMEOUT 5
+#define ARIM_ACKNAK_DELAY          2
+#define ARIM_RESP_DELAY            1
+#define ARIM_QUEUE_RETRY_TIMEOUT   1
 
 #define MBOX_TYPE_IN           0
 #define MBOX_TYPE_OUT          1
@@ -92,12 +96,15 @@
 extern pthread_t g_cmdthread;
 extern pthread_t g_datathread;
 extern pthread_t g_serialthread;
+extern pthread_t g_reactorthread;
 extern int g_cmdthread_stop;
 extern int g_cmdthread_ready;
 extern int g_datathread_stop;
 extern int g_datathread_ready;
 extern int g_serialthread_stop;
 extern int g_serialthread_ready;
+extern int g_reactorthread_stop;
+extern int g_reactorthread_ready;
 extern int g_timerthread_stop;
 extern int g_tnc_attached;
 extern int g_win_changed;
@@ -125,6 +132,8 @@ extern pthread_mutex_t mutex_file_out;
 extern pthread_mutex_t mutex_msg_out;
 extern pthread_mutex_t mutex_tnc_busy;
 extern pthread_mutex_t mutex_num_bytes;
+extern pthread_mutex_t mutex_tnc_flow;
+extern pthread_mutex_t mutex_mbox;
 
 #endif
 
@@ -21,19 +21,21 @@
 
 *************************************************************************/
 
-/* need to define _GNU_SOURCE for strptime() */
-#define _GNU_SOURCE
 #include <stdio.h>
 #include <stdlib.h>
 #include <unistd.h>
 #include <errno.h>
 #include <string.h>
+#include <fcntl.h>
+#include <sys/stat.h>
 #include <sys/time.h>
 #include <time.h>
 #include <ctype.h>
 #include "main.h"
 #include "ini.h"
 #include "mbox.h"
+#include "mbox_idx.h"
+#include "mbox_search.h"
 #include "util.h"
 #include "bufq.h"
 #include "ui_msg.h"
@@ -41,101 +43,340 @@
 
 char mbox_dir_path[MAX_PATH_SIZE];
 
-int mbox_purge(const char *fn, int days)
+static pthread_cond_t cond_mbox_compact = PTHREAD_COND_INITIALIZER;
+
+/*
+    Mailbox locking. mutex_mbox guards the mailbox indexes and serializes
+    writes to mailbox files, which are appends and in place flag changes.
+    It is only held briefly, never while message text is read, so storing
+    an incoming message doesn't wait on a reader. A reader copies the
+    index entries it needs under mutex_mbox, then reads the file without
+    it, bounded by those entries, while holding the mailbox's rwlock
+    shared. Compaction takes the rwlock exclusively to swap in the
+    rewritten file, so offsets a reader holds stay good until it's done.
+    The lock order is idx->lock, then mutex_mbox.
+*/
+
+static void mbox_copy_bytes(FILE *from, FILE *to, long offset, long size)
 {
-    FILE *mboxfp, *tempfp;
-    int fd, numch;
-    char *p, header[MAX_MBOX_HDR_SIZE], linebuf[MAX_MSG_LINE_SIZE];
-    char fpath[MAX_PATH_SIZE*2], tempfn[MAX_PATH_SIZE*2];
-    char month[16], day[8], timestamp[16], year[8], datetime[64], logbuf[MAX_LOG_LINE_SIZE];
-    struct tm tm, *ptm;
-    time_t hdr_time, cur_time;
+    char buffer[8192];
+    size_t n;
 
-    /* 0 days means "disabled" */
-    if (days == 0)
-       return 1;
+    /* block copy of mailbox contents, size -1 copies to end of file */
+    if (fseek(from, offset, SEEK_SET))
+        return;
+    while (size) {
+        n = (size < 0 || size > sizeof(buffer)) ? sizeof(buffer) : (size_t)size;
+        n = fread(buffer, 1, n, from);
+        if (!n)
+            break;
+        fwrite(buffer, 1, n, to);
+        if (size > 0)
+            size -= n;
+    }
+}
 
-    snprintf(fpath, sizeof(fpath), "%s/%s", mbox_dir_path, fn);
-    mboxfp = fopen(fpath, "r");
-    if (mboxfp == NULL)
-        return 0;
-    snprintf(tempfn, sizeof(tempfn), "%s/temp.mbox.XXXXXX", mbox_dir_path);
+static FILE *mbox_open_temp(char *tempfn, size_t size)
+{
+    FILE *tempfp;
+    int fd;
+
+    snprintf(tempfn, size, "%s/temp.mbox.XXXXXX", mbox_dir_path);
     fd = mkstemp(tempfn);
-    if (fd == -1) {
-        fclose(mboxfp);
-        return 0;
-    }
+    if (fd == -1)
+        return NULL;
     tempfp = fdopen(fd, "r+");
     if (tempfp == NULL) {
         close(fd);
-        fclose(mboxfp);
+        unlink(tempfn);
+    }
+    return tempfp;
+}
+
+static char *mbox_read_hdr(FILE *mboxfp, MBOX_IDX_ENTRY *e, char *linebuf, size_t size)
+{
+    /* read separator of indexed message, NULL if it isn't where expected */
+    if (fseek(mboxfp, e->offset, SEEK_SET) || !fgets(linebuf, size, mboxfp))
+        return NULL;
+    if (strncmp(linebuf, e->hdr, e->key_len))
+        return NULL;
+    return linebuf;
+}
+
+static int mbox_mark_msg(const char *fpath, MBOX_IDX *idx,
+                             MBOX_IDX_ENTRY *e, int flag, int set)
+{
+    char hdr[MAX_MBOX_HDR_SIZE], cur[MAX_MBOX_HDR_SIZE];
+    size_t len;
+    int fd, i, n = 0, pos[3];
+
+    /* set or clear status flags in the separator's fixed width flags
+       field, rewriting just that field in place */
+    snprintf(hdr, sizeof(hdr), "%s", e->hdr);
+    len = strlen(hdr);
+    if (e->key_len == len)
+        return 0; /* separator has no flags field */
+    switch(flag) {
+    case 'R':
+    case 'r':
+        pos[n++] = len - 3;
+        break;
+    case 'F':
+    case 'f':
+        pos[n++] = len - 2;
+        break;
+    case 'S':
+    case 's':
+        pos[n++] = len - 1;
+        break;
+    case MBOX_IDX_DEAD_FLAG:
+        pos[n++] = len - 4;
+        break;
+    case '*':
+        if (!set) {
+            pos[n++] = len - 3;
+            pos[n++] = len - 2;
+            pos[n++] = len - 1;
+        }
+        break;
+    }
+    for (i = 0; i < n; i++)
+        hdr[pos[i]] = set ? toupper(flag) : '-';
+    if (!strcmp(hdr, e->hdr))
+        return 1; /* no change */
+    fd = open(fpath, O_RDWR);
+    if (fd == -1)
+        return 0;
+    /* check separator is where the index says before writing */
+    if (pread(fd, cur, len, e->offset) != len || strncmp(cur, e->hdr, len) ||
+        pwrite(fd, &hdr[len - 4], 4, e->offset + len - 4) != 4) {
+        close(fd);
         return 0;
     }
-    cur_time = time(NULL);
-    if (!strncasecmp(g_ui_settings.utc_time, "TRUE", 4))
-        ptm = gmtime(&cur_time);
-    else
-        ptm = localtime(&cur_time);
-    cur_time = mktime(ptm);
-    flockfile(mboxfp);
-    p = fgets(linebuf, sizeof(linebuf), mboxfp);
-    while (p) {
-        while (p && strncmp(p, "From ", 5)) {
-            fprintf(tempfp, "%s", linebuf);
-            p = fgets(linebuf, sizeof(linebuf), mboxfp);
+    close(fd);
+    mbox_idx_set_hdr(idx, e, hdr);
+    return 1;
+}
+
+static int mbox_mark(const char *fn, const char *hdr, int flag, int set)
+{
+    MBOX_IDX *idx;
+    MBOX_IDX_ENTRY *e;
+    char fpath[MAX_PATH_SIZE*2];
+    int found = 0;
+
+    snprintf(fpath, sizeof(fpath), "%s/%s", mbox_dir_path, fn);
+    pthread_mutex_lock(&mutex_mbox);
+    /* find matching message separator in index */
+    idx = mbox_idx_open(fn);
+    e = idx ? mbox_idx_find(idx, hdr) : NULL;
+    if (e)
+        found = mbox_mark_msg(fpath, idx, e, flag, set);
+    pthread_mutex_unlock(&mutex_mbox);
+    return found;
+}
+
+static MBOX_IDX *mbox_begin_read(const char *fn)
+{
+    MBOX_IDX *idx;
+
+    /* hold off rewrites of the mailbox until mbox_end_read() */
+    pthread_mutex_lock(&mutex_mbox);
+    idx = mbox_idx_open(fn);
+    pthread_mutex_unlock(&mutex_mbox);
+    if (idx)
+        pthread_rwlock_rdlock(&idx->lock);
+    return idx;
+}
+
+static void mbox_end_read(MBOX_IDX *idx)
+{
+    pthread_rwlock_unlock(&idx->lock);
+}
+
+static FILE *mbox_snap_msg(const char *fn, MBOX_IDX *idx, const char *hdr, MBOX_IDX_ENTRY *snap)
+{
+    MBOX_IDX_ENTRY *e;
+    char fpath[MAX_PATH_SIZE*2];
+
+    /* copy index entry of message with separator hdr, and open mailbox to
+       read it; the copy stays good as long as the read lock is held */
+    pthread_mutex_lock(&mutex_mbox);
+    e = mbox_idx_open(fn) ? mbox_idx_find(idx, hdr) : NULL;
+    if (e)
+        *snap = *e;
+    pthread_mutex_unlock(&mutex_mbox);
+    if (e == NULL)
+        return NULL;
+    snprintf(fpath, sizeof(fpath), "%s/%s", mbox_dir_path, fn);
+    return fopen(fpath, "r");
+}
+
+typedef struct mbox_snap {
+    long offset, length;
+    char flags[MBOX_IDX_FLAGS_SIZE];
+    int dead, drop;
+} MBOX_SNAP;
+
+int mbox_compact(const char *fn, int days, int pct)
+{
+    FILE *mboxfp, *tempfp;
+    MBOX_IDX *idx, *slot;
+    MBOX_IDX_ENTRY *e;
+    MBOX_SNAP *snap = NULL;
+    struct stat st;
+    char fpath[MAX_PATH_SIZE*2], tempfn[MAX_PATH_SIZE*2], *drop;
+    char timestamp[MAX_TIMESTAMP_SIZE], logbuf[MAX_LOG_LINE_SIZE];
+    time_t cur_time;
+    unsigned long gen;
+    long pos = 0, cut = 0, end, reclaimed = 0;
+    int i, len, numch, num, aged = 0, ok, result = 0;
+
+    /* rewrite mailbox without its deleted messages and, if days isn't 0,
+       without those older than days. Deleted messages alone trigger a
+       rewrite only when they take up at least pct percent of the file,
+       0 pct means never. The copy is made without holding mutex_mbox so
+       the mailbox stays usable meanwhile; messages added and flags
+       changed during the copy are carried over before the new file is
+       renamed into place */
+    snprintf(fpath, sizeof(fpath), "%s/%s", mbox_dir_path, fn);
+    pthread_mutex_lock(&mutex_mbox);
+    idx = mbox_idx_open(fn);
+    while (idx && idx->busy) {
+        /* another thread is compacting this mailbox, wait for it */
+        pthread_cond_wait(&cond_mbox_compact, &mutex_mbox);
+        idx = mbox_idx_open(fn);
+    }
+    if (idx == NULL) {
+        pthread_mutex_unlock(&mutex_mbox);
+        return 0;
+    }
+    num = idx->cnt;
+    if (!idx->dead_bytes && !days) {
+        /* nothing to do, leave mailbox alone */
+        pthread_mutex_unlock(&mutex_mbox);
+        return 1;
+    }
+    snap = malloc((num ? num : 1) * sizeof(MBOX_SNAP));
+    if (snap == NULL) {
+        pthread_mutex_unlock(&mutex_mbox);
+        return 0;
+    }
+    /* compare against separator dates in the same local/UTC time base */
+    cur_time = mbox_idx_parse_time(util_date_timestamp(timestamp, sizeof(timestamp)));
+    for (i = 0; i < num; i++) {
+        e = &idx->entries[i];
+        snap[i].offset = e->offset;
+        snap[i].length = e->length;
+        memcpy(snap[i].flags, e->flags, sizeof(snap[i].flags));
+        snap[i].dead = snap[i].drop = e->dead;
+        if (!e->dead && days && e->timestamp != -1 &&
+            difftime(cur_time, e->timestamp) > (double)(days*24*60*60)) {
+            snap[i].drop = 1;
+            ++aged;
         }
-        if (p) {
-            snprintf(header, sizeof(header), "%s", p);
-            /* skip to month */
-            p = strtok(header, " ");
-            if (p && strtok(NULL, " ") && strtok(NULL, " ")) {
-                /* get the month */
-                p = strtok(NULL, " ");
-                if (p)
-                    snprintf(month, sizeof(month), "%s", p);
-                /* get day */
-                p = strtok(NULL, " ");
-                if (p)
-                    snprintf(day, sizeof(day), "%s", p);
-                /* get time */
-                p = strtok(NULL, " ");
-                if (p)
-                    snprintf(timestamp, sizeof(timestamp), "%s", p);
-                /* get year */
-                p = strtok(NULL, " ");
-                if (p) {
-                    snprintf(year, sizeof(year), "%s", p);
-                    snprintf(datetime, sizeof(datetime), "%s %s %s %s", day, month, year, timestamp);
-                    memset(&tm, 0, sizeof(struct tm));
-                    if (strptime(datetime, "%d %b %Y %H:%M:%S", &tm)) {
-                        hdr_time = mktime(&tm);
-                        if (hdr_time != -1) {
-                            if (difftime(cur_time, hdr_time) > (double)(days*24*60*60)) {
-                                /* message aged out, skip over it */
-                                numch = snprintf(logbuf, sizeof(logbuf), "MBOX %s purged: [%s]", fn, linebuf);
-                                if (numch >= sizeof(logbuf))
-                                    ui_truncate_line(logbuf, sizeof(logbuf));
-                                bufq_queue_debug_log(logbuf);
-                                p = fgets(linebuf, sizeof(linebuf), mboxfp);
-                                while (p && strncmp(p, "From ", 5)) {
-                                    p = fgets(linebuf, sizeof(linebuf), mboxfp);
-                                }
-                                continue;
-                            }
-                        }
-                    }
-                }
+    }
+    if (!aged && (!idx->dead_bytes || !pct ||
+                  (double)idx->dead_bytes * 100 < (double)pct * idx->indexed_to)) {
+        /* nothing to do, leave mailbox alone */
+        pthread_mutex_unlock(&mutex_mbox);
+        free(snap);
+        return 1;
+    }
+    for (i = 0; i < num; i++) {
+        e = &idx->entries[i];
+        if (snap[i].drop && !snap[i].dead) {
+            numch = snprintf(logbuf, sizeof(logbuf), "MBOX %s purged: [%s]", fn, e->hdr);
+            if (numch >= sizeof(logbuf))
+                ui_truncate_line(logbuf, sizeof(logbuf));
+            bufq_queue_debug_log(logbuf);
+        }
+    }
+    slot = idx;
+    gen = idx->gen;
+    end = idx->indexed_to;
+    idx->busy = 1;
+    pthread_mutex_unlock(&mutex_mbox);
+
+    /* copy the messages being kept into a temp file while unlocked; only
+       appends and in place flag changes can happen to the mailbox now */
+    mboxfp = fopen(fpath, "r");
+    tempfp = mboxfp ? mbox_open_temp(tempfn, sizeof(tempfn)) : NULL;
+    if (tempfp) {
+        if (!fstat(fileno(mboxfp), &st))
+            fchmod(fileno(tempfp), st.st_mode & 0777);
+        for (i = 0; i < num; i++) {
+            if (!snap[i].drop)
+                continue;
+            /* copy what precedes the message and skip over it */
+            mbox_copy_bytes(mboxfp, tempfp, pos, snap[i].offset - pos);
+            pos = snap[i].offset + snap[i].length;
+            reclaimed += snap[i].length;
+        }
+        mbox_copy_bytes(mboxfp, tempfp, pos, end - pos);
+    }
+
+    /* wait for readers to finish with offsets into the old file */
+    pthread_rwlock_wrlock(&slot->lock);
+    pthread_mutex_lock(&mutex_mbox);
+    idx = mbox_idx_open(fn);
+    if (tempfp && idx && idx->gen == gen && idx->cnt >= num &&
+        (!num || idx->entries[num - 1].offset == snap[num - 1].offset)) {
+        /* carry over messages added meanwhile */
+        mbox_copy_bytes(mboxfp, tempfp, end, idx->indexed_to - end);
+        ok = !fflush(tempfp);
+        /* and flags changed meanwhile; a message deleted meanwhile
+           stays in the new file, marked deleted */
+        for (i = 0; ok && i < num; i++) {
+            e = &idx->entries[i];
+            if (snap[i].drop) {
+                cut += snap[i].length;
+            } else if (e->dead != snap[i].dead ||
+                       memcmp(snap[i].flags, e->flags, sizeof(snap[i].flags))) {
+                len = strlen(e->hdr);
+                if (e->key_len != len)
+                    ok = pwrite(fileno(tempfp), &e->hdr[len - 4], 4,
+                                    e->offset - cut + len - 4) == 4;
             }
-            fprintf(tempfp, "%s", linebuf);
-            p = fgets(linebuf, sizeof(linebuf), mboxfp);
         }
-    } /* while (p) */
-    funlockfile(mboxfp);
-    fclose(mboxfp);
-    unlink(fpath);
-    fclose(tempfp);
-    rename(tempfn, fpath);
-    return 1;
+        if (ok && !fsync(fileno(tempfp)) && !rename(tempfn, fpath)) {
+            /* new file published, a reader that still has the old one
+               open keeps reading it until closed */
+            drop = malloc(num ? num : 1);
+            for (i = 0; drop && i < num; i++)
+                drop[i] = snap[i].drop;
+            if (drop)
+                mbox_idx_drop(idx, drop, num);
+            mbox_idx_rewritten(idx); /* rebuilds index if drop failed */
+            free(drop);
+            result = 1;
+            msg_view_restart = 1;
+            snprintf(logbuf, sizeof(logbuf),
+                "MBOX %s compacted, %ld bytes reclaimed", fn, reclaimed);
+            bufq_queue_debug_log(logbuf);
+        }
+    }
+    if (tempfp) {
+        fclose(tempfp);
+        if (!result)
+            unlink(tempfn);
+    }
+    if (mboxfp)
+        fclose(mboxfp);
+    slot->busy = 0;
+    pthread_cond_broadcast(&cond_mbox_compact);
+    pthread_mutex_unlock(&mutex_mbox);
+    pthread_rwlock_unlock(&slot->lock);
+    free(snap);
+    return result;
+}
+
+int mbox_purge(const char *fn, int days)
+{
+    /* 0 days means "disabled" */
+    if (days == 0)
+       return 1;
+    return mbox_compact(fn, days, 0);
 }
 
 char *mbox_add_msg(const char *fn, const char *fm_call, const char *to_call,
@@ -143,15 +384,19 @@ char *mbox_add_msg(const char *fn, const char *fm_call, const char *to_call,
 {
     static char separator[MAX_MBOX_HDR_SIZE];
     FILE *mboxfp;
+    MBOX_IDX *idx;
     char rcvd_hdr[MAX_ARIM_HDR_SIZE], call[TNC_MYCALL_SIZE];
     char timestamp[MAX_TIMESTAMP_SIZE], fpath[MAX_PATH_SIZE*2];
     const char *p, *prev;
     int insert_rcvd_hdr = 0, len = 0, i;
 
     snprintf(fpath, sizeof(fpath), "%s/%s", mbox_dir_path, fn);
+    pthread_mutex_lock(&mutex_mbox);
     mboxfp = fopen(fpath, "a");
-    if (mboxfp == NULL)
+    if (mboxfp == NULL) {
+        pthread_mutex_unlock(&mutex_mbox);
         return NULL;
+    }
     snprintf(call, sizeof(call), "%s", to_call);
     len = strlen(call);
     for (i = 0; i < len; i++)
@@ -204,152 +449,28 @@ char *mbox_add_msg(const char *fn, const char *fm_call, const char *to_call,
     fprintf(mboxfp, "\n\n"); /* mbox record ends with blank line */
     funlockfile(mboxfp);
     fclose(mboxfp);
+    /* index the new record */
+    idx = mbox_idx_open(fn);
+    if (idx)
+        mbox_search_on_add(idx);
+    pthread_mutex_unlock(&mutex_mbox);
     return separator;
 }
 
 int mbox_set_flag(const char *fn, const char *hdr, int flag)
 {
-    FILE *mboxfp, *tempfp;
-    int fd, found = 0;
-    char *p, linebuf[MAX_MSG_LINE_SIZE];
-    char fpath[MAX_PATH_SIZE*2], tempfn[MAX_PATH_SIZE*2];
-    size_t len;
+    int found;
 
-    snprintf(fpath, sizeof(fpath), "%s/%s", mbox_dir_path, fn);
-    mboxfp = fopen(fpath, "r");
-    if (mboxfp == NULL)
-        return 0;
-    snprintf(tempfn, sizeof(tempfn), "%s/temp.mbox.XXXXXX", mbox_dir_path);
-    fd = mkstemp(tempfn);
-    if (fd == -1) {
-        fclose(mboxfp);
-        return 0;
-    }
-    tempfp = fdopen(fd, "r+");
-    if (tempfp == NULL) {
-        close(fd);
-        fclose(mboxfp);
-        return 0;
-    }
-    flockfile(mboxfp);
-    /* find matching message separator in file */
-    len = strlen(hdr);
-    p = fgets(linebuf, sizeof(linebuf), mboxfp);
-    while (p && strncmp(linebuf, hdr, len)) {
-        /* write into temp file */
-        fprintf(tempfp, "%s", linebuf);
-        p = fgets(linebuf, sizeof(linebuf), mboxfp);
-    }
-    if (p) {
-        /* got it, set flag */
-        found = 1;
-        while (*p && *p != '\n')
-            ++p;
-        if (*p && *(p - 4) == ' ') {
-            switch(flag) {
-            case 'R':
-            case 'r':
-                *(p - 3) = 'R';
-                break;
-            case 'F':
-            case 'f':
-                *(p - 2) = 'F';
-                break;
-            case 'S':
-            case 's':
-                *(p - 1) = 'S';
-                break;
-            }
-        }
-        fprintf(tempfp, "%s", linebuf);
-        p = fgets(linebuf, sizeof(linebuf), mboxfp);
-        while (p) {
-            /* write into temp file */
-            fprintf(tempfp, "%s", linebuf);
-            p = fgets(linebuf, sizeof(linebuf), mboxfp);
-        }
-    }
-    funlockfile(mboxfp);
-    fclose(mboxfp);
-    unlink(fpath);
-    fclose(tempfp);
-    rename(tempfn, fpath);
+    found = mbox_mark(fn, hdr, flag, 1);
     msg_view_restart = 1;
     return found;
 }
 
 int mbox_clear_flag(const char *fn, const char *hdr, int flag)
 {
-    FILE *mboxfp, *tempfp;
-    int fd, found = 0;
-    char *p, linebuf[MAX_MSG_LINE_SIZE];
-    char fpath[MAX_PATH_SIZE*2], tempfn[MAX_PATH_SIZE*2];
-    size_t len;
+    int found;
 
-    snprintf(fpath, sizeof(fpath), "%s/%s", mbox_dir_path, fn);
-    mboxfp = fopen(fpath, "r");
-    if (mboxfp == NULL)
-        return 0;
-    snprintf(tempfn, sizeof(tempfn), "%s/temp.mbox.XXXXXX", mbox_dir_path);
-    fd = mkstemp(tempfn);
-    if (fd == -1) {
-        fclose(mboxfp);
-        return 0;
-    }
-    tempfp = fdopen(fd, "r+");
-    if (tempfp == NULL) {
-        close(fd);
-        fclose(mboxfp);
-        return 0;
-    }
-    flockfile(mboxfp);
-    /* find matching message separator in file */
-    len = strlen(hdr);
-    p = fgets(linebuf, sizeof(linebuf), mboxfp);
-    while (p && strncmp(linebuf, hdr, len)) {
-        /* write into temp file */
-        fprintf(tempfp, "%s", linebuf);
-        p = fgets(linebuf, sizeof(linebuf), mboxfp);
-    }
-    if (p) {
-        /* got it, clear flag */
-        found = 1;
-        while (*p && *p != '\n')
-            ++p;
-        if (*p && *(p - 4) == ' ') {
-            switch(flag) {
-            case 'R':
-            case 'r':
-                *(p - 3) = '-';
-                break;
-            case 'F':
-            case 'f':
-                *(p - 2) = '-';
-                break;
-            case 'S':
-            case 's':
-                *(p - 1) = '-';
-                break;
-            case '*':
-                *(p - 3) = '-';
-                *(p - 2) = '-';
-                *(p - 1) = '-';
-                break;
-            }
-        }
-        fprintf(tempfp, "%s", linebuf);
-        p = fgets(linebuf, sizeof(linebuf), mboxfp);
-        while (p) {
-            /* write into temp file */
-            fprintf(tempfp, "%s", linebuf);
-            p = fgets(linebuf, sizeof(linebuf), mboxfp);
-        }
-    }
-    funlockfile(mboxfp);
-    fclose(mboxfp);
-    unlink(fpath);
-    fclose(tempfp);
-    rename(tempfn, fpath);
+    found = mbox_mark(fn, hdr, flag, 0);
     msg_view_restart = 1;
     return found;
 }
@@ -357,18 +478,18 @@ int mbox_clear_flag(const char *fn, const char *hdr, int flag)
 int mbox_get_msg_list(char *msgbuffer, size_t msgbufsize,
                          const char *fn, const char *to_call)
 {
-    FILE *mboxfp;
+    MBOX_IDX *idx;
     size_t len, cnt = 0;
     int numlines = 0;
-    char linebuf[MAX_MSG_LINE_SIZE], fpath[MAX_PATH_SIZE*2];
-    char *p, test[TNC_MYCALL_SIZE+8], header[MAX_MBOX_HDR_SIZE];
+    char linebuf[MAX_MBOX_HDR_SIZE], header[MAX_MBOX_HDR_SIZE];
     int i, numch;
 
-    snprintf(fpath, sizeof(fpath), "%s/%s", mbox_dir_path, fn);
-    mboxfp = fopen(fpath, "r");
-    if (mboxfp == NULL)
+    pthread_mutex_lock(&mutex_mbox);
+    idx = mbox_idx_open(fn);
+    if (idx == NULL) {
+        pthread_mutex_unlock(&mutex_mbox);
         return 0;
-    flockfile(mboxfp);
+    }
     memset(msgbuffer, 0, msgbufsize);
     /* print preamble */
     snprintf(header, sizeof(header), "Messages for %s:\n", to_call);
@@ -379,29 +500,23 @@ int mbox_get_msg_list(char *msgbuffer, size_t msgbufsize,
         ++numlines;
     }
     /* find and copy messages addressed to 'to_call' */
-    snprintf(test, sizeof(test), " TO %s ", to_call);
-    p = fgets(linebuf, sizeof(linebuf), mboxfp);
-    while (p) {
-        if (!strncmp(p, "From ", 5)) {
-            /* message separator, see if to_call matches */
-            memset(header, 0, sizeof(header));
-            len = strlen(linebuf);
-            for (i = 0; i < len; i++)
-                header[i] = toupper(linebuf[i]);
-            if (strstr(header, test)) {
-                /* print separator into buffer sans the status flags */
-                linebuf[65] = '\0';
-                numch = snprintf(header, sizeof(header), "%3d %s\n", numlines, &linebuf[16]);
-                len = strlen(header);
-                if ((cnt + len) < msgbufsize) {
-                    strncat(msgbuffer, header, msgbufsize - cnt - 1);
-                    cnt += len;
-                    ++numlines;
-                }
-            }
+    for (i = 0; i < idx->cnt; i++) {
+        if (idx->entries[i].dead || strcasecmp(idx->entries[i].to_call, to_call))
+            continue;
+        /* print separator into buffer sans the status flags */
+        snprintf(linebuf, sizeof(linebuf), "%s", idx->entries[i].hdr);
+        if (strlen(linebuf) < 16)
+            continue;
+        linebuf[65] = '\0';
+        numch = snprintf(header, sizeof(header), "%3d %s\n", numlines, &linebuf[16]);
+        len = strlen(header);
+        if ((cnt + len) < msgbufsize) {
+            strncat(msgbuffer, header, msgbufsize - cnt - 1);
+            cnt += len;
+            ++numlines;
         }
-        p = fgets(linebuf, sizeof(linebuf), mboxfp);
     }
+    pthread_mutex_unlock(&mutex_mbox);
     if (numlines < 2) {
         snprintf(header, sizeof(header), "   No messages.\n");
         len = strlen(header);
@@ -418,8 +533,6 @@ int mbox_get_msg_list(char *msgbuffer, size_t msgbufsize,
         cnt += strlen(header);
         ++numlines;
     }
-    funlockfile(mboxfp);
-    fclose(mboxfp);
     (void)numch; /* suppress 'assigned but not used' warning for dummy var */
     return numlines;
 }
@@ -427,233 +540,246 @@ int mbox_get_msg_list(char *msgbuffer, size_t msgbufsize,
 int mbox_get_headers_to(char headers[][MAX_MBOX_HDR_SIZE],
                             int max_hdrs, const char *fn, const char *to_call)
 {
-    FILE *mboxfp;
-    char linebuf[MAX_MSG_LINE_SIZE], fpath[MAX_PATH_SIZE*2];
-    char *p, test[TNC_MYCALL_SIZE+8], header[MAX_MBOX_HDR_SIZE];
-    int i, numch, len, cnt = 0;
+    MBOX_IDX *idx;
+    int i, numch, cnt = 0;
 
-    snprintf(fpath, sizeof(fpath), "%s/%s", mbox_dir_path, fn);
-    mboxfp = fopen(fpath, "r");
-    if (mboxfp == NULL)
+    pthread_mutex_lock(&mutex_mbox);
+    idx = mbox_idx_open(fn);
+    if (idx == NULL) {
+        pthread_mutex_unlock(&mutex_mbox);
         return 0;
-    flockfile(mboxfp);
+    }
     /* find and copy messages addressed to 'to_call' */
-    snprintf(test, sizeof(test), " TO %s ", to_call);
-    p = fgets(linebuf, sizeof(linebuf), mboxfp);
-    while (p) {
-        if (!strncmp(p, "From ", 5)) {
-            /* message separator, see if to_call matches */
-            memset(header, 0, sizeof(header));
-            len = strlen(linebuf);
-            for (i = 0; i < len; i++)
-                header[i] = toupper(linebuf[i]);
-            if (strstr(header, test)) {
-                /* print separator into buffer */
-                numch = snprintf(headers[cnt++], MAX_MBOX_HDR_SIZE, "%s", linebuf);
-                if (cnt == max_hdrs)
-                    break;
-            }
-        }
-        p = fgets(linebuf, sizeof(linebuf), mboxfp);
+    for (i = 0; i < idx->cnt && cnt < max_hdrs; i++) {
+        if (!idx->entries[i].dead && !strcasecmp(idx->entries[i].to_call, to_call))
+            numch = snprintf(headers[cnt++], MAX_MBOX_HDR_SIZE, "%s\n", idx->entries[i].hdr);
     }
-    funlockfile(mboxfp);
-    fclose(mboxfp);
+    pthread_mutex_unlock(&mutex_mbox);
     (void)numch; /* suppress 'assigned but not used' warning for dummy var */
     return cnt;
 }
 
-int mbox_get_msg(char *msgbuffer, size_t msgbufsize,
-                         const char *fn, const char *hdr, int canonical_eol)
+int mbox_get_headers(char headers[][MAX_MBOX_HDR_SIZE], int max_hdrs, const char *fn)
+{
+    MBOX_IDX *idx;
+    int i, cnt = 0;
+
+    /* copy separators of all live messages, oldest first, -1 on failure */
+    pthread_mutex_lock(&mutex_mbox);
+    idx = mbox_idx_open(fn);
+    if (idx == NULL) {
+        pthread_mutex_unlock(&mutex_mbox);
+        return -1;
+    }
+    for (i = 0; i < idx->cnt && cnt < max_hdrs; i++) {
+        if (!idx->entries[i].dead)
+            snprintf(headers[cnt++], MAX_MBOX_HDR_SIZE, "%s", idx->entries[i].hdr);
+    }
+    pthread_mutex_unlock(&mutex_mbox);
+    return cnt;
+}
+
+static int mbox_read_body(FILE *mboxfp, char *msgbuffer, size_t msgbufsize,
+                              long end, int canonical_eol)
 {
-    FILE *mboxfp;
     size_t len, cnt = 0;
-    char *p, linebuf[MAX_MSG_LINE_SIZE], fpath[MAX_PATH_SIZE*2];
-    int found = 0;
+    char *p, linebuf[MAX_MSG_LINE_SIZE];
 
-    snprintf(fpath, sizeof(fpath), "%s/%s", mbox_dir_path, fn);
-    mboxfp = fopen(fpath, "r");
-    if (mboxfp == NULL)
-        return 0;
-    flockfile(mboxfp);
+    /* read message following its separator, discarding To: and From: header
+       lines; stops at end, the offset following the message */
     memset(msgbuffer, 0, msgbufsize);
-    /* find matching message separator in file */
-    p = fgets(linebuf, sizeof(linebuf), mboxfp);
-    while (p && strncmp(linebuf, hdr, strlen(hdr))) {
-        p = fgets(linebuf, sizeof(linebuf), mboxfp);
+    p = fgets(linebuf, sizeof(linebuf), mboxfp); /* From: */
+    p = fgets(linebuf, sizeof(linebuf), mboxfp); /* To:   */
+    p = fgets(linebuf, sizeof(linebuf), mboxfp); /* may be empty line terminating headers
+                                                    or possibly a Received: header */
+    if (p && *p != '\n') {
+        /* not the empty line terminating headers, so write into msg buffer */
+        len = strlen(linebuf);
+        if ((cnt + len) < msgbufsize) {
+            strncat(msgbuffer, linebuf, msgbufsize - cnt - 1);
+            cnt += len;
+        }
     }
-    if (p) {
-        /* got it, read message, discarding To: and From: header lines */
-        found = 1;
-        p = fgets(linebuf, sizeof(linebuf), mboxfp); /* From: */
-        p = fgets(linebuf, sizeof(linebuf), mboxfp); /* To:   */
-        p = fgets(linebuf, sizeof(linebuf), mboxfp); /* may be empty line terminating headers
-                                                        or possibly a Received: header */
-        if (p && *p != '\n') {
-            /* not the empty line terminating headers, so write into msg buffer */
+    while (p && ftell(mboxfp) < end) {
+        p = fgets(linebuf, sizeof(linebuf), mboxfp);
+        if (p) {
             len = strlen(linebuf);
-            if ((cnt + len) < msgbufsize) {
-                strncat(msgbuffer, linebuf, msgbufsize - cnt - 1);
-                cnt += len;
-            }
-        }
-        do {
-            p = fgets(linebuf, sizeof(linebuf), mboxfp);
-            if (p) {
-                len = strlen(linebuf);
-                /* check for 'From ' char sequence escaped with '>' char(s) */
-                while (*p && *p == '>')
-                    ++p;
-                if (p > linebuf && !strncmp(p, "From ", 5)) {
-                    /* found one, unescape line by removing first '>' char */
-                    if ((cnt + len - 1) < msgbufsize) {
-                        strncat(msgbuffer, &linebuf[1], msgbufsize - cnt - 1);
-                        cnt += len - 1;
-                    }
-                    if (canonical_eol) /* convert CRLF line endings */
-                        if (cnt > 1 && msgbuffer[cnt - 2] == '\r' && msgbuffer[cnt - 1] == '\n') {
-                            msgbuffer[cnt - 2] = '\n';
-                            msgbuffer[cnt - 1] = '\0';
-                            --cnt;
-                        }
-                } else if (p && !strncmp(p, "From ", 5)) {
-                    /* unescaped mbox separator from next msg in file, stop */
-                    break;
-                } else {
-                    /* write into msg buffer */
-                    if ((cnt + len) < msgbufsize) {
-                        strncat(msgbuffer, linebuf, msgbufsize - cnt - 1);
-                        cnt += len;
+            /* check for 'From ' char sequence escaped with '>' char(s) */
+            while (*p && *p == '>')
+                ++p;
+            if (p > linebuf && !strncmp(p, "From ", 5)) {
+                /* found one, unescape line by removing first '>' char */
+                if ((cnt + len - 1) < msgbufsize) {
+                    strncat(msgbuffer, &linebuf[1], msgbufsize - cnt - 1);
+                    cnt += len - 1;
+                }
+                if (canonical_eol) /* convert CRLF line endings */
+                    if (cnt > 1 && msgbuffer[cnt - 2] == '\r' && msgbuffer[cnt - 1] == '\n') {
+                        msgbuffer[cnt - 2] = '\n';
+                        msgbuffer[cnt - 1] = '\0';
+                        --cnt;
                     }
-                    if (canonical_eol) /* convert CRLF line endings */
-                        if (cnt > 1 && msgbuffer[cnt - 2] == '\r' && msgbuffer[cnt - 1] == '\n') {
-                            msgbuffer[cnt - 2] = '\n';
-                            msgbuffer[cnt - 1] = '\0';
-                            --cnt;
-                        }
+            } else if (p && !strncmp(p, "From ", 5)) {
+                /* unescaped mbox separator from next msg in file, stop */
+                break;
+            } else {
+                /* write into msg buffer */
+                if ((cnt + len) < msgbufsize) {
+                    strncat(msgbuffer, linebuf, msgbufsize - cnt - 1);
+                    cnt += len;
                 }
+                if (canonical_eol) /* convert CRLF line endings */
+                    if (cnt > 1 && msgbuffer[cnt - 2] == '\r' && msgbuffer[cnt - 1] == '\n') {
+                        msgbuffer[cnt - 2] = '\n';
+                        msgbuffer[cnt - 1] = '\0';
+                        --cnt;
+                    }
             }
-        } while (p);
-        /* remove empty line added when stored to mbox file */
-        if (msgbuffer[cnt - 1] == '\n' && msgbuffer[cnt - 2] == '\n')
-            msgbuffer[cnt - 2] = '\0';
+        }
     }
-    funlockfile(mboxfp);
-    fclose(mboxfp);
-    return found;
+    /* remove empty line added when stored to mbox file */
+    if (cnt > 1 && msgbuffer[cnt - 1] == '\n' && msgbuffer[cnt - 2] == '\n')
+        msgbuffer[cnt - 2] = '\0';
+    return 1;
 }
 
-int mbox_delete_msg(const char *fn, const char *hdr)
+int mbox_get_msg(char *msgbuffer, size_t msgbufsize,
+                         const char *fn, const char *hdr, int canonical_eol)
 {
-    FILE *mboxfp, *tempfp;
-    int fd, found = 0;
-    char *p, linebuf[MAX_MSG_LINE_SIZE];
-    char fpath[MAX_PATH_SIZE*2], tempfn[MAX_PATH_SIZE*2];
+    FILE *mboxfp;
+    MBOX_IDX *idx;
+    MBOX_IDX_ENTRY e;
+    char linebuf[MAX_MSG_LINE_SIZE];
+    int found = 0;
 
-    snprintf(fpath, sizeof(fpath), "%s/%s", mbox_dir_path, fn);
-    mboxfp = fopen(fpath, "r");
-    if (mboxfp == NULL)
+    memset(msgbuffer, 0, msgbufsize);
+    idx = mbox_begin_read(fn);
+    if (idx == NULL)
         return 0;
-    snprintf(tempfn, sizeof(tempfn), "%s/temp.mbox.XXXXXX", mbox_dir_path);
-    fd = mkstemp(tempfn);
-    if (fd == -1) {
+    mboxfp = mbox_snap_msg(fn, idx, hdr, &e);
+    if (mboxfp) {
+        flockfile(mboxfp);
+        if (mbox_read_hdr(mboxfp, &e, linebuf, sizeof(linebuf))) {
+            /* got it, read message */
+            found = mbox_read_body(mboxfp, msgbuffer, msgbufsize,
+                                       e.offset + e.length, canonical_eol);
+        }
+        funlockfile(mboxfp);
         fclose(mboxfp);
-        return 0;
     }
-    tempfp = fdopen(fd, "r+");
-    if (tempfp == NULL) {
-        close(fd);
-        fclose(mboxfp);
+    mbox_end_read(idx);
+    return found;
+}
+
+int mbox_get_msgs_to(char headers[][MAX_MBOX_HDR_SIZE], char *msgbuffers,
+                         size_t msgbufsize, int max_msgs, const char *fn, const char *to_call)
+{
+    FILE *mboxfp;
+    MBOX_IDX *idx;
+    MBOX_IDX_ENTRY *snap;
+    char linebuf[MAX_MSG_LINE_SIZE], fpath[MAX_PATH_SIZE*2];
+    int i, num = 0, cnt = 0;
+
+    /* copy up to max_msgs messages addressed to 'to_call' along with their
+       separators in a single pass over the mailbox, oldest first; message
+       n goes into the msgbufsize bytes starting at msgbuffers[n * msgbufsize] */
+    snprintf(fpath, sizeof(fpath), "%s/%s", mbox_dir_path, fn);
+    snap = malloc((max_msgs > 0 ? max_msgs : 1) * sizeof(MBOX_IDX_ENTRY));
+    if (snap == NULL)
+        return 0;
+    idx = mbox_begin_read(fn);
+    if (idx == NULL) {
+        free(snap);
         return 0;
     }
-    flockfile(mboxfp);
-    /* find matching message separator in file */
-    p = fgets(linebuf, sizeof(linebuf), mboxfp);
-    while (p && strncmp(linebuf, hdr, strlen(hdr))) {
-        /* write into temp file */
-        fprintf(tempfp, "%s", linebuf);
-        p = fgets(linebuf, sizeof(linebuf), mboxfp);
+    pthread_mutex_lock(&mutex_mbox);
+    if (mbox_idx_open(fn)) {
+        for (i = 0; i < idx->cnt && num < max_msgs; i++) {
+            if (!idx->entries[i].dead && !strcasecmp(idx->entries[i].to_call, to_call))
+                snap[num++] = idx->entries[i];
+        }
     }
-    if (p) {
-        /* got it, skip over message */
-        found = 1;
-        do {
-            p = fgets(linebuf, sizeof(linebuf), mboxfp);
-            if (p && !strncmp(p, "From ", 5)) {
-                /* found unescaped mbox separator from next msg in file, done */
-                fprintf(tempfp, "%s", linebuf);
-                break;
-            }
-        } while (p);
+    pthread_mutex_unlock(&mutex_mbox);
+    mboxfp = num ? fopen(fpath, "r") : NULL;
+    if (mboxfp) {
+        flockfile(mboxfp);
+        for (i = 0; i < num; i++) {
+            if (!mbox_read_hdr(mboxfp, &snap[i], linebuf, sizeof(linebuf)))
+                break; /* index out of step with file */
+            snprintf(headers[cnt], MAX_MBOX_HDR_SIZE, "%s", snap[i].hdr);
+            mbox_read_body(mboxfp, msgbuffers + cnt * msgbufsize, msgbufsize,
+                               snap[i].offset + snap[i].length, 0);
+            ++cnt;
+        }
+        funlockfile(mboxfp);
+        fclose(mboxfp);
     }
-    p = fgets(linebuf, sizeof(linebuf), mboxfp);
-    while (p) {
-        /* write into temp file */
-        fprintf(tempfp, "%s", linebuf);
-        p = fgets(linebuf, sizeof(linebuf), mboxfp);
+    mbox_end_read(idx);
+    free(snap);
+    return cnt;
+}
+
+int mbox_delete_msg(const char *fn, const char *hdr)
+{
+    /* mark it deleted; space is reclaimed by compaction */
+    return mbox_mark(fn, hdr, MBOX_IDX_DEAD_FLAG, 1);
+}
+
+int mbox_delete_msgs(const char *fn, char headers[][MAX_MBOX_HDR_SIZE], int num_hdrs)
+{
+    MBOX_IDX *idx;
+    MBOX_IDX_ENTRY *e;
+    char fpath[MAX_PATH_SIZE*2];
+    int i, cnt = 0;
+
+    /* delete a batch of messages under a single lock of the mailbox,
+       returns the number deleted */
+    snprintf(fpath, sizeof(fpath), "%s/%s", mbox_dir_path, fn);
+    pthread_mutex_lock(&mutex_mbox);
+    idx = mbox_idx_open(fn);
+    for (i = 0; idx && i < num_hdrs; i++) {
+        e = mbox_idx_find(idx, headers[i]);
+        if (e && mbox_mark_msg(fpath, idx, e, MBOX_IDX_DEAD_FLAG, 1))
+            ++cnt;
     }
-    funlockfile(mboxfp);
-    fclose(mboxfp);
-    unlink(fpath);
-    fclose(tempfp);
-    rename(tempfn, fpath);
-    return found;
+    pthread_mutex_unlock(&mutex_mbox);
+    return cnt;
 }
 
 int mbox_save_msg(const char *fn, const char *hdr, const char *savefn)
 {
-    FILE *mboxfp, *savefp, *tempfp;
+    FILE *mboxfp, *savefp;
+    MBOX_IDX *idx;
+    MBOX_IDX_ENTRY e;
     char *p, *f, linebuf[MAX_MSG_LINE_SIZE];
-    char fpath[MAX_PATH_SIZE*2], tempfn[MAX_PATH_SIZE*2];
-    int fd, found = 0;
+    int found = 0;
 
-    snprintf(fpath, sizeof(fpath), "%s/%s", mbox_dir_path, fn);
-    mboxfp = fopen(fpath, "r");
-    if (mboxfp == NULL)
+    idx = mbox_begin_read(fn);
+    if (idx == NULL)
         return 0;
-    snprintf(tempfn, sizeof(tempfn), "%s/temp.mbox.XXXXXX", mbox_dir_path);
-    fd = mkstemp(tempfn);
-    if (fd == -1) {
-        fclose(mboxfp);
-        return 0;
-    }
-    tempfp = fdopen(fd, "r+");
-    if (tempfp == NULL) {
-        close(fd);
-        fclose(mboxfp);
+    mboxfp = mbox_snap_msg(fn, idx, hdr, &e);
+    if (mboxfp == NULL) {
+        mbox_end_read(idx);
         return 0;
     }
     savefp = fopen(savefn, "w");
     if (savefp == NULL) {
         fclose(mboxfp);
-        fclose(tempfp);
+        mbox_end_read(idx);
         return 0;
     }
     flockfile(mboxfp);
-    /* find matching message separator in file */
-    p = fgets(linebuf, sizeof(linebuf), mboxfp);
-    while (p && strncmp(linebuf, hdr, strlen(hdr))) {
-        /* write into temp file */
-        fprintf(tempfp, "%s", linebuf);
-        p = fgets(linebuf, sizeof(linebuf), mboxfp);
-    }
+    p = mbox_read_hdr(mboxfp, &e, linebuf, sizeof(linebuf));
     if (p) {
-        /* got it, set 'S' flag and write separator to temp file */
+        /* got it, start printing to save file */
         found = 1;
-        while (*p && *p != '\n')
-            ++p;
-        if (*p && *(p - 4) == ' ')
-            *(p - 1) = 'S';
-        fprintf(tempfp, "%s", linebuf);
-        /* start printing to save file */
         fprintf(savefp, "%s", linebuf);
-        do {
+        while (p && ftell(mboxfp) < e.offset + e.length) {
             p = fgets(linebuf, sizeof(linebuf), mboxfp);
             if (p && !strncmp(p, "From ", 5)) {
-                /* unescaped mbox separator from next msg in file,
-                   save it to temp file and stop */
-                fprintf(tempfp, "%s", linebuf);
+                /* unescaped mbox separator from next msg in file, stop */
                 break;
-            } else {
+            } else if (p) {
                 /* check for 'From ' char sequence escaped with '>' char(s) */
                 f = linebuf;
                 while (*f && *f == '>')
@@ -664,333 +790,207 @@ int mbox_save_msg(const char *fn, const char *hdr, const char *savefn)
                 else
                     fprintf(savefp, "%s", linebuf);
             }
-            /* write into temp file */
-            fprintf(tempfp, "%s", linebuf);
-        } while (p);
-    }
-    p = fgets(linebuf, sizeof(linebuf), mboxfp);
-    while (p) {
-        /* write into temp file */
-        fprintf(tempfp, "%s", linebuf);
-        p = fgets(linebuf, sizeof(linebuf), mboxfp);
+        }
     }
     funlockfile(mboxfp);
     fclose(mboxfp);
     fclose(savefp);
-    fclose(tempfp);
-    unlink(fpath);
-    rename(tempfn, fpath);
+    if (found)
+        mbox_mark(fn, hdr, 'S', 1);
+    mbox_end_read(idx);
     return found;
 }
 
 int mbox_read_msg(char *msgbuffer, size_t msgbufsize,
                       const char *fn, const char *hdr)
 {
-    FILE *mboxfp, *tempfp;
+    FILE *mboxfp;
+    MBOX_IDX *idx;
+    MBOX_IDX_ENTRY e;
     size_t len, cnt = 0;
-    int fd, numlines = 0;
+    int numlines = 0;
     char *p, linebuf[MAX_MSG_LINE_SIZE];
-    char fpath[MAX_PATH_SIZE*2], tempfn[MAX_PATH_SIZE*2];
 
-    snprintf(fpath, sizeof(fpath), "%s/%s", mbox_dir_path, fn);
-    mboxfp = fopen(fpath, "r");
-    if (mboxfp == NULL)
+    memset(msgbuffer, 0, msgbufsize);
+    idx = mbox_begin_read(fn);
+    if (idx == NULL)
         return 0;
-    snprintf(tempfn, sizeof(tempfn), "%s/temp.mbox.XXXXXX", mbox_dir_path);
-    fd = mkstemp(tempfn);
-    if (fd == -1) {
-        fclose(mboxfp);
+    mboxfp = mbox_snap_msg(fn, idx, hdr, &e);
+    if (mboxfp == NULL) {
+        mbox_end_read(idx);
         return 0;
     }
-    tempfp = fdopen(fd, "r+");
-    if (tempfp == NULL) {
-        close(fd);
+    flockfile(mboxfp);
+    p = mbox_read_hdr(mboxfp, &e, linebuf, sizeof(linebuf));
+    if (p == NULL) {
+        /* index out of step with file, leave mailbox alone */
+        funlockfile(mboxfp);
         fclose(mboxfp);
+        mbox_end_read(idx);
         return 0;
     }
-    flockfile(mboxfp);
-    memset(msgbuffer, 0, msgbufsize);
-    /* find matching message separator in file */
-    p = fgets(linebuf, sizeof(linebuf), mboxfp);
-    while (p && strncmp(linebuf, hdr, strlen(hdr))) {
-        /* write into temp file */
-        fprintf(tempfp, "%s", linebuf);
+    /* got it, extract message into buffer */
+    while (p && ftell(mboxfp) < e.offset + e.length) {
         p = fgets(linebuf, sizeof(linebuf), mboxfp);
-    }
-    if (p) {
-        /* got it, set 'R' flag and print to file */
-        while (*p && *p != '\n')
-            ++p;
-        if (*p && *(p - 4) == ' ')
-            *(p - 3) = 'R';
-        fprintf(tempfp, "%s", linebuf);
-        /* extract message into buffer */
-        do {
-            p = fgets(linebuf, sizeof(linebuf), mboxfp);
-            if (p) {
-                len = strlen(linebuf);
-                /* check for 'From ' char sequence escaped with '>' char(s) */
-                while (*p && *p == '>')
-                    ++p;
-                if (p > linebuf && !strncmp(p, "From ", 5)) {
-                    /* found one, unescape line by removing first '>' char */
-                    if ((cnt + len - 1) < msgbufsize) {
-                        strncat(msgbuffer, &linebuf[1],  msgbufsize - cnt - 1);
-                        cnt += len - 1;
-                        ++numlines;
-                        /* convert CRLF line endings */
-                        if (cnt > 1 && msgbuffer[cnt - 2] == '\r' && msgbuffer[cnt - 1] == '\n') {
-                            msgbuffer[cnt - 2] = '\n';
-                            msgbuffer[cnt - 1] = '\0';
-                            --cnt;
-                        }
+        if (p) {
+            len = strlen(linebuf);
+            /* check for 'From ' char sequence escaped with '>' char(s) */
+            while (*p && *p == '>')
+                ++p;
+            if (p > linebuf && !strncmp(p, "From ", 5)) {
+                /* found one, unescape line by removing first '>' char */
+                if ((cnt + len - 1) < msgbufsize) {
+                    strncat(msgbuffer, &linebuf[1],  msgbufsize - cnt - 1);
+                    cnt += len - 1;
+                    ++numlines;
+                    /* convert CRLF line endings */
+                    if (cnt > 1 && msgbuffer[cnt - 2] == '\r' && msgbuffer[cnt - 1] == '\n') {
+                        msgbuffer[cnt - 2] = '\n';
+                        msgbuffer[cnt - 1] = '\0';
+                        --cnt;
                     }
-                } else if (!strncmp(p, "From ", 5)) {
-                    /* unescaped mbox separator from next msg in file,
-                       save it to temp file and stop */
-                    fprintf(tempfp, "%s", linebuf);
-                    break;
-                } else {
-                    if ((cnt + len) < msgbufsize) {
-                        strncat(msgbuffer, linebuf, msgbufsize - cnt - 1);
-                        cnt += len;
-                        ++numlines;
-                        /* convert CRLF line endings */
-                        if (cnt > 1 && msgbuffer[cnt - 2] == '\r' && msgbuffer[cnt - 1] == '\n') {
-                            msgbuffer[cnt - 2] = '\n';
-                            msgbuffer[cnt - 1] = '\0';
-                            --cnt;
-                        }
+                }
+            } else if (!strncmp(p, "From ", 5)) {
+                /* unescaped mbox separator from next msg in file, stop */
+                break;
+            } else {
+                if ((cnt + len) < msgbufsize) {
+                    strncat(msgbuffer, linebuf, msgbufsize - cnt - 1);
+                    cnt += len;
+                    ++numlines;
+                    /* convert CRLF line endings */
+                    if (cnt > 1 && msgbuffer[cnt - 2] == '\r' && msgbuffer[cnt - 1] == '\n') {
+                        msgbuffer[cnt - 2] = '\n';
+                        msgbuffer[cnt - 1] = '\0';
+                        --cnt;
                     }
                 }
-                /* write into temp file */
-                fprintf(tempfp, "%s", linebuf);
             }
-        } while (p);
-        /* remove empty line added when stored to mbox file */
-        if (msgbuffer[cnt - 1] == '\n' && msgbuffer[cnt - 2] == '\n')
-            msgbuffer[cnt - 2] = '\0';
-    }
-    p = fgets(linebuf, sizeof(linebuf), mboxfp);
-    while (p) {
-        /* write into temp file */
-        fprintf(tempfp, "%s", linebuf);
-        p = fgets(linebuf, sizeof(linebuf), mboxfp);
+        }
     }
+    /* remove empty line added when stored to mbox file */
+    if (cnt > 1 && msgbuffer[cnt - 1] == '\n' && msgbuffer[cnt - 2] == '\n')
+        msgbuffer[cnt - 2] = '\0';
     funlockfile(mboxfp);
     fclose(mboxfp);
-    fclose(tempfp);
-    unlink(fpath);
-    rename(tempfn, fpath);
+    /* set 'R' flag */
+    mbox_mark(fn, hdr, 'R', 1);
+    mbox_end_read(idx);
     return numlines;
 }
 
 int mbox_fwd_msg(char *msgbuffer, size_t msgbufsize, const char *fn, const char *hdr)
 {
-    FILE *mboxfp, *tempfp;
-    size_t len, cnt = 0;
-    int fd, found = 0;
-    char *p, linebuf[MAX_MSG_LINE_SIZE];
-    char fpath[MAX_PATH_SIZE*2], tempfn[MAX_PATH_SIZE*2];
+    FILE *mboxfp;
+    MBOX_IDX *idx;
+    MBOX_IDX_ENTRY e;
+    char linebuf[MAX_MSG_LINE_SIZE];
+    int found = 0;
 
-    snprintf(fpath, sizeof(fpath), "%s/%s", mbox_dir_path, fn);
-    mboxfp = fopen(fpath, "r");
-    if (mboxfp == NULL)
-        return 0;
-    snprintf(tempfn, sizeof(tempfn), "%s/temp.mbox.XXXXXX", mbox_dir_path);
-    fd = mkstemp(tempfn);
-    if (fd == -1) {
-        fclose(mboxfp);
-        return 0;
-    }
-    tempfp = fdopen(fd, "r+");
-    if (tempfp == NULL) {
-        close(fd);
-        fclose(mboxfp);
-        return 0;
-    }
-    flockfile(mboxfp);
     memset(msgbuffer, 0, msgbufsize);
-    /* find matching message separator in file */
-    p = fgets(linebuf, sizeof(linebuf), mboxfp);
-    while (p && strncmp(linebuf, hdr, strlen(hdr))) {
-        /* write into temp file */
-        fprintf(tempfp, "%s", linebuf);
-        p = fgets(linebuf, sizeof(linebuf), mboxfp);
-    }
-    if (p) {
-        /* got it, set flag and write separator to temp file */
-        while (*p && *p != '\n')
-            ++p;
-        if (*p && *(p - 4) == ' ')
-            *(p - 2) = 'F';
-        fprintf(tempfp, "%s", linebuf);
-        /* got it, read message, discarding To: and From: header lines */
-        found = 1;
-        p = fgets(linebuf, sizeof(linebuf), mboxfp); /* From: */
-        p = fgets(linebuf, sizeof(linebuf), mboxfp); /* To:   */
-        p = fgets(linebuf, sizeof(linebuf), mboxfp); /* may be empty line terminating headers
-                                                        or possibly a Received: header */
-        if (p && *p != '\n') {
-            /* not the empty line terminating headers, so write into msg buffer */
-            len = strlen(linebuf);
-            if ((cnt + len) < msgbufsize) {
-                strncat(msgbuffer, linebuf, msgbufsize - cnt - 1);
-                cnt += len;
-            }
+    idx = mbox_begin_read(fn);
+    if (idx == NULL)
+        return 0;
+    mboxfp = mbox_snap_msg(fn, idx, hdr, &e);
+    if (mboxfp) {
+        flockfile(mboxfp);
+        if (mbox_read_hdr(mboxfp, &e, linebuf, sizeof(linebuf))) {
+            /* got it, read message, discarding To: and From: header lines */
+            found = mbox_read_body(mboxfp, msgbuffer, msgbufsize, e.offset + e.length, 0);
         }
-        /* now copy body of message into msg buffer */
-        do {
-            p = fgets(linebuf, sizeof(linebuf), mboxfp);
-            if (p) {
-                len = strlen(linebuf);
-                /* check for 'From ' char sequence escaped with '>' char(s) */
-                while (*p && *p == '>')
-                    ++p;
-                if (p > linebuf && !strncmp(p, "From ", 5)) {
-                    /* found one, unescape line by removing first '>' char */
-                    if ((cnt + len - 1) < msgbufsize) {
-                        strncat(msgbuffer, &linebuf[1], msgbufsize - cnt - 1);
-                        cnt += len - 1;
-                    }
-                } else if (!strncmp(p, "From ", 5)) {
-                    /* unescaped mbox separator from next msg in file,
-                       save it to temp file and stop */
-                    fprintf(tempfp, "%s", linebuf);
-                    break;
-                } else {
-                    /* write into msg buffer */
-                    if ((cnt + len) < msgbufsize) {
-                        strncat(msgbuffer, linebuf, msgbufsize - cnt - 1);
-                        cnt += len;
-                    }
-                }
-                /* write into temp file */
-                fprintf(tempfp, "%s", linebuf);
-            }
-        } while (p);
-        /* remove empty line added when stored to mbox file */
-        if (msgbuffer[cnt - 1] == '\n' && msgbuffer[cnt - 2] == '\n')
-            msgbuffer[cnt - 2] = '\0';
-    }
-    /* now copy the rest of the mbox file into the temp file */
-    p = fgets(linebuf, sizeof(linebuf), mboxfp);
-    while (p) {
-        /* write into temp file */
-        fprintf(tempfp, "%s", linebuf);
-        p = fgets(linebuf, sizeof(linebuf), mboxfp);
+        funlockfile(mboxfp);
+        fclose(mboxfp);
     }
-    funlockfile(mboxfp);
-    fclose(mboxfp);
-    unlink(fpath);
-    fclose(tempfp);
-    rename(tempfn, fpath);
+    /* set 'F' flag */
+    if (found)
+        mbox_mark(fn, hdr, 'F', 1);
+    mbox_end_read(idx);
     return found;
 }
 
 int mbox_send_msg(char *msgbuffer, size_t msgbufsize,
                 char *to_call, size_t to_call_size, const char *fn, const char *hdr)
 {
-    FILE *mboxfp, *tempfp;
+    FILE *mboxfp;
+    MBOX_IDX *idx;
+    MBOX_IDX_ENTRY e;
     size_t len, cnt = 0;
-    int fd, found = 0;
-    char *p, *s, *e, linebuf[MAX_MSG_LINE_SIZE];
-    char fpath[MAX_PATH_SIZE*2], tempfn[MAX_PATH_SIZE*2];
+    char *p, *s, *t, linebuf[MAX_MSG_LINE_SIZE];
 
-    snprintf(fpath, sizeof(fpath), "%s/%s", mbox_dir_path, fn);
-    mboxfp = fopen(fpath, "r");
-    if (mboxfp == NULL)
+    memset(to_call, 0, to_call_size);
+    memset(msgbuffer, 0, msgbufsize);
+    idx = mbox_begin_read(fn);
+    if (idx == NULL)
         return 0;
-    snprintf(tempfn, sizeof(tempfn), "%s/temp.mbox.XXXXXX", mbox_dir_path);
-    fd = mkstemp(tempfn);
-    if (fd == -1) {
-        fclose(mboxfp);
+    mboxfp = mbox_snap_msg(fn, idx, hdr, &e);
+    if (mboxfp == NULL) {
+        mbox_end_read(idx);
         return 0;
     }
-    tempfp = fdopen(fd, "r+");
-    if (tempfp == NULL) {
-        close(fd);
+    flockfile(mboxfp);
+    p = mbox_read_hdr(mboxfp, &e, linebuf, sizeof(linebuf));
+    if (p == NULL) {
+        /* index out of step with file, leave mailbox alone */
+        funlockfile(mboxfp);
         fclose(mboxfp);
+        mbox_end_read(idx);
         return 0;
     }
-    flockfile(mboxfp);
-    memset(to_call, 0, to_call_size);
-    memset(msgbuffer, 0, msgbufsize);
-    /* find matching message separator in file */
-    p = fgets(linebuf, sizeof(linebuf), mboxfp);
-    while (p && strncmp(linebuf, hdr, strlen(hdr))) {
-        /* write into temp file */
-        fprintf(tempfp, "%s", linebuf);
-        p = fgets(linebuf, sizeof(linebuf), mboxfp);
-    }
+    /* got it, read message, discarding To: and From: header lines */
+    p = fgets(linebuf, sizeof(linebuf), mboxfp); /* From: */
+    p = fgets(linebuf, sizeof(linebuf), mboxfp); /* To: header, extract call sign  */
     if (p) {
-        /* got it, read message, discarding To: and From: header lines */
-        found = 1;
-        p = fgets(linebuf, sizeof(linebuf), mboxfp); /* From: */
-        p = fgets(linebuf, sizeof(linebuf), mboxfp); /* To: header, extract call sign  */
         s = p + 3;
         while (*s == ' ')
             ++s;
-        e = s;
-        while (*e && *e != ' ' && *e != '\n')
-            ++e;
-        *e = '\0';
+        t = s;
+        while (*t && *t != ' ' && *t != '\n')
+            ++t;
+        *t = '\0';
         snprintf(to_call, to_call_size, "%s", s);
-        p = fgets(linebuf, sizeof(linebuf), mboxfp); /* may be empty line terminating headers
-                                                        or possibly a Received: header */
-        if (p && *p != '\n') {
-            /* not the empty line terminating headers, so write into msg buffer */
-            len = strlen(linebuf);
-            if ((cnt + len) < msgbufsize) {
-                strncat(msgbuffer, linebuf, msgbufsize - cnt - 1);
-                cnt += len;
-            }
+    }
+    p = fgets(linebuf, sizeof(linebuf), mboxfp); /* may be empty line terminating headers
+                                                    or possibly a Received: header */
+    if (p && *p != '\n') {
+        /* not the empty line terminating headers, so write into msg buffer */
+        len = strlen(linebuf);
+        if ((cnt + len) < msgbufsize) {
+            strncat(msgbuffer, linebuf, msgbufsize - cnt - 1);
+            cnt += len;
         }
-        /* now copy body of message into msg buffer but not into temp file */
-        do {
-            p = fgets(linebuf, sizeof(linebuf), mboxfp);
-            if (p) {
-                len = strlen(linebuf);
-                /* check for 'From ' char sequence escaped with '>' char(s) */
-                while (*p && *p == '>')
-                    ++p;
-                if (p > linebuf && !strncmp(p, "From ", 5)) {
-                    /* found one, unescape line by removing first '>' char */
-                    if ((cnt + len - 1) < msgbufsize) {
-                        strncat(msgbuffer, &linebuf[1], msgbufsize - cnt - 1);
-                        cnt += len - 1;
-                    }
-                } else if (p && !strncmp(p, "From ", 5)) {
-                    /* unescaped mbox separator from next msg in file,
-                       save it to temp file and stop */
-                    fprintf(tempfp, "%s", linebuf);
-                    break;
-                } else {
-                    /* write into msg buffer */
-                    if ((cnt + len) < msgbufsize) {
-                        strncat(msgbuffer, linebuf, msgbufsize - cnt - 1);
-                        cnt += len;
-                    }
-                }
-            }
-        } while (p);
-        /* remove empty line added when stored to mbox file */
-        if (msgbuffer[cnt - 1] == '\n' && msgbuffer[cnt - 2] == '\n')
-            msgbuffer[cnt - 2] = '\0';
     }
-    /* now copy the rest of the mbox file into the temp file */
-    p = fgets(linebuf, sizeof(linebuf), mboxfp);
-    while (p) {
-        /* write into temp file */
-        fprintf(tempfp, "%s", linebuf);
+    /* now copy body of message into msg buffer */
+    while (p && ftell(mboxfp) < e.offset + e.length) {
         p = fgets(linebuf, sizeof(linebuf), mboxfp);
+        if (p) {
+            len = strlen(linebuf);
+            /* check for 'From ' char sequence escaped with '>' char(s) */
+            while (*p && *p == '>')
+                ++p;
+            if (p > linebuf && !strncmp(p, "From ", 5)) {
+                /* found one, unescape line by removing first '>' char */
+                if ((cnt + len - 1) < msgbufsize) {
+                    strncat(msgbuffer, &linebuf[1], msgbufsize - cnt - 1);
+                    cnt += len - 1;
+                }
+            } else {
+                /* write into msg buffer */
+                if ((cnt + len) < msgbufsize) {
+                    strncat(msgbuffer, linebuf, msgbufsize - cnt - 1);
+                    cnt += len;
+                }
+            }
+        }
     }
+    /* remove empty line added when stored to mbox file */
+    if (cnt > 1 && msgbuffer[cnt - 1] == '\n' && msgbuffer[cnt - 2] == '\n')
+        msgbuffer[cnt - 2] = '\0';
     funlockfile(mboxfp);
     fclose(mboxfp);
-    unlink(fpath);
-    fclose(tempfp);
-    rename(tempfn, fpath);
-    return found;
+    /* message leaves the outbox, mark it deleted */
+    mbox_mark(fn, hdr, MBOX_IDX_DEAD_FLAG, 1);
+    mbox_end_read(idx);
+    return 1;
 }
 
 int mbox_init()
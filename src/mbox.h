@@ -30,6 +30,7 @@ extern int mbox_init(void);
 extern char *mbox_add_msg(const char *fn, const char *fm_call, const char *to_call,
                               int check, const char *msg, int trace);
 extern int mbox_delete_msg(const char *fn, const char *hdr);
+extern int mbox_delete_msgs(const char *fn, char headers[][MAX_MBOX_HDR_SIZE], int num_hdrs);
 extern int mbox_save_msg(const char *fn, const char *hdr, const char *savefn);
 extern int mbox_set_flag(const char *fn, const char *hdr, int flag);
 extern int mbox_clear_flag(const char *fn, const char *hdr, int flag);
@@ -43,9 +44,13 @@ extern int mbox_get_msg_list(char *msgbuffer, size_t msgbufsize,
                                  const char *fn, const char *to_call);
 extern int mbox_get_headers_to(char headers[][MAX_MBOX_HDR_SIZE],
                         int max_hdrs, const char *fn, const char *to_call);
+extern int mbox_get_headers(char headers[][MAX_MBOX_HDR_SIZE], int max_hdrs, const char *fn);
 extern int mbox_get_msg(char *msgbuffer, size_t msgbufsize,
                             const char *fn, const char *hdr, int canonical_eol);
+extern int mbox_get_msgs_to(char headers[][MAX_MBOX_HDR_SIZE], char *msgbuffers,
+                size_t msgbufsize, int max_msgs, const char *fn, const char *to_call);
 extern int mbox_purge(const char *fn, int days);
+extern int mbox_compact(const char *fn, int days, int pct);
 extern char mbox_dir_path[];
 
 #endif
@@ -0,0 +1,613 @@
+/***********************************************************************
+
+    ARIM Amateur Radio Instant Messaging program for the ARDOP TNC.
+
+    Copyright (C) 2016-2021 Robert Cunnings NW8L
+
+    This file is part of the ARIM messaging program.
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+*************************************************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <string.h>
+#include <ctype.h>
+#include <sys/stat.h>
+#include "main.h"
+#include "ini.h"
+#include "bufq.h"
+#include "mbox.h"
+#include "mbox_idx.h"
+
+/*
+    Sidecar index for mbox files. Each mailbox has a companion file
+    <mbox>.idx holding the offset, length, timestamp and separator line
+    of every message, so messages can be found by separator through a
+    hash table rather than by reading the whole mailbox. Deleted messages
+    stay in the file, marked by a 'D' in the separator's flags field, and
+    are skipped by lookups until the mailbox is compacted. The index is
+    loaded on first use and brought up to date from the last indexed
+    offset whenever the mailbox has grown; if the mailbox was replaced
+    or truncated behind our back it is rebuilt from scratch. All
+    functions must be called with mutex_mbox held.
+*/
+
+#define MBOX_IDX_MAX_FILES      8
+#define MBOX_IDX_MIN_CAP        256
+#define MBOX_IDX_MAGIC          "ARIMIDX"
+#define MBOX_IDX_VERSION        1
+
+typedef struct mbox_idx_file_hdr {
+    char magic[8];
+    unsigned int version;
+    unsigned int rec_size;
+    long long indexed_to;
+    long long dev;
+    long long ino;
+    long long count;
+} MBOX_IDX_FILE_HDR;
+
+typedef struct mbox_idx_file_rec {
+    long long offset;
+    long long length;
+    long long timestamp;
+    char hdr[MAX_MBOX_HDR_SIZE];
+} MBOX_IDX_FILE_REC;
+
+static MBOX_IDX mbox_idx_tbl[MBOX_IDX_MAX_FILES];
+
+static const char *mbox_idx_months[] = {
+    "Jan", "Feb", "Mar", "Apr", "May", "Jun",
+    "Jul", "Aug", "Sep", "Oct", "Nov", "Dec",
+};
+
+time_t mbox_idx_make_time(int year, int mon, int day, int hour, int min, int sec)
+{
+    unsigned int yoe, doy, doe;
+    long days;
+    int era;
+
+    /* days since the epoch for the civil date, mon is 0-11 */
+    if (mon < 2)
+        --year;
+    era = (year >= 0 ? year : year - 399) / 400;
+    yoe = (unsigned int)(year - era * 400);
+    doy = (153 * (mon + (mon > 1 ? -2 : 10)) + 2) / 5 + day - 1;
+    doe = yoe * 365 + yoe / 4 - yoe / 100 + doy;
+    days = (long)era * 146097 + (long)doe - 719468;
+    return (time_t)days * 86400 + hour * 3600 + min * 60 + sec;
+}
+
+time_t mbox_idx_parse_time(const char *date)
+{
+    int i, mon, day, hour, min, sec, year;
+
+    /* fixed format separator date, e.g. "Tue Mar 19 14:57:28 2019",
+       taken as UTC whatever the local/UTC time setting was when it was
+       written, so only differences between two such times are meaningful */
+    if (strlen(date) < 24 || date[3] != ' ' || date[7] != ' ' ||
+        date[10] != ' ' || date[13] != ':' || date[16] != ':' || date[19] != ' ')
+        return -1;
+    for (mon = 0; mon < 12; mon++) {
+        if (!strncmp(&date[4], mbox_idx_months[mon], 3))
+            break;
+    }
+    if (mon == 12)
+        return -1;
+    for (i = 8; i < 24; i++) {
+        if (i == 10 || i == 13 || i == 16 || i == 19)
+            continue;
+        if (!isdigit((int)date[i]) && !(i == 8 && date[i] == ' '))
+            return -1;
+    }
+    day = (date[8] == ' ' ? 0 : (date[8] - '0') * 10) + (date[9] - '0');
+    hour = (date[11] - '0') * 10 + (date[12] - '0');
+    min = (date[14] - '0') * 10 + (date[15] - '0');
+    sec = (date[17] - '0') * 10 + (date[18] - '0');
+    year = atoi(&date[20]);
+    return mbox_idx_make_time(year, mon, day, hour, min, sec);
+}
+
+static unsigned int mbox_idx_hash(const char *s, size_t len)
+{
+    unsigned int h = 2166136261U;
+    size_t i;
+
+    for (i = 0; i < len; i++) {
+        h ^= (unsigned char)s[i];
+        h *= 16777619U;
+    }
+    return h;
+}
+
+static size_t mbox_idx_key_len(const char *hdr, size_t len)
+{
+    size_t i;
+
+    /* the message key is the separator without its trailing flags field */
+    if (len < 5 || hdr[len - 5] != ' ')
+        return len;
+    for (i = len - 4; i < len; i++) {
+        if (!strchr("-RFSD", hdr[i]))
+            return len;
+    }
+    return len - 5;
+}
+
+static void mbox_idx_copy_token(char *dst, size_t dstsize, const char *src)
+{
+    size_t i = 0;
+
+    while (*src && *src != ' ' && i < dstsize - 1)
+        dst[i++] = toupper((int)*src++);
+    dst[i] = '\0';
+}
+
+static void mbox_idx_parse(MBOX_IDX_ENTRY *e, const char *line)
+{
+    const char *p;
+    size_t len;
+
+    snprintf(e->hdr, sizeof(e->hdr), "%s", line);
+    len = strlen(e->hdr);
+    while (len && (e->hdr[len - 1] == '\n' || e->hdr[len - 1] == '\r'))
+        e->hdr[--len] = '\0';
+    e->key_len = mbox_idx_key_len(e->hdr, len);
+    if (e->key_len < len)
+        memcpy(e->flags, &e->hdr[len - 3], 3);
+    else
+        memcpy(e->flags, "---", 3);
+    e->flags[3] = '\0';
+    e->dead = (e->key_len < len && e->hdr[len - 4] == MBOX_IDX_DEAD_FLAG);
+    e->hash = mbox_idx_hash(e->hdr, e->key_len);
+    /* From <call> <date> To <call> <size> <check> <flags> */
+    p = e->hdr + 5;
+    mbox_idx_copy_token(e->fm_call, sizeof(e->fm_call), p);
+    while (*p && *p != ' ')
+        ++p;
+    while (*p == ' ')
+        ++p;
+    e->timestamp = mbox_idx_parse_time(p);
+    p = strstr(p, " To ");
+    if (p) {
+        p += 4;
+        while (*p == ' ')
+            ++p;
+        mbox_idx_copy_token(e->to_call, sizeof(e->to_call), p);
+    } else {
+        e->to_call[0] = '\0';
+    }
+}
+
+static void mbox_idx_rehash(MBOX_IDX *idx)
+{
+    int i, n, *b;
+
+    n = idx->nbuckets ? idx->nbuckets : MBOX_IDX_MIN_CAP;
+    while (n < idx->cnt + idx->cnt / 3)
+        n *= 2;
+    if (n != idx->nbuckets) {
+        b = realloc(idx->buckets, n * sizeof(int));
+        if (!b)
+            return; /* keep old table, chains just get longer */
+        idx->buckets = b;
+        idx->nbuckets = n;
+    }
+    for (i = 0; i < idx->nbuckets; i++)
+        idx->buckets[i] = -1;
+    for (i = 0; i < idx->cnt; i++) {
+        n = idx->entries[i].hash & (idx->nbuckets - 1);
+        idx->entries[i].next = idx->buckets[n];
+        idx->buckets[n] = i;
+    }
+}
+
+static MBOX_IDX_ENTRY *mbox_idx_add(MBOX_IDX *idx, long offset, const char *line)
+{
+    MBOX_IDX_ENTRY *e;
+    int n;
+
+    if (idx->cnt == idx->cap) {
+        n = idx->cap ? idx->cap * 2 : MBOX_IDX_MIN_CAP;
+        e = realloc(idx->entries, n * sizeof(MBOX_IDX_ENTRY));
+        if (!e)
+            return NULL;
+        idx->entries = e;
+        idx->cap = n;
+    }
+    e = &idx->entries[idx->cnt++];
+    e->offset = offset;
+    e->length = 0;
+    mbox_idx_parse(e, line);
+    if (!idx->nbuckets || idx->cnt + idx->cnt / 3 > idx->nbuckets) {
+        mbox_idx_rehash(idx);
+    } else {
+        n = e->hash & (idx->nbuckets - 1);
+        e->next = idx->buckets[n];
+        idx->buckets[n] = idx->cnt - 1;
+    }
+    return e;
+}
+
+static void mbox_idx_count_dead(MBOX_IDX *idx)
+{
+    int i;
+
+    idx->dead_bytes = 0;
+    for (i = 0; i < idx->cnt; i++) {
+        if (idx->entries[i].dead)
+            idx->dead_bytes += idx->entries[i].length;
+    }
+}
+
+static void mbox_idx_reset(MBOX_IDX *idx)
+{
+    idx->cnt = 0;
+    idx->indexed_to = 0;
+    idx->dead_bytes = 0;
+    if (idx->nbuckets)
+        mbox_idx_rehash(idx);
+}
+
+static void mbox_idx_path(MBOX_IDX *idx, char *path, size_t size, int sidecar)
+{
+    snprintf(path, size, "%s/%s%s", mbox_dir_path, idx->fn, sidecar ? ".idx" : "");
+}
+
+static int mbox_idx_write_recs(MBOX_IDX *idx, FILE *fp, int first)
+{
+    MBOX_IDX_FILE_HDR fh;
+    MBOX_IDX_FILE_REC rec;
+    int i;
+
+    if (fseek(fp, sizeof(fh) + (long)first * sizeof(rec), SEEK_SET))
+        return 0;
+    for (i = first; i < idx->cnt; i++) {
+        memset(&rec, 0, sizeof(rec));
+        rec.offset = idx->entries[i].offset;
+        rec.length = idx->entries[i].length;
+        rec.timestamp = idx->entries[i].timestamp;
+        snprintf(rec.hdr, sizeof(rec.hdr), "%s", idx->entries[i].hdr);
+        if (fwrite(&rec, sizeof(rec), 1, fp) != 1)
+            return 0;
+    }
+    /* header goes last, so a partial update is ignored by the next load */
+    memset(&fh, 0, sizeof(fh));
+    memcpy(fh.magic, MBOX_IDX_MAGIC, sizeof(MBOX_IDX_MAGIC));
+    fh.version = MBOX_IDX_VERSION;
+    fh.rec_size = sizeof(rec);
+    fh.indexed_to = idx->indexed_to;
+    fh.dev = idx->dev;
+    fh.ino = idx->ino;
+    fh.count = idx->cnt;
+    if (fflush(fp) || fseek(fp, 0, SEEK_SET) || fwrite(&fh, sizeof(fh), 1, fp) != 1)
+        return 0;
+    return fflush(fp) == 0;
+}
+
+static void mbox_idx_save(MBOX_IDX *idx, int first)
+{
+    FILE *fp;
+    char path[MAX_PATH_SIZE*2], tempfn[MAX_PATH_SIZE*2];
+    int fd, ok;
+
+    mbox_idx_path(idx, path, sizeof(path), 1);
+    if (first > 0) {
+        /* appended records, update sidecar in place */
+        fp = fopen(path, "r+");
+        if (fp) {
+            ok = mbox_idx_write_recs(idx, fp, first);
+            fclose(fp);
+            if (ok)
+                return;
+        }
+    }
+    /* write whole sidecar to temp file and move it into place */
+    snprintf(tempfn, sizeof(tempfn), "%s/temp.idx.XXXXXX", mbox_dir_path);
+    fd = mkstemp(tempfn);
+    if (fd == -1)
+        return;
+    fp = fdopen(fd, "w");
+    if (fp == NULL) {
+        close(fd);
+        unlink(tempfn);
+        return;
+    }
+    ok = mbox_idx_write_recs(idx, fp, 0);
+    fclose(fp);
+    if (!ok || rename(tempfn, path)) {
+        unlink(tempfn);
+        bufq_queue_debug_log("MBOX: failed to write index file");
+    }
+}
+
+static void mbox_idx_save_rec(MBOX_IDX *idx, int i)
+{
+    FILE *fp;
+    MBOX_IDX_FILE_REC rec;
+    char path[MAX_PATH_SIZE*2];
+
+    /* record changed in place, e.g. flags, header needs no update */
+    mbox_idx_path(idx, path, sizeof(path), 1);
+    fp = fopen(path, "r+");
+    if (fp == NULL) {
+        mbox_idx_save(idx, 0);
+        return;
+    }
+    memset(&rec, 0, sizeof(rec));
+    rec.offset = idx->entries[i].offset;
+    rec.length = idx->entries[i].length;
+    rec.timestamp = idx->entries[i].timestamp;
+    snprintf(rec.hdr, sizeof(rec.hdr), "%s", idx->entries[i].hdr);
+    if (fseek(fp, sizeof(MBOX_IDX_FILE_HDR) + (long)i * sizeof(rec), SEEK_SET) ||
+        fwrite(&rec, sizeof(rec), 1, fp) != 1) {
+        fclose(fp);
+        mbox_idx_save(idx, 0);
+        return;
+    }
+    fclose(fp);
+}
+
+static int mbox_idx_load(MBOX_IDX *idx, FILE *mboxfp, struct stat *st)
+{
+    FILE *fp;
+    MBOX_IDX_FILE_HDR fh;
+    MBOX_IDX_FILE_REC rec;
+    MBOX_IDX_ENTRY *e;
+    char path[MAX_PATH_SIZE*2], linebuf[MAX_MBOX_HDR_SIZE+1];
+    long long i, next = -1;
+
+    mbox_idx_reset(idx);
+    mbox_idx_path(idx, path, sizeof(path), 1);
+    fp = fopen(path, "r");
+    if (fp == NULL)
+        return 0;
+    if (fread(&fh, sizeof(fh), 1, fp) != 1 ||
+        memcmp(fh.magic, MBOX_IDX_MAGIC, sizeof(MBOX_IDX_MAGIC)) ||
+        fh.version != MBOX_IDX_VERSION || fh.rec_size != sizeof(rec) ||
+        fh.dev != (long long)st->st_dev || fh.ino != (long long)st->st_ino ||
+        fh.indexed_to > (long long)st->st_size || fh.count < 0) {
+        fclose(fp);
+        return 0;
+    }
+    for (i = 0; i < fh.count; i++) {
+        if (fread(&rec, sizeof(rec), 1, fp) != 1 ||
+            (next != -1 && rec.offset != next) || rec.length <= 0)
+            break;
+        rec.hdr[sizeof(rec.hdr) - 1] = '\0';
+        e = mbox_idx_add(idx, (long)rec.offset, rec.hdr);
+        if (!e)
+            break;
+        e->length = (long)rec.length;
+        e->timestamp = (time_t)rec.timestamp;
+        next = rec.offset + rec.length;
+    }
+    fclose(fp);
+    if (i < fh.count || (next != -1 && next != fh.indexed_to)) {
+        mbox_idx_reset(idx);
+        return 0;
+    }
+    /* spot check: last indexed separator must still be where it was */
+    if (idx->cnt) {
+        e = &idx->entries[idx->cnt - 1];
+        if (fseek(mboxfp, e->offset, SEEK_SET) ||
+            !fgets(linebuf, sizeof(linebuf), mboxfp) ||
+            strncmp(linebuf, e->hdr, strlen(e->hdr))) {
+            mbox_idx_reset(idx);
+            return 0;
+        }
+    }
+    idx->indexed_to = (long)fh.indexed_to;
+    mbox_idx_count_dead(idx);
+    return 1;
+}
+
+static int mbox_idx_scan(MBOX_IDX *idx, FILE *mboxfp)
+{
+    char linebuf[MAX_MSG_LINE_SIZE];
+    long pos;
+    size_t len;
+    int bol = 1, first;
+
+    /* index separators found past the indexed part of the file,
+       returns number of the first record changed */
+    first = idx->cnt ? idx->cnt - 1 : 0;
+    pos = idx->indexed_to;
+    if (fseek(mboxfp, pos, SEEK_SET))
+        return -1;
+    while (fgets(linebuf, sizeof(linebuf), mboxfp)) {
+        len = strlen(linebuf);
+        if (bol && !strncmp(linebuf, "From ", 5)) {
+            if (idx->cnt)
+                idx->entries[idx->cnt - 1].length = pos - idx->entries[idx->cnt - 1].offset;
+            if (!mbox_idx_add(idx, pos, linebuf))
+                return -1;
+        }
+        bol = (len && linebuf[len - 1] == '\n');
+        pos += len;
+    }
+    if (idx->cnt)
+        idx->entries[idx->cnt - 1].length = pos - idx->entries[idx->cnt - 1].offset;
+    idx->indexed_to = pos;
+    mbox_idx_count_dead(idx);
+    return first;
+}
+
+static int mbox_idx_sync(MBOX_IDX *idx)
+{
+    FILE *mboxfp;
+    struct stat st;
+    char path[MAX_PATH_SIZE*2];
+    int first, reloaded = 0;
+
+    mbox_idx_path(idx, path, sizeof(path), 0);
+    mboxfp = fopen(path, "r");
+    if (mboxfp == NULL)
+        return 0;
+    if (fstat(fileno(mboxfp), &st)) {
+        fclose(mboxfp);
+        return 0;
+    }
+    if (!idx->ino || idx->dev != st.st_dev || idx->ino != st.st_ino ||
+        idx->indexed_to > st.st_size) {
+        /* first use, or mailbox replaced: load sidecar or start over */
+        reloaded = !mbox_idx_load(idx, mboxfp, &st);
+        ++idx->gen;
+        idx->dev = st.st_dev;
+        idx->ino = st.st_ino;
+    }
+    if (idx->indexed_to < st.st_size) {
+        first = mbox_idx_scan(idx, mboxfp);
+        if (first == -1) {
+            fclose(mboxfp);
+            mbox_idx_reset(idx);
+            idx->ino = 0;
+            ++idx->gen;
+            bufq_queue_debug_log("MBOX: failed to index mailbox file");
+            return 0;
+        }
+        mbox_idx_save(idx, reloaded ? 0 : first);
+    } else if (reloaded) {
+        mbox_idx_save(idx, 0);
+    }
+    fclose(mboxfp);
+    return 1;
+}
+
+MBOX_IDX *mbox_idx_open(const char *fn)
+{
+    MBOX_IDX *idx = NULL;
+    int i;
+
+    for (i = 0; i < MBOX_IDX_MAX_FILES; i++) {
+        if (!strcmp(mbox_idx_tbl[i].fn, fn)) {
+            idx = &mbox_idx_tbl[i];
+            break;
+        }
+        if (!idx && !mbox_idx_tbl[i].fn[0])
+            idx = &mbox_idx_tbl[i];
+    }
+    if (!idx || strlen(fn) >= sizeof(idx->fn))
+        return NULL;
+    if (!idx->fn[0]) {
+        snprintf(idx->fn, sizeof(idx->fn), "%s", fn);
+        pthread_rwlock_init(&idx->lock, NULL);
+    }
+    if (!mbox_idx_sync(idx))
+        return NULL;
+    return idx;
+}
+
+MBOX_IDX_ENTRY *mbox_idx_find(MBOX_IDX *idx, const char *hdr)
+{
+    char key[MAX_MBOX_HDR_SIZE];
+    unsigned int h;
+    size_t len, klen;
+    int i, best = -1;
+
+    snprintf(key, sizeof(key), "%s", hdr);
+    len = strlen(key);
+    while (len && (key[len - 1] == '\n' || key[len - 1] == '\r'))
+        key[--len] = '\0';
+    if (!len || !idx->nbuckets)
+        return NULL;
+    /* messages are matched on separator sans flags, so a stale copy of
+       the separator still finds its message after a flag change */
+    klen = mbox_idx_key_len(key, len);
+    h = mbox_idx_hash(key, klen);
+    for (i = idx->buckets[h & (idx->nbuckets - 1)]; i != -1; i = idx->entries[i].next) {
+        if (idx->entries[i].hash == h && idx->entries[i].key_len == klen &&
+            !idx->entries[i].dead && !strncmp(idx->entries[i].hdr, key, klen) &&
+            (best == -1 || i < best))
+            best = i;
+    }
+    if (best == -1 && klen == len) {
+        /* not a whole separator, fall back to prefix match */
+        for (i = 0; i < idx->cnt; i++) {
+            if (!idx->entries[i].dead && !strncmp(idx->entries[i].hdr, key, len)) {
+                best = i;
+                break;
+            }
+        }
+    }
+    return best == -1 ? NULL : &idx->entries[best];
+}
+
+void mbox_idx_set_hdr(MBOX_IDX *idx, MBOX_IDX_ENTRY *e, const char *hdr)
+{
+    unsigned int h = e->hash;
+    size_t klen = e->key_len;
+    time_t t = e->timestamp;
+    int dead = e->dead;
+
+    /* separator rewritten in place with same length, e.g. flags changed */
+    mbox_idx_parse(e, hdr);
+    if (e->timestamp == -1)
+        e->timestamp = t;
+    if (e->dead != dead)
+        idx->dead_bytes += e->dead ? e->length : -e->length;
+    if (e->hash != h || e->key_len != klen)
+        mbox_idx_rehash(idx);
+    mbox_idx_save_rec(idx, e - idx->entries);
+}
+
+void mbox_idx_drop(MBOX_IDX *idx, const char *drop, int num)
+{
+    MBOX_IDX_ENTRY *e;
+    int i, n = 0;
+    long cut = 0;
+
+    /* messages flagged in drop[0..num) cut out of mailbox,
+       later records move down */
+    for (i = 0; i < idx->cnt; i++) {
+        e = &idx->entries[i];
+        if (i < num && drop[i]) {
+            cut += e->length;
+            continue;
+        }
+        e->offset -= cut;
+        if (n != i)
+            idx->entries[n] = *e;
+        ++n;
+    }
+    idx->cnt = n;
+    idx->indexed_to -= cut;
+    mbox_idx_count_dead(idx);
+    mbox_idx_rehash(idx);
+}
+
+int mbox_idx_rewritten(MBOX_IDX *idx)
+{
+    struct stat st;
+    char path[MAX_PATH_SIZE*2];
+
+    /* mailbox replaced by a rewritten copy whose layout the caller has
+       already applied to the index; adopt the new file and persist */
+    ++idx->gen;
+    mbox_idx_path(idx, path, sizeof(path), 0);
+    if (stat(path, &st) || st.st_size != idx->indexed_to) {
+        /* layout doesn't match, rebuild on next use */
+        mbox_idx_reset(idx);
+        idx->ino = 0;
+        return 0;
+    }
+    idx->dev = st.st_dev;
+    idx->ino = st.st_ino;
+    mbox_idx_save(idx, 0);
+    return 1;
+}
+
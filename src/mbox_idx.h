@@ -0,0 +1,76 @@
+/***********************************************************************
+
+    ARIM Amateur Radio Instant Messaging program for the ARDOP TNC.
+
+    Copyright (C) 2016-2021 Robert Cunnings NW8L
+
+    This file is part of the ARIM messaging program.
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+*************************************************************************/
+
+#ifndef _MBOX_IDX_H_INCLUDED_
+#define _MBOX_IDX_H_INCLUDED_
+
+#include <sys/types.h>
+#include <time.h>
+#include <pthread.h>
+#include "main.h"
+#include "ini.h"
+
+#define MBOX_IDX_FNAME_SIZE     32
+#define MBOX_IDX_FLAGS_SIZE     4
+#define MBOX_IDX_DEAD_FLAG      'D'
+
+typedef struct mbox_idx_entry {
+    long offset;                      /* of separator line in mbox file */
+    long length;                      /* of whole record, separator included */
+    time_t timestamp;                 /* separator date in seconds, read as UTC */
+    char hdr[MAX_MBOX_HDR_SIZE];      /* separator line sans EOL */
+    char fm_call[TNC_MYCALL_SIZE];
+    char to_call[TNC_MYCALL_SIZE];
+    char flags[MBOX_IDX_FLAGS_SIZE];  /* R, F and S status flags or '-' */
+    size_t key_len;                   /* length of hdr sans flags field */
+    int dead;                         /* deleted, awaiting compaction */
+    unsigned int hash;
+    int next;                         /* hash chain */
+} MBOX_IDX_ENTRY;
+
+typedef struct mbox_idx {
+    char fn[MBOX_IDX_FNAME_SIZE];
+    MBOX_IDX_ENTRY *entries;
+    int cnt, cap;
+    int *buckets;
+    int nbuckets;
+    long indexed_to;                  /* mbox file offset covered by index */
+    long dead_bytes;                  /* held by deleted messages */
+    int busy;                         /* being compacted */
+    unsigned long gen;                /* bumped when file layout changes */
+    pthread_rwlock_t lock;            /* held shared by snapshot readers,
+                                         exclusive to swap in a rewrite */
+    dev_t dev;
+    ino_t ino;
+} MBOX_IDX;
+
+extern MBOX_IDX *mbox_idx_open(const char *fn);
+extern MBOX_IDX_ENTRY *mbox_idx_find(MBOX_IDX *idx, const char *hdr);
+extern void mbox_idx_set_hdr(MBOX_IDX *idx, MBOX_IDX_ENTRY *e, const char *hdr);
+extern void mbox_idx_drop(MBOX_IDX *idx, const char *drop, int num);
+extern int mbox_idx_rewritten(MBOX_IDX *idx);
+extern time_t mbox_idx_make_time(int year, int mon, int day, int hour, int min, int sec);
+extern time_t mbox_idx_parse_time(const char *date);
+
+#endif
+
@@ -0,0 +1,548 @@
+/***********************************************************************
+
+    ARIM Amateur Radio Instant Messaging program for the ARDOP TNC.
+
+    Copyright (C) 2016-2021 Robert Cunnings NW8L
+
+    This file is part of the ARIM messaging program.
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+*************************************************************************/
+
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+#include <time.h>
+#include <pthread.h>
+#include "main.h"
+#include "mbox.h"
+#include "mbox_idx.h"
+#include "mbox_search.h"
+
+/*
+    Inverted index for full text search of mailboxes. Each message is a
+    document numbered in mailbox order; every word in its body, and the
+    From and To calls from its separator, map to the list of documents
+    containing them. The index is built in memory on the first search of
+    a mailbox and then extended as messages are added, reading only the
+    new messages. Deleted messages are filtered out through the mailbox
+    index at query time; when a mailbox is rewritten by compaction the
+    search index is rebuilt on next use. Search indexes are guarded by
+    mutex_search, taken after the mailbox's read lock and before
+    mutex_mbox; mailbox text is read without holding mutex_mbox, so a
+    search never holds up storing a new message.
+*/
+
+#define MBOX_SEARCH_MAX_FILES   4
+#define MBOX_SEARCH_MIN_WORD    2
+#define MBOX_SEARCH_MAX_WORD    24
+#define MBOX_SEARCH_MIN_CAP     1024
+
+typedef struct mbox_search_term {
+    char *word;                       /* NULL if slot is free */
+    unsigned int hash;
+    int *docs;                        /* ascending document numbers */
+    int cnt, cap;
+} MBOX_SEARCH_TERM;
+
+typedef struct mbox_search_tbl {
+    char fn[MBOX_IDX_FNAME_SIZE];
+    long *docs;                       /* mbox file offset of each document */
+    int num_docs, cap_docs;
+    MBOX_SEARCH_TERM *terms;          /* open addressed hash table */
+    int num_terms, cap_terms;
+    long indexed_to;                  /* mbox file offset covered by index */
+    unsigned long gen;                /* of mailbox layout indexed */
+    int built;
+} MBOX_SEARCH_TBL;
+
+typedef struct mbox_search_msg {
+    long offset, length;
+    char fm_call[TNC_MYCALL_SIZE];
+    char to_call[TNC_MYCALL_SIZE];
+} MBOX_SEARCH_MSG;
+
+static MBOX_SEARCH_TBL mbox_search_tbl[MBOX_SEARCH_MAX_FILES];
+static pthread_mutex_t mutex_search = PTHREAD_MUTEX_INITIALIZER;
+
+static unsigned int mbox_search_hash(const char *s, size_t len)
+{
+    unsigned int h = 2166136261U;
+    size_t i;
+
+    for (i = 0; i < len; i++) {
+        h ^= (unsigned char)s[i];
+        h *= 16777619U;
+    }
+    return h;
+}
+
+static void mbox_search_reset(MBOX_SEARCH_TBL *tbl)
+{
+    int i;
+
+    for (i = 0; i < tbl->cap_terms; i++) {
+        free(tbl->terms[i].word);
+        free(tbl->terms[i].docs);
+    }
+    free(tbl->terms);
+    free(tbl->docs);
+    tbl->terms = NULL;
+    tbl->docs = NULL;
+    tbl->num_terms = tbl->cap_terms = 0;
+    tbl->num_docs = tbl->cap_docs = 0;
+    tbl->indexed_to = 0;
+    tbl->built = 0;
+}
+
+static int mbox_search_grow(MBOX_SEARCH_TBL *tbl)
+{
+    MBOX_SEARCH_TERM *terms, *t;
+    int i, j, cap;
+
+    /* double the hash table, keeping load under one half */
+    cap = tbl->cap_terms ? tbl->cap_terms * 2 : MBOX_SEARCH_MIN_CAP;
+    terms = calloc(cap, sizeof(MBOX_SEARCH_TERM));
+    if (terms == NULL)
+        return 0;
+    for (i = 0; i < tbl->cap_terms; i++) {
+        t = &tbl->terms[i];
+        if (!t->word)
+            continue;
+        j = t->hash & (cap - 1);
+        while (terms[j].word)
+            j = (j + 1) & (cap - 1);
+        terms[j] = *t;
+    }
+    free(tbl->terms);
+    tbl->terms = terms;
+    tbl->cap_terms = cap;
+    return 1;
+}
+
+static MBOX_SEARCH_TERM *mbox_search_lookup(MBOX_SEARCH_TBL *tbl,
+                                                const char *word, size_t len, int create)
+{
+    MBOX_SEARCH_TERM *t;
+    unsigned int h;
+    int i;
+
+    if (!tbl->cap_terms && (!create || !mbox_search_grow(tbl)))
+        return NULL;
+    h = mbox_search_hash(word, len);
+    i = h & (tbl->cap_terms - 1);
+    while (tbl->terms[i].word) {
+        t = &tbl->terms[i];
+        if (t->hash == h && !strncmp(t->word, word, len) && t->word[len] == '\0')
+            return t;
+        i = (i + 1) & (tbl->cap_terms - 1);
+    }
+    if (!create)
+        return NULL;
+    if ((tbl->num_terms + 1) * 2 > tbl->cap_terms) {
+        if (!mbox_search_grow(tbl))
+            return NULL;
+        return mbox_search_lookup(tbl, word, len, create);
+    }
+    t = &tbl->terms[i];
+    t->word = malloc(len + 1);
+    if (t->word == NULL)
+        return NULL;
+    memcpy(t->word, word, len);
+    t->word[len] = '\0';
+    t->hash = h;
+    ++tbl->num_terms;
+    return t;
+}
+
+static void mbox_search_add_word(MBOX_SEARCH_TBL *tbl, const char *word, size_t len)
+{
+    MBOX_SEARCH_TERM *t;
+    int *docs, doc = tbl->num_docs - 1;
+
+    t = mbox_search_lookup(tbl, word, len, 1);
+    if (t == NULL || (t->cnt && t->docs[t->cnt - 1] == doc))
+        return; /* out of memory or already listed for this message */
+    if (t->cnt == t->cap) {
+        docs = realloc(t->docs, (t->cap ? t->cap * 2 : 4) * sizeof(int));
+        if (docs == NULL)
+            return;
+        t->docs = docs;
+        t->cap = t->cap ? t->cap * 2 : 4;
+    }
+    t->docs[t->cnt++] = doc;
+}
+
+static void mbox_search_add_text(MBOX_SEARCH_TBL *tbl, const char *text,
+                                     size_t size, const char *prefix)
+{
+    char word[MBOX_SEARCH_MAX_WORD + 8];
+    size_t i, n, plen = strlen(prefix);
+
+    /* words are runs of letters and digits, folded to lower case */
+    memcpy(word, prefix, plen);
+    i = 0;
+    while (i < size) {
+        while (i < size && !isalnum((unsigned char)text[i]))
+            ++i;
+        n = 0;
+        while (i < size && isalnum((unsigned char)text[i])) {
+            if (n < MBOX_SEARCH_MAX_WORD)
+                word[plen + n] = tolower((unsigned char)text[i]);
+            ++n;
+            ++i;
+        }
+        if (n >= MBOX_SEARCH_MIN_WORD && n <= MBOX_SEARCH_MAX_WORD)
+            mbox_search_add_word(tbl, word, plen + n);
+    }
+}
+
+static int mbox_search_add_msg(MBOX_SEARCH_TBL *tbl, MBOX_SEARCH_MSG *e, const char *msg)
+{
+    const char *p;
+    long *docs;
+    int i;
+
+    if (tbl->num_docs == tbl->cap_docs) {
+        docs = realloc(tbl->docs,
+            (tbl->cap_docs ? tbl->cap_docs * 2 : MBOX_SEARCH_MIN_CAP) * sizeof(long));
+        if (docs == NULL)
+            return 0;
+        tbl->docs = docs;
+        tbl->cap_docs = tbl->cap_docs ? tbl->cap_docs * 2 : MBOX_SEARCH_MIN_CAP;
+    }
+    tbl->docs[tbl->num_docs++] = e->offset;
+    /* calls from separator, both as words and tagged by role */
+    mbox_search_add_text(tbl, e->fm_call, strlen(e->fm_call), "");
+    mbox_search_add_text(tbl, e->fm_call, strlen(e->fm_call), "fm:");
+    mbox_search_add_text(tbl, e->to_call, strlen(e->to_call), "");
+    mbox_search_add_text(tbl, e->to_call, strlen(e->to_call), "to:");
+    /* body follows separator and the From: and To: header lines */
+    p = msg;
+    for (i = 0; i < 3 && p < msg + e->length; i++) {
+        p = memchr(p, '\n', msg + e->length - p);
+        if (p == NULL)
+            return 1;
+        ++p;
+    }
+    mbox_search_add_text(tbl, p, msg + e->length - p, "");
+    return 1;
+}
+
+static MBOX_IDX_ENTRY *mbox_search_entry(MBOX_IDX *idx, long offset)
+{
+    int lo = 0, hi = idx->cnt - 1, mid;
+
+    /* index entries are in file order */
+    while (lo <= hi) {
+        mid = (lo + hi) / 2;
+        if (idx->entries[mid].offset == offset)
+            return &idx->entries[mid];
+        if (idx->entries[mid].offset < offset)
+            lo = mid + 1;
+        else
+            hi = mid - 1;
+    }
+    return NULL;
+}
+
+static MBOX_SEARCH_MSG *mbox_search_pending(MBOX_SEARCH_TBL *tbl, MBOX_IDX *idx, int *num)
+{
+    MBOX_SEARCH_MSG *msgs;
+    int i, lo, hi;
+
+    /* with mutex_mbox held, list messages not yet in search index */
+    *num = 0;
+    if (tbl->built && tbl->gen != idx->gen) {
+        /* mailbox rewritten, start over */
+        mbox_search_reset(tbl);
+    }
+    tbl->built = 1;
+    tbl->gen = idx->gen;
+    if (tbl->indexed_to == idx->indexed_to)
+        return NULL;
+    lo = 0;
+    hi = idx->cnt;
+    while (lo < hi) {
+        i = (lo + hi) / 2;
+        if (idx->entries[i].offset < tbl->indexed_to)
+            lo = i + 1;
+        else
+            hi = i;
+    }
+    msgs = malloc((idx->cnt - lo) * sizeof(MBOX_SEARCH_MSG));
+    if (msgs == NULL)
+        return NULL;
+    for (i = lo; i < idx->cnt; i++) {
+        msgs[*num].offset = idx->entries[i].offset;
+        msgs[*num].length = idx->entries[i].length;
+        memcpy(msgs[*num].fm_call, idx->entries[i].fm_call, TNC_MYCALL_SIZE);
+        memcpy(msgs[*num].to_call, idx->entries[i].to_call, TNC_MYCALL_SIZE);
+        ++*num;
+    }
+    return msgs;
+}
+
+static int mbox_search_sync(MBOX_SEARCH_TBL *tbl, MBOX_SEARCH_MSG *msgs, int num)
+{
+    FILE *mboxfp;
+    MBOX_SEARCH_MSG *e;
+    char *buf = NULL, *p, path[MAX_PATH_SIZE*2];
+    long bufsize = 0;
+    int i, result = 1;
+
+    /* add listed messages to search index, reading them from the mailbox */
+    if (!num)
+        return 1;
+    snprintf(path, sizeof(path), "%s/%s", mbox_dir_path, tbl->fn);
+    mboxfp = fopen(path, "r");
+    if (mboxfp == NULL)
+        return 0;
+    for (i = 0; i < num; i++) {
+        e = &msgs[i];
+        if (e->length + 1 > bufsize) {
+            p = realloc(buf, e->length + 1);
+            if (p == NULL) {
+                result = 0;
+                break;
+            }
+            buf = p;
+            bufsize = e->length + 1;
+        }
+        if (fseek(mboxfp, e->offset, SEEK_SET) ||
+            fread(buf, 1, e->length, mboxfp) != e->length) {
+            result = 0;
+            break;
+        }
+        buf[e->length] = '\0';
+        if (!mbox_search_add_msg(tbl, e, buf)) {
+            result = 0;
+            break;
+        }
+        tbl->indexed_to = e->offset + e->length;
+    }
+    free(buf);
+    fclose(mboxfp);
+    if (!result)
+        mbox_search_reset(tbl);
+    return result;
+}
+
+static MBOX_SEARCH_TBL *mbox_search_get_tbl(const char *fn)
+{
+    MBOX_SEARCH_TBL *tbl = NULL;
+    int i;
+
+    for (i = 0; i < MBOX_SEARCH_MAX_FILES; i++) {
+        if (!strcmp(mbox_search_tbl[i].fn, fn))
+            return &mbox_search_tbl[i];
+        if (!tbl && !mbox_search_tbl[i].fn[0])
+            tbl = &mbox_search_tbl[i];
+    }
+    if (tbl && strlen(fn) < sizeof(tbl->fn))
+        snprintf(tbl->fn, sizeof(tbl->fn), "%s", fn);
+    else
+        tbl = NULL;
+    return tbl;
+}
+
+void mbox_search_on_add(MBOX_IDX *idx)
+{
+    MBOX_SEARCH_TBL *tbl;
+    MBOX_SEARCH_MSG *msgs;
+    int i, num;
+
+    /* called with mutex_mbox held; keep an index that's in use up to
+       date, others are built on demand. Skipped if a search is running,
+       the next one catches up */
+    if (pthread_mutex_trylock(&mutex_search))
+        return;
+    for (i = 0; i < MBOX_SEARCH_MAX_FILES; i++) {
+        tbl = &mbox_search_tbl[i];
+        if (!tbl->built || strcmp(tbl->fn, idx->fn))
+            continue;
+        if (tbl->gen != idx->gen) {
+            mbox_search_reset(tbl);
+        } else {
+            msgs = mbox_search_pending(tbl, idx, &num);
+            mbox_search_sync(tbl, msgs, num);
+            free(msgs);
+        }
+        break;
+    }
+    pthread_mutex_unlock(&mutex_search);
+}
+
+static int mbox_search_has_doc(MBOX_SEARCH_TERM *t, int doc)
+{
+    int lo = 0, hi = t->cnt - 1, mid;
+
+    while (lo <= hi) {
+        mid = (lo + hi) / 2;
+        if (t->docs[mid] == doc)
+            return 1;
+        if (t->docs[mid] < doc)
+            lo = mid + 1;
+        else
+            hi = mid - 1;
+    }
+    return 0;
+}
+
+static int mbox_search_parse_date(const char *s, time_t *t)
+{
+    int year, mon, day;
+    char c;
+
+    if (sscanf(s, "%4d-%2d-%2d%c", &year, &mon, &day, &c) != 3 ||
+        mon < 1 || mon > 12 || day < 1 || day > 31)
+        return 0;
+    *t = mbox_idx_make_time(year, mon - 1, day, 0, 0, 0);
+    return 1;
+}
+
+int mbox_search(char headers[][MAX_MBOX_HDR_SIZE], int max_hdrs, const char *fn,
+                    const char *query, int (*accept)(const char *to_call))
+{
+    MBOX_IDX *idx;
+    MBOX_IDX_ENTRY *e;
+    MBOX_SEARCH_TBL *tbl;
+    MBOX_SEARCH_TERM *terms[MBOX_SEARCH_MAX_TERMS], *t;
+    char buf[MAX_CMD_SIZE], word[MBOX_SEARCH_MAX_WORD + 8], *p, *s;
+    time_t since = -1, until = -1;
+    size_t n;
+    MBOX_SEARCH_MSG *msgs = NULL;
+    int i, j, k, doc, num_terms = 0, num_words = 0, num = 0, cnt = 0, missing = 0;
+
+    /* find live messages matching all words in query, plus any of
+       'fm:call', 'to:call', 'since:yyyy-mm-dd', 'until:yyyy-mm-dd' and
+       'on:yyyy-mm-dd'; fills headers oldest first with up to max_hdrs
+       of the newest matches, returns the count or -1 if query is bad */
+    pthread_mutex_lock(&mutex_mbox);
+    idx = mbox_idx_open(fn);
+    pthread_mutex_unlock(&mutex_mbox);
+    if (idx == NULL)
+        return -1;
+    /* bring search index up to date, reading mailbox unlocked */
+    pthread_rwlock_rdlock(&idx->lock);
+    pthread_mutex_lock(&mutex_search);
+    pthread_mutex_lock(&mutex_mbox);
+    tbl = mbox_idx_open(fn) ? mbox_search_get_tbl(fn) : NULL;
+    if (tbl)
+        msgs = mbox_search_pending(tbl, idx, &num);
+    pthread_mutex_unlock(&mutex_mbox);
+    if (tbl == NULL || !mbox_search_sync(tbl, msgs, num)) {
+        free(msgs);
+        cnt = -1;
+        goto done;
+    }
+    free(msgs);
+    pthread_mutex_lock(&mutex_mbox);
+    snprintf(buf, sizeof(buf), "%s", query);
+    for (p = strtok(buf, " \t"); p; p = strtok(NULL, " \t")) {
+        if (!strncasecmp(p, "since:", 6) || !strncasecmp(p, "until:", 6) ||
+            !strncasecmp(p, "on:", 3)) {
+            s = strchr(p, ':') + 1;
+            if (!mbox_search_parse_date(s, tolower((int)*p) == 'u' ? &until : &since)) {
+                cnt = -1;
+                goto unlock;
+            }
+            if (tolower((int)*p) == 'o')
+                until = since;
+            ++num_words;
+            continue;
+        }
+        s = p;
+        n = 0;
+        if (!strncasecmp(p, "fm:", 3) || !strncasecmp(p, "to:", 3)) {
+            word[0] = tolower((int)p[0]);
+            word[1] = tolower((int)p[1]);
+            word[2] = ':';
+            s = p + 3;
+            n = 3;
+        }
+        /* split word the same way message text was split */
+        while (*s) {
+            while (*s && !isalnum((unsigned char)*s))
+                ++s;
+            for (k = n; *s && isalnum((unsigned char)*s); s++, k++) {
+                if (k < sizeof(word))
+                    word[k] = tolower((unsigned char)*s);
+            }
+            if (k - n < MBOX_SEARCH_MIN_WORD || k - n > MBOX_SEARCH_MAX_WORD)
+                continue;
+            if (num_terms == MBOX_SEARCH_MAX_TERMS) {
+                cnt = -1;
+                goto unlock;
+            }
+            t = mbox_search_lookup(tbl, word, k, 0);
+            if (t == NULL)
+                missing = 1;
+            else
+                terms[num_terms++] = t;
+            ++num_words;
+        }
+    }
+    if (!num_words) {
+        cnt = -1;
+        goto unlock;
+    }
+    if (until != -1)
+        until += 24 * 60 * 60; /* through end of that day */
+    if (missing)
+        goto unlock;
+    /* walk the shortest list, newest first, checking the others */
+    for (i = 1; i < num_terms; i++) {
+        if (terms[i]->cnt < terms[0]->cnt) {
+            t = terms[0];
+            terms[0] = terms[i];
+            terms[i] = t;
+        }
+    }
+    i = num_terms ? terms[0]->cnt : tbl->num_docs;
+    while (--i >= 0 && cnt < max_hdrs) {
+        doc = num_terms ? terms[0]->docs[i] : i;
+        for (j = 1; j < num_terms; j++) {
+            if (!mbox_search_has_doc(terms[j], doc))
+                break;
+        }
+        if (j < num_terms)
+            continue;
+        e = mbox_search_entry(idx, tbl->docs[doc]);
+        if (e == NULL || e->dead)
+            continue;
+        if ((since != -1 && e->timestamp < since) ||
+            (until != -1 && e->timestamp >= until))
+            continue;
+        if (accept && !accept(e->to_call))
+            continue;
+        snprintf(headers[cnt++], MAX_MBOX_HDR_SIZE, "%s", e->hdr);
+    }
+unlock:
+    pthread_mutex_unlock(&mutex_mbox);
+done:
+    pthread_mutex_unlock(&mutex_search);
+    pthread_rwlock_unlock(&idx->lock);
+    /* return oldest first, same as mbox_get_headers() */
+    for (i = 0, j = cnt - 1; i < j; i++, j--) {
+        memcpy(buf, headers[i], MAX_MBOX_HDR_SIZE);
+        memcpy(headers[i], headers[j], MAX_MBOX_HDR_SIZE);
+        memcpy(headers[j], buf, MAX_MBOX_HDR_SIZE);
+    }
+    return cnt;
+}
+
@@ -0,0 +1,39 @@
+/***********************************************************************
+
+    ARIM Amateur Radio Instant Messaging program for the ARDOP TNC.
+
+    Copyright (C) 2016-2021 Robert Cunnings NW8L
+
+    This file is part of the ARIM messaging program.
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+*************************************************************************/
+
+
+#ifndef _MBOX_SEARCH_H_INCLUDED_
+#define _MBOX_SEARCH_H_INCLUDED_
+
+#include "main.h"
+#include "mbox_idx.h"
+
+#define MBOX_SEARCH_MAX_TERMS   8
+#define MBOX_SEARCH_MAX_REMOTE  20
+
+extern int mbox_search(char headers[][MAX_MBOX_HDR_SIZE], int max_hdrs, const char *fn,
+                           const char *query, int (*accept)(const char *to_call));
+extern void mbox_search_on_add(MBOX_IDX *idx);
+
+#endif
+
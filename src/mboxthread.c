@@ -0,0 +1,129 @@
+/***********************************************************************
+
+    ARIM Amateur Radio Instant Messaging program for the ARDOP TNC.
+
+    Copyright (C) 2016-2021 Robert Cunnings NW8L
+
+    This file is part of the ARIM messaging program.
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+*************************************************************************/
+
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <string.h>
+#include <pthread.h>
+#include <sys/resource.h>
+#include <sys/syscall.h>
+#include "main.h"
+#include "ini.h"
+#include "mbox.h"
+#include "bufq.h"
+#include "mboxthread.h"
+
+/*
+    Mailbox maintenance workers. Each mailbox has its own low priority
+    thread that purges aged messages and compacts away deleted ones on
+    request, so the three mailboxes are processed concurrently and none
+    of this work holds up startup or the ui.
+*/
+
+#define MBOXTHREAD_NICE         10
+
+static const char *mboxthread_fnames[] = {
+    MBOX_INBOX_FNAME, MBOX_OUTBOX_FNAME, MBOX_SENTBOX_FNAME,
+};
+
+#define MBOXTHREAD_CNT (sizeof(mboxthread_fnames) / sizeof(mboxthread_fnames[0]))
+
+static pthread_t mboxthread[MBOXTHREAD_CNT];
+static pthread_mutex_t mutex_mboxthread = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t cond_mboxthread = PTHREAD_COND_INITIALIZER;
+static int mboxthread_stop, mboxthread_started;
+static unsigned int mboxthread_gen;
+static int mboxthread_purge[MBOXTHREAD_CNT];
+
+static void *mboxthread_func(void *data)
+{
+    unsigned int gen = 0;
+    size_t n = (size_t)data;
+    int days, pct, purge, stop;
+
+    /* stay out of the way of the ui and protocol threads */
+    setpriority(PRIO_PROCESS, syscall(SYS_gettid), MBOXTHREAD_NICE);
+    for (;;) {
+        pthread_mutex_lock(&mutex_mboxthread);
+        while (!mboxthread_stop && gen == mboxthread_gen)
+            pthread_cond_wait(&cond_mboxthread, &mutex_mboxthread);
+        gen = mboxthread_gen;
+        purge = mboxthread_purge[n];
+        mboxthread_purge[n] = 0;
+        stop = mboxthread_stop;
+        pthread_mutex_unlock(&mutex_mboxthread);
+        if (stop)
+            break;
+        days = purge ? atoi(g_arim_settings.max_msg_days) : 0;
+        pct = atoi(g_arim_settings.mbox_compact_pct);
+        if (!mbox_compact(mboxthread_fnames[n], days, pct))
+            bufq_queue_debug_log("MBOX: mailbox maintenance failed");
+    }
+    return data;
+}
+
+int mboxthread_start()
+{
+    size_t i;
+
+    mboxthread_stop = 0;
+    for (i = 0; i < MBOXTHREAD_CNT; i++) {
+        if (pthread_create(&mboxthread[i], NULL, mboxthread_func, (void *)i)) {
+            mboxthread_end();
+            return 0;
+        }
+        ++mboxthread_started;
+    }
+    return 1;
+}
+
+void mboxthread_end()
+{
+    int i;
+
+    pthread_mutex_lock(&mutex_mboxthread);
+    mboxthread_stop = 1;
+    pthread_cond_broadcast(&cond_mboxthread);
+    pthread_mutex_unlock(&mutex_mboxthread);
+    for (i = 0; i < mboxthread_started; i++)
+        pthread_join(mboxthread[i], NULL);
+    mboxthread_started = 0;
+}
+
+void mboxthread_request(int purge)
+{
+    size_t i;
+
+    /* wake all workers; purge also drops messages older than the
+       max-msg-days setting, otherwise only deleted ones are dropped
+       once they pass the mbox-compact-pct threshold */
+    pthread_mutex_lock(&mutex_mboxthread);
+    ++mboxthread_gen;
+    for (i = 0; purge && i < MBOXTHREAD_CNT; i++)
+        mboxthread_purge[i] = 1;
+    pthread_cond_broadcast(&cond_mboxthread);
+    pthread_mutex_unlock(&mutex_mboxthread);
+}
+
@@ -0,0 +1,200 @@
+/***********************************************************************
+
+    ARIM Amateur Radio Instant Messaging program for the ARDOP TNC.
+
+    Copyright (C) 2016-2021 Robert Cunnings NW8L
+
+    This file is part of the ARIM messaging program.
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+*************************************************************************/
+
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <sys/epoll.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#include <unistd.h>
+#include <netdb.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include "main.h"
+#include "reactorthread.h"
+#include "cmdthread.h"
+#include "datathread.h"
+#include "arim.h"
+#include "arim_proto.h"
+#include "bufq.h"
+#include "ini.h"
+#include "ardop_cmds.h"
+#include "ardop_data.h"
+#include "tnc_attach.h"
+#include "tnc_state.h"
+
+#define REACTOR_MAX_EVENTS  8
+
+static int reactorthread_connect(const char *port)
+{
+    struct addrinfo hints, *res = NULL;
+    int sock;
+
+    memset(&hints, 0, sizeof hints);
+    hints.ai_family = AF_UNSPEC;  /* IPv4 or IPv6 */
+    hints.ai_socktype = SOCK_STREAM;
+    getaddrinfo(g_tnc_settings[g_cur_tnc].ipaddr, port, &hints, &res);
+    if (!res) {
+        bufq_queue_debug_log("Reactor thread: failed to resolve IP address");
+        return -1;
+    }
+    sock = socket(res->ai_family, res->ai_socktype, res->ai_protocol);
+    if (sock != -1 && connect(sock, res->ai_addr, res->ai_addrlen) == -1) {
+        bufq_queue_debug_log("Reactor thread: failed to open TCP socket");
+        close(sock);
+        sock = -1;
+    }
+    freeaddrinfo(res);
+    return sock;
+}
+
+static int reactorthread_add_fd(int epfd, int fd)
+{
+    struct epoll_event ev;
+
+    memset(&ev, 0, sizeof(ev));
+    ev.events = EPOLLIN;
+    ev.data.fd = fd;
+    return epoll_ctl(epfd, EPOLL_CTL_ADD, fd, &ev);
+}
+
+static void reactorthread_watch_out(int epfd, int fd, int *watching)
+{
+    struct epoll_event ev;
+    int want;
+
+    /* watch for writability only while a short write is pending */
+    want = datathread_is_writing();
+    if (want == *watching)
+        return;
+    memset(&ev, 0, sizeof(ev));
+    ev.events = want ? (EPOLLIN | EPOLLOUT) : EPOLLIN;
+    ev.data.fd = fd;
+    if (epoll_ctl(epfd, EPOLL_CTL_MOD, fd, &ev) == 0)
+        *watching = want;
+}
+
+void *reactorthread_func(void *data)
+{
+    struct epoll_event events[REACTOR_MAX_EVENTS];
+    unsigned char buffer[MAX_CMD_SIZE], *rxbuf;
+    ssize_t rsize;
+    size_t rxlen;
+    int i, n, fd, cmdsock, datasock, cmdevfd, dataevfd, timerfd, epfd, arim_timeout;
+    int watch_out = 0;
+
+    bufq_queue_debug_log("Reactor thread: initializing");
+    cmdsock = reactorthread_connect(g_tnc_settings[g_cur_tnc].port);
+    snprintf((char *)buffer, sizeof(buffer), "%d", atoi(g_tnc_settings[g_cur_tnc].port) + 1);
+    datasock = cmdsock == -1 ? -1 : reactorthread_connect((char *)buffer);
+    if (cmdsock == -1 || datasock == -1) {
+        if (cmdsock != -1)
+            close(cmdsock);
+        g_reactorthread_stop = 1;
+        pthread_exit(data);
+    }
+    fcntl(datasock, F_SETFL, fcntl(datasock, F_GETFL) | O_NONBLOCK);
+    /* timeout specified in secs */
+    arim_timeout = atoi(g_arim_settings.frame_timeout);
+    /* protocol timers, armed only while there's work under way */
+    timerfd = datathread_timer_open(datasock, arim_timeout);
+    cmdevfd = bufq_event_fd(BUFQ_EV_CMD_OUT);
+    dataevfd = bufq_event_fd(BUFQ_EV_DATA_OUT);
+    epfd = epoll_create1(0);
+    if (epfd == -1 || timerfd == -1 ||
+        reactorthread_add_fd(epfd, cmdsock) == -1 ||
+        reactorthread_add_fd(epfd, datasock) == -1 ||
+        reactorthread_add_fd(epfd, cmdevfd) == -1 ||
+        reactorthread_add_fd(epfd, dataevfd) == -1 ||
+        reactorthread_add_fd(epfd, timerfd) == -1) {
+        bufq_queue_debug_log("Reactor thread: failed to set up epoll");
+        if (epfd != -1)
+            close(epfd);
+        datathread_timer_close();
+        close(cmdsock);
+        close(datasock);
+        g_reactorthread_stop = 1;
+        pthread_exit(data);
+    }
+    g_reactorthread_ready = 1;
+    tnc_state_set_busy(0);
+    arim_reset();
+    ardop_cmds_init();
+    datathread_sched_tick();
+    while (!g_reactorthread_stop) {
+        /* all TNC I/O and protocol processing is done here, one event at a time */
+        n = epoll_wait(epfd, events, REACTOR_MAX_EVENTS, -1);
+        if (n == -1) {
+            if (errno != EINTR)
+                bufq_queue_debug_log("Reactor thread: epoll wait error (-1)");
+            continue;
+        }
+        for (i = 0; i < n && !g_reactorthread_stop; i++) {
+            fd = events[i].data.fd;
+            if (fd == timerfd) {
+                datathread_on_timer();
+            } else if (fd == cmdevfd) {
+                bufq_clear(BUFQ_EV_CMD_OUT);
+                cmdthread_next_cmd_out(cmdsock);
+            } else if (fd == dataevfd) {
+                datathread_on_queued(datasock);
+            } else if (fd == cmdsock || fd == datasock) {
+                if (fd == datasock && (events[i].events & EPOLLOUT))
+                    datathread_on_writable(datasock);
+                if (!(events[i].events & (EPOLLIN | EPOLLHUP | EPOLLERR)))
+                    continue;
+                if (fd == cmdsock) {
+                    rsize = read(fd, buffer, MAX_CMD_SIZE - 1);
+                } else {
+                    /* read straight into the frame decoder's buffer */
+                    rxbuf = ardop_data_rx_space(&rxlen);
+                    rsize = read(fd, rxbuf, rxlen);
+                }
+                if (rsize == 0) {
+                    bufq_queue_debug_log("Reactor thread: Socket closed by TNC");
+                    tnc_detach(); /* close TCP connection to TNC */
+                } else if (rsize == -1) {
+                    if (errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR)
+                        bufq_queue_debug_log("Reactor thread: Socket read error (-1)");
+                } else if (fd == cmdsock) {
+                    ardop_cmds_proc_resp((char *)buffer, rsize);
+                } else {
+                    ardop_data_on_read(rsize);
+                }
+            }
+        }
+        datathread_sched_tick();
+        reactorthread_watch_out(epfd, datasock, &watch_out);
+    }
+    tnc_state_set_busy(0);
+    bufq_queue_debug_log("Reactor thread: terminating");
+    sleep(2);
+    close(epfd);
+    datathread_timer_close();
+    close(cmdsock);
+    close(datasock);
+    return data;
+}
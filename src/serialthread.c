@@ -41,6 +41,8 @@
 #include "ardop_data.h"
 #include "util.h"
 #include "ui.h"
+#include "tnc_state.h"
+#include "timer.h"
 
 #define IO_STATE_ERROR            (-1)
 #define IO_STATE_IDLE               0
@@ -57,6 +59,7 @@
 #define IO_CHAN_STATUS           0xFE
 #define IO_CHAN_GEN_POLL         0xFF
 
+#define IO_TICK_MSEC               50
 #define IO_TIME_OUT                40 /* 40 50 msec ticks = 2 sec */
 #define IO_DATA_BLOCK_SIZE        240 /* reserve 16 bytes for framing overheads */
 
@@ -66,11 +69,21 @@
 #define TNC_HOST_RESP_OK            0
 #define TNC_HOST_RESP_OK_MSG        1
 #define TNC_HOST_RESP_FAIL_MSG      2
+#define TNC_HOST_MON_DATA           6
 #define TNC_HOST_DATA               7
 
-static int io_state, io_timer, io_seq, io_rpts;
+/* host mode receive states */
+#define RX_HUNT                     0 /* waiting for 1st sync byte */
+#define RX_SYNC                     1 /* waiting for 2nd sync byte */
+#define RX_BODY                     2 /* receiving frame */
+#define RX_STUFF                    3 /* got 0xAA in frame, waiting for stuffing byte */
+
+static int io_state, io_timer, io_seq, io_rpts, io_ticks;
 static int respsize, tnc_init;
+static int rx_state, rx_need;
+static unsigned short rx_crc;
 static char respbuf[MAX_CMD_SIZE*2];
+static int file_out_cancel; /* guarded by mutex_file_out */
 
 unsigned short crc16_table[256] = {
     0x0000, 0x1189, 0x2312, 0x329B, 0x4624, 0x57AD, 0x6536, 0x74BF, 
@@ -187,9 +200,7 @@ int serialthread_next_cmd_out(int fd)
     int state;
 
     state = io_state;
-    pthread_mutex_lock(&mutex_cmd_out);
     cmd = cmdq_pop(&g_cmd_out_q);
-    pthread_mutex_unlock(&mutex_cmd_out);
     if (cmd) {
         msgbuf[0] = IO_CHAN_CMD;
         msgbuf[1] = HOST_TNC_DATA;
@@ -202,22 +213,54 @@ int serialthread_next_cmd_out(int fd)
     return state;
 }
 
+static int serialthread_end_file_out(FILE **fp, size_t *nblk, size_t *nrem, int state)
+{
+    /* abandon a streamed file whose source can't be read */
+    bufq_queue_debug_log("Serial thread: Send file frame to TNC, read from file failed");
+    fclose(*fp);
+    *fp = NULL;
+    *nblk = *nrem = 0;
+    return state;
+}
+
+void serialthread_cancel_send_file_out()
+{
+    /* may be called from any thread, the transfer is dropped
+       by the serial thread before it sends the next block */
+    pthread_mutex_lock(&mutex_file_out);
+    file_out_cancel = 1;
+    pthread_mutex_unlock(&mutex_file_out);
+}
+
 int serialthread_send_file_out(int fd)
 {
     static size_t sent = 0, nblk = 0, nrem = 0;
     static unsigned char databuf[MAX_FILE_SIZE+4], framebuf[MAX_CMD_SIZE*2];
+    static FILE *fp = NULL; /* if set, payload is read from here block by block */
     FILEQUEUEITEM *item;
     unsigned char *p, *s;
-    int state;
+    int state, cancel;
 
     state = io_state;
+    pthread_mutex_lock(&mutex_file_out);
+    cancel = file_out_cancel;
+    file_out_cancel = 0;
+    pthread_mutex_unlock(&mutex_file_out);
+    if (cancel) { /* transfer canceled or link lost, release it */
+        if (fp)
+            fclose(fp);
+        fp = NULL;
+        nblk = nrem = sent = 0;
+    }
     if (!nblk && !nrem) { /* nothing to send, check for queued file */
         pthread_mutex_lock(&mutex_file_out);
         item = fileq_pop(&g_file_out_q);
         pthread_mutex_unlock(&mutex_file_out);
         if (!item)
             return state;
-        memcpy(databuf, item->data, item->size);
+        fp = item->fp;
+        if (!fp)
+            memcpy(databuf, item->data, item->size);
         nblk = item->size / IO_DATA_BLOCK_SIZE;
         nrem = item->size % IO_DATA_BLOCK_SIZE;
         sent = 0;
@@ -230,8 +273,13 @@ int serialthread_send_file_out(int fd)
         p = &framebuf[3];
         *p++ = (IO_DATA_BLOCK_SIZE >> 8) & 0xFF;
         *p++ = IO_DATA_BLOCK_SIZE & 0xFF;
-        s = databuf + sent;
-        memcpy(p, s, IO_DATA_BLOCK_SIZE);
+        if (fp) {
+            if (fread(p, 1, IO_DATA_BLOCK_SIZE, fp) != IO_DATA_BLOCK_SIZE)
+                return serialthread_end_file_out(&fp, &nblk, &nrem, state);
+        } else {
+            s = databuf + sent;
+            memcpy(p, s, IO_DATA_BLOCK_SIZE);
+        }
         state = serialthread_send_frame(fd, (unsigned char *)framebuf, IO_DATA_BLOCK_SIZE + 5);
         if (state == IO_STATE_ERROR) {
             bufq_queue_debug_log("Serial thread: Send file frame to TNC, write to serial port failed");
@@ -246,8 +294,13 @@ int serialthread_send_file_out(int fd)
         p = &framebuf[3];
         *p++ = (nrem >> 8) & 0xFF;
         *p++ = nrem & 0xFF;
-        s = databuf + sent;
-        memcpy(p, s, nrem);
+        if (fp) {
+            if (fread(p, 1, nrem, fp) != nrem)
+                return serialthread_end_file_out(&fp, &nblk, &nrem, state);
+        } else {
+            s = databuf + sent;
+            memcpy(p, s, nrem);
+        }
         state = serialthread_send_frame(fd, (unsigned char *)framebuf, nrem + 5);
         if (state == IO_STATE_ERROR) {
             bufq_queue_debug_log("Serial thread: Send file frame to TNC, write to serial port failed");
@@ -257,6 +310,10 @@ int serialthread_send_file_out(int fd)
         }
         nrem = sent = 0;
     }
+    if (fp && !nblk && !nrem) {
+        fclose(fp);
+        fp = NULL;
+    }
     return state;
 }
 
@@ -332,9 +389,7 @@ int serialthread_send_data_out(int fd)
 
     state = io_state;
     if (!nblk && !nrem) { /* nothing to send, check for queued data */
-        pthread_mutex_lock(&mutex_data_out);
         data = dataq_pop(&g_data_out_q);
-        pthread_mutex_unlock(&mutex_data_out);
         if (!data)
             return state;
         snprintf(databuf, sizeof(databuf), "%s", data);
@@ -523,33 +578,6 @@ int serialthread_gen_poll(int fd)
     return state;
 }
 
-int serialthread_unstuff_frame(char *buf, char *data, size_t size)
-{
-    char *in, *out, *end;
-
-    if (data[0] == 0xAA && data[1] == 0xAA)
-        in = data + 2;
-    else
-        in = data;
-    end = data + size;
-    out = buf;
-    while (in < end) {
-        *out = *in;
-        if (*in == 0xAA) {
-            ++in;
-            if (*in && in < end) /* byte stuffing error */
-                return -1;
-        }
-        ++in;
-        ++out;
-    }
-    if (out - buf > MAX_CMD_SIZE+2) {
-        /* too much data, force reset */
-        return -1;
-    }
-    return out - buf;
-}
-
 int serialthread_handle_gp_resp(char *resp, int size, int fd)
 {
     int state, channel;
@@ -658,10 +686,70 @@ int serialthread_dispatch_resp(char *resp, int size, int fd)
     return state;
 }
 
+static void serialthread_rx_reset()
+{
+    rx_state = RX_HUNT;
+    respsize = 0;
+}
+
+static int serialthread_rx_byte(unsigned char b, int fd, int state)
+{
+    int code;
+
+    if (respsize >= sizeof(respbuf) - 1) {
+        /* too much data, abandon frame */
+        bufq_queue_debug_log("Serialthread: Rx frame too large");
+        serialthread_rx_reset();
+        io_timer = 0;
+        return IO_STATE_IDLE;
+    }
+    respbuf[respsize++] = b;
+    rx_crc = (rx_crc >> 8) ^ crc16_table[(rx_crc ^ b) & 0xFF];
+    if (respsize == 2) {
+        if ((b & 0x80) != io_seq) {
+            /* bad sequence counter, ignore response frame */
+            bufq_queue_debug_log("Serialthread: Bad rx sequence counter in frame");
+            serialthread_rx_reset();
+            io_timer = 0;
+            return IO_STATE_IDLE;
+        }
+        io_seq ^= 0x80; /* update sequence bit for next frame received */
+        /* frame size depends on op code: none, null terminated or counted data */
+        code = b & 0x7F;
+        if (code == TNC_HOST_RESP_OK)
+            rx_need = 4;
+        else if (code == TNC_HOST_MON_DATA || code == TNC_HOST_DATA)
+            rx_need = 0; /* wait for the count byte */
+        else
+            rx_need = -1; /* wait for the null terminator */
+    } else if (respsize == 3 && !rx_need) {
+        rx_need = 3 + b + 1 + 2;
+    } else if (respsize > 2 && rx_need == -1 && !b) {
+        rx_need = respsize + 2;
+    }
+    if (rx_need <= 0 || respsize < rx_need)
+        return state; /* wait for more data */
+    /* have the entire frame, check CRC */
+    rx_state = RX_HUNT;
+    if (rx_crc != 0xF0B8) {
+        bufq_queue_debug_log("Serialthread: Bad CRC in rx frame");
+        respsize = 0;
+        io_timer = 0;
+        return IO_STATE_IDLE;
+    }
+    respbuf[respsize] = '\0';
+    respbuf[1] &= 0x7F;   /* clear sequence counter bit */
+    state = serialthread_dispatch_resp(respbuf, respsize, fd);
+    respsize = 0;
+    io_timer = 0;
+    return state;
+}
+
 size_t serialthread_on_rcv(char *data, size_t size, int fd)
 {
-    int state, datasize;
-    unsigned int crc16;
+    int state;
+    size_t i;
+    unsigned char b;
     char temp[MAX_CMD_SIZE*2];
 
     state = io_state;
@@ -680,45 +768,184 @@ size_t serialthread_on_rcv(char *data, size_t size, int fd)
         state = serialthread_enter_host_mode(fd);
         break;
     default:
-        if (data[0] == 0xAA && data [1] == 0xAA) { /* host mode response from TNC */
-            if (size >= 4 && data[2] == 0xAA && data[3] == 0x55) {
-                /* repeat request; resend previous frame */
-                respsize = 0;
-                bufq_queue_debug_log("Serialthread: Received request to repeat last frame sent");
-                return serialthread_send_frame(fd, NULL, 0);
-            }
-            if (size < 6) /* not a whole frame yet */
-                return state;
-            if ((data[3] & 0x80) != io_seq) {
-                /* bad sequence counter, ignore response frame */
-                bufq_queue_debug_log("Serialthread: Bad rx sequence counter in frame");
-                respsize = 0;
-                io_timer = 0;
-                return IO_STATE_IDLE;
+        /* host mode, frames may be split or run together across reads */
+        for (i = 0; i < size; i++) {
+            b = (unsigned char)data[i];
+            switch (rx_state) {
+            case RX_HUNT:
+                if (b == 0xAA)
+                    rx_state = RX_SYNC;
+                break;
+            case RX_SYNC:
+                if (b == 0xAA) {
+                    /* start of frame */
+                    rx_state = RX_BODY;
+                    respsize = rx_need = 0;
+                    rx_crc = 0xFFFF;
+                } else {
+                    rx_state = RX_HUNT;
+                }
+                break;
+            case RX_BODY:
+                if (b == 0xAA)
+                    rx_state = RX_STUFF;
+                else
+                    state = serialthread_rx_byte(b, fd, state);
+                break;
+            case RX_STUFF:
+                if (b == 0x00) {
+                    /* stuffed 0xAA data byte */
+                    rx_state = RX_BODY;
+                    state = serialthread_rx_byte(0xAA, fd, state);
+                } else if (b == 0x55 && !respsize) {
+                    /* repeat request; resend previous frame */
+                    serialthread_rx_reset();
+                    bufq_queue_debug_log("Serialthread: Received request to repeat last frame sent");
+                    state = serialthread_send_frame(fd, NULL, 0);
+                } else if (b == 0xAA) {
+                    /* sync, frame in progress was cut short */
+                    bufq_queue_debug_log("Serialthread: Incomplete rx frame");
+                    rx_state = RX_BODY;
+                    respsize = rx_need = 0;
+                    rx_crc = 0xFFFF;
+                } else {
+                    /* byte stuffing error, abandon data */
+                    serialthread_rx_reset();
+                    io_timer = 0;
+                    state = IO_STATE_IDLE;
+                    bufq_queue_debug_log("Serialthread: Error unstuffing rx frame");
+                }
+                break;
             }
-            io_seq ^= 0x80; /* update sequence bit for next frame received */
-            respsize = 0;   /* new frame, clear buffer */
         }
-        datasize = serialthread_unstuff_frame(respbuf + respsize, data, size);
-        if (datasize == -1) {
-            /* error unstuffing frame or too large, abandon data */
-            respsize = 0;
+        break;
+    }
+    return state;
+}
+
+int serialthread_send_queued(int fd)
+{
+    int state;
+
+    /* if command is queued, send it */
+    state = serialthread_next_cmd_out(fd);
+    if (state != IO_STATE_IDLE)
+        return state;
+    /* if data is queued, send it */
+    state = serialthread_send_file_out(fd);
+    if (state != IO_STATE_IDLE)
+        return state;
+    state = serialthread_send_msg_out(fd);
+    if (state != IO_STATE_IDLE)
+        return state;
+    return serialthread_send_data_out(fd);
+}
+
+static void serialthread_on_tick(int fd, int arim_timeout)
+{
+    time_t cur_time;
+
+    if (!io_ticks--) { /* generate periodic event every 200 msec */
+        io_ticks = 3;
+        arim_on_event(EV_PERIODIC, 0);
+    }
+    if (arim_data_waiting) {
+        cur_time = time(NULL);
+        if (cur_time - arim_start_time > arim_timeout) {
+            /* timeout, reset arim state */
+            arim_reset();
+            arim_data_waiting = arim_start_time = 0;
+            bufq_queue_debug_log("Data thread: ARIM frame time out");
+            arim_on_event(EV_FRAME_TO, 0);
+        }
+    }
+    if (io_timer)
+        --io_timer;
+    if (io_timer == 0) {
+        switch (io_state) {
+        case IO_STATE_IDLE:
+            /* if command or data is queued, send it */
+            io_state = serialthread_send_queued(fd);
+            if (io_state != IO_STATE_IDLE)
+                break;
+            /* pump outbound and inbound arq line queues */
+            arim_arq_on_cmd(NULL, 0);
+            arim_arq_on_resp(NULL, 0);
+            if (io_state == IO_STATE_IDLE) /* no command queued, send general poll cmd */
+                io_state = serialthread_gen_poll(fd);
+            break;
+        case IO_STATE_BUSY:
+            if (io_rpts && --io_rpts == 0) {
+                /* send frame attempt timed out, try to restart TNC */
+                bufq_queue_debug_log("Serial thread: Frame send timeout, restarting TNC");
+                io_rpts = 3;
+                serialthread_rx_reset();
+                arim_reset();
+                tnc_state_set_busy(0);
+                io_state = serialthread_test_cmd_mode_1st(fd);
+            } else {
+                /* repeat previous command */
+                bufq_queue_debug_log("Serial thread: Frame ack timeout, repeating");
+                io_state = serialthread_send_frame(fd, NULL, 0);
+            }
+            break;
+        case IO_STATE_TEST_CMD_MODE_1ST:
+            if (io_rpts && --io_rpts == 0) {
+                /* timed out, must be in host mode, try to exit */
+                bufq_queue_debug_log("Serial thread: Test TNC cmd mode timeout, exiting host mode");
+                io_state = serialthread_exit_host_mode(fd);
+            } else {
+                /* repeat previous command */
+                io_state = serialthread_test_cmd_mode_1st(fd);
+            }
+            break;
+        case IO_STATE_TEST_CMD_MODE_2ND:
+            if (io_rpts && --io_rpts == 0) {
+                /* timed out, abandon attempt to attach to TNC */
+                bufq_queue_debug_log("Serial thread: Test TNC cmd mode timeout, detaching");
+                io_state = IO_STATE_IDLE;
+                g_serialthread_stop = 1; /* detach from TNC */
+            } else {
+                /* repeat previous command */
+                io_state = serialthread_test_cmd_mode_2nd(fd);
+            }
+            break;
+        case IO_STATE_SET_ARDOP_MODE:
+            if (io_rpts && --io_rpts == 0) {
+                /* timed out, abandon attempt to attach to TNC */
+                bufq_queue_debug_log("Serial thread: Set TNC ARDOP mode wait timeout, detaching");
+                io_state = IO_STATE_IDLE;
+                g_serialthread_stop = 1; /* detach from TNC */
+            } else {
+                /* repeat previous command */
+                io_state = serialthread_set_ardop_mode(fd);
+            }
+            break;
+        case IO_STATE_EXIT_HOST_MODE:
+            bufq_queue_debug_log("Serial thread: Exited host mode, reinitializing TNC");
+            io_rpts = 3;
+            io_state = serialthread_test_cmd_mode_2nd(fd);
+            break;
+        case IO_STATE_ENTER_HOST_MODE:
+            bufq_queue_debug_log("Serial thread: Entered host mode, initializing TNC");
+            tnc_init = 1; /* set sequence counter 'not defined' flag' */
+            io_seq = 0;   /* clear sequence counter */
             io_timer = 0;
-            state = IO_STATE_IDLE;
-            bufq_queue_debug_log("Serialthread: Error unstuffing rx frame");
-        } else {
-            respsize += datasize;
-            crc16 = calc_crc16((unsigned char *)respbuf, respsize);
-            if (crc16 == 0xF0B8) {
-                /* have the entire response payload */
-                respbuf[1] &= 0x7F;   /* clear sequence counter bit */
-                state = serialthread_dispatch_resp(respbuf, respsize, fd);
-                respsize = 0;
-                io_timer = 0;
-            } /* if crc bad assume frame isn't complete, wait for more data */
+            serialthread_rx_reset();
+            io_state = IO_STATE_IDLE;
+            ardop_cmds_init();
+            break;
+        case IO_STATE_ERROR:
+            bufq_queue_debug_log("Serial thread: I/O error, returning to idle state");
+            io_rpts = 0;
+            io_timer = 0;
+            io_state = IO_STATE_IDLE;
+            break;
+        default:
+            bufq_queue_debug_log("Serial thread: Unknown IO state");
+            break;
         }
     }
-    return state;
 }
 
 void *serialthread_func(void *data)
@@ -728,8 +955,8 @@ void *serialthread_func(void *data)
     struct timeval timeout;
     struct termios io_set;
     ssize_t rsize;
-    int result, serialfd, arim_timeout, msec_200;
-    time_t cur_time;
+    int result, serialfd, arim_timeout, cmdevfd, dataevfd, timerfd, maxfd;
+    long long now, next_tick;
 
     bufq_queue_debug_log("Serial thread: initializing");
     /* open serial port */
@@ -761,158 +988,80 @@ void *serialthread_func(void *data)
     /* ARIM protocol timeout specified in secs */
     arim_timeout = atoi(g_arim_settings.frame_timeout);
     arim_reset();
-    snprintf(g_tnc_settings[g_cur_tnc].busy,
-        sizeof(g_tnc_settings[g_cur_tnc].busy), "%s", "FALSE");
-    respsize = 0;
+    tnc_state_set_busy(0);
+    serialthread_rx_reset();
     io_rpts = 3;
-    msec_200 = 3;
+    io_ticks = 3;
+    /* protocol state deadlines */
+    timerfd = timer_svc_open(&proto_timers);
+    if (timerfd == -1) {
+        bufq_queue_debug_log("Serial thread: failed to create protocol timer");
+        close(serialfd);
+        g_serialthread_stop = 1;
+        pthread_exit(data);
+    }
     io_state = serialthread_test_cmd_mode_1st(serialfd);
+    cmdevfd = bufq_event_fd(BUFQ_EV_CMD_OUT);
+    dataevfd = bufq_event_fd(BUFQ_EV_DATA_OUT);
+    maxfd = serialfd > cmdevfd ? serialfd : cmdevfd;
+    maxfd = maxfd > dataevfd ? maxfd : dataevfd;
+    maxfd = maxfd > timerfd ? maxfd : timerfd;
+    next_tick = util_msec_now() + IO_TICK_MSEC;
     while (1) {
         FD_ZERO(&readfds);
         FD_ZERO(&errorfds);
         FD_SET(serialfd, &readfds);
+        FD_SET(cmdevfd, &readfds);
+        FD_SET(dataevfd, &readfds);
+        FD_SET(timerfd, &readfds);
         FD_SET(serialfd, &errorfds);
+        /* host mode link is polled, so a 50 msec tick is kept while
+           the event pipes wake the thread when traffic is queued */
+        now = util_msec_now();
         timeout.tv_sec = 0;
-        timeout.tv_usec = 50000; /* 50 msec */
-        result = select(serialfd + 1, &readfds, (fd_set *)0, &errorfds, &timeout);
-        switch (result) {
-        case 0:
-            if (!msec_200--) { /* generate periodic event every 200 msec */
-                msec_200 = 3;
-                arim_on_event(EV_PERIODIC, 0);
-            }
-            if (arim_data_waiting) {
-                cur_time = time(NULL);
-                if (cur_time - arim_start_time > arim_timeout) {
-                    /* timeout, reset arim state */
-                    arim_reset();
-                    arim_data_waiting = arim_start_time = 0;
-                    bufq_queue_debug_log("Data thread: ARIM frame time out");
-                    arim_on_event(EV_FRAME_TO, 0);
-                }
-            }
-            if (io_timer)
-                --io_timer;
-            if (io_timer == 0) {
-                switch (io_state) {
-                case IO_STATE_IDLE:
-                    /* if command is queued, send it */
-                    io_state = serialthread_next_cmd_out(serialfd);
-                    if (io_state != IO_STATE_IDLE)
-                        break;
-                    /* if data is queued, send it */
-                    io_state = serialthread_send_file_out(serialfd);
-                    if (io_state != IO_STATE_IDLE)
-                        break;
-                    io_state = serialthread_send_msg_out(serialfd);
-                    if (io_state != IO_STATE_IDLE)
-                        break;
-                    io_state = serialthread_send_data_out(serialfd);
-                    if (io_state != IO_STATE_IDLE)
-                        break;
-                    /* pump outbound and inbound arq line queues */
-                    arim_arq_on_cmd(NULL, 0);
-                    arim_arq_on_resp(NULL, 0);
-                    if (io_state == IO_STATE_IDLE) /* no command queued, send general poll cmd */
-                        io_state = serialthread_gen_poll(serialfd);
-                    break;
-                case IO_STATE_BUSY:
-                    if (io_rpts && --io_rpts == 0) {
-                        /* send frame attempt timed out, try to restart TNC */
-                        bufq_queue_debug_log("Serial thread: Frame send timeout, restarting TNC");
-                        io_rpts = 3;
-                        respsize = 0;
-                        arim_reset();
-                        snprintf(g_tnc_settings[g_cur_tnc].busy,
-                            sizeof(g_tnc_settings[g_cur_tnc].busy), "%s", "FALSE");
-                        io_state = serialthread_test_cmd_mode_1st(serialfd);
-                    } else {
-                        /* repeat previous command */
-                        bufq_queue_debug_log("Serial thread: Frame ack timeout, repeating");
-                        io_state = serialthread_send_frame(serialfd, NULL, 0);
-                    }
-                    break;
-                case IO_STATE_TEST_CMD_MODE_1ST:
-                    if (io_rpts && --io_rpts == 0) {
-                        /* timed out, must be in host mode, try to exit */
-                        bufq_queue_debug_log("Serial thread: Test TNC cmd mode timeout, exiting host mode");
-                        io_state = serialthread_exit_host_mode(serialfd);
-                    } else {
-                        /* repeat previous command */
-                        io_state = serialthread_test_cmd_mode_1st(serialfd);
-                    }
-                    break;
-                case IO_STATE_TEST_CMD_MODE_2ND:
-                    if (io_rpts && --io_rpts == 0) {
-                        /* timed out, abandon attempt to attach to TNC */
-                        bufq_queue_debug_log("Serial thread: Test TNC cmd mode timeout, detaching");
-                        io_state = IO_STATE_IDLE;
-                        g_serialthread_stop = 1; /* detach from TNC */
-                    } else {
-                        /* repeat previous command */
-                        io_state = serialthread_test_cmd_mode_2nd(serialfd);
-                    }
-                    break;
-                case IO_STATE_SET_ARDOP_MODE:
-                    if (io_rpts && --io_rpts == 0) {
-                        /* timed out, abandon attempt to attach to TNC */
-                        bufq_queue_debug_log("Serial thread: Set TNC ARDOP mode wait timeout, detaching");
-                        io_state = IO_STATE_IDLE;
-                        g_serialthread_stop = 1; /* detach from TNC */
-                    } else {
-                        /* repeat previous command */
-                        io_state = serialthread_set_ardop_mode(serialfd);
-                    }
-                    break;
-                case IO_STATE_EXIT_HOST_MODE:
-                    bufq_queue_debug_log("Serial thread: Exited host mode, reinitializing TNC");
-                    io_rpts = 3;
-                    io_state = serialthread_test_cmd_mode_2nd(serialfd);
-                    break;
-                case IO_STATE_ENTER_HOST_MODE:
-                    bufq_queue_debug_log("Serial thread: Entered host mode, initializing TNC");
-                    tnc_init = 1; /* set sequence counter 'not defined' flag' */
-                    io_seq = 0;   /* clear sequence counter */
-                    io_timer = 0;
-                    io_state = IO_STATE_IDLE;
-                    ardop_cmds_init();
-                    break;
-                case IO_STATE_ERROR:
-                    bufq_queue_debug_log("Serial thread: I/O error, returning to idle state");
-                    io_rpts = 0;
-                    io_timer = 0;
-                    io_state = IO_STATE_IDLE;
-                    break;
-                default:
-                    bufq_queue_debug_log("Serial thread: Unknown IO state");
-                    break;
-                }
-            }
-            break;
-        case -1:
-            bufq_queue_debug_log("Serial thread: Socket select error (-1)");
-            break;
-        default:
+        timeout.tv_usec = next_tick > now ? (next_tick - now) * 1000 : 0;
+        result = select(maxfd + 1, &readfds, (fd_set *)0, &errorfds, &timeout);
+        if (result > 0 && (FD_ISSET(cmdevfd, &readfds) || FD_ISSET(dataevfd, &readfds))) {
+            bufq_clear(BUFQ_EV_CMD_OUT);
+            bufq_clear(BUFQ_EV_DATA_OUT);
+            if (io_state == IO_STATE_IDLE && io_timer == 0)
+                io_state = serialthread_send_queued(serialfd);
+        }
+        if (result > 0) {
+            if (FD_ISSET(timerfd, &readfds))
+                timer_on_expired(&proto_timers);
             if (FD_ISSET(serialfd, &readfds)) {
                 rsize = read(serialfd, buffer, sizeof(buffer) - 1);
                 if (rsize != -1)
                     io_state = serialthread_on_rcv(buffer, rsize, serialfd);
                 else
                     bufq_queue_debug_log("Serial thread: Error on serial port read");
+                /* link freed by TNC response, send anything queued meanwhile */
+                if (io_state == IO_STATE_IDLE && io_timer == 0)
+                    io_state = serialthread_send_queued(serialfd);
             }
-            if (FD_ISSET(serialfd, &errorfds)) {
+            if (FD_ISSET(serialfd, &errorfds))
                 bufq_queue_debug_log("Serial thread: Serial port select error (FD_ISSET)");
-                break;
-            }
+        } else if (result == -1) {
+            bufq_queue_debug_log("Serial thread: Socket select error (-1)");
+        }
+        /* the tick runs on a deadline checked on every pass, so steady
+           serial or event pipe traffic can't hold it off */
+        now = util_msec_now();
+        if (now >= next_tick) {
+            next_tick += IO_TICK_MSEC;
+            if (next_tick <= now) /* fell behind, don't run a burst of ticks */
+                next_tick = now + IO_TICK_MSEC;
+            serialthread_on_tick(serialfd, arim_timeout);
         }
         if (g_serialthread_stop)
             break;
     }
     serialthread_exit_host_mode(serialfd);
-    snprintf(g_tnc_settings[g_cur_tnc].busy,
-        sizeof(g_tnc_settings[g_cur_tnc].busy), "%s", "FALSE");
+    tnc_state_set_busy(0);
     bufq_queue_debug_log("Serial thread: terminating");
     sleep(2);
+    timer_svc_close(&proto_timers);
     close(serialfd);
     return data;
 }
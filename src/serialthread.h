@@ -29,6 +29,7 @@ extern "C" {
 #endif
 
 extern void *serialthread_func(void *data);
+extern void serialthread_cancel_send_file_out(void);
 
 #ifdef __cplusplus
 }
@@ -0,0 +1,200 @@
+/***********************************************************************
+
+    ARIM Amateur Radio Instant Messaging program for the ARDOP TNC.
+
+    Copyright (C) 2016-2021 Robert Cunnings NW8L
+
+    This file is part of the ARIM messaging program.
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+*************************************************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <unistd.h>
+#include <sys/timerfd.h>
+#include "main.h"
+#include "util.h"
+#include "timer.h"
+
+/*
+    Millisecond timer service driven by a timerfd. The thread which owns
+    the service polls its fd along with its other descriptors and calls
+    timer_on_expired() when it becomes readable; callbacks run on that
+    thread. The timerfd is armed for the earliest deadline only, so no
+    wakeups occur when no timers are pending. Timers may be started and
+    cancelled from any thread. There are only ever a handful of timers,
+    so deadlines are kept in a small table rather than a timer wheel.
+*/
+
+static void timer_set_fd(TIMER_SVC *svc)
+{
+    struct itimerspec its;
+    long long due = 0;
+    int i;
+
+    /* call with svc->mutex held */
+    for (i = 0; i < TIMER_MAX_TIMERS; i++) {
+        if (svc->timers[i].id && (!due || svc->timers[i].due < due))
+            due = svc->timers[i].due;
+    }
+    memset(&its, 0, sizeof(its));
+    if (due) {
+        its.it_value.tv_sec = due / 1000;
+        its.it_value.tv_nsec = (due % 1000) * 1000000L;
+        if (!its.it_value.tv_sec && !its.it_value.tv_nsec)
+            its.it_value.tv_nsec = 1; /* zero would disarm the timer */
+    }
+    if (svc->fd != -1)
+        timerfd_settime(svc->fd, TFD_TIMER_ABSTIME, &its, NULL);
+}
+
+static TIMER_ENTRY *timer_find(TIMER_SVC *svc, unsigned int id)
+{
+    int i;
+
+    /* call with svc->mutex held */
+    for (i = 0; id && i < TIMER_MAX_TIMERS; i++) {
+        if (svc->timers[i].id == id)
+            return &svc->timers[i];
+    }
+    return NULL;
+}
+
+static unsigned int timer_add(TIMER_SVC *svc, unsigned int delay_ms,
+                                  unsigned int period_ms, TIMER_FUNC func, void *arg)
+{
+    TIMER_ENTRY *t;
+
+    /* call with svc->mutex held */
+    for (t = svc->timers; t < &svc->timers[TIMER_MAX_TIMERS] && t->id; t++)
+        ;
+    if (t == &svc->timers[TIMER_MAX_TIMERS])
+        return 0;
+    if (++svc->next_id == 0)
+        svc->next_id = 1;
+    t->id = svc->next_id;
+    t->due = util_msec_now() + delay_ms;
+    t->period = period_ms;
+    t->func = func;
+    t->arg = arg;
+    timer_set_fd(svc);
+    return t->id;
+}
+
+int timer_svc_open(TIMER_SVC *svc)
+{
+    pthread_mutex_lock(&svc->mutex);
+    memset(svc->timers, 0, sizeof(svc->timers));
+    if (svc->fd == -1)
+        svc->fd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+    pthread_mutex_unlock(&svc->mutex);
+    return svc->fd;
+}
+
+void timer_svc_close(TIMER_SVC *svc)
+{
+    pthread_mutex_lock(&svc->mutex);
+    memset(svc->timers, 0, sizeof(svc->timers));
+    if (svc->fd != -1)
+        close(svc->fd);
+    svc->fd = -1;
+    pthread_mutex_unlock(&svc->mutex);
+}
+
+unsigned int timer_start(TIMER_SVC *svc, unsigned int delay_ms,
+                             unsigned int period_ms, TIMER_FUNC func, void *arg)
+{
+    unsigned int id;
+
+    /* returns handle for timer_cancel(), or 0 if the table is full */
+    pthread_mutex_lock(&svc->mutex);
+    id = timer_add(svc, delay_ms, period_ms, func, arg);
+    pthread_mutex_unlock(&svc->mutex);
+    return id;
+}
+
+void timer_arm(TIMER_SVC *svc, unsigned int *id, unsigned int delay_ms,
+                   unsigned int period_ms, TIMER_FUNC func, void *arg)
+{
+    /* start timer unless the one whose handle is stored in *id is still
+       pending. Safe against a racing expiry: a one-shot timer is retired
+       before its callback runs, so a callback that decides not to re-arm
+       can't cancel out an arm request made meanwhile by another thread */
+    pthread_mutex_lock(&svc->mutex);
+    if (!timer_find(svc, *id))
+        *id = timer_add(svc, delay_ms, period_ms, func, arg);
+    pthread_mutex_unlock(&svc->mutex);
+}
+
+void timer_cancel(TIMER_SVC *svc, unsigned int id)
+{
+    TIMER_ENTRY *t;
+
+    pthread_mutex_lock(&svc->mutex);
+    if ((t = timer_find(svc, id))) {
+        memset(t, 0, sizeof(*t));
+        timer_set_fd(svc);
+    }
+    pthread_mutex_unlock(&svc->mutex);
+}
+
+int timer_is_active(TIMER_SVC *svc, unsigned int id)
+{
+    int active;
+
+    pthread_mutex_lock(&svc->mutex);
+    active = (timer_find(svc, id) != NULL);
+    pthread_mutex_unlock(&svc->mutex);
+    return active;
+}
+
+void timer_on_expired(TIMER_SVC *svc)
+{
+    TIMER_ENTRY due[TIMER_MAX_TIMERS];
+    uint64_t expired;
+    ssize_t rsize = 0;
+    long long now;
+    int i, cnt = 0;
+
+    /* drain the expiry count, deadlines are checked below regardless */
+    if (svc->fd != -1)
+        rsize = read(svc->fd, &expired, sizeof(expired));
+    pthread_mutex_lock(&svc->mutex);
+    now = util_msec_now();
+    for (i = 0; i < TIMER_MAX_TIMERS; i++) {
+        if (!svc->timers[i].id || svc->timers[i].due > now)
+            continue;
+        due[cnt++] = svc->timers[i];
+        if (svc->timers[i].period) {
+            svc->timers[i].due += svc->timers[i].period;
+            if (svc->timers[i].due <= now)
+                svc->timers[i].due = now + svc->timers[i].period; /* overrun */
+        } else {
+            memset(&svc->timers[i], 0, sizeof(svc->timers[i]));
+        }
+    }
+    timer_set_fd(svc);
+    pthread_mutex_unlock(&svc->mutex);
+    /* run callbacks unlocked so they may start or cancel timers */
+    for (i = 0; i < cnt; i++) {
+        if (due[i].func)
+            due[i].func(due[i].arg);
+    }
+    (void)rsize; /* suppress 'assigned but not used' warning */
+}
+
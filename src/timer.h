@@ -0,0 +1,61 @@
+/***********************************************************************
+
+    ARIM Amateur Radio Instant Messaging program for the ARDOP TNC.
+
+    Copyright (C) 2016-2021 Robert Cunnings NW8L
+
+    This file is part of the ARIM messaging program.
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+*************************************************************************/
+
+#ifndef _TIMER_H_INCLUDED_
+#define _TIMER_H_INCLUDED_
+
+#include <pthread.h>
+
+#define TIMER_MAX_TIMERS        8
+
+typedef void (*TIMER_FUNC)(void *arg);
+
+typedef struct timer_entry {
+    unsigned int id;      /* handle, 0 if slot is free */
+    long long due;        /* monotonic msec */
+    unsigned int period;  /* msec, 0 for a one-shot timer */
+    TIMER_FUNC func;
+    void *arg;
+} TIMER_ENTRY;
+
+typedef struct timer_svc {
+    int fd;
+    unsigned int next_id;
+    pthread_mutex_t mutex;
+    TIMER_ENTRY timers[TIMER_MAX_TIMERS];
+} TIMER_SVC;
+
+#define TIMER_SVC_INITIALIZER   { -1, 0, PTHREAD_MUTEX_INITIALIZER, { { 0 } } }
+
+extern int timer_svc_open(TIMER_SVC *svc);
+extern void timer_svc_close(TIMER_SVC *svc);
+extern unsigned int timer_start(TIMER_SVC *svc, unsigned int delay_ms,
+                                    unsigned int period_ms, TIMER_FUNC func, void *arg);
+extern void timer_arm(TIMER_SVC *svc, unsigned int *id, unsigned int delay_ms,
+                                    unsigned int period_ms, TIMER_FUNC func, void *arg);
+extern void timer_cancel(TIMER_SVC *svc, unsigned int id);
+extern int timer_is_active(TIMER_SVC *svc, unsigned int id);
+extern void timer_on_expired(TIMER_SVC *svc);
+
+#endif
+
@@ -27,9 +27,11 @@
 #include <ctype.h>
 #include "ini.h"
 #include "main.h"
+#include "bufq.h"
 #include "cmdthread.h"
 #include "datathread.h"
 #include "serialthread.h"
+#include "reactorthread.h"
 #include "ini.h"
 #include "ui.h"
 #include "arim_beacon.h"
@@ -37,6 +39,7 @@
 #include "log.h"
 #include "arim_arq.h"
 #include "arim_proto.h"
+#include "ardop_cmds.h"
 
 TNC_VERSION g_tnc_version;
 
@@ -100,6 +103,7 @@ int tnc_attach_tcp(int which)
         result2 = pthread_create(&g_datathread, NULL, datathread_func, NULL);
         if (result2) {
             g_cmdthread_stop = 1;
+            bufq_signal(BUFQ_EV_CMD_OUT); /* wake thread so it sees stop flag */
             pthread_join(g_cmdthread, NULL);
             g_cmdthread = 0;
         }
@@ -115,6 +119,7 @@ int tnc_attach_tcp(int which)
                 if (!g_datathread_stop) {
                     /* shut down the other thread */
                     g_datathread_stop = 1;
+                    bufq_signal(BUFQ_EV_DATA_OUT); /* wake thread so it sees stop flag */
                     pthread_join(g_datathread, NULL);
                     g_datathread = 0;
                     g_datathread_ready = 0;
@@ -126,6 +131,7 @@ int tnc_attach_tcp(int which)
                 if (!g_cmdthread_stop) {
                     /* shut down the other thread */
                     g_cmdthread_stop = 1;
+                    bufq_signal(BUFQ_EV_CMD_OUT); /* wake thread so it sees stop flag */
                     pthread_join(g_cmdthread, NULL);
                     g_cmdthread = 0;
                     g_cmdthread_ready = 0;
@@ -158,11 +164,13 @@ int tnc_detach_tcp()
 {
     if (g_cmdthread) {
         g_cmdthread_stop = 1;
+        bufq_signal(BUFQ_EV_CMD_OUT); /* wake thread so it sees stop flag */
         pthread_join(g_cmdthread, NULL);
         g_cmdthread = 0;
     }
     if (g_datathread) {
         g_datathread_stop = 1;
+        bufq_signal(BUFQ_EV_DATA_OUT); /* wake thread so it sees stop flag */
         pthread_join(g_datathread, NULL);
         g_datathread = 0;
     }
@@ -220,6 +228,47 @@ int tnc_detach_serial()
     return 1;
 }
 
+int tnc_attach_reactor(int which)
+{
+    int result = 0;
+
+    g_cur_tnc = which;
+    g_reactorthread_ready = 0;
+    g_reactorthread_stop = 0;
+    result = pthread_create(&g_reactorthread, NULL, reactorthread_func, NULL);
+    if (result) {
+        g_reactorthread = 0;
+        ui_print_status("Failed to start TNC service thread", 1);
+        return 0;
+    }
+    /* while waiting for thread to signal ready status,
+       check stop flag and terminate if set, because thread
+       encountered an error when attempting to connect */
+    do {
+        if (g_reactorthread_stop) {
+            pthread_join(g_reactorthread, NULL);
+            g_reactorthread = 0;
+            ui_print_status("Failed to connect to TNC", 1);
+            return 0;
+        }
+    } while (!g_reactorthread_ready);
+    g_tnc_attached = 1;
+    arim_beacon_set(atoi(g_tnc_settings[g_cur_tnc].btime));
+    ui_print_status("TNC connection successful", 1);
+    return 1;
+}
+
+int tnc_detach_reactor()
+{
+    if (g_reactorthread) {
+        g_reactorthread_stop = 1;
+        bufq_signal(BUFQ_EV_CMD_OUT); /* wake thread so it sees stop flag */
+        pthread_join(g_reactorthread, NULL);
+        g_reactorthread = 0;
+    }
+    return 1;
+}
+
 int tnc_attach(int which)
 {
     int result;
@@ -251,6 +300,8 @@ int tnc_attach(int which)
 
     if (!strncasecmp(g_tnc_settings[which].interface, "serial", 6))
         result = tnc_attach_serial(which);
+    else if (!strncasecmp(g_tnc_settings[which].tcp_reactor, "TRUE", 4))
+        result = tnc_attach_reactor(which);
     else
         result = tnc_attach_tcp(which);
     if (!result)
@@ -269,8 +320,11 @@ void tnc_detach()
     arim_set_state(ST_IDLE);
     if (!strncasecmp(g_tnc_settings[g_cur_tnc].interface, "serial", 6))
         tnc_detach_serial();
+    else if (g_reactorthread)
+        tnc_detach_reactor();
     else
         tnc_detach_tcp();
+    ardop_cmds_log_stats();
 
     //////////////////
     // Added hamlib - 20230115
@@ -0,0 +1,175 @@
+/***********************************************************************
+
+    ARIM Amateur Radio Instant Messaging program for the ARDOP TNC.
+
+    Copyright (C) 2016-2021 Robert Cunnings NW8L
+
+    This file is part of the ARIM messaging program.
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+*************************************************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdatomic.h>
+#include "main.h"
+#include "ini.h"
+#include "tnc_state.h"
+
+/*
+    Typed copy of the TNC's run time state, kept alongside the string
+    fields in g_tnc_settings which remain for display and the config
+    views. The setters update both, so they must not be called with
+    mutex_tnc_set held. Readers of the snapshot never lock: single
+    values are atomics and the remote call/bandwidth pair is published
+    with a sequence lock. Writers of the pair are already serialized
+    by mutex_tnc_set.
+*/
+
+static atomic_int rt_buffer, rt_state, rt_busy, rt_fec_repeats;
+static atomic_uint rt_seq;
+static char rt_remote_call[TNC_MYCALL_SIZE];
+static char rt_bw_hz[TNC_ARQ_BW_SIZE];
+
+static int tnc_state_parse_state(const char *state)
+{
+    if (!strncasecmp(state, "DISC", 4))
+        return TNC_STATE_DISC;
+    if (!strncasecmp(state, "FECRCV", 6))
+        return TNC_STATE_FECRCV;
+    if (!strncasecmp(state, "FECSEND", 7))
+        return TNC_STATE_FECSEND;
+    if (!strncasecmp(state, "ISS", 3))
+        return TNC_STATE_ISS;
+    if (!strncasecmp(state, "IRS", 3))
+        return TNC_STATE_IRS;
+    if (!strncasecmp(state, "IDLE", 4))
+        return TNC_STATE_IDLE;
+    if (!strncasecmp(state, "OFFLINE", 7))
+        return TNC_STATE_OFFLINE;
+    return TNC_STATE_OTHER;
+}
+
+static void tnc_state_publish_remote()
+{
+    /* called with mutex_tnc_set held */
+    atomic_fetch_add_explicit(&rt_seq, 1, memory_order_relaxed);
+    atomic_thread_fence(memory_order_release);
+    snprintf(rt_remote_call, sizeof(rt_remote_call), "%s",
+                 g_tnc_settings[g_cur_tnc].arq_remote_call);
+    snprintf(rt_bw_hz, sizeof(rt_bw_hz), "%s",
+                 g_tnc_settings[g_cur_tnc].arq_bandwidth_hz);
+    atomic_fetch_add_explicit(&rt_seq, 1, memory_order_release);
+}
+
+void tnc_state_init()
+{
+    pthread_mutex_lock(&mutex_tnc_set);
+    atomic_store(&rt_buffer, atoi(g_tnc_settings[g_cur_tnc].buffer));
+    atomic_store(&rt_state, tnc_state_parse_state(g_tnc_settings[g_cur_tnc].state));
+    atomic_store(&rt_busy, !strncmp(g_tnc_settings[g_cur_tnc].busy, "TRUE", 4));
+    atomic_store(&rt_fec_repeats, atoi(g_tnc_settings[g_cur_tnc].fecrepeats));
+    tnc_state_publish_remote();
+    pthread_mutex_unlock(&mutex_tnc_set);
+}
+
+void tnc_state_set_buffer(size_t cnt)
+{
+    pthread_mutex_lock(&mutex_tnc_set);
+    snprintf(g_tnc_settings[g_cur_tnc].buffer,
+        sizeof(g_tnc_settings[g_cur_tnc].buffer), "%zu", cnt);
+    pthread_mutex_unlock(&mutex_tnc_set);
+    atomic_store(&rt_buffer, (int)cnt);
+}
+
+int tnc_state_get_buffer()
+{
+    return atomic_load(&rt_buffer);
+}
+
+void tnc_state_set_state(const char *state)
+{
+    pthread_mutex_lock(&mutex_tnc_set);
+    snprintf(g_tnc_settings[g_cur_tnc].state,
+        sizeof(g_tnc_settings[g_cur_tnc].state), "%s", state);
+    pthread_mutex_unlock(&mutex_tnc_set);
+    atomic_store(&rt_state, tnc_state_parse_state(state));
+}
+
+int tnc_state_get_state()
+{
+    return atomic_load(&rt_state);
+}
+
+void tnc_state_set_busy(int busy)
+{
+    pthread_mutex_lock(&mutex_tnc_set);
+    snprintf(g_tnc_settings[g_cur_tnc].busy,
+        sizeof(g_tnc_settings[g_cur_tnc].busy), "%s", busy ? "TRUE" : "FALSE");
+    pthread_mutex_unlock(&mutex_tnc_set);
+    atomic_store(&rt_busy, busy ? 1 : 0);
+}
+
+int tnc_state_is_busy()
+{
+    return atomic_load(&rt_busy);
+}
+
+void tnc_state_set_fec_repeats(const char *val)
+{
+    pthread_mutex_lock(&mutex_tnc_set);
+    snprintf(g_tnc_settings[g_cur_tnc].fecrepeats,
+        sizeof(g_tnc_settings[g_cur_tnc].fecrepeats), "%s", val);
+    pthread_mutex_unlock(&mutex_tnc_set);
+    atomic_store(&rt_fec_repeats, atoi(val));
+}
+
+int tnc_state_get_fec_repeats()
+{
+    return atomic_load(&rt_fec_repeats);
+}
+
+void tnc_state_set_remote(const char *call, const char *bw_hz)
+{
+    /* bw_hz NULL leaves the ARQ bandwidth unchanged */
+    pthread_mutex_lock(&mutex_tnc_set);
+    snprintf(g_tnc_settings[g_cur_tnc].arq_remote_call,
+        sizeof(g_tnc_settings[g_cur_tnc].arq_remote_call), "%s", call);
+    if (bw_hz)
+        snprintf(g_tnc_settings[g_cur_tnc].arq_bandwidth_hz,
+            sizeof(g_tnc_settings[g_cur_tnc].arq_bandwidth_hz), "%s", bw_hz);
+    tnc_state_publish_remote();
+    pthread_mutex_unlock(&mutex_tnc_set);
+}
+
+void tnc_state_copy_remote(char *call, size_t call_size, char *bw_hz, size_t bw_hz_size)
+{
+    char tcall[TNC_MYCALL_SIZE], tbw[TNC_ARQ_BW_SIZE];
+    unsigned int seq;
+
+    do {
+        while ((seq = atomic_load_explicit(&rt_seq, memory_order_acquire)) & 1)
+            ; /* update in progress */
+        memcpy(tcall, rt_remote_call, sizeof(tcall));
+        memcpy(tbw, rt_bw_hz, sizeof(tbw));
+        atomic_thread_fence(memory_order_acquire);
+    } while (seq != atomic_load_explicit(&rt_seq, memory_order_relaxed));
+    tcall[sizeof(tcall) - 1] = tbw[sizeof(tbw) - 1] = '\0';
+    if (call)
+        snprintf(call, call_size, "%s", tcall);
+    if (bw_hz)
+        snprintf(bw_hz, bw_hz_size, "%s", tbw);
+}
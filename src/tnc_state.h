@@ -0,0 +1,50 @@
+/***********************************************************************
+
+    ARIM Amateur Radio Instant Messaging program for the ARDOP TNC.
+
+    Copyright (C) 2016-2021 Robert Cunnings NW8L
+
+    This file is part of the ARIM messaging program.
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+*************************************************************************/
+
+#ifndef _TNC_STATE_H_INCLUDED_
+#define _TNC_STATE_H_INCLUDED_
+
+#define TNC_STATE_OTHER         0
+#define TNC_STATE_OFFLINE       1
+#define TNC_STATE_DISC          2
+#define TNC_STATE_ISS           3
+#define TNC_STATE_IRS           4
+#define TNC_STATE_IDLE          5
+#define TNC_STATE_FECSEND       6
+#define TNC_STATE_FECRCV        7
+
+extern void tnc_state_init(void);
+extern void tnc_state_set_buffer(size_t cnt);
+extern int tnc_state_get_buffer(void);
+extern void tnc_state_set_state(const char *state);
+extern int tnc_state_get_state(void);
+extern void tnc_state_set_busy(int busy);
+extern int tnc_state_is_busy(void);
+extern void tnc_state_set_fec_repeats(const char *val);
+extern int tnc_state_get_fec_repeats(void);
+extern void tnc_state_set_remote(const char *call, const char *bw_hz);
+extern void tnc_state_copy_remote(char *call, size_t call_size,
+                                      char *bw_hz, size_t bw_hz_size);
+
+#endif
+
@@ -592,7 +592,10 @@ void ui_check_status_dirty()
     case STATUS_PING_MSG_SEND:
         ui_print_status("ARIM Busy: ping ACK quality >= threshold, sending message", 1);
         sleep(2); /* don't rush the ardopc TNC */
-        arim_send_msg_pp();
+        if (!arim_send_msg_pp()) {
+            ui_print_status("ARIM Idle: cannot send message, saving to Outbox", 1);
+            arim_store_msg_prev_out();
+        }
         break;
     case STATUS_PING_ACK_TIMEOUT:
         ui_print_status("ARIM Idle: ping ACK wait time out", 1);
@@ -618,7 +621,8 @@ void ui_check_status_dirty()
     case STATUS_PING_QRY_SEND:
         ui_print_status("ARIM Busy: ping ACK quality >= threshold, sending query", 1);
         sleep(2); /* don't rush the ardopc TNC */
-        arim_send_query_pp();
+        if (!arim_send_query_pp())
+            ui_print_status("ARIM Idle: cannot send query", 1);
         break;
     case STATUS_PING_QRY_ACK_TO:
         ui_print_status("ARIM Idle: ping ACK timeout, query send canceled", 1);
@@ -681,6 +685,9 @@ void ui_check_status_dirty()
         ui_status_xfer_end(); /* end progress meter */
         ui_print_status("ARIM Idle: ARQ file download failed", 1);
         break;
+    case STATUS_ARQ_FILE_RCV_SAME:
+        ui_print_status("ARIM Idle: ARQ file download skipped, local copy is current", 1);
+        break;
     case STATUS_ARQ_FILE_RCV_TIMEOUT:
         ui_status_xfer_end(); /* end progress meter */
         ui_print_status("ARIM Idle: ARQ file download timeout", 1);
@@ -729,6 +736,7 @@ void ui_check_status_dirty()
     case STATUS_ARQ_MSG_SEND_ERROR:
         ui_status_xfer_end(); /* end progress meter */
         ui_print_status("ARIM Idle: ARQ message upload failed", 1);
+        arim_arq_msg_on_send_cancel();
         break;
     case STATUS_ARQ_MSG_SEND_ACK:
         ui_status_xfer_end(); /* end progress meter */
@@ -738,6 +746,7 @@ void ui_check_status_dirty()
     case STATUS_ARQ_MSG_SEND_TIMEOUT:
         ui_status_xfer_end(); /* end progress meter */
         ui_print_status("ARIM Idle: ARQ message upload timeout", 1);
+        arim_arq_msg_on_send_cancel();
         break;
     case STATUS_ARQ_AUTH_BUSY:
         ui_print_status("ARIM Busy: ARQ session authentication in progress", 1);
@@ -135,6 +135,7 @@
 #define STATUS_ARQ_FLIST_SEND_ACK       95
 #define STATUS_ARQ_FLIST_SEND_TIMEOUT   96
 #define STATUS_ARQ_CONN_REQ_REPEAT      97
+#define STATUS_ARQ_FILE_RCV_SAME        98
 
 #define STATUS_XFER_PROG_START          101
 #define STATUS_XFER_PROG_UPDATE         102
@@ -136,9 +136,7 @@ void ui_print_ctable()
         refresh_ctable = 1;
     }
 
-    pthread_mutex_lock(&mutex_ctable);
     p = cmdq_pop(&g_ctable_q);
-    pthread_mutex_unlock(&mutex_ctable);
 
     /*
       layout of record taken from queue:
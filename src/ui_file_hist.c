@@ -31,6 +31,8 @@
 #include "ui_tnc_cmd_win.h"
 #include "util.h"
 #include "ardop_data.h"
+#include "arim_arq_codec.h"
+#include "arim_arq_sync.h"
 
 WINDOW *ui_ftable_win;
 int show_ftable;
@@ -40,9 +42,9 @@ int max_ftable_rows;
 typedef struct ft {
     char call[16];
     char fname[70];
-    char size[8];
+    char size[10];
     char check[8];
-    int compressed;
+    char codec[ARQ_CODEC_FLAG_SIZE];
     int inbound;
     int done;
     time_t start_time;
@@ -136,18 +138,17 @@ void ui_print_ftable()
         refresh_ftable = 1;
     }
 
-    pthread_mutex_lock(&mutex_ftable);
     p = cmdq_pop(&g_ftable_q);
-    pthread_mutex_unlock(&mutex_ftable);
 
     /*
       layout of record taken from queue:
          byte 0:     type 'O' outbound, 'I' inbound, 'D' outbound done, 'S' inbound starting
-         byte 1:     compression flag 'Z' compressed or ' ' not compressed
+         byte 1:     codec, ' ' none, 'Z' zlib, '1'-'9' zlib with dictionary vN,
+                     'L' lz, 'T' text or 'D' /FSYNC delta
          byte 2-13:  remote station call sign
-         byte 14-19: file size
-         byte 20-23: checksum
-         byte 24-87: file name
+         byte 14-21: file size
+         byte 22-25: checksum
+         byte 26-89: file name
     */
 
     if (p) {
@@ -156,11 +157,14 @@ void ui_print_ftable()
             memmove(&ftable_list[1], &ftable_list[0], MAX_FTABLE_LIST_LEN * sizeof(FT_ENTRY));
             memset(&ftable_list[0], 0, sizeof(FT_ENTRY));
             ftable_list[0].inbound = 0;
-            ftable_list[0].compressed = (p[1] == 'Z' ? 1 : 0);
+            if (p[1] == ARQ_SYNC_HIST_CODE)
+                snprintf(ftable_list[0].codec, sizeof(ftable_list[0].codec), ARQ_SYNC_HIST_FLAG);
+            else
+                arim_arq_codec_hist_flag(p[1], ftable_list[0].codec, sizeof(ftable_list[0].codec));
             snprintf(ftable_list[0].call, sizeof(ftable_list[0].call), "%.11s", &p[2]);
-            snprintf(ftable_list[0].size, sizeof(ftable_list[0].size), "%.6s", &p[14]);
-            snprintf(ftable_list[0].check, sizeof(ftable_list[0].check), "%.4s", &p[20]);
-            snprintf(ftable_list[0].fname, sizeof(ftable_list[0].fname), "%.64s", &p[24]);
+            snprintf(ftable_list[0].size, sizeof(ftable_list[0].size), "%.8s", &p[14]);
+            snprintf(ftable_list[0].check, sizeof(ftable_list[0].check), "%.4s", &p[22]);
+            snprintf(ftable_list[0].fname, sizeof(ftable_list[0].fname), "%.64s", &p[26]);
             ftable_list[0].start_time = time(NULL);
             ++ftable_list_cnt;
             if (ftable_list_cnt > MAX_FTABLE_LIST_LEN)
@@ -182,11 +186,14 @@ void ui_print_ftable()
                 ftable_list[0].start_time = time(NULL);
             }
             ftable_list[0].inbound = 1;
-            ftable_list[0].compressed = (p[1] == 'Z' ? 1 : 0);
+            if (p[1] == ARQ_SYNC_HIST_CODE)
+                snprintf(ftable_list[0].codec, sizeof(ftable_list[0].codec), ARQ_SYNC_HIST_FLAG);
+            else
+                arim_arq_codec_hist_flag(p[1], ftable_list[0].codec, sizeof(ftable_list[0].codec));
             snprintf(ftable_list[0].call, sizeof(ftable_list[0].call), "%.11s", &p[2]);
-            snprintf(ftable_list[0].size, sizeof(ftable_list[0].size), "%.6s", &p[14]);
-            snprintf(ftable_list[0].check, sizeof(ftable_list[0].check), "%.4s", &p[20]);
-            snprintf(ftable_list[0].fname, sizeof(ftable_list[0].fname), "%.64s", &p[24]);
+            snprintf(ftable_list[0].size, sizeof(ftable_list[0].size), "%.8s", &p[14]);
+            snprintf(ftable_list[0].check, sizeof(ftable_list[0].check), "%.4s", &p[22]);
+            snprintf(ftable_list[0].fname, sizeof(ftable_list[0].fname), "%.64s", &p[26]);
             ftable_list[0].stop_time = time(NULL);
             if (!ftable_list[0].done)
                 ftable_list[0].done = 1;
@@ -247,9 +254,9 @@ void ui_print_ftable()
                     secs = 1;
                 snprintf(elapsed_time, sizeof(elapsed_time),
                             "%02d:%02d:%02d", hours, minutes, secs);
-                numch = snprintf(file_data, sizeof(file_data), "[%2d] %s %.11s %s [%s] %s %.6s bytes %.4s %s",
+                numch = snprintf(file_data, sizeof(file_data), "[%2d] %s %.11s %s [%s] %-4s %.8s bytes %.4s %s",
                                  i + 1, ftable_list[i].inbound ? ">>" : "<<", ftable_list[i].call,
-                                     start_time, elapsed_time, ftable_list[i].compressed ? "-z" : "  ",
+                                     start_time, elapsed_time, ftable_list[i].codec,
                                          ftable_list[i].size, ftable_list[i].check, ftable_list[i].fname);
                 if (numch >= sizeof(file_data))
                     ui_truncate_line(file_data, sizeof(file_data));
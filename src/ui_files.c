@@ -813,8 +813,8 @@ restart:
             ui_files_get_line(linebuf, max_cols - 1);
             /* process the command */
             if (linebuf[0] == ':') {
-                if (g_tnc_attached)
-                    bufq_queue_data_out(&linebuf[1]);
+                if (g_tnc_attached && !bufq_queue_data_out(&linebuf[1]))
+                    ui_print_status("Unproto: cannot send, outbound queue full", 1);
                 break;
             } else if (linebuf[0] == '!') {
                 if (g_tnc_attached)
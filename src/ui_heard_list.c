@@ -234,9 +234,7 @@ void ui_print_heard_list()
         memset(&heard_list, 0, sizeof(heard_list));
     }
 
-    pthread_mutex_lock(&mutex_heard);
     p = cmdq_pop(&g_heard_q);
-    pthread_mutex_unlock(&mutex_heard);
 
     if (p) {
         memmove(&heard_list[1], &heard_list[0], MAX_HEARD_LIST_LEN * sizeof(HL_ENTRY));
@@ -127,7 +127,8 @@ const char *help[] = {
     "    line to finish, or '/can' to cancel.",
     "  'sq call query' to send query, call is station and query",
     "    is one of 'version', 'gridsq', 'info', 'pname', 'heard',",
-    "    'flist', 'netcalls' or 'file fn' where fn is file name.",
+    "    'flist', 'netcalls', 'file fn' where fn is file name or",
+    "    'msearch q' where q is a message search query.",
     "  'li' to open inbox message list, then:",
     "    'rm n' to read, 'km n' to kill, 'sv n fn' to save to",
     "    file, 'fm n call' to forward, 'cf n fl' to clear flag,",
@@ -145,6 +146,10 @@ const char *help[] = {
     "    'pm d' to purge old where n is msg nbr, fn is file name,",
     "    call is destination call sign, fl is message flag (R,F,S",
     "    or * for all) and d is age in days. Press 'q' to quit.",
+    "  In any message list, 'sr q' lists only messages matching",
+    "    search query q, 'sr' lists all again. q is words that must",
+    "    all appear, plus optional 'fm:call', 'to:call' and",
+    "    'since:', 'until:' or 'on:' followed by date yyyy-mm-dd.",
     "",
     "FEC mode Recent Messages view:",
     "  Press 'r' hot key to open the Recent Messages view, then:",
@@ -206,6 +211,10 @@ const char *help[] = {
     "        placed in that folder at the local station; if not then it",
     "        is placed in the default 'download' folder. Works for both",
     "        text and binary file types.",
+    "      '/fsync [-z] fn [> dir]', like '/fget' but when a copy of",
+    "        the file downloaded before is in the destination folder,",
+    "        only the parts of the file that changed since then are",
+    "        sent. Falls back to '/fget' if there is no local copy.",
     "      '/fput [-z] fn [> dir]', where -z is compression option, fn",
     "        is a file in the shared files folder on the local station,",
     "        or a file path relative to that folder, and dir is optional",
@@ -228,6 +237,9 @@ const char *help[] = {
     "        to your station from the remote station's outbox to your",
     "        inbox. Default value of n is 10. Messages are deleted",
     "        from remote station's outbox. Requires authentication.",
+    "      '/msearch q' returns a list of messages in the remote",
+    "        station's inbox addressed to a net call and matching",
+    "        search query q; see 'sr q' in message lists.",
     "      '/auth' triggers the mutual authentication process.",
     "    When entering the command, the '/' character must be the",
     "    first one on the line or the command won't be recognized.",
@@ -254,6 +266,10 @@ const char *help[] = {
     "    fn is file name, call is destination call sign, fl is message",
     "    flag (R,F,S or * for all) and d is age in days.",
     "    Press 'q' to quit.",
+    "  In any message list, 'sr q' lists only messages matching",
+    "    search query q, 'sr' lists all again. q is words that must",
+    "    all appear, plus optional 'fm:call', 'to:call' and",
+    "    'since:', 'until:' or 'on:' followed by date yyyy-mm-dd.",
     "",
     "ARQ mode shared files viewer commands:",
     "  Press 'f' hot key to open the shared files viewer, then:",
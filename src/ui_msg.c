@@ -44,6 +44,8 @@
 #include "ui_cmd_prompt_win.h"
 #include "bufq.h"
 #include "mbox.h"
+#include "mboxthread.h"
+#include "mbox_search.h"
 
 #define MAX_CMD_HIST            10+1
 
@@ -646,11 +648,10 @@ int ui_list_get_line(char *cmd_line, size_t max_len)
 void ui_list_msg(const char *fn, int mbox_type)
 {
     WINDOW *mbox_win;
-    FILE *mboxfp;
     char *p, linebuf[MAX_MBOX_HDR_SIZE+1], msgbuffer[MAX_UNCOMP_DATA_SIZE];
     static char list[MAX_MBOX_LIST_LEN+1][MAX_MBOX_HDR_SIZE];
+    static char query[MAX_CMD_SIZE];
     char to_call[MAX_CALLSIGN_SIZE];
-    char fpath[MAX_PATH_SIZE];
     static int once = 0;
     int i, temp, max_cols, max_mbox_rows, cmd, cur, top, start, quit = 0;
 
@@ -669,43 +670,34 @@ void ui_list_msg(const char *fn, int mbox_type)
         wbkgd(mbox_win, COLOR_PAIR(7));
     ui_set_active_win(mbox_win);
     max_mbox_rows = tnc_data_box_h - 2;
-    mbox_purge(fn, atoi(g_arim_settings.max_msg_days));
+    mboxthread_request(1); /* purge old messages in the background */
+    query[0] = '\0';
 
 restart:
     msg_view_restart = 0;
     wclear(mbox_win);
-    start = 0;
-    snprintf(fpath, sizeof(fpath), "%s/%s", mbox_dir_path, fn);
-    mboxfp = fopen(fpath, "r");
-    if (!mboxfp) {
+    if (query[0]) {
+        /* list only messages matching search query */
+        start = mbox_search(list, MAX_MBOX_LIST_LEN, fn, query, NULL);
+        if (start == -1) {
+            ui_print_status("Search messages: invalid query", 1);
+            query[0] = '\0';
+            goto restart;
+        }
+    } else {
+        start = mbox_get_headers(list, MAX_MBOX_LIST_LEN, fn);
+    }
+    if (start == -1) {
         ui_print_status("List: failed to open mailbox file", 1);
         ui_set_active_win(tnc_data_box);
         return;
     }
-    flockfile(mboxfp);
-    p = fgets(linebuf, sizeof(linebuf), mboxfp);
-    while (p) {
-        while (p && strncmp(p, "From ", 5))
-            p = fgets(linebuf, sizeof(linebuf), mboxfp);
-        if (p) {
-            snprintf(list[start], sizeof(list[0]), "%s", p);
-            p = list[start];
-            while (*p && *p != '\n')
-                ++p;
-            *p = '\0';
-            ++start;
-            if (start == MAX_MBOX_LIST_LEN) {
-                cmd = ui_show_dialog("\tToo many messages to list;\n"
-                                     "\tnewer messages can't be shown.\n"
-                                     "\tKill older messages to\n"
-                                     "\tmake room for new.\n \n\t[O]k", "oO \n");
-                break;
-            }
-            p = fgets(linebuf, sizeof(linebuf), mboxfp);
-        }
+    if (start == MAX_MBOX_LIST_LEN && !query[0]) {
+        cmd = ui_show_dialog("\tToo many messages to list;\n"
+                             "\tnewer messages can't be shown.\n"
+                             "\tKill older messages to\n"
+                             "\tmake room for new.\n \n\t[O]k", "oO \n");
     }
-    funlockfile(mboxfp);
-    fclose(mboxfp);
     --start;
     max_cols = (tnc_data_box_w - 4) + 1;
     if (max_cols > sizeof(linebuf))
@@ -720,22 +712,27 @@ restart:
         ui_print_msg_list_title(mbox_type);
     wrefresh(mbox_win);
     status_timer = 1;
+    if (query[0]) {
+        snprintf(msgbuffer, sizeof(msgbuffer),
+                 "Search messages: %d found, 'sr' to show all", start + 1);
+        ui_print_status(msgbuffer, 1);
+    }
     while (!quit) {
         if (status_timer && --status_timer == 0) {
             if (mbox_type == MBOX_TYPE_OUT) {
                 if (arim_is_arq_state())
                     ui_print_status("<SP> for prompt: 'rm n' read, 'km n' kill, 'sm [-z] n' send, "
-                                    "'cf n fl' clr flag, 'pm d' purge old, 'q' quit", 0);
+                                    "'cf n fl' clr flag, 'sr q' search, 'pm d' purge old, 'q' quit", 0);
                 else
                     ui_print_status("<SP> for prompt: 'rm n' read, 'km n' kill, 'sm n' send, "
-                                    "'cf n fl' clr flag, 'pm d' purge old, 'q' quit", 0);
+                                    "'cf n fl' clr flag, 'sr q' search, 'pm d' purge old, 'q' quit", 0);
             } else {
                 if (arim_is_arq_state())
                     ui_print_status("<SP> for prompt: 'rm n' read, 'sv n fn' save, 'km n' kill, "
-                                    "'fm [-z] n' fwd, 'cf n fl' clr flag, 'pm d' purge old, 'q' quit", 0);
+                                    "'fm [-z] n' fwd, 'cf n fl' clr flag, 'sr q' search, 'pm d' purge old, 'q' quit", 0);
                 else
                     ui_print_status("<SP> for prompt: 'rm n' read, 'sv n fn' save, 'km n' kill, "
-                                    "'fm n call' fwd, 'cf n fl' clr flag, 'pm d' purge old, 'q' quit", 0);
+                                    "'fm n call' fwd, 'cf n fl' clr flag, 'sr q' search, 'pm d' purge old, 'q' quit", 0);
             }
         }
         cmd = getch();
@@ -745,8 +742,8 @@ restart:
             ui_list_get_line(linebuf, max_cols - 1);
             /* process the command */
             if (linebuf[0] == ':') {
-                if (g_tnc_attached)
-                    bufq_queue_data_out(&linebuf[1]);
+                if (g_tnc_attached && !bufq_queue_data_out(&linebuf[1]))
+                    ui_print_status("Unproto: cannot send, outbound queue full", 1);
                 break;
             } else if (linebuf[0] == '!') {
                 if (g_tnc_attached)
@@ -917,6 +914,11 @@ restart:
                     } else {
                         ui_print_status("Fwd message: invalid message number", 1);
                     }
+                } else if (!strncasecmp(p, "sr", 2)) {
+                    /* rest of line is the query, none to show all */
+                    p = strtok(NULL, "");
+                    snprintf(query, sizeof(query), "%s", p ? p : "");
+                    goto restart;
                 } else if (!strncasecmp(p, "cf", 2)) {
                     p = strtok(NULL, " \t");
                     if (!p || !(i = atoi(p))) {
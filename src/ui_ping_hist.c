@@ -142,9 +142,7 @@ void ui_print_ptable()
         refresh_ptable = 1;
     }
 
-    pthread_mutex_lock(&mutex_ptable);
     p = cmdq_pop(&g_ptable_q);
-    pthread_mutex_unlock(&mutex_ptable);
 
     /*
       layout of record taken from queue:
@@ -274,7 +274,6 @@ void ui_print_data_in()
 {
     char *p;
 
-    pthread_mutex_lock(&mutex_data_in);
     p = dataq_pop(&g_data_in_q);
     while (p) {
         if (data_buf_cnt < MAX_DATA_BUF_LEN)
@@ -296,7 +295,6 @@ void ui_print_data_in()
         }
         p = dataq_pop(&g_data_in_q);
     }
-    pthread_mutex_unlock(&mutex_data_in);
     if (data_buf_cnt > max_data_rows) {
         data_buf_top = data_buf_end - max_data_rows;
         if (data_buf_top < 0)
@@ -39,17 +39,14 @@ const char *months[] = {
     "Jan", "Feb", "Mar", "Apr", "May", "Jun", "Jul", "Aug", "Sep", "Oct", "Nov", "Dec",
 };
 
-unsigned int ccitt_crc16(const unsigned char *data, size_t size)
+unsigned int ccitt_crc16_update(unsigned int cs, const unsigned char *data, size_t size)
 {
     size_t i, cnt;
-    unsigned int work, cs;
+    unsigned int work;
 
-    cs = 0xFFFF;
-    if (size < 1)
-        return ~cs;
-    cnt = 0;
-    do {
-        work = 0x00FF & data[cnt++];
+    /* fold size bytes into running checksum cs, seeded with 0xFFFF */
+    for (cnt = 0; cnt < size; cnt++) {
+        work = 0x00FF & data[cnt];
         for (i = 0; i < 8; i++) {
             if ((cs & 0x0001) ^ (work & 0x0001))
                 cs = (cs >> 1) ^ 0x8408;
@@ -57,13 +54,31 @@ unsigned int ccitt_crc16(const unsigned char *data, size_t size)
                 cs >>= 1;
             work >>= 1;
         }
-    } while (cnt < size);
+    }
+    return cs;
+}
+
+unsigned int ccitt_crc16_final(unsigned int cs)
+{
+    unsigned int work;
+
     cs = ~cs;
     work = cs;
     cs = (cs << 8) | (work >> 8 & 0x00FF);
     return cs & 0xFFFF;
 }
 
+unsigned int ccitt_crc16(const unsigned char *data, size_t size)
+{
+    unsigned int cs;
+
+    cs = 0xFFFF;
+    if (size < 1)
+        return ~cs;
+    cs = ccitt_crc16_update(cs, data, size);
+    return ccitt_crc16_final(cs);
+}
+
 char *util_timestamp(char *buffer, size_t maxsize)
 {
     time_t t;
@@ -204,3 +219,12 @@ char *util_clock_tm(time_t t, char *buffer, size_t maxsize)
     return buffer;
 }
 
+
+long long util_msec_now()
+{
+    struct timespec ts;
+
+    /* monotonic clock, unaffected by changes to the time of day */
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (long long)ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
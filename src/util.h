@@ -35,6 +35,9 @@ extern char *util_rcv_timestamp(char *buffer, size_t maxsize);
 extern char *util_clock(char *buffer, size_t maxsize);
 extern char *util_clock_tm(time_t t, char *buffer, size_t maxsize);
 extern unsigned int ccitt_crc16(const unsigned char *data, size_t size);
+extern unsigned int ccitt_crc16_update(unsigned int cs, const unsigned char *data, size_t size);
+extern unsigned int ccitt_crc16_final(unsigned int cs);
+extern long long util_msec_now(void);
 
 #endif
 